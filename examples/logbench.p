@@ -0,0 +1,21 @@
+/* Writes log lines with printf() and print(), for the console output
+ * benchmark in source/amx/pawnrun/prun_log.c. The host sets "lines" to the
+ * number of lines to write; each line holds a few integers, a hexadecimal
+ * value, a fixed-width string and a floating point number.
+ */
+#include <console>
+#include <float>
+
+public lines = 100000
+
+main()
+    {
+    new Float:load = 0.25
+    for (new i = 0; i < lines; i++)
+        {
+        printf "%8d event=%-8s code=%04x load=%.2f delta=%+d\n", i, "update", i & 0xffff, load, i % 7 - 3
+        load = load + 0.01
+        if (i % 16 == 0)
+            print "checkpoint reached\n"
+        }
+    }
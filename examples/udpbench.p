@@ -0,0 +1,36 @@
+/* Counts the packets that arrive on the datagram port, for the loopback
+ * benchmark in source/amx/pawnrun/prun_dgram.c. By default, the packets are
+ * received in batches; compile with PERPACKET=1 to receive them one by one.
+ * When the host sets "echo", the script sends every packet back.
+ */
+#include <datagram>
+
+public received = 0
+public echo = 0
+
+#if defined PERPACKET
+@receivepacket(const packet[], size, const source[])
+    {
+    received++
+    if (echo)
+        sendpacket packet, size * 8 / cellbits, source
+    }
+#else
+@receivebatch(socket, const packets[], const info[][DGramInfo], count)
+    {
+    received += count
+    if (echo)
+        {
+        new source[22]
+        for (new i = 0; i < count; i++)
+            {
+            dgramaddress source, info[i][DGramAddress], info[i][DGramPort]
+            dgramsend socket, packets[info[i][DGramOffset]], info[i][DGramSize] * 8 / cellbits, source
+            }
+        }
+    }
+#endif
+
+main()
+    {
+    }
@@ -59,6 +59,12 @@
 #if (defined _Windows && !defined AMX_NODYNALOAD) || (defined JIT && __WIN32__)
   #include <windows.h>
 #endif
+#if (defined _Windows || defined LINUX || defined __FreeBSD__ || defined __OpenBSD__) && !defined AMX_NODYNALOAD
+  #define AMX_DYNALOAD          /* extension modules are loaded from DLLs or shared libraries */
+  #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    #include <pthread.h>
+  #endif
+#endif
 
 
 /* When one or more of the AMX_funcname macris are defined, we want
@@ -68,6 +74,9 @@
 #if defined AMX_ALIGN       || defined AMX_ALLOT        || defined AMX_CLEANUP
   #define AMX_EXPLIT_FUNCTIONS
 #endif
+#if defined AMX_BREAKPOINT
+  #define AMX_EXPLIT_FUNCTIONS
+#endif
 #if defined AMX_CLONE        || defined AMX_DEFCALLBACK || defined AMX_EXEC
   #define AMX_EXPLIT_FUNCTIONS
 #endif
@@ -83,6 +92,9 @@
 #if defined AMX_SETCALLBACK || defined AMX_SETDEBUGHOOK || defined AMX_XXXNATIVES
   #define AMX_EXPLIT_FUNCTIONS
 #endif
+#if defined AMX_SETBUDGET
+  #define AMX_EXPLIT_FUNCTIONS
+#endif
 #if defined AMX_XXXPUBLICS  || defined AMX_XXXPUBVARS   || defined AMX_XXXSTRING
   #define AMX_EXPLIT_FUNCTIONS
 #endif
@@ -93,6 +105,7 @@
   /* no constant set, set them all */
   #define AMX_ALIGN             /* amx_Align16(), amx_Align32() and amx_Align64() */
   #define AMX_ALLOT             /* amx_Allot() and amx_Release() */
+  #define AMX_BREAKPOINT        /* amx_SetBreakpoint() and amx_ClearBreakpoint() */
   #define AMX_DEFCALLBACK       /* amx_Callback() */
   #define AMX_CLEANUP           /* amx_Cleanup() */
   #define AMX_CLONE             /* amx_Clone() */
@@ -106,6 +119,7 @@
   #define AMX_PUSHXXX           /* amx_Push(), amx_PushArray() and amx_PushString() */
   #define AMX_RAISEERROR        /* amx_RaiseError() */
   #define AMX_REGISTER          /* amx_Register() */
+  #define AMX_SETBUDGET         /* amx_SetBudget() */
   #define AMX_SETCALLBACK       /* amx_SetCallback() */
   #define AMX_SETDEBUGHOOK      /* amx_SetDebugHook() */
   #define AMX_XXXNATIVES        /* amx_NumNatives(), amx_GetNative() and amx_FindNative() */
@@ -129,6 +143,21 @@
 #if defined JIT
   #define AMX_NO_MACRO_INSTR    /* JIT is incompatible with macro instructions */
 #endif
+#if defined __64BIT__ && PAWN_CELL_SIZE!=64
+  /* jump targets cannot be relocated to addresses if a pointer does not fit
+   * in a cell; for the same reason, the "labels as values" interpreter, which
+   * stores the label addresses in the code cells, cannot be used
+   */
+  #if !defined AMX_DONT_RELOCATE
+    #define AMX_DONT_RELOCATE
+  #endif
+  #if !defined AMX_NO_LABELS
+    #define AMX_NO_LABELS
+  #endif
+#endif
+#if (defined __GNUC__ || defined __ICC) && !defined AMX_NO_LABELS
+  #define AMX_LABELS            /* "labels as values" (indirect threaded) interpreter */
+#endif
 
 typedef enum {
   OP_NONE,              /* invalid opcode */
@@ -292,6 +321,7 @@ typedef enum {
   /* ----- */
   OP_SYSREQ_D,
   OP_SYSREQ_ND,
+  OP_BREAKPT,   /* BREAK patched by amx_SetBreakpoint() */
   /* ----- */
   OP_NUM_OPCODES
 } OPCODE;
@@ -307,6 +337,218 @@ typedef enum {
                            ? (char *)((unsigned char*)(hdr) + (unsigned)((AMX_FUNCSTUBNT*)(entry))->nameofs) \
                            : ((AMX_FUNCSTUB*)(entry))->name )
 
+#if defined AMX_DYNALOAD
+  #if defined _Windows
+    typedef int (FAR WINAPI *AMX_ENTRY)(AMX FAR *amx);
+    typedef HINSTANCE AMX_LIBHANDLE;
+  #else
+    typedef int (*AMX_ENTRY)(AMX *amx);
+    typedef void *AMX_LIBHANDLE;
+  #endif
+
+  /* An extension module is loaded once per process and it is shared by all
+   * abstract machines that refer to it; it is unloaded when the last of these
+   * is cleaned up. The natives that the module registers for the first
+   * abstract machine are kept in a hash table, and the natives of any next
+   * abstract machine are bound from that table, before the module's
+   * initialization function runs. That function still runs for every abstract
+   * machine (modules may keep state per abstract machine), but its call to
+   * amx_Register() then finds nothing left to look up.
+   */
+  typedef struct tagAMX_LIBRARY {
+    struct tagAMX_LIBRARY *next;
+    char name[sNAMEMAX+1];
+    AMX_LIBHANDLE hlib;
+    AMX_ENTRY init, cleanup;
+    int refcount;
+    int indexed;                /* natives of the module are in the table */
+    AMX_NATIVE_INFO *natives;   /* hash table, "size" is zero or a power of 2 */
+    int size, count;
+  } AMX_LIBRARY;
+
+  static struct {
+    AMX_LIBRARY *first;
+    AMX *initamx;               /* abstract machine for which a module initializes */
+    AMX_LIBRARY *initlib;       /* the module that initializes */
+  } Libraries;
+
+  #if defined __WIN32__
+    static SRWLOCK LibLock = SRWLOCK_INIT;
+    #define lib_lock()    AcquireSRWLockExclusive(&LibLock)
+    #define lib_unlock()  ReleaseSRWLockExclusive(&LibLock)
+  #elif defined _Windows
+    #define lib_lock()    /* 16-bit Windows has no threads */
+    #define lib_unlock()
+  #else
+    static pthread_mutex_t LibLock = PTHREAD_MUTEX_INITIALIZER;
+    #define lib_lock()    pthread_mutex_lock(&LibLock)
+    #define lib_unlock()  pthread_mutex_unlock(&LibLock)
+  #endif
+
+static unsigned lib_hash(const char *name)
+{
+  unsigned hash=2166136261u;    /* FNV-1a */
+  while (*name!='\0')
+    hash=(hash ^ (unsigned char)*name++)*16777619u;
+  return hash;
+}
+
+static AMX_NATIVE lib_find(const AMX_LIBRARY *lib,const char *name)
+{
+  unsigned i;
+
+  if (lib->size==0)
+    return NULL;
+  for (i=lib_hash(name) & (lib->size-1); lib->natives[i].name!=NULL; i=(i+1) & (lib->size-1))
+    if (strcmp(lib->natives[i].name,name)==0)
+      return lib->natives[i].func;
+  return NULL;
+}
+
+static void lib_index(AMX_LIBRARY *lib,const char *name,AMX_NATIVE func)
+{
+  unsigned i;
+  char *copy;
+
+  if (lib->count+1>lib->size/2) {
+    /* grow the table; when memory runs out, the native is simply left out
+     * (it is then still found by the linear search in amx_Register())
+     */
+    AMX_NATIVE_INFO *table;
+    int j,size=(lib->size==0) ? 64 : 2*lib->size;
+    if ((table=(AMX_NATIVE_INFO*)calloc(size,sizeof(AMX_NATIVE_INFO)))==NULL)
+      return;
+    for (j=0; j<lib->size; j++) {
+      if (lib->natives[j].name!=NULL) {
+        for (i=lib_hash(lib->natives[j].name) & (size-1); table[i].name!=NULL; i=(i+1) & (size-1))
+          /* nothing */;
+        table[i]=lib->natives[j];
+      } /* if */
+    } /* for */
+    free(lib->natives);
+    lib->natives=table;
+    lib->size=size;
+  } /* if */
+  for (i=lib_hash(name) & (lib->size-1); lib->natives[i].name!=NULL; i=(i+1) & (lib->size-1))
+    if (strcmp(lib->natives[i].name,name)==0)
+      return;   /* first registration wins, as in amx_Register() */
+  /* the name is copied, the native table need not be static */
+  if ((copy=(char*)malloc(strlen(name)+1))==NULL)
+    return;
+  strcpy(copy,name);
+  lib->natives[i].name=copy;
+  lib->natives[i].func=func;
+  lib->count++;
+}
+
+static AMX_LIBRARY *lib_load(const char *name)
+{
+  AMX_LIBRARY *lib;
+  AMX_LIBHANDLE hlib;
+  char funcname[sNAMEMAX+12]; /* +1 for '\0', +4 for 'amx_', +7 for 'Cleanup' */
+  #if defined _Windows
+    char libname[sNAMEMAX+8]; /* +1 for '\0', +3 for 'amx' prefix, +4 for extension */
+  #else
+    char libname[_MAX_PATH];
+    char *root;
+    #if !defined AMX_LIBPATH
+      #define AMX_LIBPATH     "AMXLIB"
+    #endif
+  #endif
+
+  libname[0]='\0';
+  #if !defined _Windows
+    root=getenv("AMXLIB");
+    if (root!=NULL && *root!='\0') {
+      strcpy(libname,root);
+      if (libname[strlen(libname)-1]!='/')
+        strcat(libname,"/");
+    } /* if */
+  #endif
+  strcat(libname,"amx");
+  strcat(libname,name);
+  #if defined _Windows
+    strcat(libname,".dll");
+    #if defined __WIN32__
+      hlib=LoadLibraryA(libname);
+    #else
+      hlib=LoadLibrary(libname);
+      if (hlib<=HINSTANCE_ERROR)
+        hlib=NULL;
+    #endif
+  #else
+    strcat(libname,".so");
+    hlib=dlopen(libname,RTLD_NOW);
+  #endif
+  if (hlib==NULL)
+    return NULL;
+
+  if ((lib=(AMX_LIBRARY*)malloc(sizeof(AMX_LIBRARY)))==NULL) {
+    #if defined _Windows
+      FreeLibrary(hlib);
+    #else
+      dlclose(hlib);
+    #endif
+    return NULL;
+  } /* if */
+  memset(lib,0,sizeof(AMX_LIBRARY));
+  strcpy(lib->name,name);
+  lib->hlib=hlib;
+  /* a library that does not have the required initialization function is
+   * simply ignored
+   */
+  strcpy(funcname,"amx_");
+  strcat(funcname,name);
+  strcat(funcname,"Init");
+  #if defined _Windows
+    lib->init=(AMX_ENTRY)GetProcAddress(hlib,funcname);
+  #else
+    lib->init=(AMX_ENTRY)dlsym(hlib,funcname);
+  #endif
+  strcpy(funcname,"amx_");
+  strcat(funcname,name);
+  strcat(funcname,"Cleanup");
+  #if defined _Windows
+    lib->cleanup=(AMX_ENTRY)GetProcAddress(hlib,funcname);
+  #else
+    lib->cleanup=(AMX_ENTRY)dlsym(hlib,funcname);
+  #endif
+  lib->next=Libraries.first;
+  Libraries.first=lib;
+  return lib;
+}
+
+static void lib_unload(AMX_LIBRARY *lib)
+{
+  AMX_LIBRARY **link;
+  int i;
+
+  for (link=&Libraries.first; *link!=NULL && *link!=lib; link=&(*link)->next)
+    /* nothing */;
+  assert(*link==lib);
+  *link=lib->next;
+  #if defined _Windows
+    FreeLibrary(lib->hlib);
+  #else
+    dlclose(lib->hlib);
+  #endif
+  for (i=0; i<lib->size; i++)
+    if (lib->natives[i].name!=NULL)
+      free((void*)lib->natives[i].name);
+  free(lib->natives);
+  free(lib);
+}
+
+static AMX_LIBRARY *lib_lookup(const char *name)
+{
+  AMX_LIBRARY *lib;
+
+  for (lib=Libraries.first; lib!=NULL && strcmp(lib->name,name)!=0; lib=lib->next)
+    /* nothing */;
+  return lib;
+}
+#endif /* AMX_DYNALOAD */
+
 #if !defined NDEBUG
   static int check_endian(void)
   {
@@ -484,16 +726,16 @@ int AMXAPI amx_Callback(AMX *amx, cell index, cell *result, const cell *params)
     if ((amx->flags & AMX_FLAG_JITC)!=0)
       assert(amx->sysreq_d==0);
   #endif
-  if (amx->sysreq_d!=0) {
+  if (amx->sysreq_d!=0 && sizeof(f)<=sizeof(cell)) {
     /* at the point of the call, the CIP pseudo-register points directly
-     * behind the SYSREQ instruction and its parameter(s)
+     * behind the SYSREQ instruction and its parameter(s); the function
+     * pointer must fit in a cell (amx_Init() does not set sysreq_d otherwise)
      */
     unsigned char *code=amx->base+(int)hdr->cod+(int)amx->cip-sizeof(cell);
     assert(amx->cip >= 4 && amx->cip < (hdr->dat - hdr->cod));
-    assert_static(sizeof(f)<=sizeof(cell)); /* function pointer must fit in a cell */
     if (amx->flags & AMX_FLAG_SYSREQN)		/* SYSREQ.N has 2 parameters */
       code-=sizeof(cell);
-#if defined __GNUC__ || defined __ICC || defined ASM32
+#if defined AMX_LABELS || defined ASM32
     if (*(cell*)code==index) {
 #else
     if (*(cell*)code!=OP_SYSREQ_PRI) {
@@ -545,7 +787,7 @@ static int amx_BrowseRelocate(AMX *amx)
   long codesize;
   OPCODE op;
   int sysreq_flg;
-  #if defined __GNUC__ || defined __ICC || defined ASM32 || defined JIT
+  #if defined AMX_LABELS || defined ASM32 || defined JIT
     cell *opcode_list;
   #endif
   #if defined JIT
@@ -574,18 +816,18 @@ static int amx_BrowseRelocate(AMX *amx)
 
   amx->sysreq_d=0;      /* preset */
   sysreq_flg=0;
-  #if defined __GNUC__ || defined __ICC || defined ASM32 || defined JIT
+  #if defined AMX_LABELS || defined ASM32 || defined JIT
     amx_Exec(amx, (cell*)(void*)&opcode_list, 0);
   #endif
 
   /* start browsing code */
   for (cip=0; cip<codesize; ) {
     op=(OPCODE) *(ucell *)(code+(int)cip);
-    if ((unsigned)op>=OP_NUM_OPCODES) {
+    if ((unsigned)op>=OP_NUM_OPCODES || op==OP_BREAKPT) {
       amx->flags &= ~AMX_FLAG_BROWSE;
       return AMX_ERR_INVINSTR;
     } /* if */
-    #if defined __GNUC__ || defined __ICC || defined ASM32 || defined JIT
+    #if defined AMX_LABELS || defined ASM32 || defined JIT
       /* relocate opcode (only works if the size of an opcode is at least
        * as big as the size of a pointer (jump address); so basically we
        * rely on the opcode and a pointer being 32-bit
@@ -834,7 +1076,7 @@ static int amx_BrowseRelocate(AMX *amx)
       /* only either type of system request opcode should be found (otherwise,
        * we probably have a non-conforming compiler
        */
-      #if (defined __GNUC__ || defined __ICC || defined ASM32 || defined JIT) && !defined __64BIT__
+      #if defined AMX_LABELS || defined ASM32 || defined JIT
         /* to use direct system requests, a function pointer must fit in a cell;
          * because the native function's address will be stored as the parameter
          * of SYSREQ.D
@@ -919,6 +1161,57 @@ static void expand(unsigned char *code, long codesize, long memsize)
   /* when all bytes have been expanded, the complete memory block should be done */
   assert(memsize==0);
 }
+
+#if !defined AMX_COMPACTINPLACE
+/* expand_copy() decodes the compact code from a copy, from the start forward;
+ * this is more than twice as quick as the in-place expansion, because it
+ * needs no look-ahead for the start of a sequence and no ring buffer for the
+ * cells that would overwrite input that is not yet decoded. It returns
+ * AMX_ERR_MEMORY if there is no memory for the copy, and AMX_ERR_FORMAT if
+ * the code expands past the end of the memory block.
+ */
+static int expand_copy(unsigned char *code, long codesize, long memsize)
+{
+  unsigned char *buffer;
+  const unsigned char *src,*end;
+  ucell *dest,*destend;
+  ucell c;
+  unsigned char b;
+
+  assert(memsize % sizeof(cell) == 0);
+  /* the copy gets a terminating zero byte, so that a sequence that (wrongly)
+   * has the continuation bit set on its last byte still ends in the buffer
+   */
+  if ((buffer=(unsigned char*)malloc((size_t)codesize+1))==NULL)
+    return AMX_ERR_MEMORY;
+  memcpy(buffer,code,(size_t)codesize);
+  buffer[(size_t)codesize]=0;
+  src=buffer;
+  end=buffer+(size_t)codesize;
+  dest=(ucell*)code;
+  destend=(ucell*)(code+(size_t)memsize);
+  while (src<end) {
+    /* a sequence holds the most significant bits first; the first byte is
+     * sign-extended from bit 6
+     */
+    b=*src++;
+    c=(ucell)(((cell)(b & 0x7f) ^ 0x40) - 0x40);
+    while ((b & 0x80)!=0) {
+      b=*src++;
+      c=(c<<7) | (b & 0x7f);
+    } /* while */
+    if (dest>=destend) {
+      free(buffer);     /* the header does not match the code */
+      return AMX_ERR_FORMAT;
+    } /* if */
+    *dest++=c;
+  } /* while */
+  /* when all bytes have been expanded, the complete memory block should be done */
+  assert(dest==destend);
+  free(buffer);
+  return AMX_ERR_NONE;
+}
+#endif /* !AMX_COMPACTINPLACE */
 #endif /* AMX_COMPACTMARGIN > 2 */
 
 int AMXAPI amx_Init(AMX *amx,void *program)
@@ -926,28 +1219,20 @@ int AMXAPI amx_Init(AMX *amx,void *program)
   AMX_HEADER *hdr;
   int err;
   unsigned char *data;
-  #if (defined _Windows || defined LINUX || defined __FreeBSD__ || defined __OpenBSD__) && !defined AMX_NODYNALOAD
-    #if defined _Windows
-      char libname[sNAMEMAX+8]; /* +1 for '\0', +3 for 'amx' prefix, +4 for extension */
-      typedef int (FAR WINAPI *AMX_ENTRY)(AMX _FAR *amx);
-      HINSTANCE hlib;
-    #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-      char libname[_MAX_PATH];
-      char *root;
-      typedef int (*AMX_ENTRY)(AMX *amx);
-      void *hlib;
-      #if !defined AMX_LIBPATH
-        #define AMX_LIBPATH     "AMXLIB"
-      #endif
-    #endif
-    int numlibraries,i;
-    AMX_FUNCSTUB *lib;
-    AMX_ENTRY libinit;
+  #if defined AMX_DYNALOAD
+    int numlibraries,numnatives,i,j;
+    AMX_FUNCSTUB *lib,*func;
+    AMX_LIBRARY *xlib;
+    AMX_NATIVE funcptr;
   #endif
 
   if ((amx->flags & AMX_FLAG_RELOC)!=0)
     return AMX_ERR_INIT;  /* already initialized (may not do so twice) */
 
+  #if defined AMX_OPCODESTATS
+    amx_ResetOpcodeStats(); /* do not carry over the counts of an earlier run */
+  #endif
+
   hdr=(AMX_HEADER *)program;
   /* the header is in Little Endian, on a Big Endian machine, swap all
    * multi-byte words
@@ -999,6 +1284,12 @@ int AMXAPI amx_Init(AMX *amx,void *program)
   assert((hdr->flags & AMX_FLAG_COMPACT)!=0 || hdr->hea == hdr->size);
   if ((hdr->flags & AMX_FLAG_COMPACT)!=0) {
     #if AMX_COMPACTMARGIN > 2
+      #if !defined AMX_COMPACTINPLACE
+        if ((err=expand_copy((unsigned char *)program+(int)hdr->cod,
+                             hdr->size - hdr->cod, hdr->hea - hdr->cod))==AMX_ERR_FORMAT)
+          return err;
+        if (err==AMX_ERR_MEMORY)
+      #endif
       expand((unsigned char *)program+(int)hdr->cod,
              hdr->size - hdr->cod, hdr->hea - hdr->cod);
     #else
@@ -1092,54 +1383,42 @@ int AMXAPI amx_Init(AMX *amx,void *program)
     return err;
 
   /* load any extension modules that the AMX refers to */
-  #if (defined _Windows || defined LINUX || defined __FreeBSD__ || defined __OpenBSD__) && !defined AMX_NODYNALOAD
-    #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-      root=getenv("AMXLIB");
-    #endif
+  #if defined AMX_DYNALOAD
     hdr=(AMX_HEADER *)amx->base;
     numlibraries=NUMENTRIES(hdr,libraries,pubvars);
+    numnatives=NUMENTRIES(hdr,natives,libraries);
     for (i=0; i<numlibraries; i++) {
       lib=GETENTRY(hdr,libraries,i);
-      libname[0]='\0';
-      #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-        if (root!=NULL && *root!='\0') {
-          strcpy(libname,root);
-          if (libname[strlen(libname)-1]!='/')
-            strcat(libname,"/");
+      lib_lock();
+      if ((xlib=lib_lookup(GETENTRYNAME(hdr,lib)))==NULL)
+        xlib=lib_load(GETENTRYNAME(hdr,lib));
+      if (xlib!=NULL) {
+        int initerr=AMX_ERR_NONE;
+        xlib->refcount++;
+        if (xlib->indexed) {
+          /* bind the natives that the module registered before */
+          func=GETENTRY(hdr,natives,0);
+          for (j=0; j<numnatives; j++) {
+            if (func->address==0 && (funcptr=lib_find(xlib,GETENTRYNAME(hdr,func)))!=NULL)
+              func->address=(ucell)funcptr;
+            func=(AMX_FUNCSTUB*)((unsigned char*)func+hdr->defsize);
+          } /* for */
         } /* if */
-      #endif
-      strcat(libname,"amx");
-      strcat(libname,GETENTRYNAME(hdr,lib));
-      #if defined _Windows
-        strcat(libname,".dll");
-        #if defined __WIN32__
-          hlib=LoadLibraryA(libname);
-        #else
-          hlib=LoadLibrary(libname);
-          if (hlib<=HINSTANCE_ERROR)
-            hlib=NULL;
-        #endif
-      #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-        strcat(libname,".so");
-        hlib=dlopen(libname,RTLD_NOW);
-      #endif
-      if (hlib!=NULL) {
-        /* a library that cannot be loaded or that does not have the required
-         * initialization function is simply ignored
+        if (xlib->init!=NULL) {
+          Libraries.initamx=amx;
+          Libraries.initlib=xlib;
+          initerr=xlib->init(amx);
+          Libraries.initamx=NULL;
+          Libraries.initlib=NULL;
+        } /* if */
+        /* the table is complete only if the module initialized; AMX_ERR_NOTFOUND
+         * just means that natives of other modules are not yet registered
          */
-        char funcname[sNAMEMAX+9]; /* +1 for '\0', +4 for 'amx_', +4 for 'Init' */
-        strcpy(funcname,"amx_");
-        strcat(funcname,GETENTRYNAME(hdr,lib));
-        strcat(funcname,"Init");
-        #if defined _Windows
-          libinit=(AMX_ENTRY)GetProcAddress(hlib,funcname);
-        #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-          libinit=(AMX_ENTRY)dlsym(hlib,funcname);
-        #endif
-        if (libinit!=NULL)
-          libinit(amx);
+        if (initerr==AMX_ERR_NONE || initerr==AMX_ERR_NOTFOUND)
+          xlib->indexed=1;
       } /* if */
-      lib->address=(ucell)hlib;
+      lib_unlock();
+      lib->address=(xlib!=NULL) ? (ucell)xlib->hlib : 0;
     } /* for */
   #endif
 
@@ -1249,42 +1528,33 @@ int AMXAPI amx_InitJIT(AMX *amx,void *compiled_program,void *reloc_table)
 #if defined AMX_CLEANUP
 int AMXAPI amx_Cleanup(AMX *amx)
 {
-  #if (defined _Windows || defined LINUX || defined __FreeBSD__ || defined __OpenBSD__) && !defined AMX_NODYNALOAD
-    #if defined _Windows
-      typedef int (FAR WINAPI *AMX_ENTRY)(AMX FAR *amx);
-    #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-      typedef int (*AMX_ENTRY)(AMX *amx);
-    #endif
+  #if defined AMX_DYNALOAD
     AMX_HEADER *hdr;
     int numlibraries,i;
     AMX_FUNCSTUB *lib;
-    AMX_ENTRY libcleanup;
+    AMX_LIBRARY *xlib;
   #endif
 
-  /* unload all extension modules */
-  #if (defined _Windows || defined LINUX || defined __FreeBSD__ || defined __OpenBSD__) && !defined AMX_NODYNALOAD
+  /* release all extension modules; a module is unloaded when no other
+   * abstract machine uses it
+   */
+  #if defined AMX_DYNALOAD
     hdr=(AMX_HEADER *)amx->base;
     assert(hdr->magic==AMX_MAGIC);
     numlibraries=NUMENTRIES(hdr,libraries,pubvars);
     for (i=0; i<numlibraries; i++) {
       lib=GETENTRY(hdr,libraries,i);
       if (lib->address!=0) {
-        char funcname[sNAMEMAX+12]; /* +1 for '\0', +4 for 'amx_', +7 for 'Cleanup' */
-        strcpy(funcname,"amx_");
-        strcat(funcname,GETENTRYNAME(hdr,lib));
-        strcat(funcname,"Cleanup");
-        #if defined _Windows
-          libcleanup=(AMX_ENTRY)GetProcAddress((HINSTANCE)lib->address,funcname);
-        #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-          libcleanup=(AMX_ENTRY)dlsym((void*)lib->address,funcname);
-        #endif
-        if (libcleanup!=NULL)
-          libcleanup(amx);
-        #if defined _Windows
-          FreeLibrary((HINSTANCE)lib->address);
-        #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-          dlclose((void*)lib->address);
-        #endif
+        lib_lock();
+        if ((xlib=lib_lookup(GETENTRYNAME(hdr,lib)))!=NULL) {
+          if (xlib->cleanup!=NULL)
+            xlib->cleanup(amx);
+          assert(xlib->refcount>0);
+          if (--xlib->refcount==0)
+            lib_unload(xlib);
+        } /* if */
+        lib_unlock();
+        lib->address=0;
       } /* if */
     } /* for */
   #else
@@ -1322,6 +1592,8 @@ int AMXAPI amx_Clone(AMX *amxClone, AMX *amxSource, void *data)
     amxClone->callback=amxSource->callback;
   if (amxClone->debug==NULL)
     amxClone->debug=amxSource->debug;
+  if (amxClone->budget==0)
+    amxClone->budget=amxSource->budget;
   amxClone->flags=amxSource->flags;
 
   /* copy the data segment; the stack and the heap can be left uninitialized */
@@ -1410,26 +1682,20 @@ int AMXAPI amx_GetNative(AMX *amx, int index, char *funcname)
 
 int AMXAPI amx_FindNative(AMX *amx, const char *name, int *index)
 {
-  int first,last,mid,result;
+  int idx,last;
   char pname[sNAMEMAX+1];
 
   amx_NumNatives(amx, &last);
-  last--;       /* last valid index is 1 less than the number of functions */
-  first=0;
-  /* binary search */
-  while (first<=last) {
-    mid=(first+last)/2;
-    amx_GetNative(amx, mid, pname);
-    result=strcmp(pname,name);
-    if (result>0) {
-      last=mid-1;
-    } else if (result<0) {
-      first=mid+1;
-    } else {
-      *index=mid;
+  /* linear search, the native table is sorted on the function id (the order
+   * in which the functions were declared), not on the name
+   */
+  for (idx=0; idx<last; idx++) {
+    amx_GetNative(amx, idx, pname);
+    if (strcmp(pname,name)==0) {
+      *index=idx;
       return AMX_ERR_NONE;
     } /* if */
-  } /* while */
+  } /* for */
   /* not found, set to an invalid index, so amx_Exec() will fail */
   *index=INT_MAX;
   return AMX_ERR_NOTFOUND;
@@ -1703,6 +1969,16 @@ int AMXAPI amx_Register(AMX *amx, const AMX_NATIVE_INFO *list, int number)
   assert(hdr->natives<=hdr->libraries);
   numnatives=NUMENTRIES(hdr,natives,libraries);
 
+  #if defined AMX_DYNALOAD
+    /* when an extension module registers its natives for the first time, add
+     * these to the module's table (the module's initialization function runs
+     * with the lock held, so only "initamx" needs to be checked here)
+     */
+    if (amx==Libraries.initamx && !Libraries.initlib->indexed && list!=NULL)
+      for (i=0; list[i].name!=NULL && (i<number || number==-1); i++)
+        lib_index(Libraries.initlib,list[i].name,list[i].func);
+  #endif
+
   err=AMX_ERR_NONE;
   func=GETENTRY(hdr,natives,0);
   for (i=0; i<numnatives; i++) {
@@ -1851,16 +2127,73 @@ int AMXAPI amx_PushString(AMX *amx, cell *amx_addr, cell **phys_addr, const char
 #define ABORT(amx,v)    { (amx)->stk=reset_stk; (amx)->hea=reset_hea; return v; }
 
 #define CHKMARGIN()     if (hea+STKMARGIN>stk) return AMX_ERR_STACKERR
+
+/* The instruction budget (see amx_SetBudget()) is only charged on calls and
+ * on backward jumps, so that straight-line code runs at full speed. When it
+ * runs out, the abstract machine stops at the jump target, in the same
+ * restartable state as after a "sleep" instruction.
+ */
+#define CHKBUDGET()     if (budget>0 && --budget==0) goto preempt
+#define JUMPTO(dest)    do { cell *from_=cip; cip=(dest); if (cip<=from_) CHKBUDGET(); } while (0)
+
+#if defined AMX_OPCODESTATS
+  /* Execution counts of all opcodes and of all pairs of adjacent opcodes (the
+   * row is the opcode that executed first); the counts are shared by all
+   * abstract machines, see amx_OpcodeStats(), and amx_Init() resets them.
+   * The first opcode that runs in a call to amx_Exec() is paired with OP_NONE.
+   */
+  static unsigned long opcode_count[OP_NUM_OPCODES];
+  static unsigned long opcode_pairs[OP_NUM_OPCODES][OP_NUM_OPCODES];
+  #define COUNTOP(op)   do { int op_=(op); opcode_count[op_]++; opcode_pairs[prevop][op_]++; prevop=op_; } while (0)
+#else
+  #define COUNTOP(op)
+#endif
 #define CHKSTACK()      if (stk>amx->stp) return AMX_ERR_STACKLOW
 #define CHKHEAP()       if (hea<amx->hlw) return AMX_ERR_HEAPLOW
 
-#if (defined __GNUC__ || defined __ICC) && !(defined ASM32 || defined JIT)
+#if defined AMX_LABELS && !(defined ASM32 || defined JIT)
     /* GNU C version uses the "labels as values" extension to create
      * fast "indirect threaded" interpreter. The Intel C/C++ compiler
      * supports this too.
      */
 
+#if defined AMX_OPCODESTATS
+/* The code holds the addresses of the labels, so the opcode must be looked up
+ * from the label address before it can be counted.
+ */
+#define LABELHASH_SIZE  512     /* must be a power of 2, > OP_NUM_OPCODES */
+static const void *labelhash_label[LABELHASH_SIZE];
+static short labelhash_op[LABELHASH_SIZE];
+
+#define LABELHASH(p)    ( (unsigned)(((size_t)(p) >> 2) * 2654435761UL) & (LABELHASH_SIZE-1) )
+
+static int label_opcode(const void * const *opcodelist, const void *label)
+{
+  unsigned h;
+  int op;
+
+  if (labelhash_label[LABELHASH(opcodelist[0])]==NULL) {
+    /* first use, build the table (opcodes that share a label map to the
+     * lowest opcode number)
+     */
+    for (op=0; op<OP_NUM_OPCODES; op++) {
+      for (h=LABELHASH(opcodelist[op]); labelhash_label[h]!=NULL && labelhash_label[h]!=opcodelist[op]; h=(h+1) & (LABELHASH_SIZE-1))
+        /* nothing */;
+      if (labelhash_label[h]==NULL) {
+        labelhash_label[h]=opcodelist[op];
+        labelhash_op[h]=(short)op;
+      } /* if */
+    } /* for */
+  } /* if */
+  for (h=LABELHASH(label); labelhash_label[h]!=label; h=(h+1) & (LABELHASH_SIZE-1))
+    assert(labelhash_label[h]!=NULL);
+  return labelhash_op[h];
+}
+
+#define NEXT(cip)       { COUNTOP(label_opcode(amx_opcodelist,*(void **)cip)); goto **(void **)cip++; }
+#else
 #define NEXT(cip)       goto **(void **)cip++
+#endif
 
 int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
 {
@@ -1904,7 +2237,8 @@ static const void * const amx_opcodelist[] = {
         &&op_push3_s,   &&op_push3_adr, &&op_push4_c,   &&op_push4,
         &&op_push4_s,   &&op_push4_adr, &&op_push5_c,   &&op_push5,
         &&op_push5_s,   &&op_push5_adr, &&op_load_both, &&op_load_s_both,
-        &&op_const,     &&op_const_s,   &&op_sysreq_d,  &&op_sysreq_nd };
+        &&op_const,     &&op_const_s,   &&op_sysreq_d,  &&op_sysreq_nd,
+        &&op_breakpt };
   AMX_HEADER *hdr;
   AMX_FUNCSTUB *func;
   unsigned char *code, *data;
@@ -1912,7 +2246,11 @@ static const void * const amx_opcodelist[] = {
   cell reset_stk, reset_hea, *cip;
   cell offs,val;
   ucell codesize;
+  long budget;
   int num,i;
+  #if defined AMX_OPCODESTATS
+    int prevop=OP_NONE;
+  #endif
 
   /* HACK: return label table (for amx_BrowseRelocate) if amx structure
    * has the AMX_FLAG_BROWSE flag set.
@@ -1947,6 +2285,7 @@ static const void * const amx_opcodelist[] = {
   reset_hea=hea;
   alt=frm=pri=0;/* just to avoid compiler warnings */
   num=0;        /* just to avoid compiler warnings */
+  budget=amx->budget;
 
   /* get the start address */
   if (index==AMX_EXEC_MAIN) {
@@ -2304,89 +2643,91 @@ static const void * const amx_opcodelist[] = {
   op_call:
     PUSH(((unsigned char *)cip-code)+sizeof(cell));/* push address behind instruction */
     cip=JUMPABS(code, cip);                     /* jump to the address */
+    CHKBUDGET();
     NEXT(cip);
   op_call_pri:
     PUSH((unsigned char *)cip-code);
     cip=(cell *)(code+(int)pri);
+    CHKBUDGET();
     NEXT(cip);
   op_jump:
     /* since the GETPARAM() macro modifies cip, you cannot
      * do GETPARAM(cip) directly */
-    cip=JUMPABS(code, cip);
+    JUMPTO(JUMPABS(code, cip));
     NEXT(cip);
   op_jrel:
     offs=*cip;
-    cip=(cell *)((unsigned char *)cip + (int)offs + sizeof(cell));
+    JUMPTO((cell *)((unsigned char *)cip + (int)offs + sizeof(cell)));
     NEXT(cip);
   op_jzer:
     if (pri==0)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jnz:
     if (pri!=0)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jeq:
     if (pri==alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jneq:
     if (pri!=alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jless:
     if ((ucell)pri < (ucell)alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jleq:
     if ((ucell)pri <= (ucell)alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jgrtr:
     if ((ucell)pri > (ucell)alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jgeq:
     if ((ucell)pri >= (ucell)alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jsless:
     if (pri<alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jsleq:
     if (pri<=alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jsgrtr:
     if (pri>alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
   op_jsgeq:
     if (pri>=alt)
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
     else
       cip=(cell *)((unsigned char *)cip+sizeof(cell));
     NEXT(cip);
@@ -2773,7 +3114,7 @@ static const void * const amx_opcodelist[] = {
     SKIPPARAM(1);
     NEXT(cip);
   op_jump_pri:
-    cip=(cell *)(code+(int)pri);
+    JUMPTO((cell *)(code+(int)pri));
     NEXT(cip);
   op_switch: {
     cell *cptr;
@@ -2830,6 +3171,10 @@ static const void * const amx_opcodelist[] = {
     NEXT(cip);
 #endif
   op_break:
+    if ((amx->flags & AMX_FLAG_DBGTRAP)!=0)
+      NEXT(cip);
+    /* drop through */
+  op_breakpt:
     assert((amx->flags & AMX_FLAG_BROWSE)==0);
     if (amx->debug!=NULL) {
       /* store status */
@@ -2991,6 +3336,20 @@ static const void * const amx_opcodelist[] = {
     } /* if */
     NEXT(cip);
 #endif
+
+  preempt:
+    /* the instruction budget is used up; store the complete status, so that
+     * the host can resume with AMX_EXEC_CONT
+     */
+    amx->frm=frm;
+    amx->pri=pri;
+    amx->alt=alt;
+    amx->cip=(cell)((unsigned char*)cip-code);
+    amx->stk=stk;
+    amx->hea=hea;
+    amx->reset_stk=reset_stk;
+    amx->reset_hea=reset_hea;
+    return AMX_ERR_BUDGET;
 }
 
 #else
@@ -3045,7 +3404,11 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
   #else
     OPCODE op;
     cell offs,val;
+    long budget;
     int num;
+    #if defined AMX_OPCODESTATS
+      int prevop=OP_NONE;
+    #endif
   #endif
   #if defined ASM32
     extern void const *amx_opcodelist[];
@@ -3103,6 +3466,9 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
   reset_stk=stk;
   reset_hea=hea;
   alt=frm=pri=0;/* just to avoid compiler warnings */
+  #if !(defined ASM32 || defined JIT)
+    budget=amx->budget;
+  #endif
 
   /* get the start address */
   if (index==AMX_EXEC_MAIN) {
@@ -3207,6 +3573,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
 
   for ( ;; ) {
     op=(OPCODE) _RCODE();
+    COUNTOP(op);
     switch (op) {
     case OP_LOAD_PRI:
       GETPARAM(offs);
@@ -3504,89 +3871,91 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
     case OP_CALL:
       PUSH(((unsigned char *)cip-code)+sizeof(cell));/* skip address */
       cip=JUMPABS(code, cip);                   /* jump to the address */
+      CHKBUDGET();
       break;
     case OP_CALL_PRI:
       PUSH((unsigned char *)cip-code);
       cip=(cell *)(code+(int)pri);
+      CHKBUDGET();
       break;
     case OP_JUMP:
       /* since the GETPARAM() macro modifies cip, you cannot
        * do GETPARAM(cip) directly */
-      cip=JUMPABS(code, cip);
+      JUMPTO(JUMPABS(code, cip));
       break;
     case OP_JREL:
       offs=*cip;
-      cip=(cell *)((unsigned char *)cip + (int)offs + sizeof(cell));
+      JUMPTO((cell *)((unsigned char *)cip + (int)offs + sizeof(cell)));
       break;
     case OP_JZER:
       if (pri==0)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JNZ:
       if (pri!=0)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JEQ:
       if (pri==alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JNEQ:
       if (pri!=alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JLESS:
       if ((ucell)pri < (ucell)alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JLEQ:
       if ((ucell)pri <= (ucell)alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JGRTR:
       if ((ucell)pri > (ucell)alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JGEQ:
       if ((ucell)pri >= (ucell)alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JSLESS:
       if (pri<alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JSLEQ:
       if (pri<=alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JSGRTR:
       if (pri>alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
     case OP_JSGEQ:
       if (pri>=alt)
-        cip=JUMPABS(code, cip);
+        JUMPTO(JUMPABS(code, cip));
       else
         cip=(cell *)((unsigned char *)cip+sizeof(cell));
       break;
@@ -3970,7 +4339,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       SKIPPARAM(1);
       break;
     case OP_JUMP_PRI:
-      cip=(cell *)(code+(int)pri);
+      JUMPTO((cell *)(code+(int)pri));
       break;
     case OP_SWITCH: {
       cell *cptr;
@@ -4025,6 +4394,10 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       break;
 #endif
     case OP_BREAK:
+      if ((amx->flags & AMX_FLAG_DBGTRAP)!=0)
+        break;
+      /* drop through */
+    case OP_BREAKPT:
       assert((amx->flags & AMX_FLAG_BROWSE)==0);
       if (amx->debug!=NULL) {
         /* store status */
@@ -4194,10 +4567,45 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       ABORT(amx,AMX_ERR_INVINSTR);
     } /* switch */
   } /* for */
+
+preempt:
+  /* the instruction budget is used up; store the complete status, so that
+   * the host can resume with AMX_EXEC_CONT
+   */
+  amx->frm=frm;
+  amx->pri=pri;
+  amx->alt=alt;
+  amx->cip=(cell)((unsigned char*)cip-code);
+  amx->stk=stk;
+  amx->hea=hea;
+  amx->reset_stk=reset_stk;
+  amx->reset_hea=reset_hea;
+  return AMX_ERR_BUDGET;
 #endif
 }
 
-#endif  /* __GNUC__ || __ICC */
+#endif  /* AMX_LABELS */
+
+#if defined AMX_OPCODESTATS
+int AMXAPI amx_OpcodeStats(int *number, const unsigned long **counts, const unsigned long **pairs)
+{
+  /* "pairs" is a square matrix of "number" rows */
+  if (number!=NULL)
+    *number=OP_NUM_OPCODES;
+  if (counts!=NULL)
+    *counts=opcode_count;
+  if (pairs!=NULL)
+    *pairs=&opcode_pairs[0][0];
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI amx_ResetOpcodeStats(void)
+{
+  memset(opcode_count,0,sizeof opcode_count);
+  memset(opcode_pairs,0,sizeof opcode_pairs);
+  return AMX_ERR_NONE;
+}
+#endif /* AMX_OPCODESTATS */
 
 #endif /* AMX_EXEC || AMX_INIT */
 
@@ -4211,6 +4619,21 @@ int AMXAPI amx_SetCallback(AMX *amx,AMX_CALLBACK callback)
 }
 #endif /* AMX_SETCALLBACK */
 
+#if defined AMX_SETBUDGET
+int AMXAPI amx_SetBudget(AMX *amx,long budget)
+{
+  assert(amx!=NULL);
+  if (budget<0)
+    return AMX_ERR_PARAMS;
+  #if defined ASM32 || defined JIT
+    if (budget>0)
+      return AMX_ERR_GENERAL;   /* not supported by the assembler core and the JIT */
+  #endif
+  amx->budget=budget;
+  return AMX_ERR_NONE;
+}
+#endif /* AMX_SETBUDGET */
+
 #if defined AMX_SETDEBUGHOOK
 int AMXAPI amx_SetDebugHook(AMX *amx,AMX_DEBUG debug)
 {
@@ -4220,6 +4643,65 @@ int AMXAPI amx_SetDebugHook(AMX *amx,AMX_DEBUG debug)
 }
 #endif /* AMX_SETDEBUGHOOK */
 
+#if defined AMX_BREAKPOINT
+static int patch_break(AMX *amx, cell addr, OPCODE from, OPCODE to)
+{
+  AMX_HEADER *hdr;
+  cell *code;
+  #if defined AMX_LABELS && !(defined ASM32 || defined JIT)
+    cell *opcode_list;
+  #endif
+
+  assert(amx!=NULL);
+  if ((amx->flags & AMX_FLAG_RELOC)==0)
+    return AMX_ERR_INIT;
+  hdr=(AMX_HEADER *)amx->base;
+  assert(hdr!=NULL);
+  assert(hdr->magic==AMX_MAGIC);
+  if (addr<0 || addr>=hdr->dat-hdr->cod || addr % sizeof(cell)!=0)
+    return AMX_ERR_MEMACCESS;
+  code=(cell *)(amx->base+(int)hdr->cod+(int)addr);
+
+  #if defined ASM32 || defined JIT
+    /* the assembler abstract machine and the JIT have no trap opcode */
+    (void)code;
+    (void)from;
+    (void)to;
+    return AMX_ERR_DEBUG;
+  #elif defined AMX_LABELS
+    /* the opcodes were relocated to label addresses, get the label table
+     * in the same way as amx_BrowseRelocate() does
+     */
+    amx->flags|=AMX_FLAG_BROWSE;
+    amx_Exec(amx, (cell*)(void*)&opcode_list, 0);
+    amx->flags&=~AMX_FLAG_BROWSE;
+    if (*code!=opcode_list[from])
+      return AMX_ERR_INVINSTR;
+    *code=opcode_list[to];
+    return AMX_ERR_NONE;
+  #else
+    if (*code!=(cell)from)
+      return AMX_ERR_INVINSTR;
+    *code=(cell)to;
+    return AMX_ERR_NONE;
+  #endif
+}
+
+/* amx_SetBreakpoint() replaces the BREAK instruction at "addr" (relative to
+ * the code segment) by a trap. When the AMX_FLAG_DBGTRAP flag is set, the
+ * debug hook is only called on these traps, rather than on every BREAK.
+ */
+int AMXAPI amx_SetBreakpoint(AMX *amx, cell addr)
+{
+  return patch_break(amx, addr, OP_BREAK, OP_BREAKPT);
+}
+
+int AMXAPI amx_ClearBreakpoint(AMX *amx, cell addr)
+{
+  return patch_break(amx, addr, OP_BREAKPT, OP_BREAK);
+}
+#endif /* AMX_BREAKPOINT */
+
 #if defined AMX_RAISEERROR
 int AMXAPI amx_RaiseError(AMX *amx, int error)
 {
@@ -36,6 +36,9 @@
 
 #if defined HAVE_STDINT_H
   #include <stdint.h>
+  #if defined INT64_MAX && !defined HAVE_I64
+    #define HAVE_I64
+  #endif
 #else
   #if defined __LCC__ || defined __DMC__ || defined LINUX || (defined __WATCOMC__ && __WATCOMC__ >= 1200)
     #if defined HAVE_INTTYPES_H
@@ -229,8 +232,13 @@ typedef struct tagAMX_NATIVE_INFO {
   AMX_NATIVE func       PACKED;
 } AMX_NATIVE_INFO;
 
+/* AMX_USERNUM sets the size of the user data tables in struct AMX. It was 4
+ * in earlier releases; as it changes the layout of struct AMX, extension
+ * modules and assembler cores must be rebuilt with the same value (see
+ * AMXDEF.ASM and AMXDEFN.ASM).
+ */
 #if !defined AMX_USERNUM
-#define AMX_USERNUM     4
+#define AMX_USERNUM     8
 #endif
 #define sEXPMAX         19      /* maximum name length for file version <= 6 */
 #define sNAMEMAX        31      /* maximum name length of symbol name */
@@ -282,6 +290,8 @@ typedef struct tagAMX {
     int reloc_size      PACKED; /* required temporary buffer for relocations */
     long code_size      PACKED; /* estimated memory footprint of the native code */
   #endif
+  /* fields below are not mirrored in amxdef.asm and amxdefn.asm */
+  long budget           PACKED; /* calls and backward jumps per amx_Exec(), 0 = no limit */
 } AMX;
 
 /* The AMX_HEADER structure is both the memory format as the file format. The
@@ -331,6 +341,7 @@ enum {
   AMX_ERR_DIVIDE,       /* divide by zero */
   AMX_ERR_SLEEP,        /* go into sleepmode - code can be restarted */
   AMX_ERR_INVSTATE,     /* invalid state for this access */
+  AMX_ERR_BUDGET,       /* instruction budget used up - code can be restarted */
 
   AMX_ERR_MEMORY = 16,  /* out of memory */
   AMX_ERR_FORMAT,       /* invalid file format */
@@ -351,6 +362,7 @@ enum {
 #define AMX_FLAG_COMPACT  0x04  /* compact encoding */
 #define AMX_FLAG_SLEEP    0x08  /* script uses the sleep instruction (possible re-entry or power-down mode) */
 #define AMX_FLAG_NOCHECKS 0x10  /* no array bounds checking; no BREAK opcodes */
+#define AMX_FLAG_DBGTRAP 0x400  /* debug hook is only called at breakpoints set with amx_SetBreakpoint() */
 #define AMX_FLAG_SYSREQN 0x800  /* script new (optimized) version of SYSREQ opcode */
 #define AMX_FLAG_NTVREG 0x1000  /* all native functions are registered */
 #define AMX_FLAG_JITC   0x2000  /* abstract machine is JIT compiled */
@@ -399,6 +411,7 @@ uint32_t * AMXAPI amx_Align32(uint32_t *v);
 int AMXAPI amx_Allot(AMX *amx, int cells, cell *amx_addr, cell **phys_addr);
 int AMXAPI amx_Callback(AMX *amx, cell index, cell *result, const cell *params);
 int AMXAPI amx_Cleanup(AMX *amx);
+int AMXAPI amx_ClearBreakpoint(AMX *amx, cell addr);
 int AMXAPI amx_Clone(AMX *amxClone, AMX *amxSource, void *data);
 int AMXAPI amx_Exec(AMX *amx, cell *retval, int index);
 int AMXAPI amx_FindNative(AMX *amx, const char *name, int *index);
@@ -422,12 +435,16 @@ int AMXAPI amx_NumNatives(AMX *amx, int *number);
 int AMXAPI amx_NumPublics(AMX *amx, int *number);
 int AMXAPI amx_NumPubVars(AMX *amx, int *number);
 int AMXAPI amx_NumTags(AMX *amx, int *number);
+int AMXAPI amx_OpcodeStats(int *number, const unsigned long **counts, const unsigned long **pairs);
 int AMXAPI amx_Push(AMX *amx, cell value);
 int AMXAPI amx_PushArray(AMX *amx, cell *amx_addr, cell **phys_addr, const cell array[], int numcells);
 int AMXAPI amx_PushString(AMX *amx, cell *amx_addr, cell **phys_addr, const char *string, int pack, int use_wchar);
 int AMXAPI amx_RaiseError(AMX *amx, int error);
 int AMXAPI amx_Register(AMX *amx, const AMX_NATIVE_INFO *nativelist, int number);
 int AMXAPI amx_Release(AMX *amx, cell amx_addr);
+int AMXAPI amx_ResetOpcodeStats(void);
+int AMXAPI amx_SetBreakpoint(AMX *amx, cell addr);
+int AMXAPI amx_SetBudget(AMX *amx, long budget);
 int AMXAPI amx_SetCallback(AMX *amx, AMX_CALLBACK callback);
 int AMXAPI amx_SetDebugHook(AMX *amx, AMX_DEBUG debug);
 int AMXAPI amx_SetString(cell *dest, const char *source, int pack, int use_wchar, size_t size);
@@ -125,8 +125,8 @@ static char *messages[] = {
       /* AMX_ERR_NATIVE    */ "Native function failed",
       /* AMX_ERR_DIVIDE    */ "Divide by zero",
       /* AMX_ERR_SLEEP     */ "(sleep mode)",
-      /* 13 */                "(reserved)",
-      /* 14 */                "(reserved)",
+      /* AMX_ERR_INVSTATE  */ "Invalid state for this access",
+      /* AMX_ERR_BUDGET    */ "(instruction budget used up)",
       /* 15 */                "(reserved)",
       /* AMX_ERR_MEMORY    */ "Out of memory",
       /* AMX_ERR_FORMAT    */ "Invalid/unsupported P-code file format",
@@ -46,6 +46,11 @@
 #if defined USE_CURSES
   #include <curses.h>
 #endif
+#if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__ || defined MACOS
+  #include <unistd.h>     /* for isatty() */
+#elif defined __WIN32__ || defined _WIN32 || defined WIN32 || defined __MSDOS__
+  #include <io.h>         /* for _isatty() */
+#endif
 #include "amx.h"
 #if defined __WIN32__ || defined _WIN32 || defined WIN32
   #include <windows.h>
@@ -392,16 +397,136 @@
   #define CreateConsole()
 #endif
 
+/* The output of print() and printf() is collected in a buffer per abstract
+ * machine (in its user data). When the output goes to a terminal, the buffer
+ * and the stream are flushed after each call. When the output is redirected,
+ * complete lines are passed on to the stream and the stream is flushed in the
+ * idle function, before reading input and on clean-up.
+ */
+#if !defined AMXCONSOLE_BUFSIZE
+  #define AMXCONSOLE_BUFSIZE  512
+#endif
+
+typedef struct tagCONSOLEBUFFER {
+  int length;
+  TCHAR text[AMXCONSOLE_BUFSIZE+1];   /* +1 for the terminating zero */
+} CONSOLEBUFFER;
+
+typedef struct tagCONSOLEINFO {
+  CONSOLEBUFFER buffer;
+  #if !defined AMXCONSOLE_NOIDLE
+    AMX_IDLE PrevIdle;
+    int idxKeyPressed;    /* -1 if the script has no @keypressed() */
+  #endif
+} CONSOLEINFO;
+
+static CONSOLEINFO *getconsoleinfo(AMX *amx)
+{
+  CONSOLEINFO *info;
+
+  if (amx_GetUserData(amx,AMX_USERTAG('C','o','n','s'),(void**)&info)!=AMX_ERR_NONE)
+    info=NULL;
+  return info;
+}
+
+static void cons_flush(CONSOLEBUFFER *buffer)
+{
+  if (buffer->length>0) {
+    buffer->text[buffer->length]=__T('\0');
+    amx_putstr(buffer->text);
+    buffer->length=0;
+  } /* if */
+}
+
+/* writes the complete lines in the buffer and keeps the trailing partial line */
+static void cons_flushlines(CONSOLEBUFFER *buffer)
+{
+  TCHAR save;
+  int length;
+
+  for (length=buffer->length; length>0 && buffer->text[length-1]!=__T('\n'); length--)
+    /* nothing */;
+  if (length>0) {
+    save=buffer->text[length];
+    buffer->text[length]=__T('\0');
+    amx_putstr(buffer->text);
+    buffer->text[length]=save;
+    buffer->length-=length;
+    memmove(buffer->text,buffer->text+length,buffer->length*sizeof(TCHAR));
+  } /* if */
+}
+
 static int cons_putstr(void *dest,const TCHAR *str)
 {
-  (void)dest;
-  return amx_putstr(str);
+  CONSOLEBUFFER *buffer=(CONSOLEBUFFER*)dest;
+  int length;
+
+  if (buffer==NULL)
+    return amx_putstr(str);
+  length=(int)_tcslen(str);
+  if (buffer->length+length>AMXCONSOLE_BUFSIZE) {
+    cons_flush(buffer);
+    if (length>AMXCONSOLE_BUFSIZE)
+      return amx_putstr(str);
+  } /* if */
+  memcpy(buffer->text+buffer->length,str,length*sizeof(TCHAR));
+  buffer->length+=length;
+  return length;
 }
 
 static int cons_putchar(void *dest,TCHAR ch)
 {
-  (void)dest;
-  return amx_putchar(ch);
+  CONSOLEBUFFER *buffer=(CONSOLEBUFFER*)dest;
+
+  if (buffer!=NULL && ch==__T('\0'))
+    cons_flush(buffer);         /* the buffer is written as a string, so it cannot hold a '\0' */
+  if (buffer==NULL || ch==__T('\0'))
+    return amx_putchar(ch);
+  if (buffer->length>=AMXCONSOLE_BUFSIZE)
+    cons_flush(buffer);
+  buffer->text[buffer->length++]=ch;
+  return 1;
+}
+
+static int cons_interactive(void)
+{
+  #if defined AMX_TERMINAL || defined USE_CURSES
+    return 1;
+  #else
+    static int interactive=-1;
+    if (interactive<0) {
+      #if defined __WIN32__ || defined _WIN32 || defined WIN32 || defined __MSDOS__
+        interactive=_isatty(_fileno(stdout))!=0;
+      #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__ || defined MACOS
+        interactive=isatty(fileno(stdout))!=0;
+      #else
+        interactive=1;
+      #endif
+    } /* if */
+    return interactive;
+  #endif
+}
+
+/* writes any pending output of the abstract machine, before other output or
+ * before reading input
+ */
+static void cons_sync(AMX *amx)
+{
+  CONSOLEINFO *info=getconsoleinfo(amx);
+
+  if (info!=NULL)
+    cons_flush(&info->buffer);
+}
+
+static void cons_endcall(CONSOLEBUFFER *buffer)
+{
+  if (cons_interactive()) {
+    if (buffer!=NULL)
+      cons_flush(buffer);
+    amx_fflush();
+  } else if (buffer!=NULL) {
+    cons_flushlines(buffer);
+  } /* if */
 }
 
 #endif /* AMX_STRING_LIB */
@@ -411,6 +536,7 @@ enum {
   SV_HEX
 };
 
+#if defined FIXEDPOINT
 static TCHAR *reverse(TCHAR *string,int stop)
 {
 	int start=0;
@@ -480,6 +606,56 @@ static TCHAR *amx_strval(TCHAR buffer[], long value, int format, int width)
 	reverse(buffer+start,stop-start);
 	return buffer;
 }
+#endif /* FIXEDPOINT */
+
+/* Formats the value backwards, ending at "end" (where the terminating zero is
+ * stored); returns a pointer to the first digit.
+ */
+static TCHAR *formatdigits(TCHAR *end,ucell value,int format)
+{
+  *end=__T('\0');
+  if (format==SV_DECIMAL) {
+    do {
+      *--end=(TCHAR)(value%10+__T('0'));
+      value/=10;
+    } while (value!=0);
+  } else {
+    do {
+      *--end=(TCHAR)"0123456789ABCDEF"[value & 0x0f];
+      value>>=4;
+    } while (value!=0);
+  } /* if */
+  return end;
+}
+
+/* Writes "count" filler characters, in as few calls as possible */
+static void putpadding(int count,TCHAR filler,int (*f_putstr)(void*,const TCHAR *),void *user)
+{
+  TCHAR padding[33];
+  int i,n;
+
+  while (count>0) {
+    n=(count<(int)(sizeof padding/sizeof padding[0])-1) ? count : (int)(sizeof padding/sizeof padding[0])-1;
+    for (i=0; i<n; i++)
+      padding[i]=filler;
+    padding[n]=__T('\0');
+    f_putstr(user,padding);
+    count-=n;
+  } /* while */
+}
+
+/* Writes a field that is padded to the given width; the padding goes after
+ * the text if "align" is '-', and in front of it otherwise.
+ */
+static void putfield(const TCHAR *text,int length,TCHAR align,int width,TCHAR filler,
+                     int (*f_putstr)(void*,const TCHAR *),void *user)
+{
+  if (align!=__T('-'))
+    putpadding(width-length,filler,f_putstr,user);
+  f_putstr(user,text);
+  if (align==__T('-'))
+    putpadding(width-length,filler,f_putstr,user);
+}
 
 #if defined FIXEDPOINT
   #define FIXEDMULT     1000
@@ -558,10 +734,8 @@ static int dochar(AMX *amx,TCHAR ch,cell param,TCHAR sign,TCHAR decpoint,int wid
                   int (*f_putstr)(void*,const TCHAR *),int (*f_putchar)(void*,TCHAR),void *user)
 {
   cell *cptr;
-  TCHAR buffer[40];
-  #if defined FLOATPOINT
-    TCHAR formatstring[40];
-  #endif
+  TCHAR buffer[128];
+  TCHAR *str;
 
   #if !defined FIXEDPOINT && !defined FLOATPOINT
     (void)decpoint;
@@ -576,58 +750,45 @@ static int dochar(AMX *amx,TCHAR ch,cell param,TCHAR sign,TCHAR decpoint,int wid
 
   case __T('c'):
     amx_GetAddr(amx,param,&cptr);
-    width--;            /* single character itself has a with of 1 */
+    /* the character goes through f_putchar(), so that a '\0' is written too */
     if (sign!=__T('-'))
-      while (width-->0)
-        f_putchar(user,filler);
+      putpadding(width-1,filler,f_putstr,user);
     f_putchar(user,(TCHAR)*cptr);
-    while (width-->0)
-      f_putchar(user,filler);
+    if (sign==__T('-'))
+      putpadding(width-1,filler,f_putstr,user);
     return 1;
 
   case __T('d'): {
     cell value;
-    int length=1;
     amx_GetAddr(amx,param,&cptr);
     value=*cptr;
-    if (value<0 || sign==__T('+'))
-      length++;
+    str=formatdigits(buffer+sizeof buffer/sizeof buffer[0]-1,
+                     (value<0) ? (ucell)0-(ucell)value : (ucell)value,SV_DECIMAL);
     if (value<0)
-      value=-value;
-    while (value>=10) {
-      length++;
-      value/=10;
-    } /* while */
-    width-=length;
-    if (sign!=__T('-'))
-      while (width-->0)
-        f_putchar(user,filler);
-    amx_strval(buffer,*cptr,SV_DECIMAL,0);
-    if (sign==__T('+') && *cptr>=0)
-      f_putchar(user,sign);
-    f_putstr(user,buffer);
-    while (width-->0)
-      f_putchar(user,filler);
+      *--str=__T('-');
+    else if (sign==__T('+'))
+      *--str=__T('+');
+    putfield(str,(int)(buffer+sizeof buffer/sizeof buffer[0]-1-str),sign,width,filler,f_putstr,user);
     return 1;
   } /* case */
 
 #if defined FLOATPOINT
   case __T('f'): /* 32-bit floating point number */
   case __T('r'): /* if floating point is enabled, %r == %f */
-    /* build a format string */
     if (digits==INT_MAX)
       digits=5;
     else if (digits>25)
       digits=25;
-    _tcscpy(formatstring,__T("%"));
-    if (sign!=__T('\0'))
-      _stprintf(formatstring+_tcslen(formatstring),__T("%c"),sign);
-    if (width>0)
-      _stprintf(formatstring+_tcslen(formatstring),__T("%d"),width);
-    _stprintf(formatstring+_tcslen(formatstring),__T(".%df"),digits);
+    if (width>(int)(sizeof buffer/sizeof buffer[0])-2)
+      width=(int)(sizeof buffer/sizeof buffer[0])-2;
     /* ??? decimal comma? */
     amx_GetAddr(amx,param,&cptr);
-    _stprintf(buffer,formatstring,*(float*)cptr);
+    if (sign==__T('+'))
+      _stprintf(buffer,__T("%+*.*f"),width,digits,*(float*)cptr);
+    else if (sign==__T('-'))
+      _stprintf(buffer,__T("%-*.*f"),width,digits,*(float*)cptr);
+    else
+      _stprintf(buffer,__T("%*.*f"),width,digits,*(float*)cptr);
     f_putstr(user,buffer);
     return 1;
 #endif
@@ -644,6 +805,8 @@ static int dochar(AMX *amx,TCHAR ch,cell param,TCHAR sign,TCHAR decpoint,int wid
       digits=3;
     else if (digits>25)
       digits=25;
+    if (width>(int)(sizeof buffer/sizeof buffer[0])-2)
+      width=(int)(sizeof buffer/sizeof buffer[0])-2;
     formatfixed(buffer,*cptr,sign,width,decpoint,digits,filler);
     assert(_tcslen(buffer)<sizeof buffer);
     f_putstr(user,buffer);
@@ -670,25 +833,11 @@ static int dochar(AMX *amx,TCHAR ch,cell param,TCHAR sign,TCHAR decpoint,int wid
     return 1;
   } /* case */
 
-  case __T('x'): {
-    ucell value;
-    int length=1;
+  case __T('x'):
     amx_GetAddr(amx,param,&cptr);
-    value=*(ucell*)cptr;
-    while (value>=0x10) {
-      length++;
-      value>>=4;
-    } /* while */
-    width-=length;
-    if (sign!=__T('-'))
-      while (width-->0)
-        f_putchar(user,filler);
-    amx_strval(buffer,(long)*cptr,SV_HEX,0);
-    f_putstr(user,buffer);
-    while (width-->0)
-      f_putchar(user,filler);
+    str=formatdigits(buffer+sizeof buffer/sizeof buffer[0]-1,(ucell)*cptr,SV_HEX);
+    putfield(str,(int)(buffer+sizeof buffer/sizeof buffer[0]-1-str),sign,width,filler,f_putstr,user);
     return 1;
-  } /* case */
 
   } /* switch */
   /* error in the string format, try to repair */
@@ -767,6 +916,8 @@ int amx_printstring(AMX *amx,cell *cstr,AMX_FMTINFO *info)
   int (*f_putchar)(void*,TCHAR);
   void *user;
   int skip,length;
+  TCHAR cache[100];
+  int idx=0;
 
   if (info!=NULL) {
     f_putstr=info->f_putstr;
@@ -793,9 +944,6 @@ int amx_printstring(AMX *amx,cell *cstr,AMX_FMTINFO *info)
   /* if no placeholders appear, we can use a quicker routine */
   if (info==NULL || info->params==NULL) {
 
-    TCHAR cache[100];
-    int idx=0;
-
     if ((ucell)*cstr>UNPACKEDMAX) {
       int j=sizeof(cell)-sizeof(char);
       char c;
@@ -810,9 +958,9 @@ int amx_printstring(AMX *amx,cell *cstr,AMX_FMTINFO *info)
         } else {
           if (length--<=0)
             break;              /* print up to a certain length */
-          assert(idx<sizeof cache);
+          assert(idx<sizeof cache/sizeof cache[0]);
           cache[idx++]=c;
-          if (idx==sizeof cache - 1) {
+          if (idx==sizeof cache/sizeof cache[0] - 1) {
             cache[idx]=__T('\0');
             f_putstr(user,cache);
             idx=0;
@@ -827,9 +975,9 @@ int amx_printstring(AMX *amx,cell *cstr,AMX_FMTINFO *info)
       for (i=0; cstr[i]!=0; i++) {
       	if (skip-->0)
       	  continue;
-        assert(idx<sizeof cache);
+        assert(idx<sizeof cache/sizeof cache[0]);
         cache[idx++]=(TCHAR)cstr[i];
-        if (idx==sizeof cache - 1) {
+        if (idx==sizeof cache/sizeof cache[0] - 1) {
           cache[idx]=__T('\0');
           f_putstr(user,cache);
           idx=0;
@@ -855,10 +1003,21 @@ int amx_printstring(AMX *amx,cell *cstr,AMX_FMTINFO *info)
           break;
         switch (formatstate(c,&fmtstate,&sign,&decpoint,&width,&digits,&filler)) {
         case -1:
-          f_putchar(user,c);
+          /* collect plain characters, to write them in one call */
+          cache[idx++]=c;
+          if (idx==sizeof cache/sizeof cache[0] - 1) {
+            cache[idx]=__T('\0');
+            f_putstr(user,cache);
+            idx=0;
+          } /* if */
           break;
         case 1:
           assert(info!=NULL && info->params!=NULL);
+          if (idx>0) {
+            cache[idx]=__T('\0');
+            f_putstr(user,cache);
+            idx=0;
+          } /* if */
           paramidx+=dochar(amx,c,info->params[paramidx],sign,decpoint,width,digits,filler,
                            f_putstr,f_putchar,user);
           fmtstate=FMT_NONE;
@@ -878,10 +1037,21 @@ int amx_printstring(AMX *amx,cell *cstr,AMX_FMTINFO *info)
       for (i=0; cstr[i]!=0; i++) {
         switch (formatstate((TCHAR)cstr[i],&fmtstate,&sign,&decpoint,&width,&digits,&filler)) {
         case -1:
-          f_putchar(user,(TCHAR)cstr[i]);
+          /* collect plain characters, to write them in one call */
+          cache[idx++]=(TCHAR)cstr[i];
+          if (idx==sizeof cache/sizeof cache[0] - 1) {
+            cache[idx]=__T('\0');
+            f_putstr(user,cache);
+            idx=0;
+          } /* if */
           break;
         case 1:
           assert(info!=NULL && info->params!=NULL);
+          if (idx>0) {
+            cache[idx]=__T('\0');
+            f_putstr(user,cache);
+            idx=0;
+          } /* if */
           paramidx+=dochar(amx,(TCHAR)cstr[i],info->params[paramidx],sign,decpoint,width,digits,filler,
                            f_putstr,f_putchar,user);
           fmtstate=FMT_NONE;
@@ -894,6 +1064,10 @@ int amx_printstring(AMX *amx,cell *cstr,AMX_FMTINFO *info)
         } /* switch */
       } /* for */
     } /* if */
+    if (idx>0) {
+      cache[idx]=__T('\0');
+      f_putstr(user,cache);
+    } /* if */
 
   } /* if (info==NULL || info->params==NULL) */
 
@@ -908,15 +1082,18 @@ static cell AMX_NATIVE_CALL n_print(AMX *amx,const cell *params)
 {
   cell *cstr;
   AMX_FMTINFO info;
+  CONSOLEINFO *coninfo;
 
   memset(&info,0,sizeof info);
   info.skip= ((size_t)params[0]>=2*sizeof(cell)) ? (int)params[2] : 0;
   info.length= ((size_t)params[0]>=3*sizeof(cell)) ? (int)(params[3]-info.skip) : INT_MAX;
 
   CreateConsole();
+  coninfo=getconsoleinfo(amx);
+  info.user=(coninfo!=NULL) ? &coninfo->buffer : NULL;
   amx_GetAddr(amx,params[1],&cstr);
   amx_printstring(amx,cstr,&info);
-  amx_fflush();
+  cons_endcall((CONSOLEBUFFER*)info.user);
   return 0;
 }
 #else
@@ -925,18 +1102,26 @@ static cell AMX_NATIVE_CALL n_print(AMX *amx,const cell *params)
 {
   cell *cstr;
   int oldcolours;
+  AMX_FMTINFO info;
+  CONSOLEINFO *coninfo;
 
   CreateConsole();
+  coninfo=getconsoleinfo(amx);
 
-  /* set the new colours */
+  /* set the new colours (pending text keeps the old colours) */
+  cons_sync(amx);
   oldcolours=amx_setattr((int)params[2],(int)params[3],(int)params[4]);
 
+  memset(&info,0,sizeof info);
+  info.length=INT_MAX;
+  info.user=(coninfo!=NULL) ? &coninfo->buffer : NULL;
   amx_GetAddr(amx,params[1],&cstr);
-  amx_printstring(amx,cstr,NULL);
+  amx_printstring(amx,cstr,&info);
+  cons_sync(amx);
 
   /* reset the colours */
   (void)amx_setattr(oldcolours & 0xff,(oldcolours >> 8) & 0x7f,(oldcolours >> 15) & 0x01);
-  amx_fflush();
+  cons_endcall((CONSOLEBUFFER*)info.user);
   return 0;
 }
 #endif
@@ -945,17 +1130,20 @@ static cell AMX_NATIVE_CALL n_printf(AMX *amx,const cell *params)
 {
   cell *cstr;
   AMX_FMTINFO info;
+  CONSOLEINFO *coninfo;
 
   memset(&info,0,sizeof info);
   info.params=params+2;
   info.numparams=(int)(params[0]/sizeof(cell))-1;
   info.skip=0;
   info.length=INT_MAX;
+  coninfo=getconsoleinfo(amx);
+  info.user=(coninfo!=NULL) ? &coninfo->buffer : NULL;
 
   CreateConsole();
   amx_GetAddr(amx,params[1],&cstr);
   amx_printstring(amx,cstr,&info);
-  amx_fflush();
+  cons_endcall((CONSOLEBUFFER*)info.user);
   return 0;
 }
 
@@ -964,8 +1152,9 @@ static cell AMX_NATIVE_CALL n_getchar(AMX *amx,const cell *params)
 {
   int c;
 
-  (void)amx;
   CreateConsole();
+  cons_sync(amx);
+  amx_fflush();          /* make any pending output visible before reading */
   c=amx_getch();
   if (params[1]) {
     #if defined(SUPPRESS_ECHO)
@@ -986,6 +1175,8 @@ static cell AMX_NATIVE_CALL n_getstring(AMX *amx,const cell *params)
   cell *cptr;
 
   CreateConsole();
+  cons_sync(amx);
+  amx_fflush();          /* make any pending output visible before reading */
   max=(int)params[2];
   if (max<=0)
     return 0;
@@ -1074,6 +1265,8 @@ static cell AMX_NATIVE_CALL n_getvalue(AMX *amx,const cell *params)
   int chars,n;
 
   CreateConsole();
+  cons_sync(amx);
+  amx_fflush();          /* make any pending output visible before reading */
   base=(int)params[1];
   if (base<2 || base>36)
     return 0;
@@ -1133,26 +1326,26 @@ static cell AMX_NATIVE_CALL n_getvalue(AMX *amx,const cell *params)
 
 static cell AMX_NATIVE_CALL n_clrscr(AMX *amx,const cell *params)
 {
-  (void)amx;
   (void)params;
   CreateConsole();
+  cons_sync(amx);
   amx_clrscr();
   return 0;
 }
 
 static cell AMX_NATIVE_CALL n_clreol(AMX *amx,const cell *params)
 {
-  (void)amx;
   (void)params;
   CreateConsole();
+  cons_sync(amx);
   amx_clreol();
   return 0;
 }
 
 static cell AMX_NATIVE_CALL n_gotoxy(AMX *amx,const cell *params)
 {
-  (void)amx;
   CreateConsole();
+  cons_sync(amx);
   amx_gotoxy((int)params[1],(int)params[2]);
   return 0;
 }
@@ -1173,47 +1366,53 @@ static cell AMX_NATIVE_CALL n_wherexy(AMX *amx,const cell *params)
 
 static cell AMX_NATIVE_CALL n_setattr(AMX *amx,const cell *params)
 {
-  (void)amx;
   CreateConsole();
+  cons_sync(amx);
   (void)amx_setattr((int)params[1],(int)params[2],(int)params[3]);
   return 0;
 }
 
 static cell AMX_NATIVE_CALL n_consctrl(AMX *amx,const cell *params)
 {
-  (void)amx;
   CreateConsole();
+  cons_sync(amx);
   (void)amx_termctl((int)params[1],(int)params[2]);
   return 0;
 }
 
 static cell AMX_NATIVE_CALL n_console(AMX *amx,const cell *params)
 {
-  (void)amx;
   CreateConsole();
+  cons_sync(amx);
   amx_console((int)params[1],(int)params[2],(int)params[3]);
   return 0;
 }
 
 
 #if !defined AMXCONSOLE_NOIDLE
-static AMX_IDLE PrevIdle = NULL;
-static int idxKeyPressed = -1;
-
+/* the idle function passes the pending output on and flushes the stream;
+ * it also calls @keypressed() if the script has such a function
+ */
 static int AMXAPI amx_ConsoleIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
 {
+  CONSOLEINFO *info;
   int err=0, key;
 
-  assert(idxKeyPressed >= 0);
+  info = getconsoleinfo(amx);
+  assert(info != NULL);
 
-  if (PrevIdle != NULL)
-    PrevIdle(amx, Exec);
+  if (info->PrevIdle != NULL)
+    err = info->PrevIdle(amx, Exec);
+
+  /* redirected output is not flushed after every print(), so do it here */
+  cons_flush(&info->buffer);
+  amx_fflush();
 
-  if (kbhit()) {
+  if (err == AMX_ERR_NONE && info->idxKeyPressed >= 0 && kbhit()) {
     key = getch();
     amx_Push(amx, key);
-    err = Exec(amx, NULL, idxKeyPressed);
-    while (err == AMX_ERR_SLEEP)
+    err = Exec(amx, NULL, info->idxKeyPressed);
+    while (err == AMX_ERR_SLEEP || err == AMX_ERR_BUDGET)
       err = Exec(amx, NULL, AMX_EXEC_CONT);
   } /* if */
 
@@ -1242,13 +1441,28 @@ const AMX_NATIVE_INFO console_Natives[] = {
 
 int AMXEXPORT amx_ConsoleInit(AMX *amx)
 {
+  CONSOLEINFO *info;
+  int err;
+
+  if ((info = (CONSOLEINFO*)malloc(sizeof(CONSOLEINFO))) == NULL)
+    return AMX_ERR_MEMORY;
+  info->buffer.length = 0;
+  if ((err = amx_SetUserData(amx, AMX_USERTAG('C','o','n','s'), info)) != AMX_ERR_NONE) {
+    free(info);
+    return err;
+  } /* if */
+
   #if !defined AMXCONSOLE_NOIDLE
-    /* see whether there is an @keypressed() function */
-    if (amx_FindPublic(amx, "@keypressed", &idxKeyPressed) == AMX_ERR_NONE) {
-      if (amx_GetUserData(amx, AMX_USERTAG('I','d','l','e'), (void**)&PrevIdle) != AMX_ERR_NONE)
-        PrevIdle = NULL;
+    /* chain the idle function to the one of any module that was initialized
+     * earlier (the script is then event-driven), and install it when there is
+     * an @keypressed() function
+     */
+    if (amx_FindPublic(amx, "@keypressed", &info->idxKeyPressed) != AMX_ERR_NONE)
+      info->idxKeyPressed = -1;
+    if (amx_GetUserData(amx, AMX_USERTAG('I','d','l','e'), (void**)&info->PrevIdle) != AMX_ERR_NONE)
+      info->PrevIdle = NULL;
+    if (info->PrevIdle != NULL || info->idxKeyPressed >= 0)
       amx_SetUserData(amx, AMX_USERTAG('I','d','l','e'), (void*)amx_ConsoleIdle);
-    } /* if */
   #endif
 
   return amx_Register(amx, console_Natives, -1);
@@ -1256,10 +1470,14 @@ int AMXEXPORT amx_ConsoleInit(AMX *amx)
 
 int AMXEXPORT amx_ConsoleCleanup(AMX *amx)
 {
-  (void)amx;
-  #if !defined AMXCONSOLE_NOIDLE
-    PrevIdle = NULL;
-  #endif
+  CONSOLEINFO *info=getconsoleinfo(amx);
+
+  if (info != NULL) {
+    cons_flush(&info->buffer);
+    free(info);
+    amx_SetUserData(amx, AMX_USERTAG('C','o','n','s'), NULL);
+  } /* if */
+  amx_fflush();
   return AMX_ERR_NONE;
 }
 
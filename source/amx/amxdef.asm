@@ -12,8 +12,8 @@ amx_s   STRUC
     _stk        DD ?
     _stp        DD ?
     _flags      DD ?
-    _usertags   DD 4 DUP (?)    ; 4 = AMX_USERNUM (#define'd in amx.h)
-    _userdata   DD 4 DUP (?)    ; 4 = AMX_USERNUM (#define'd in amx.h)
+    _usertags   DD 8 DUP (?)    ; 8 = AMX_USERNUM (#define'd in amx.h)
+    _userdata   DD 8 DUP (?)    ; 8 = AMX_USERNUM (#define'd in amx.h)
     _error      DD ?
     _paramcount DD ?
     _pri        DD ?
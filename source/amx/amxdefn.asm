@@ -12,8 +12,8 @@ _hlw:        resd 1
 _stk:        resd 1
 _stp:        resd 1
 _flags:      resd 1
-_usertags:   resd 4	; 4 = AMX_USERNUM (#define'd in amx.h)
-_userdata:   resd 4	; 4 = AMX_USERNUM (#define'd in amx.h)
+_usertags:   resd 8	; 8 = AMX_USERNUM (#define'd in amx.h)
+_userdata:   resd 8	; 8 = AMX_USERNUM (#define'd in amx.h)
 _error:      resd 1
 _paramcount: resd 1
 _pri:        resd 1
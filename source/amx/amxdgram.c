@@ -23,16 +23,32 @@
  *  Version: $Id: amxdgram.c 3664 2006-11-08 12:09:25Z thiadmer $
  */
 
+#if defined __linux__ && !defined AMXDGRAM_NOMMSG
+  /* on Linux, the sockets are watched with epoll and packets are received
+   * and sent in batches, with recvmmsg() and sendmmsg()
+   */
+  #if !defined _GNU_SOURCE
+    #define _GNU_SOURCE
+  #endif
+  #define DGRAM_MMSG
+#endif
 #include <assert.h>
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>     /* for malloc()/free() */
+#include <string.h>
 #if defined LINUX
   #include <arpa/inet.h>
+  #include <errno.h>
   #include <netinet/in.h>
   #include <sys/ioctl.h>
   #include <sys/types.h>
   #include <sys/socket.h>
   #include <netdb.h>
   #include <unistd.h>
+  #if defined DGRAM_MMSG
+    #include <sys/epoll.h>
+  #endif
 #else
   #include <malloc.h>
   #include <winsock.h>
@@ -44,12 +60,59 @@
 #define SRC_BUFSIZE     22
 #define BUFLEN          512
 #define AMX_DGRAMPORT   9930  /* default port */
+#define DGRAM_SOCKETS   16    /* maximum number of sockets per abstract machine */
+#define DGRAM_BATCH     32    /* maximum number of packets per receive or send */
+#define DGRAM_ROUNDS    8     /* maximum number of receives per socket per idle call */
+#define DGRAM_FIELDS    4     /* fields per packet for @receivebatch(), see DGramInfo */
+
+#define PACKET_CELLS(size)  (((size)+sizeof(cell)-1)/sizeof(cell))
 
 #if !defined SOCKET_ERROR
   #define SOCKET_ERROR -1
 #endif
+#if defined LINUX
+  typedef socklen_t addrlen_t;
+#else
+  typedef int addrlen_t;
+#endif
+
+typedef struct tagPACKET {
+  cell data[PACKET_CELLS(BUFLEN)+1];  /* room for a zero terminator */
+  int size;                     /* in bytes */
+  struct sockaddr_in addr;      /* source or destination */
+} PACKET;
 
-static int sLocal;
+/* the sockets and the received and outgoing packets are kept per abstract
+ * machine (in its user data); socket 0 is the default socket, which is
+ * bound to the port set with listenport()
+ */
+typedef struct tagDGRAMINFO {
+  int sockets[DGRAM_SOCKETS];   /* -1 for unused entries */
+  short port;                   /* port for the default socket */
+  int bound;                    /* whether the default socket is bound */
+  int dispatching;              /* set while the received packets are handled */
+  AMX_IDLE PrevIdle;
+  int idxReceiveString;
+  int idxReceivePacket;
+  int idxReceiveBatch;
+  #if defined DGRAM_MMSG
+    int epoll;
+    struct mmsghdr msgs[DGRAM_BATCH];
+    struct iovec iov[DGRAM_BATCH];
+  #endif
+  PACKET received[DGRAM_BATCH];
+  int qsocket;                  /* socket of the queued packets */
+  int qcount;                   /* number of queued packets */
+  PACKET queued[DGRAM_BATCH];
+} DGRAMINFO;
+
+static DGRAMINFO *getdgraminfo(AMX *amx)
+{
+  void *ptr;
+  if (amx_GetUserData(amx, AMX_USERTAG('D','G','r','m'), &ptr) != AMX_ERR_NONE)
+    return NULL;
+  return (DGRAMINFO*)ptr;
+}
 
 static unsigned long udp_GetHostAddr(const char *host,int index)
 {
@@ -68,82 +131,81 @@ static unsigned long udp_GetHostAddr(const char *host,int index)
   return addr;
 }
 
-static int udp_Open(void)
+static void udp_Startup(void)
 {
-#if defined __WIN32 || defined _WIN32 || defined WIN32
-  WORD wVersionRequested = MAKEWORD(1,1);
-  WSADATA wsaData;
-#endif
-  int optval = 1;
-
   #if defined __WIN32 || defined _WIN32 || defined WIN32
+    WORD wVersionRequested = MAKEWORD(1,1);
+    WSADATA wsaData;
     WSAStartup(wVersionRequested, &wsaData);
   #endif
+}
 
-  if ((sLocal=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+static void udp_Shutdown(void)
+{
+  #if defined __WIN32 || defined _WIN32 || defined WIN32
+    WSACleanup();
+  #endif
+}
+
+static int udp_Open(void)
+{
+  int sock;
+  int optval = 1;
+
+  if ((sock=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
     return -1;
 
-  if (setsockopt(sLocal, SOL_SOCKET, SO_BROADCAST, (void*)&optval, sizeof optval) == -1)
+  if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, (void*)&optval, sizeof optval) == -1)
     return -1;
 
-  return sLocal;
+  return sock;
 }
 
-static int udp_Close(void)
+static void udp_Close(int sock)
 {
-  if (sLocal>=0) {
+  if (sock>=0) {
     #if defined __WIN32 || defined _WIN32 || defined WIN32
-      closesocket(sLocal);
+      closesocket(sock);
     #else
-      close(sLocal);
+      close(sock);
     #endif
   } /* if */
-
-  #if defined __WIN32 || defined _WIN32 || defined WIN32
-    WSACleanup();
-  #endif
-
-  return 0;
 }
 
-static int udp_Send(const char *host,short port,const char *message,int size)
+static int udp_Bind(int sock,short port)
 {
-  struct sockaddr_in sRemote;
-
-  if (sLocal<0)
-    return -1;
-
-  memset((void *)&sRemote,sizeof sRemote,0);
-  sRemote.sin_family=AF_INET;
-  sRemote.sin_port=htons(port);
-  sRemote.sin_addr.s_addr= (host==NULL) ? htonl(INADDR_BROADCAST) : udp_GetHostAddr(host,0);
+  struct sockaddr_in sFrom;
 
-  if (sendto(sLocal,message,size,0,(struct sockaddr *)&sRemote,sizeof sRemote)==-1)
+  memset((void *)&sFrom,0,sizeof sFrom);
+  sFrom.sin_family=AF_INET;
+  sFrom.sin_port=htons(port);
+  sFrom.sin_addr.s_addr=htonl(INADDR_ANY);
+  if (bind(sock,(struct sockaddr *)&sFrom,sizeof sFrom)==-1)
     return -1;
 
-  return size;
+  return 0;
 }
 
-/* This call is blocking
- * if source is not NULL, it must point to a buffer that can contain at least
- * 22 characters.
- */
-static int udp_Receive(char *message,size_t maxmsg,char *source)
+/* a NULL host sends a broadcast */
+static void udp_SetAddress(struct sockaddr_in *addr,const char *host,short port)
 {
-  struct sockaddr_in sSource;
-  int slen=sizeof(sSource);
-  int size;
+  memset((void *)addr,0,sizeof *addr);
+  addr->sin_family=AF_INET;
+  addr->sin_port=htons(port);
+  addr->sin_addr.s_addr= (host==NULL) ? htonl(INADDR_BROADCAST) : udp_GetHostAddr(host,0);
+}
 
-  size=recvfrom(sLocal, message, maxmsg, 0, (struct sockaddr *)&sSource, &slen);
-  if (size==-1)
+static int udp_Send(int sock,const struct sockaddr_in *addr,const char *message,int size)
+{
+  if (sock<0)
+    return -1;
+  if (sendto(sock,message,size,0,(const struct sockaddr *)addr,sizeof *addr)==-1)
     return -1;
-  if (source!=NULL)
-    sprintf(source, "%s:%d", inet_ntoa(sSource.sin_addr), ntohs(sSource.sin_port));
-
   return size;
 }
 
-static int udp_IsPacket(void)
+#if !defined DGRAM_MMSG
+static int udp_IsPacket(int sock)
 {
   int result;
   fd_set rdset;
@@ -156,33 +218,154 @@ static int udp_IsPacket(void)
   time.tv_sec=0;
   time.tv_usec=1;
   FD_ZERO(&rdset);
-  FD_SET(sLocal,&rdset);
-  result=select(0,&rdset,NULL,NULL,&time);
+  FD_SET(sock,&rdset);
+  result=select(sock+1,&rdset,NULL,NULL,&time);
   if (result==SOCKET_ERROR)
     return -1;
 
   return result != 0;
 }
+#endif
 
-static int udp_Listen(short port)
+/* udp_ReceiveBatch() reads the packets that are waiting on the socket (up to
+ * DGRAM_BATCH) into info->received, without blocking; it returns the number
+ * of packets, or -1 on error.
+ */
+static int udp_ReceiveBatch(DGRAMINFO *info,int sock)
 {
-  struct sockaddr_in sFrom;
+  int count;
+  #if defined DGRAM_MMSG
+    int i;
+    for (i=0; i<DGRAM_BATCH; i++) {
+      info->iov[i].iov_base=info->received[i].data;
+      info->iov[i].iov_len=BUFLEN;
+      memset(&info->msgs[i].msg_hdr,0,sizeof info->msgs[i].msg_hdr);
+      info->msgs[i].msg_hdr.msg_iov=&info->iov[i];
+      info->msgs[i].msg_hdr.msg_iovlen=1;
+      info->msgs[i].msg_hdr.msg_name=&info->received[i].addr;
+      info->msgs[i].msg_hdr.msg_namelen=sizeof info->received[i].addr;
+    } /* for */
+    count=recvmmsg(sock,info->msgs,DGRAM_BATCH,MSG_DONTWAIT,NULL);
+    if (count<0)
+      return (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR) ? 0 : -1;
+    for (i=0; i<count; i++)
+      info->received[i].size=(int)info->msgs[i].msg_len;
+  #else
+    PACKET *packet;
+    addrlen_t slen;
+    for (count=0; count<DGRAM_BATCH && udp_IsPacket(sock)>0; count++) {
+      packet=&info->received[count];
+      slen=sizeof packet->addr;
+      packet->size=recvfrom(sock,(char*)packet->data,BUFLEN,0,(struct sockaddr *)&packet->addr,&slen);
+      if (packet->size==-1)
+        return (count>0) ? count : -1;
+    } /* for */
+  #endif
+  return count;
+}
 
-  memset((void *)&sFrom,sizeof sFrom,0);
-  sFrom.sin_family=AF_INET;
-  sFrom.sin_port=htons(port);
-  sFrom.sin_addr.s_addr=htonl(INADDR_ANY);
-  if (bind(sLocal,(struct sockaddr *)&sFrom,sizeof sFrom)==-1)
-    return -1;
+/* udp_SendBatch() returns the number of packets that were sent */
+static int udp_SendBatch(DGRAMINFO *info,int sock,PACKET *packets,int count)
+{
+  int sent=0;
+  #if defined DGRAM_MMSG
+    int i,n;
+    for (i=0; i<count; i++) {
+      info->iov[i].iov_base=packets[i].data;
+      info->iov[i].iov_len=packets[i].size;
+      memset(&info->msgs[i].msg_hdr,0,sizeof info->msgs[i].msg_hdr);
+      info->msgs[i].msg_hdr.msg_iov=&info->iov[i];
+      info->msgs[i].msg_hdr.msg_iovlen=1;
+      info->msgs[i].msg_hdr.msg_name=&packets[i].addr;
+      info->msgs[i].msg_hdr.msg_namelen=sizeof packets[i].addr;
+    } /* for */
+    while (sent<count) {
+      if ((n=sendmmsg(sock,info->msgs+sent,count-sent,0))<=0) {
+        if (n<0 && errno==EINTR)
+          continue;
+        break;
+      } /* if */
+      sent+=n;
+    } /* while */
+  #else
+    (void)info;
+    for ( ; sent<count; sent++)
+      if (udp_Send(sock,&packets[sent].addr,(const char*)packets[sent].data,packets[sent].size)<0)
+        break;
+  #endif
+  return sent;
+}
 
-  return 0;
+static int dgram_Watch(DGRAMINFO *info,int idx)
+{
+  #if defined DGRAM_MMSG
+    struct epoll_event event;
+    memset(&event,0,sizeof event);
+    event.events=EPOLLIN;
+    event.data.u32=(uint32_t)idx;
+    return epoll_ctl(info->epoll,EPOLL_CTL_ADD,info->sockets[idx],&event);
+  #else
+    (void)info;
+    (void)idx;
+    return 0;
+  #endif
+}
+
+static void dgram_Flush(DGRAMINFO *info)
+{
+  if (info->qcount>0 && info->sockets[info->qsocket]>=0)
+    udp_SendBatch(info,info->sockets[info->qsocket],info->queued,info->qcount);
+  info->qcount=0;
+}
+
+static void dgram_Close(DGRAMINFO *info,int idx)
+{
+  if (info->qsocket==idx)
+    dgram_Flush(info);
+  #if defined DGRAM_MMSG
+    epoll_ctl(info->epoll,EPOLL_CTL_DEL,info->sockets[idx],NULL);
+  #endif
+  udp_Close(info->sockets[idx]);
+  info->sockets[idx]=-1;
 }
 
-static AMX_IDLE PrevIdle = NULL;
-static int idxReceiveString = -1;
-static int idxReceivePacket = -1;
-static short dgramPort = 0;
-static int dgramBound = 0;
+/* While the idle function runs the callbacks for received packets, the
+ * packets that the script sends are queued and sent in a batch when the
+ * callbacks return (or when the queue is full); packets that are too big for
+ * the queue are sent immediately, after the queue is flushed.
+ */
+static int dgram_Send(DGRAMINFO *info,int idx,char *host,const void *data,int size)
+{
+  struct sockaddr_in addr;
+  short port=AMX_DGRAMPORT;
+  char *ptr;
+  PACKET *packet;
+
+  if (idx<0 || idx>=DGRAM_SOCKETS || info->sockets[idx]<0)
+    return 0;
+  /* destination has the format "127.0.0.1:9930" */
+  if (host != NULL && (ptr=strchr(host,':'))!=NULL && isdigit(ptr[1])) {
+    *ptr++='\0';
+    port=(short)atoi(ptr);
+  } /* if */
+  if (host != NULL && *host == '\0')
+    host = NULL;
+
+  if (info->dispatching && size<=BUFLEN) {
+    if (info->qcount==DGRAM_BATCH || (info->qcount>0 && info->qsocket!=idx))
+      dgram_Flush(info);
+    packet=&info->queued[info->qcount++];
+    udp_SetAddress(&packet->addr,host,port);
+    memcpy(packet->data,data,size);
+    packet->size=size;
+    info->qsocket=idx;
+    return 1;
+  } /* if */
+
+  dgram_Flush(info);
+  udp_SetAddress(&addr,host,port);
+  return udp_Send(info->sockets[idx],&addr,(const char*)data,size) >= 0;
+}
 
 /* sendstring(const message[], const destination[]="")
  * destination has the format "127.0.0.1:9930"; when set to an empty string,
@@ -197,8 +380,10 @@ static cell AMX_NATIVE_CALL n_sendstring(AMX *amx, const cell *params)
   int r = 0, length;
   cell *cstr;
   char *host, *message, *ptr;
-  short port=AMX_DGRAMPORT;
+  DGRAMINFO *info;
 
+  if ((info=getdgraminfo(amx))==NULL)
+    return 0;
   amx_GetAddr(amx, params[1], &cstr);
   amx_UTF8Len(cstr, &length);
 
@@ -218,11 +403,7 @@ static cell AMX_NATIVE_CALL n_sendstring(AMX *amx, const cell *params)
     } /* if */
 
     amx_StrParam(amx, params[2], host);
-    if (host != NULL && (ptr=strchr(host,':'))!=NULL && isdigit(ptr[1])) {
-      *ptr++='\0';
-      port=(short)atoi(ptr);
-    } /* if */
-    r= (udp_Send(host,port,message,strlen(message)+1) > 0);
+    r=dgram_Send(info,0,host,message,strlen(message)+1);
   } /* if */
 
   return r;
@@ -236,16 +417,14 @@ static cell AMX_NATIVE_CALL n_sendstring(AMX *amx, const cell *params)
 static cell AMX_NATIVE_CALL n_sendpacket(AMX *amx, const cell *params)
 {
   cell *cstr;
-  char *host, *ptr;
-  short port=AMX_DGRAMPORT;
+  char *host;
+  DGRAMINFO *info;
 
+  if ((info=getdgraminfo(amx))==NULL)
+    return 0;
   amx_GetAddr(amx, params[1], &cstr);
   amx_StrParam(amx, params[3], host);
-  if (host != NULL && (ptr=strchr(host,':'))!=NULL && isdigit(ptr[1])) {
-    *ptr++='\0';
-    port=(short)atoi(ptr);
-  } /* if */
-  return (udp_Send(host,port,(const char *)cstr,params[2] * sizeof(cell)) > 0);
+  return dgram_Send(info,0,host,cstr,(int)(params[2] * sizeof(cell)));
 }
 
 /* listenport(port)
@@ -254,70 +433,268 @@ static cell AMX_NATIVE_CALL n_sendpacket(AMX *amx, const cell *params)
  */
 static cell AMX_NATIVE_CALL n_listenport(AMX *amx, const cell *params)
 {
-  (void)amx;
-  dgramPort = (short)params[1];
+  DGRAMINFO *info=getdgraminfo(amx);
+  if (info != NULL)
+    info->port = (short)params[1];
   return 0;
 }
 
-static int AMXAPI amx_DGramIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
+/* dgramopen(port=0)
+ * Opens another socket, bound to the given port (or to a free port if the
+ * port is zero). Packets that arrive on the socket go to the same public
+ * functions as those on the default socket.
+ * Returns the socket (a value above zero), or zero on failure.
+ */
+static cell AMX_NATIVE_CALL n_dgramopen(AMX *amx, const cell *params)
+{
+  DGRAMINFO *info;
+  int idx;
+
+  if ((info=getdgraminfo(amx))==NULL)
+    return 0;
+  for (idx=1; idx<DGRAM_SOCKETS && info->sockets[idx]>=0; idx++)
+    /* nothing */;
+  if (idx>=DGRAM_SOCKETS || (info->sockets[idx]=udp_Open())<0)
+    return 0;
+  if (udp_Bind(info->sockets[idx],(short)params[1])<0 || dgram_Watch(info,idx)<0) {
+    udp_Close(info->sockets[idx]);
+    info->sockets[idx]=-1;
+    return 0;
+  } /* if */
+  return idx;
+}
+
+/* dgramclose(socket)
+ * Closes a socket that was opened with dgramopen(); the default socket cannot
+ * be closed.
+ */
+static cell AMX_NATIVE_CALL n_dgramclose(AMX *amx, const cell *params)
+{
+  DGRAMINFO *info;
+  int idx=(int)params[1];
+
+  if ((info=getdgraminfo(amx))==NULL || idx<=0 || idx>=DGRAM_SOCKETS || info->sockets[idx]<0)
+    return 0;
+  dgram_Close(info,idx);
+  return 1;
+}
+
+/* dgramport(socket=0)
+ * Returns the local port of the socket, or zero if the socket is not bound
+ * (yet).
+ */
+static cell AMX_NATIVE_CALL n_dgramport(AMX *amx, const cell *params)
 {
-  char message[BUFLEN], source[SRC_BUFSIZE];
+  DGRAMINFO *info;
+  struct sockaddr_in addr;
+  addrlen_t slen=sizeof addr;
+  int idx=(int)params[1];
+
+  if ((info=getdgraminfo(amx))==NULL || idx<0 || idx>=DGRAM_SOCKETS || info->sockets[idx]<0)
+    return 0;
+  if (getsockname(info->sockets[idx],(struct sockaddr *)&addr,&slen)==-1)
+    return 0;
+  return ntohs(addr.sin_port);
+}
+
+/* dgramsend(socket, const packet[], size, const destination[]="")
+ * Like sendpacket(), but on the given socket.
+ */
+static cell AMX_NATIVE_CALL n_dgramsend(AMX *amx, const cell *params)
+{
+  cell *cstr;
+  char *host;
+  DGRAMINFO *info;
+
+  if ((info=getdgraminfo(amx))==NULL)
+    return 0;
+  amx_GetAddr(amx, params[2], &cstr);
+  amx_StrParam(amx, params[4], host);
+  return dgram_Send(info,(int)params[1],host,cstr,(int)(params[3] * sizeof(cell)));
+}
+
+/* dgramaddress(destination[], address, port, maxlength=sizeof destination)
+ * Formats an address and a port (as passed to @receivebatch) as a string
+ * like "127.0.0.1:9930", which can be passed to the functions that send a
+ * packet.
+ * Returns the length of the string.
+ */
+static cell AMX_NATIVE_CALL n_dgramaddress(AMX *amx, const cell *params)
+{
+  char source[SRC_BUFSIZE];
+  unsigned long addr=(unsigned long)params[2];
+  cell *cstr;
+
+  sprintf(source,"%lu.%lu.%lu.%lu:%d",(addr>>24) & 0xff,(addr>>16) & 0xff,
+          (addr>>8) & 0xff,addr & 0xff,(int)(params[3] & 0xffff));
+  amx_GetAddr(amx, params[1], &cstr);
+  amx_SetString(cstr, source, 0, 0, (size_t)params[4]);
+  return strlen(source);
+}
+
+/* dgram_Deliver() passes a single packet to @receivestring() or to
+ * @receivepacket()
+ */
+static int dgram_Deliver(AMX *amx, int AMXAPI Exec(AMX *, cell *, int), DGRAMINFO *info, PACKET *packet)
+{
+  char source[SRC_BUFSIZE];
+  char *message=(char*)packet->data;
   cell amx_addr_msg, amx_addr_src;
-  int len, chars;
+  int len=packet->size;
+  int chars;
   int err=0;
 
-  assert(idxReceiveString >= 0 || idxReceivePacket >= 0);
-
-  if (PrevIdle != NULL)
-    PrevIdle(amx, Exec);
+  message[len]='\0';
+  sprintf(source, "%s:%d", inet_ntoa(packet->addr.sin_addr), ntohs(packet->addr.sin_port));
+  amx_PushString(amx,&amx_addr_src,NULL,source,1,0);
+  /* check the presence of a byte order mark: if it is absent, the received
+   * packet is no string; also check the packet size against string length
+   */
+  if ((len<3 || message[0]!='\xef' || message[1]!='\xbb' || message[2]!='\xbf'
+      || len!=(int)strlen(message)+1 || info->idxReceiveString<0) && info->idxReceivePacket>=0)
+  {
+    /* receive as "packet" */
+    amx_Push(amx,len);
+    amx_PushArray(amx,&amx_addr_msg,NULL,packet->data,(len>0) ? (int)PACKET_CELLS(len) : 1);
+    err=Exec(amx,NULL,info->idxReceivePacket);
+  } else {
+    const char *msg=message;
+    if (len>=3 && msg[0]=='\xef' && msg[1]=='\xbb' && msg[2]=='\xbf')
+      msg+=3;                   /* skip BOM */
+    /* optionally convert from UTF-8 to a wide string */
+    if (amx_UTF8Check(msg,&chars)==AMX_ERR_NONE) {
+      cell *array=alloca((chars+1)*sizeof(cell));
+      cell *ptr=array;
+      if (array!=NULL) {
+        while (err==AMX_ERR_NONE && *msg!='\0')
+          amx_UTF8Get(msg,&msg,ptr++);
+        *ptr=0;                 /* zero-terminate */
+        amx_PushArray(amx,&amx_addr_msg,NULL,array,chars+1);
+      } /* if */
+    } else {
+      amx_PushString(amx,&amx_addr_msg,NULL,msg,1,0);
+    } /* if */
+    err=Exec(amx,NULL,info->idxReceiveString);
+  } /* if */
+  while (err==AMX_ERR_SLEEP || err==AMX_ERR_BUDGET)
+    err=Exec(amx,NULL,AMX_EXEC_CONT);
+  amx_Release(amx,amx_addr_msg);
+  amx_Release(amx,amx_addr_src);
+  return err;
+}
 
-  /* set up listener (first call only) */
-  if (!dgramBound) {
-    if (dgramPort==0)
-      dgramPort=AMX_DGRAMPORT;  /* use default port if none was set */
-    if (udp_Listen(dgramPort)==-1)
-      return AMX_ERR_GENERAL;
-    dgramBound=1;
+/* dgram_DeliverBatch() passes all received packets to @receivebatch() in a
+ * single call: the packets are stored back to back in one array (each packet
+ * starts at a cell boundary) and a two-dimensional array holds the offset,
+ * the size, the source address and the source port of every packet
+ */
+static int dgram_DeliverBatch(AMX *amx, int AMXAPI Exec(AMX *, cell *, int), DGRAMINFO *info, int idx, int count)
+{
+  cell amx_addr_info, amx_addr_pkt;
+  cell *rows, *cells, *row;
+  int i, total, offset, err;
+
+  for (total=0, i=0; i<count; i++)
+    total+=(int)PACKET_CELLS(info->received[i].size);
+  if ((err=amx_Allot(amx,count*(1+DGRAM_FIELDS),&amx_addr_info,&rows))!=AMX_ERR_NONE)
+    return err;
+  if ((err=amx_Allot(amx,(total>0) ? total : 1,&amx_addr_pkt,&cells))!=AMX_ERR_NONE) {
+    amx_Release(amx,amx_addr_info);
+    return err;
   } /* if */
 
-  if (udp_IsPacket()) {
-    len=udp_Receive(message, sizeof message / sizeof message[0], source);
-    amx_PushString(amx,&amx_addr_src,NULL,source,1,0);
-    /* check the presence of a byte order mark: if it is absent, the received
-     * packet is no string; also check the packet size against string length
+  for (offset=0, i=0; i<count; i++) {
+    PACKET *packet=&info->received[i];
+    /* the indirection vector holds the offset in bytes from each entry to
+     * the start of its row
      */
-    if ((message[0]!='\xef' || message[1]!='\xbb' || message[2]!='\xbf'
-        || len!=(int)strlen(message)+1 || idxReceiveString<0) && idxReceivePacket>=0)
-    {
-      /* receive as "packet" */
-      amx_Push(amx,len);
-      amx_PushArray(amx,&amx_addr_msg,NULL,(cell*)message,len);
-      err=Exec(amx,NULL,idxReceivePacket);
+    rows[i]=(cell)((count-i + i*DGRAM_FIELDS) * sizeof(cell));
+    row=rows + count + i*DGRAM_FIELDS;
+    row[0]=offset;
+    row[1]=packet->size;
+    row[2]=(cell)ntohl(packet->addr.sin_addr.s_addr);
+    row[3]=ntohs(packet->addr.sin_port);
+    memcpy(cells+offset,packet->data,PACKET_CELLS(packet->size)*sizeof(cell));
+    offset+=(int)PACKET_CELLS(packet->size);
+  } /* for */
+
+  amx_Push(amx,count);
+  amx_Push(amx,amx_addr_info);
+  amx_Push(amx,amx_addr_pkt);
+  amx_Push(amx,idx);
+  err=Exec(amx,NULL,info->idxReceiveBatch);
+  while (err==AMX_ERR_SLEEP || err==AMX_ERR_BUDGET)
+    err=Exec(amx,NULL,AMX_EXEC_CONT);
+  amx_Release(amx,amx_addr_info);
+  return err;
+}
+
+/* dgram_Receive() handles the packets that are waiting on one socket; to
+ * leave time for the other idle functions, it stops after DGRAM_ROUNDS
+ * batches (the remaining packets are handled on the next idle call)
+ */
+static int dgram_Receive(AMX *amx, int AMXAPI Exec(AMX *, cell *, int), DGRAMINFO *info, int idx)
+{
+  int round,count,i;
+  int err=AMX_ERR_NONE;
+
+  for (round=0; round<DGRAM_ROUNDS && err==AMX_ERR_NONE; round++) {
+    if (info->sockets[idx]<0)
+      break;                    /* closed by the script */
+    if ((count=udp_ReceiveBatch(info,info->sockets[idx]))<=0)
+      break;
+    if (info->idxReceiveBatch>=0) {
+      err=dgram_DeliverBatch(amx,Exec,info,idx,count);
     } else {
-      const char *msg=message;
-      if (msg[0]=='\xef' && msg[1]=='\xbb' && msg[2]=='\xbf')
-        msg+=3;                 /* skip BOM */
-      /* optionally convert from UTF-8 to a wide string */
-      if (amx_UTF8Check(msg,&chars)==AMX_ERR_NONE) {
-        cell *array=alloca((chars+1)*sizeof(cell));
-        cell *ptr=array;
-        if (array!=NULL) {
-          while (err==AMX_ERR_NONE && *msg!='\0')
-            amx_UTF8Get(msg,&msg,ptr++);
-          *ptr=0;               /* zero-terminate */
-          amx_PushArray(amx,&amx_addr_msg,NULL,array,chars+1);
-        } /* if */
-      } else {
-        amx_PushString(amx,&amx_addr_msg,NULL,msg,1,0);
-      } /* if */
-      err=Exec(amx,NULL,idxReceiveString);
+      for (i=0; i<count && err==AMX_ERR_NONE; i++)
+        err=dgram_Deliver(amx,Exec,info,&info->received[i]);
     } /* if */
-    while (err==AMX_ERR_SLEEP)
-      err=Exec(amx,NULL,AMX_EXEC_CONT);
-    amx_Release(amx,amx_addr_msg);
-    amx_Release(amx,amx_addr_src);
+    if (count<DGRAM_BATCH)
+      break;
+  } /* for */
+  return err;
+}
+
+static int AMXAPI amx_DGramIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
+{
+  DGRAMINFO *info;
+  int err=AMX_ERR_NONE;
+  #if defined DGRAM_MMSG
+    struct epoll_event events[DGRAM_SOCKETS];
+    int i,count;
+  #else
+    int idx;
+  #endif
+
+  info=getdgraminfo(amx);
+  assert(info != NULL);
+  assert(info->idxReceiveString >= 0 || info->idxReceivePacket >= 0 || info->idxReceiveBatch >= 0);
+
+  if (info->PrevIdle != NULL)
+    info->PrevIdle(amx, Exec);
+
+  /* set up listener (first call only) */
+  if (!info->bound) {
+    if (info->port==0)
+      info->port=AMX_DGRAMPORT; /* use default port if none was set */
+    if (udp_Bind(info->sockets[0],info->port)==-1)
+      return AMX_ERR_GENERAL;
+    info->bound=1;
   } /* if */
 
+  info->dispatching=1;
+  #if defined DGRAM_MMSG
+    count=epoll_wait(info->epoll,events,DGRAM_SOCKETS,0);
+    for (i=0; i<count && err==AMX_ERR_NONE; i++)
+      err=dgram_Receive(amx,Exec,info,(int)events[i].data.u32);
+  #else
+    for (idx=0; idx<DGRAM_SOCKETS && err==AMX_ERR_NONE; idx++)
+      if (info->sockets[idx]>=0)
+        err=dgram_Receive(amx,Exec,info,idx);
+  #endif
+  info->dispatching=0;
+  dgram_Flush(info);
+
   return err;
 }
 
@@ -325,24 +702,73 @@ static int AMXAPI amx_DGramIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
   extern "C"
 #endif
 AMX_NATIVE_INFO dgram_Natives[] = {
-  { "sendstring", n_sendstring },
-  { "sendpacket", n_sendpacket },
-  { "listenport", n_listenport },
+  { "sendstring",   n_sendstring },
+  { "sendpacket",   n_sendpacket },
+  { "listenport",   n_listenport },
+  { "dgramopen",    n_dgramopen },
+  { "dgramclose",   n_dgramclose },
+  { "dgramport",    n_dgramport },
+  { "dgramsend",    n_dgramsend },
+  { "dgramaddress", n_dgramaddress },
   { NULL, NULL }        /* terminator */
 };
 
+static void dgram_Free(DGRAMINFO *info)
+{
+  int idx;
+
+  for (idx=0; idx<DGRAM_SOCKETS; idx++)
+    if (info->sockets[idx]>=0)
+      dgram_Close(info,idx);
+  #if defined DGRAM_MMSG
+    if (info->epoll>=0)
+      close(info->epoll);
+  #endif
+  udp_Shutdown();
+  free(info);
+}
+
 int AMXEXPORT amx_DGramInit(AMX *amx)
 {
-  dgramBound = 0;
-  if (udp_Open()==-1)
+  DGRAMINFO *info;
+  int err,idx;
+
+  if ((info=(DGRAMINFO*)malloc(sizeof(DGRAMINFO))) == NULL)
+    return AMX_ERR_MEMORY;
+  for (idx=0; idx<DGRAM_SOCKETS; idx++)
+    info->sockets[idx]=-1;
+  info->port=0;
+  info->bound=0;
+  info->dispatching=0;
+  info->PrevIdle=NULL;
+  info->qsocket=0;
+  info->qcount=0;
+  udp_Startup();
+  #if defined DGRAM_MMSG
+    if ((info->epoll=epoll_create(DGRAM_SOCKETS))<0) {
+      dgram_Free(info);
+      return AMX_ERR_GENERAL;
+    } /* if */
+  #endif
+  if ((info->sockets[0]=udp_Open())<0 || dgram_Watch(info,0)<0) {
+    dgram_Free(info);
     return AMX_ERR_GENERAL;
+  } /* if */
+  if ((err=amx_SetUserData(amx, AMX_USERTAG('D','G','r','m'), info)) != AMX_ERR_NONE) {
+    dgram_Free(info);
+    return err;
+  } /* if */
 
-  /* see whether there is an @receivestring() function */
-  if (amx_FindPublic(amx,"@receivestring",&idxReceiveString)==AMX_ERR_NONE
-      || amx_FindPublic(amx,"@receivepacket",&idxReceivePacket)==AMX_ERR_NONE)
-  {
-    if (amx_GetUserData(amx,AMX_USERTAG('I','d','l','e'),(void**)&PrevIdle)!=AMX_ERR_NONE)
-      PrevIdle=NULL;
+  /* see whether there are functions to receive packets */
+  if (amx_FindPublic(amx,"@receivestring",&info->idxReceiveString)!=AMX_ERR_NONE)
+    info->idxReceiveString=-1;
+  if (amx_FindPublic(amx,"@receivepacket",&info->idxReceivePacket)!=AMX_ERR_NONE)
+    info->idxReceivePacket=-1;
+  if (amx_FindPublic(amx,"@receivebatch",&info->idxReceiveBatch)!=AMX_ERR_NONE)
+    info->idxReceiveBatch=-1;
+  if (info->idxReceiveString>=0 || info->idxReceivePacket>=0 || info->idxReceiveBatch>=0) {
+    if (amx_GetUserData(amx,AMX_USERTAG('I','d','l','e'),(void**)&info->PrevIdle)!=AMX_ERR_NONE)
+      info->PrevIdle=NULL;
     amx_SetUserData(amx,AMX_USERTAG('I','d','l','e'),amx_DGramIdle);
   } /* if */
 
@@ -351,7 +777,12 @@ int AMXEXPORT amx_DGramInit(AMX *amx)
 
 int AMXEXPORT amx_DGramCleanup(AMX *amx)
 {
-  (void)amx;
-  udp_Close();
+  DGRAMINFO *info=getdgraminfo(amx);
+
+  if (info != NULL) {
+    dgram_Flush(info);
+    dgram_Free(info);
+    amx_SetUserData(amx, AMX_USERTAG('D','G','r','m'), NULL);
+  } /* if */
   return AMX_ERR_NONE;
 }
@@ -44,6 +44,40 @@
 #endif
 #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__ || defined MACOS
   #include <dirent.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+#if !defined AMXFILE_NOASYNC
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    typedef CRITICAL_SECTION    MUTEX;
+    typedef CONDITION_VARIABLE  CONDVAR;
+    typedef HANDLE              THREAD;
+    #define mutex_init(m)       InitializeCriticalSection(m)
+    #define mutex_destroy(m)    DeleteCriticalSection(m)
+    #define mutex_lock(m)       EnterCriticalSection(m)
+    #define mutex_unlock(m)     LeaveCriticalSection(m)
+    #define cond_init(c)        InitializeConditionVariable(c)
+    #define cond_destroy(c)     ((void)(c))
+    #define cond_wait(c,m)      SleepConditionVariableCS((c),(m),INFINITE)
+    #define cond_signal(c)      WakeConditionVariable(c)
+    #define cond_broadcast(c)   WakeAllConditionVariable(c)
+  #else
+    #include <pthread.h>
+    typedef pthread_mutex_t     MUTEX;
+    typedef pthread_cond_t      CONDVAR;
+    typedef pthread_t           THREAD;
+    #define mutex_init(m)       pthread_mutex_init((m),NULL)
+    #define mutex_destroy(m)    pthread_mutex_destroy(m)
+    #define mutex_lock(m)       pthread_mutex_lock(m)
+    #define mutex_unlock(m)     pthread_mutex_unlock(m)
+    #define cond_init(c)        pthread_cond_init((c),NULL)
+    #define cond_destroy(c)     pthread_cond_destroy(c)
+    #define cond_wait(c,m)      pthread_cond_wait((c),(m))
+    #define cond_signal(c)      pthread_cond_signal(c)
+    #define cond_broadcast(c)   pthread_cond_broadcast(c)
+  #endif
 #endif
 #include "osdefs.h"
 #include "amx.h"
@@ -92,17 +126,175 @@ enum seek_whence {
 };
 
 
+#define LINE_CHUNK      512     /* initial buffer size for reading a line */
+
+/* a machine word, to scan several bytes at a time */
+typedef unsigned long scanword;
+#define WORD_ONES       (~(scanword)0/255)
+#define WORD_HIGHBITS   (WORD_ONES*0x80)
+#define WORD_HASZERO(w) (((w)-WORD_ONES) & ~(w) & WORD_HIGHBITS)
+
+/* utf8_leader() returns the number of follow-up bytes of a UTF-8 leader code
+ * (or -1 if the byte is not a leader code); it strips the length bits from
+ * the leader code and sets the lowest value that the full code may have
+ */
+static int utf8_leader(cell *c,cell *lowmark)
+{
+  if ((*c & 0xe0)==0xc0) {
+    /* 110xxxxx 10xxxxxx */
+    *c&=0x1f;
+    *lowmark=0x80;
+    return 1;
+  } else if ((*c & 0xf0)==0xe0) {
+    /* 1110xxxx 10xxxxxx 10xxxxxx (16 bits, BMP plane) */
+    *c&=0x0f;
+    *lowmark=0x800;
+    return 2;
+  } else if ((*c & 0xf8)==0xf0) {
+    /* 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */
+    *c&=0x07;
+    *lowmark=0x10000;
+    return 3;
+  } else if ((*c & 0xfc)==0xf8) {
+    /* 111110xx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx */
+    *c&=0x03;
+    *lowmark=0x200000;
+    return 4;
+  } else if ((*c & 0xfe)==0xfc) {
+    /* 1111110x 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx (31 bits) */
+    *c&=0x01;
+    *lowmark=0x4000000;
+    return 5;
+  } /* if */
+  return -1;
+}
+
+/* decode_utf8() decodes a line of UTF-8 text (up to and including the
+ * newline) from a buffer into unpacked cells; it stores at most max-1
+ * characters plus a zero terminator. It returns the number of characters, or
+ * -1 if the text is not valid UTF-8. The number of bytes that were decoded is
+ * stored in "used".
+ */
+static long decode_utf8(const unsigned char *text,size_t length,cell *string,size_t max,size_t *used)
+{
+  size_t index,pos,i;
+  scanword w;
+  cell c,lowmark;
+  int follow;
+
+  assert(max>0);
+  index=0;
+  pos=0;
+  while (index<max-1 && pos<length) {
+    /* copy runs of ASCII characters (without newline) a word at a time */
+    while (index+sizeof w<=max-1 && pos+sizeof w<=length) {
+      memcpy(&w,text+pos,sizeof w);
+      if ((w & WORD_HIGHBITS)!=0 || WORD_HASZERO(w ^ (WORD_ONES*'\n')))
+        break;
+      for (i=0; i<sizeof w; i++)
+        string[index+i]=text[pos+i];
+      index+=sizeof w;
+      pos+=sizeof w;
+    } /* while */
+    if (index>=max-1 || pos>=length)
+      break;
+
+    c=text[pos++];
+    if (c<0x80) {
+      /* 0xxxxxxx (US-ASCII) */
+      string[index++]=c;
+      if (c==__T('\n'))
+        break;                  /* read newline, done */
+      continue;
+    } /* if */
+    if ((follow=utf8_leader(&c,&lowmark))<0 || pos+follow>length)
+      return -1;                /* invalid leader, or incomplete code */
+    while (follow-->0) {
+      if ((text[pos] & 0xc0)!=0x80)
+        return -1;
+      c=(c << 6) | (text[pos++] & 0x3f);
+    } /* while */
+    /* encoding a character in more bytes than is strictly needed, is not
+     * really valid UTF-8; we are strict here to increase the chance of
+     * heuristic dectection of non-UTF-8 text (JAVA writes zero bytes as a
+     * 2-byte code UTF-8, which is invalid); the code positions 0xd800--0xdfff
+     * and 0xfffe & 0xffff do not exist in UCS-4 (and hence, they do not exist
+     * in Unicode)
+     */
+    if (c<lowmark || (c>=0xd800 && c<=0xdfff) || c==0xfffe || c==0xffff)
+      return -1;
+    string[index++]=c;
+  } /* while */
+  assert(index<max);
+  string[index]=0;
+  *used=pos;
+  return (long)index;
+}
+
+/* scan_line() returns the length in bytes of the first line in the buffer
+ * (at most "max" bytes), for 8-bit text: the line ends after a newline, or
+ * after a carriage return that is not followed by a newline
+ */
+static size_t scan_line(const unsigned char *text,size_t length,size_t max)
+{
+  const unsigned char *ptr;
+
+  if (length>max)
+    length=max;
+  if ((ptr=(const unsigned char*)memchr(text,'\n',length))!=NULL)
+    length=(size_t)(ptr-text)+1;
+  if ((ptr=(const unsigned char*)memchr(text,'\r',length))!=NULL && ptr+1<text+length && ptr[1]!='\n')
+    length=(size_t)(ptr-text)+1;
+  return length;
+}
+
+/* readline() reads a line from the file with fgets(), up to and including
+ * the newline, but at most "limit" bytes; the buffer grows (on the heap) if
+ * the line does not fit in it. It returns the buffer that holds the line,
+ * which must be freed if it is not the buffer passed in.
+ */
+static unsigned char *readline(FILE *fp,unsigned char *buffer,size_t size,size_t limit,size_t *length)
+{
+  unsigned char *text,*grown;
+  size_t len,chunk,count;
+
+  text=buffer;
+  len=0;
+  for ( ;; ) {
+    chunk=size-len;             /* room in the buffer, including the terminator */
+    if (chunk>limit-len+1)
+      chunk=limit-len+1;
+    if (chunk<2 || fgets((char*)text+len,(int)chunk,fp)==NULL)
+      break;
+    count=strlen((char*)text+len);
+    len+=count;
+    if (count==0 || len>=limit || text[len-1]=='\n' || len<size-1)
+      break;                    /* complete line, end of file, or zero byte */
+    /* the line does not fit in the buffer, make it bigger */
+    if (text==buffer) {
+      if ((grown=(unsigned char*)malloc(2*size))!=NULL)
+        memcpy(grown,text,len);
+    } else {
+      grown=(unsigned char*)realloc(text,2*size);
+    } /* if */
+    if (grown==NULL)
+      break;
+    text=grown;
+    size*=2;
+  } /* for */
+  *length=len;
+  return text;
+}
+
 /* This function only stores unpacked strings. UTF-8 is used for
  * Unicode, and packed strings can only store 7-bit and 8-bit
  * character sets (ASCII, Latin-1).
  */
 static size_t fgets_cell(FILE *fp,cell *string,size_t max,int utf8mode)
 {
-  size_t index;
-  fpos_t pos;
-  cell c;
-  int follow,lastcr;
-  cell lowmark;
+  unsigned char local[LINE_CHUNK],*text;
+  size_t length,used;
+  long count;
 
   assert(sizeof(cell)>=4);
   assert(fp!=NULL);
@@ -110,198 +302,142 @@ static size_t fgets_cell(FILE *fp,cell *string,size_t max,int utf8mode)
   if (max==0)
     return 0;
 
-  /* get the position, in case we have to back up */
-  fgetpos(fp, &pos);
+  /* read the complete line, so that it can be decoded in memory; in UTF-8
+   * mode, a character takes at most 6 bytes
+   */
+  text=readline(fp,local,sizeof local,utf8mode ? (max-1)*6 : max-1,&length);
+  count= utf8mode ? decode_utf8(text,length,string,max,&used) : -1;
+  if (count<0) {
+    /* non-conforming UTF-8 codes were found, which means that the string is
+     * probably not intended as UTF-8; store it as 8-bit text
+     */
+    used=scan_line(text,length,max-1);
+    for (count=0; count<(long)used; count++)
+      string[count]=text[count];
+    string[count]=__T('\0');
+  } /* if */
+  /* give back the bytes that were read beyond the end of the line */
+  if (used<length)
+    fseek(fp,-(long)(length-used),SEEK_CUR);
+  if (text!=local)
+    free(text);
+
+  assert((size_t)count<max);
+  return (size_t)count;
+}
 
-  index=0;
-  follow=0;
-  lowmark=0;
-  lastcr=0;
-  for ( ;; ) {
-    assert(index<max);
-    if (index==max-1)
-      break;                    /* string fully filled */
-    if ((c=fgetc(fp))==EOF) {
-      if (!utf8mode || follow==0)
-        break;                  /* no more characters */
-      /* If an EOF happened halfway an UTF-8 code, the string cannot be
-       * UTF-8 mode, and we must restart.
-       */
-      index=0;
-      fsetpos(fp, &pos);
-      continue;
-    } /* if */
+/* fgetc_cell() reads a single character, which may be UTF-8 encoded */
+static cell fgetc_cell(FILE *fp)
+{
+  unsigned char text[6];
+  cell string[2],c,lowmark;
+  size_t length,used;
+  int follow;
 
-    /* 8-bit characters are unsigned */
-    if (c<0)
-      c=-c;
-
-    if (utf8mode) {
-      if (follow>0 && (c & 0xc0)==0x80) {
-        /* leader code is active, combine with earlier code */
-        string[index]=(string[index] << 6) | ((unsigned char)c & 0x3f);
-        if (--follow==0) {
-          /* encoding a character in more bytes than is strictly needed,
-           * is not really valid UTF-8; we are strict here to increase
-           * the chance of heuristic dectection of non-UTF-8 text
-           * (JAVA writes zero bytes as a 2-byte code UTF-8, which is invalid)
-           */
-          if (string[index]<lowmark)
-            utf8mode=0;
-          /* the code positions 0xd800--0xdfff and 0xfffe & 0xffff do not
-           * exist in UCS-4 (and hence, they do not exist in Unicode)
-           */
-          if (string[index]>=0xd800 && string[index]<=0xdfff
-              || string[index]==0xfffe || string[index]==0xffff)
-            utf8mode=0;
-          index++;
-        } /* if */
-      } else if (follow==0 && (c & 0x80)==0x80) {
-        /* UTF-8 leader code */
-        if ((c & 0xe0)==0xc0) {
-          /* 110xxxxx 10xxxxxx */
-          follow=1;
-          lowmark=0x80;
-          string[index]=c & 0x1f;
-        } else if ((c & 0xf0)==0xe0) {
-          /* 1110xxxx 10xxxxxx 10xxxxxx (16 bits, BMP plane) */
-          follow=2;
-          lowmark=0x800;
-          string[index]=c & 0x0f;
-        } else if ((c & 0xf8)==0xf0) {
-          /* 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */
-          follow=3;
-          lowmark=0x10000;
-          string[index]=c & 0x07;
-        } else if ((c & 0xfc)==0xf8) {
-          /* 111110xx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx */
-          follow=4;
-          lowmark=0x200000;
-          string[index]=c & 0x03;
-        } else if ((c & 0xfe)==0xfc) {
-          /* 1111110x 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx (31 bits) */
-          follow=5;
-          lowmark=0x4000000;
-          string[index]=c & 0x01;
-        } else {
-          /* this is invalid UTF-8 */
-          utf8mode=0;
-        } /* if */
-      } else if (follow==0 && (c & 0x80)==0x00) {
-        /* 0xxxxxxx (US-ASCII) */
-        string[index++]=c;
-        if (c==__T('\n'))
-          break;        /* read newline, done */
-      } else {
-        /* this is invalid UTF-8 */
-        utf8mode=0;
-      } /* if */
-      if (!utf8mode) {
-        /* UTF-8 mode was switched just off, which means that non-conforming
-         * UTF-8 codes were found, which means in turn that the string is
-         * probably not intended as UTF-8; start over again
-         */
-        index=0;
-        fsetpos(fp, &pos);
-      } /* if */
-    } else {
-      string[index++]=c;
-      if (c==__T('\n')) {
-        break;                  /* read newline, done */
-      } else if (lastcr) {
-        ungetc(c,fp);           /* carriage return was read, no newline follows */
-        break;
-      } /* if */
-      lastcr=(c==__T('\r'));
-    } /* if */
-  } /* for */
-  assert(index<max);
-  string[index]=__T('\0');
+  if ((follow=fgetc(fp))==EOF)
+    return EOF;
+  c=text[0]=(unsigned char)follow;
+  length=1;
+  if ((follow=utf8_leader(&c,&lowmark))>0)
+    while (follow-->0 && (c=fgetc(fp))!=EOF)
+      text[length++]=(unsigned char)c;
+  if (decode_utf8(text,length,string,2,&used)<=0) {
+    string[0]=text[0];          /* not UTF-8, return the byte */
+    used=1;
+  } /* if */
+  if (used<length)
+    fseek(fp,-(long)(length-used),SEEK_CUR);
+  return string[0];
+}
 
-  return index;
+/* utf8_put() stores a character as UTF-8 in the buffer (which must have room
+ * for 6 bytes) and returns the number of bytes
+ */
+static size_t utf8_put(unsigned char *buffer,cell c)
+{
+  if (c<0x80) {
+    /* 0xxxxxxx */
+    buffer[0]=(unsigned char)c;
+    return 1;
+  } else if (c<0x800) {
+    /* 110xxxxx 10xxxxxx */
+    buffer[0]=(unsigned char)((c>>6) & 0x1f | 0xc0);
+    buffer[1]=(unsigned char)(c & 0x3f | 0x80);
+    return 2;
+  } else if (c<0x10000) {
+    /* 1110xxxx 10xxxxxx 10xxxxxx (16 bits, BMP plane) */
+    buffer[0]=(unsigned char)((c>>12) & 0x0f | 0xe0);
+    buffer[1]=(unsigned char)((c>>6) & 0x3f | 0x80);
+    buffer[2]=(unsigned char)(c & 0x3f | 0x80);
+    return 3;
+  } else if (c<0x200000) {
+    /* 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */
+    buffer[0]=(unsigned char)((c>>18) & 0x07 | 0xf0);
+    buffer[1]=(unsigned char)((c>>12) & 0x3f | 0x80);
+    buffer[2]=(unsigned char)((c>>6) & 0x3f | 0x80);
+    buffer[3]=(unsigned char)(c & 0x3f | 0x80);
+    return 4;
+  } else if (c<0x4000000) {
+    /* 111110xx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx */
+    buffer[0]=(unsigned char)((c>>24) & 0x03 | 0xf8);
+    buffer[1]=(unsigned char)((c>>18) & 0x3f | 0x80);
+    buffer[2]=(unsigned char)((c>>12) & 0x3f | 0x80);
+    buffer[3]=(unsigned char)((c>>6) & 0x3f | 0x80);
+    buffer[4]=(unsigned char)(c & 0x3f | 0x80);
+    return 5;
+  } /* if */
+  /* 1111110x 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx (31 bits) */
+  buffer[0]=(unsigned char)((c>>30) & 0x01 | 0xfc);
+  buffer[1]=(unsigned char)((c>>24) & 0x3f | 0x80);
+  buffer[2]=(unsigned char)((c>>18) & 0x3f | 0x80);
+  buffer[3]=(unsigned char)((c>>12) & 0x3f | 0x80);
+  buffer[4]=(unsigned char)((c>>6) & 0x3f | 0x80);
+  buffer[5]=(unsigned char)(c & 0x3f | 0x80);
+  return 6;
 }
 
+/* the string is encoded in a buffer, which is written in blocks */
 static size_t fputs_cell(FILE *fp,cell *string,int utf8mode)
 {
-  size_t count=0;
+  unsigned char buffer[LINE_CHUNK];
+  size_t count=0,len=0;
 
   assert(sizeof(cell)>=4);
   assert(fp!=NULL);
   assert(string!=NULL);
 
   while (*string!=0) {
-    if (utf8mode) {
-      cell c=*string;
-      if (c<0x80) {
-        /* 0xxxxxxx */
-        fputc((unsigned char)c,fp);
-      } else if (c<0x800) {
-        /* 110xxxxx 10xxxxxx */
-        fputc((unsigned char)((c>>6) & 0x1f | 0xc0),fp);
-        fputc((unsigned char)(c & 0x3f | 0x80),fp);
-      } else if (c<0x10000) {
-        /* 1110xxxx 10xxxxxx 10xxxxxx (16 bits, BMP plane) */
-        fputc((unsigned char)((c>>12) & 0x0f | 0xe0),fp);
-        fputc((unsigned char)((c>>6) & 0x3f | 0x80),fp);
-        fputc((unsigned char)(c & 0x3f | 0x80),fp);
-      } else if (c<0x200000) {
-        /* 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */
-        fputc((unsigned char)((c>>18) & 0x07 | 0xf0),fp);
-        fputc((unsigned char)((c>>12) & 0x3f | 0x80),fp);
-        fputc((unsigned char)((c>>6) & 0x3f | 0x80),fp);
-        fputc((unsigned char)(c & 0x3f | 0x80),fp);
-      } else if (c<0x4000000) {
-        /* 111110xx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx */
-        fputc((unsigned char)((c>>24) & 0x03 | 0xf8),fp);
-        fputc((unsigned char)((c>>18) & 0x3f | 0x80),fp);
-        fputc((unsigned char)((c>>12) & 0x3f | 0x80),fp);
-        fputc((unsigned char)((c>>6) & 0x3f | 0x80),fp);
-        fputc((unsigned char)(c & 0x3f | 0x80),fp);
-      } else {
-        /* 1111110x 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx (31 bits) */
-        fputc((unsigned char)((c>>30) & 0x01 | 0xfc),fp);
-        fputc((unsigned char)((c>>24) & 0x3f | 0x80),fp);
-        fputc((unsigned char)((c>>18) & 0x3f | 0x80),fp);
-        fputc((unsigned char)((c>>12) & 0x3f | 0x80),fp);
-        fputc((unsigned char)((c>>6) & 0x3f | 0x80),fp);
-        fputc((unsigned char)(c & 0x3f | 0x80),fp);
-      } /* if */
-    } else {
-      /* not UTF-8 mode */
-      fputc((unsigned char)*string,fp);
+    if (len+6>sizeof buffer) {
+      fwrite(buffer,1,len,fp);
+      len=0;
     } /* if */
+    if (utf8mode)
+      len+=utf8_put(buffer+len,*string);
+    else
+      buffer[len++]=(unsigned char)*string;   /* not UTF-8 mode */
     string++;
     count++;
   } /* while */
+  if (len>0)
+    fwrite(buffer,1,len,fp);
   return count;
 }
 
 static size_t fgets_char(FILE *fp, char *string, size_t max)
 {
-  size_t index;
-  int c,lastcr;
-
-  index=0;
-  lastcr=0;
-  for ( ;; ) {
-    assert(index<max);
-    if (index==max-1)
-      break;                    /* string fully filled */
-    if ((c=fgetc(fp))==EOF)
-      break;                    /* no more characters */
-    string[index++]=(char)c;
-    if (c==__T('\n')) {
-      break;                    /* read newline, done */
-    } else if (lastcr) {
-      ungetc(c,fp);             /* carriage return was read, no newline follows */
-      break;
-    } /* if */
-    lastcr=(c==__T('\r'));
-  } /* for */
-  assert(index<max);
-  string[index]=__T('\0');
-
-  return index;
+  unsigned char local[LINE_CHUNK],*text;
+  size_t length,used;
+
+  assert(max>0);
+  text=readline(fp,local,sizeof local,max-1,&length);
+  used=scan_line(text,length,max-1);
+  memcpy(string,text,used);
+  string[used]=__T('\0');
+  if (used<length)
+    fseek(fp,-(long)(length-used),SEEK_CUR);
+  if (text!=local)
+    free(text);
+  return used;
 }
 
 #if defined __WIN32__ || defined _WIN32 || defined WIN32
@@ -422,15 +558,13 @@ static char *completename(TCHAR *dest, TCHAR *src, size_t size)
   #endif
 }
 
-/* File: fopen(const name[], filemode: mode) */
-static cell AMX_NATIVE_CALL n_fopen(AMX *amx, const cell *params)
+static FILE *openfile(const TCHAR *fullname,int mode)
 {
   TCHAR *attrib,*altattrib;
-  TCHAR *name,fullname[_MAX_PATH];
-  FILE *f = NULL;
+  FILE *f;
 
   altattrib=NULL;
-  switch (params[2] & 0x7fff) {
+  switch (mode & 0x7fff) {
   case io_read:
     attrib=__T("rb");
     break;
@@ -445,16 +579,25 @@ static cell AMX_NATIVE_CALL n_fopen(AMX *amx, const cell *params)
     attrib=__T("ab");
     break;
   default:
-    return 0;
+    return NULL;
   } /* switch */
 
+  f=_tfopen(fullname,attrib);
+  if (f==NULL && altattrib!=NULL)
+    f=_tfopen(fullname,altattrib);
+  return f;
+}
+
+/* File: fopen(const name[], filemode: mode) */
+static cell AMX_NATIVE_CALL n_fopen(AMX *amx, const cell *params)
+{
+  TCHAR *name,fullname[_MAX_PATH];
+  FILE *f = NULL;
+
   /* get the filename */
   amx_StrParam(amx,params[1],name);
-  if (name!=NULL && completename(fullname,name,sizeof fullname)!=NULL) {
-    f=_tfopen(fullname,attrib);
-    if (f==NULL && altattrib!=NULL)
-      f=_tfopen(fullname,altattrib);
-  } /* if */
+  if (name!=NULL && completename(fullname,name,sizeof fullname)!=NULL)
+    f=openfile(fullname,(int)params[2]);
   return (cell)f;
 }
 
@@ -546,21 +689,10 @@ static cell AMX_NATIVE_CALL n_fputchar(AMX *amx, const cell *params)
 /* fgetchar(File: handle, bool:utf8 = true) */
 static cell AMX_NATIVE_CALL n_fgetchar(AMX *amx, const cell *params)
 {
-  cell str[2];
-  size_t result;
-
   UNUSED_PARAM(amx);
-  if (params[2]) {
-    result=fgets_cell((FILE*)params[1],str,2,1);
-  } else {
-    str[0]=fgetc((FILE*)params[1]);
-    result= (str[0]!=EOF);
-  } /* if */
-  assert(result==0 || result==1);
-  if (result==0)
-    return EOF;
-  else
-    return str[0];
+  if (params[2])
+    return fgetc_cell((FILE*)params[1]);
+  return fgetc((FILE*)params[1]);
 }
 
 #if PAWN_CELL_SIZE==16
@@ -573,42 +705,87 @@ static cell AMX_NATIVE_CALL n_fgetchar(AMX *amx, const cell *params)
   #error Unsupported cell size
 #endif
 
+static cell writeblock(FILE *fp,const cell *cptr,cell max)
+{
+  cell count=0;
+
+  if (max<=0)
+    return 0;
+  #if BYTE_ORDER==BIG_ENDIAN
+  {
+    /* the file holds the cells in Little Endian, swap them in blocks */
+    ucell block[LINE_CHUNK/sizeof(cell)];
+    size_t num,i;
+    while (count<max) {
+      num=(size_t)(max-count);
+      if (num>sizeof block/sizeof block[0])
+        num=sizeof block/sizeof block[0];
+      for (i=0; i<num; i++) {
+        block[i]=(ucell)cptr[count+i];
+        aligncell(&block[i]);
+      } /* for */
+      i=fwrite(block,sizeof(cell),num,fp);
+      count+=(cell)i;
+      if (i!=num)
+        break;          /* write error */
+    } /* while */
+  }
+  #else
+    count=(cell)fwrite(cptr,sizeof(cell),(size_t)max,fp);
+  #endif
+  return count;
+}
+
+static cell readblock(FILE *fp,cell *cptr,cell max)
+{
+  cell count;
+
+  if (max<=0)
+    return 0;
+  count=(cell)fread(cptr,sizeof(cell),(size_t)max,fp);
+  #if BYTE_ORDER==BIG_ENDIAN
+  {
+    cell i;
+    for (i=0; i<count; i++)
+      aligncell((ucell*)&cptr[i]);
+  }
+  #endif
+  return count;
+}
+
+static int seekwhence(cell whence)
+{
+  switch (whence) {
+  case seek_start:
+    return SEEK_SET;
+  case seek_current:
+    return SEEK_CUR;
+  case seek_end:
+    return SEEK_END;
+  } /* switch */
+  return -1;
+}
+
 /* fblockwrite(File: handle, buffer[], size=sizeof buffer) */
 static cell AMX_NATIVE_CALL n_fblockwrite(AMX *amx, const cell *params)
 {
   cell *cptr;
-  cell count;
 
   amx_GetAddr(amx,params[2],&cptr);
-  if (cptr!=NULL) {
-    cell max=params[3];
-    ucell v;
-    for (count=0; count<max; count++) {
-      v=(ucell)*cptr++;
-      if (fwrite(aligncell(&v),sizeof(cell),1,(FILE*)params[1])!=1)
-        break;          /* write error */
-    } /* for */
-  } /* if */
-  return count;
+  if (cptr==NULL)
+    return 0;
+  return writeblock((FILE*)params[1],cptr,params[3]);
 }
 
 /* fblockread(File: handle, buffer[], size=sizeof buffer) */
 static cell AMX_NATIVE_CALL n_fblockread(AMX *amx, const cell *params)
 {
   cell *cptr;
-  cell count;
 
   amx_GetAddr(amx,params[2],&cptr);
-  if (cptr!=NULL) {
-    cell max=params[3];
-    ucell v;
-    for (count=0; count<max; count++) {
-      if (fread(&v,sizeof(cell),1,(FILE*)params[1])!=1)
-        break;          /* write error */
-      *cptr++=(cell)*aligncell(&v);
-    } /* for */
-  } /* if */
-  return count;
+  if (cptr==NULL)
+    return 0;
+  return readblock((FILE*)params[1],cptr,params[3]);
 }
 
 /* File: ftemp() */
@@ -622,24 +799,14 @@ static cell AMX_NATIVE_CALL n_ftemp(AMX *amx, const cell *params)
 /* fseek(File: handle, position, seek_whence: whence=seek_start) */
 static cell AMX_NATIVE_CALL n_fseek(AMX *amx, const cell *params)
 {
-  int whence;
-  switch (params[3]) {
-  case seek_start:
-    whence=SEEK_SET;
-    break;
-  case seek_current:
-    whence=SEEK_CUR;
-    break;
-  case seek_end:
-    whence=SEEK_END;
-    //if (params[2]>0)
-    //  params[2]=-params[2];
-    break;
-  default:
-    return 0;
-  } /* switch */
+  int whence=seekwhence(params[3]);
   UNUSED_PARAM(amx);
-  return lseek(fileno((FILE*)params[1]),params[2],whence);
+  if (whence<0)
+    return 0;
+  /* go through the C library, so that its read buffer is dropped */
+  if (fseek((FILE*)params[1],params[2],whence)!=0)
+    return -1;
+  return ftell((FILE*)params[1]);
 }
 
 /* bool: fremove(const name[]) */
@@ -657,11 +824,12 @@ static cell AMX_NATIVE_CALL n_fremove(AMX *amx, const cell *params)
 /* flength(File: handle) */
 static cell AMX_NATIVE_CALL n_flength(AMX *amx, const cell *params)
 {
+  FILE *fp=(FILE*)params[1];
   long l,c;
-  int fn=fileno((FILE*)params[1]);
-  c=lseek(fn,0,SEEK_CUR); /* save the current position */
-  l=lseek(fn,0,SEEK_END); /* return the file position at its end */
-  lseek(fn,c,SEEK_SET);   /* restore the file pointer */
+  c=ftell(fp);            /* save the current position */
+  fseek(fp,0,SEEK_END);
+  l=ftell(fp);            /* return the file position at its end */
+  fseek(fp,c,SEEK_SET);   /* restore the file pointer */
   UNUSED_PARAM(amx);
   return l;
 }
@@ -716,7 +884,7 @@ static int matchfiles(const TCHAR *path,int skip,TCHAR *out,int outlen)
       strcpy(dirname,".");
     } else {
       strncpy(dirname,path,(int)(basename-path));
-      dirname[(int)(basename-path)]=_T('\0');
+      dirname[(int)(basename-path)]=__T('\0');
     } /* if */
     if ((dir=opendir(dirname))!=NULL) {
       while ((entry=readdir(dir))!=NULL) {
@@ -763,6 +931,814 @@ static cell AMX_NATIVE_CALL n_fmatch(AMX *amx, const cell *params)
   return fullname[0]!='\0';
 }
 
+/* A mapped file is a read-only file whose contents are mapped into memory
+ * (or, on systems without memory mapping, read into memory as a whole), so
+ * that lines and blocks are copied straight from memory.
+ */
+typedef struct tagMAPPEDFILE {
+  const unsigned char *data;
+  size_t length;
+  size_t pos;
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    HANDLE hfile,hmap;
+  #endif
+} MAPPEDFILE;
+
+static MAPPEDFILE *mapfile(const TCHAR *name)
+{
+  MAPPEDFILE *mf;
+
+  if ((mf=(MAPPEDFILE*)malloc(sizeof(MAPPEDFILE)))==NULL)
+    return NULL;
+  mf->data=NULL;
+  mf->length=0;
+  mf->pos=0;
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    mf->hmap=NULL;
+    mf->hfile=CreateFile(name,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if (mf->hfile==INVALID_HANDLE_VALUE) {
+      free(mf);
+      return NULL;
+    } /* if */
+    mf->length=GetFileSize(mf->hfile,NULL);
+    if (mf->length>0) {
+      if ((mf->hmap=CreateFileMapping(mf->hfile,NULL,PAGE_READONLY,0,0,NULL))!=NULL)
+        mf->data=(const unsigned char*)MapViewOfFile(mf->hmap,FILE_MAP_READ,0,0,0);
+      if (mf->data==NULL) {
+        if (mf->hmap!=NULL)
+          CloseHandle(mf->hmap);
+        CloseHandle(mf->hfile);
+        free(mf);
+        return NULL;
+      } /* if */
+    } /* if */
+  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__ || defined MACOS
+  {
+    struct stat st;
+    int fd;
+    void *ptr;
+    if ((fd=open(name,O_RDONLY))<0) {
+      free(mf);
+      return NULL;
+    } /* if */
+    if (fstat(fd,&st)==0 && st.st_size>0) {
+      mf->length=(size_t)st.st_size;
+      ptr=mmap(NULL,mf->length,PROT_READ,MAP_PRIVATE,fd,0);
+      if (ptr!=MAP_FAILED)
+        mf->data=(const unsigned char*)ptr;
+    } /* if */
+    close(fd);                  /* the mapping stays valid */
+    if (mf->length>0 && mf->data==NULL) {
+      free(mf);
+      return NULL;
+    } /* if */
+  }
+  #else
+  {
+    FILE *fp;
+    unsigned char *ptr;
+    if ((fp=_tfopen(name,__T("rb")))==NULL) {
+      free(mf);
+      return NULL;
+    } /* if */
+    fseek(fp,0,SEEK_END);
+    mf->length=(size_t)ftell(fp);
+    fseek(fp,0,SEEK_SET);
+    if (mf->length>0) {
+      if ((ptr=(unsigned char*)malloc(mf->length))==NULL
+          || fread(ptr,1,mf->length,fp)!=mf->length)
+      {
+        free(ptr);
+        fclose(fp);
+        free(mf);
+        return NULL;
+      } /* if */
+      mf->data=ptr;
+    } /* if */
+    fclose(fp);
+  }
+  #endif
+  return mf;
+}
+
+static void unmapfile(MAPPEDFILE *mf)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    if (mf->data!=NULL)
+      UnmapViewOfFile((LPCVOID)mf->data);
+    if (mf->hmap!=NULL)
+      CloseHandle(mf->hmap);
+    CloseHandle(mf->hfile);
+  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__ || defined MACOS
+    if (mf->data!=NULL)
+      munmap((void*)mf->data,mf->length);
+  #else
+    free((void*)mf->data);
+  #endif
+  free(mf);
+}
+
+#if !defined AMXFILE_MAPS
+  #define AMXFILE_MAPS  16      /* maximum number of mapped files per abstract machine */
+#endif
+
+/* The state of an abstract machine is kept in its "user data"; it is only
+ * created for scripts that map files or make asynchronous requests. A
+ * "MappedFile:" handle is an index in the table of mapped files (plus one),
+ * so that it fits in a cell on any host.
+ */
+typedef struct tagFILEINFO {
+  MAPPEDFILE *maps[AMXFILE_MAPS];
+  #if !defined AMXFILE_NOASYNC
+    int async;          /* the asynchronous functions are set up */
+    AMX_IDLE PrevIdle;
+    MUTEX lock;
+    CONDVAR finished;   /* signalled when "pending" drops to zero */
+    struct tagFILEREQUEST *done;      /* finished requests, in order */
+    struct tagFILEREQUEST **donetail;
+    int pending;        /* requests that have not finished */
+    int undelivered;    /* requests whose public function was not called */
+    cell nextid;
+  #endif
+} FILEINFO;
+
+static FILEINFO *getfileinfo(AMX *amx)
+{
+  void *ptr;
+  if (amx_GetUserData(amx, AMX_USERTAG('F','i','l','e'), &ptr) != AMX_ERR_NONE)
+    return NULL;
+  return (FILEINFO*)ptr;
+}
+
+static MAPPEDFILE *getmapped(AMX *amx,cell handle)
+{
+  FILEINFO *info=getfileinfo(amx);
+  if (info==NULL || handle<=0 || handle>AMXFILE_MAPS)
+    return NULL;
+  return info->maps[(int)handle-1];
+}
+
+/* MappedFile: fmapopen(const name[]) */
+static cell AMX_NATIVE_CALL n_fmapopen(AMX *amx, const cell *params)
+{
+  TCHAR *name,fullname[_MAX_PATH];
+  FILEINFO *info=getfileinfo(amx);
+  int idx;
+
+  if (info==NULL)
+    return 0;
+  for (idx=0; idx<AMXFILE_MAPS && info->maps[idx]!=NULL; idx++)
+    /* nothing */;
+  if (idx>=AMXFILE_MAPS)
+    return 0;           /* too many mapped files */
+  amx_StrParam(amx,params[1],name);
+  if (name!=NULL && completename(fullname,name,sizeof fullname)!=NULL)
+    info->maps[idx]=mapfile(fullname);
+  return (info->maps[idx]!=NULL) ? idx+1 : 0;
+}
+
+/* bool: fmapclose(MappedFile: handle) */
+static cell AMX_NATIVE_CALL n_fmapclose(AMX *amx, const cell *params)
+{
+  MAPPEDFILE *mf=getmapped(amx,params[1]);
+
+  if (mf==NULL)
+    return 0;
+  unmapfile(mf);
+  getfileinfo(amx)->maps[(int)params[1]-1]=NULL;
+  return 1;
+}
+
+/* fmapread(MappedFile: handle, string[], size=sizeof string, bool:pack=false)
+ * Reads the next line, like fread().
+ */
+static cell AMX_NATIVE_CALL n_fmapread(AMX *amx, const cell *params)
+{
+  MAPPEDFILE *mf=getmapped(amx,params[1]);
+  const unsigned char *text;
+  size_t max,length,used;
+  long count;
+  cell *cptr;
+  char *str;
+
+  max=(size_t)params[3];
+  if (mf==NULL || params[3]<=0)
+    return 0;
+  if (params[4])
+    max*=sizeof(cell);
+  amx_GetAddr(amx,params[2],&cptr);
+  if (cptr==NULL) {
+    amx_RaiseError(amx, AMX_ERR_NATIVE);
+    return 0;
+  } /* if */
+
+  text=mf->data+mf->pos;
+  length=mf->length-mf->pos;
+  if (params[4]) {
+    /* store as packed string, read an ASCII/ANSI string */
+    used=scan_line(text,length,max-1);
+    if ((str=(char*)alloca(used+1))==NULL) {
+      amx_RaiseError(amx, AMX_ERR_NATIVE);
+      return 0;
+    } /* if */
+    memcpy(str,text,used);
+    str[used]='\0';
+    amx_SetString(cptr,str,1,0,max);
+    count=(long)used;
+  } else if ((count=decode_utf8(text,length,cptr,max,&used))<0) {
+    /* store and unpacked string, but the text is not UTF-8 */
+    used=scan_line(text,length,max-1);
+    for (count=0; count<(long)used; count++)
+      cptr[count]=text[count];
+    cptr[count]=0;
+  } /* if */
+  mf->pos+=used;
+  return count;
+}
+
+/* fmapblockread(MappedFile: handle, buffer[], size=sizeof buffer) */
+static cell AMX_NATIVE_CALL n_fmapblockread(AMX *amx, const cell *params)
+{
+  MAPPEDFILE *mf=getmapped(amx,params[1]);
+  cell *cptr;
+  size_t count;
+
+  amx_GetAddr(amx,params[2],&cptr);
+  if (mf==NULL || cptr==NULL || params[3]<=0)
+    return 0;
+  count=(mf->length-mf->pos)/sizeof(cell);
+  if (count>(size_t)params[3])
+    count=(size_t)params[3];
+  memcpy(cptr,mf->data+mf->pos,count*sizeof(cell));
+  mf->pos+=count*sizeof(cell);
+  #if BYTE_ORDER==BIG_ENDIAN
+  {
+    size_t i;
+    for (i=0; i<count; i++)
+      aligncell((ucell*)&cptr[i]);
+  }
+  #endif
+  return (cell)count;
+}
+
+/* fmapseek(MappedFile: handle, position, seek_whence: whence=seek_start) */
+static cell AMX_NATIVE_CALL n_fmapseek(AMX *amx, const cell *params)
+{
+  MAPPEDFILE *mf=getmapped(amx,params[1]);
+  long pos;
+
+  if (mf==NULL)
+    return -1;
+  switch (params[3]) {
+  case seek_start:
+    pos=0;
+    break;
+  case seek_current:
+    pos=(long)mf->pos;
+    break;
+  case seek_end:
+    pos=(long)mf->length;
+    break;
+  default:
+    return -1;
+  } /* switch */
+  pos+=(long)params[2];
+  if (pos<0 || pos>(long)mf->length)
+    return -1;
+  mf->pos=(size_t)pos;
+  return (cell)pos;
+}
+
+/* fmaplength(MappedFile: handle) */
+static cell AMX_NATIVE_CALL n_fmaplength(AMX *amx, const cell *params)
+{
+  MAPPEDFILE *mf=getmapped(amx,params[1]);
+
+  if (mf==NULL)
+    return 0;
+  return (cell)mf->length;
+}
+
+
+#if !defined AMXFILE_NOASYNC
+
+/* Asynchronous file requests are run by a pool of worker threads, which is
+ * shared by all abstract machines. Every worker has its own queue, and all
+ * requests on a file go to the same worker (picked from the file handle), so
+ * that they run in the order in which they were made. A finished request is
+ * moved to the list of the abstract machine that made it; the idle function
+ * of that abstract machine calls the public function of the request, and it
+ * copies the data that was read into the abstract machine only then.
+ */
+#if !defined AMXFILE_THREADS
+  #define AMXFILE_THREADS 4
+#endif
+
+enum {
+  ASYNC_OPEN,
+  ASYNC_READ,
+  ASYNC_BLOCKREAD,
+  ASYNC_WRITE,
+  ASYNC_BLOCKWRITE,
+  ASYNC_SEEK,
+  ASYNC_CLOSE,
+};
+
+typedef struct tagFILEREQUEST {
+  struct tagFILEREQUEST *next;
+  struct tagFILEINFO *owner;
+  int op;
+  int index;            /* public function, -1 for none */
+  cell id;
+  cell payload;
+  FILE *fp;
+  cell size;            /* size of the buffer, or the position for a seek */
+  int flag;             /* packed string, open mode or seek direction */
+  cell result;
+  cell *data;           /* data to write, or data that was read */
+  TCHAR *name;          /* full path of the file to open */
+} FILEREQUEST;
+
+typedef struct tagWORKQUEUE {
+  MUTEX lock;
+  CONDVAR work;
+  FILEREQUEST *head;
+  FILEREQUEST *tail;
+  THREAD thread;
+} WORKQUEUE;
+
+/* amx_FileInit() and amx_FileCleanup() start and stop the pool; they must
+ * not be called from several threads at the same time
+ */
+static struct {
+  int users;            /* abstract machines that use the pool */
+  int numthreads;
+  int quit;
+  WORKQUEUE queues[AMXFILE_THREADS];
+} Pool;
+
+static void request_free(FILEREQUEST *req)
+{
+  if (req->data!=NULL)
+    free(req->data);
+  if (req->name!=NULL)
+    free(req->name);
+  free(req);
+}
+
+static void request_run(FILEREQUEST *req)
+{
+  int whence;
+
+  switch (req->op) {
+  case ASYNC_OPEN:
+    req->fp=openfile(req->name,req->flag);
+    req->result=(cell)(intptr_t)req->fp;
+    break;
+  case ASYNC_READ:
+    /* the buffer was allocated for "size" cells; a packed string is read
+     * as bytes into the same buffer
+     */
+    if (req->flag)
+      req->result=(cell)fgets_char(req->fp,(char*)req->data,(size_t)req->size*sizeof(cell));
+    else
+      req->result=(cell)fgets_cell(req->fp,req->data,(size_t)req->size,1);
+    break;
+  case ASYNC_BLOCKREAD:
+    req->result=readblock(req->fp,req->data,req->size);
+    break;
+  case ASYNC_WRITE:
+    if (req->flag) {
+      char *str=(char*)malloc((size_t)req->size*sizeof(cell)+1);
+      req->result=0;
+      if (str!=NULL) {
+        amx_GetString(str,req->data,0,(size_t)req->size*sizeof(cell)+1);
+        if (fputs(str,req->fp)>=0)
+          req->result=(cell)strlen(str);
+        free(str);
+      } /* if */
+    } else {
+      req->result=(cell)fputs_cell(req->fp,req->data,1);
+    } /* if */
+    break;
+  case ASYNC_BLOCKWRITE:
+    req->result=writeblock(req->fp,req->data,req->size);
+    break;
+  case ASYNC_SEEK:
+    whence=seekwhence(req->flag);
+    if (whence<0 || fseek(req->fp,req->size,whence)!=0)
+      req->result=-1;
+    else
+      req->result=ftell(req->fp);
+    break;
+  case ASYNC_CLOSE:
+    req->result= (fclose(req->fp)==0);
+    break;
+  } /* switch */
+}
+
+#if defined __WIN32__ || defined _WIN32 || defined WIN32
+static DWORD WINAPI worker_main(LPVOID arg)
+#else
+static void *worker_main(void *arg)
+#endif
+{
+  WORKQUEUE *queue=(WORKQUEUE*)arg;
+  FILEREQUEST *req;
+  FILEINFO *info;
+
+  for ( ;; ) {
+    mutex_lock(&queue->lock);
+    while (queue->head==NULL && !Pool.quit)
+      cond_wait(&queue->work,&queue->lock);
+    if ((req=queue->head)==NULL) {
+      mutex_unlock(&queue->lock);
+      break;                    /* quit, and the queue is empty */
+    } /* if */
+    queue->head=req->next;
+    if (queue->head==NULL)
+      queue->tail=NULL;
+    mutex_unlock(&queue->lock);
+
+    request_run(req);
+
+    /* hand the request over to the abstract machine */
+    info=req->owner;
+    req->next=NULL;
+    mutex_lock(&info->lock);
+    *info->donetail=req;
+    info->donetail=&req->next;
+    if (--info->pending==0)
+      cond_broadcast(&info->finished);
+    mutex_unlock(&info->lock);
+  } /* for */
+  return 0;
+}
+
+static int pool_start(void)
+{
+  int i;
+
+  if (Pool.users++>0)
+    return AMX_ERR_NONE;
+  Pool.quit=0;
+  for (i=0; i<AMXFILE_THREADS; i++) {
+    WORKQUEUE *queue=&Pool.queues[i];
+    queue->head=queue->tail=NULL;
+    mutex_init(&queue->lock);
+    cond_init(&queue->work);
+    #if defined __WIN32__ || defined _WIN32 || defined WIN32
+      if ((queue->thread=CreateThread(NULL,0,worker_main,(LPVOID)queue,0,NULL))==NULL)
+        break;
+    #else
+      if (pthread_create(&queue->thread,NULL,worker_main,(void*)queue)!=0)
+        break;
+    #endif
+  } /* for */
+  Pool.numthreads=i;
+  if (i==0) {
+    Pool.users=0;
+    return AMX_ERR_GENERAL;
+  } /* if */
+  return AMX_ERR_NONE;
+}
+
+static void pool_stop(void)
+{
+  int i;
+
+  assert(Pool.users>0);
+  if (--Pool.users>0)
+    return;
+  for (i=0; i<Pool.numthreads; i++) {
+    mutex_lock(&Pool.queues[i].lock);
+    Pool.quit=1;
+    cond_signal(&Pool.queues[i].work);
+    mutex_unlock(&Pool.queues[i].lock);
+  } /* for */
+  for (i=0; i<Pool.numthreads; i++) {
+    #if defined __WIN32__ || defined _WIN32 || defined WIN32
+      WaitForSingleObject(Pool.queues[i].thread,INFINITE);
+      CloseHandle(Pool.queues[i].thread);
+    #else
+      pthread_join(Pool.queues[i].thread,NULL);
+    #endif
+    mutex_destroy(&Pool.queues[i].lock);
+    cond_destroy(&Pool.queues[i].work);
+  } /* for */
+  Pool.numthreads=0;
+}
+
+/* request_new() creates a request for the public function whose name is in
+ * the parameter; it returns NULL if the function does not exist (an empty
+ * name means that no function is called)
+ */
+static FILEREQUEST *request_new(AMX *amx,int op,cell handle,cell function,cell payload)
+{
+  FILEINFO *info;
+  FILEREQUEST *req;
+  char *name;
+  int index=-1;
+
+  if ((info=getfileinfo(amx))==NULL || !info->async)
+    return NULL;
+  amx_StrParam(amx,function,name);
+  if (name!=NULL && amx_FindPublic(amx,name,&index)!=AMX_ERR_NONE)
+    return NULL;
+  if ((req=(FILEREQUEST*)malloc(sizeof(FILEREQUEST)))==NULL)
+    return NULL;
+  memset(req,0,sizeof(FILEREQUEST));
+  req->owner=info;
+  req->op=op;
+  req->index=index;
+  req->fp=(FILE*)(intptr_t)handle;
+  req->payload=payload;
+  return req;
+}
+
+static cell request_submit(FILEREQUEST *req)
+{
+  FILEINFO *info=req->owner;
+  WORKQUEUE *queue;
+  cell id;
+
+  mutex_lock(&info->lock);
+  id=req->id=++info->nextid;
+  if (id<=0)
+    id=req->id=info->nextid=1;  /* wrapped around */
+  info->pending++;
+  info->undelivered++;
+  mutex_unlock(&info->lock);
+
+  /* all requests on a file go to the same worker */
+  if (req->op==ASYNC_OPEN)
+    queue=&Pool.queues[id % Pool.numthreads];
+  else
+    queue=&Pool.queues[((size_t)req->fp >> 4) % (size_t)Pool.numthreads];
+  mutex_lock(&queue->lock);
+  if (queue->tail!=NULL)
+    queue->tail->next=req;
+  else
+    queue->head=req;
+  queue->tail=req;
+  cond_signal(&queue->work);
+  mutex_unlock(&queue->lock);
+  return id;
+}
+
+/* faopen(const name[], filemode: mode, const function[], payload=0)
+ * The public function gets the handle of the file (zero on failure) in its
+ * second parameter, see fadone(). All functions below return the number of
+ * the request, or zero on failure.
+ */
+static cell AMX_NATIVE_CALL n_faopen(AMX *amx, const cell *params)
+{
+  TCHAR *name,fullname[_MAX_PATH];
+  FILEREQUEST *req;
+
+  amx_StrParam(amx,params[1],name);
+  if (name==NULL || completename(fullname,name,sizeof fullname)==NULL)
+    return 0;
+  if ((req=request_new(amx,ASYNC_OPEN,0,params[3],params[4]))==NULL)
+    return 0;
+  req->flag=(int)params[2];
+  if ((req->name=(TCHAR*)malloc((_tcslen(fullname)+1)*sizeof(TCHAR)))==NULL) {
+    request_free(req);
+    return 0;
+  } /* if */
+  _tcscpy(req->name,fullname);
+  return request_submit(req);
+}
+
+/* faread(File: handle, size, const function[], bool:pack=false, payload=0)
+ * Reads a line of at most "size" cells, like fread().
+ */
+static cell AMX_NATIVE_CALL n_faread(AMX *amx, const cell *params)
+{
+  FILEREQUEST *req;
+
+  if (params[1]==0 || params[2]<=0)
+    return 0;
+  if ((req=request_new(amx,ASYNC_READ,params[1],params[3],params[5]))==NULL)
+    return 0;
+  req->size=params[2];
+  req->flag=(params[4]!=0);
+  if ((req->data=(cell*)malloc((size_t)req->size*sizeof(cell)))==NULL) {
+    request_free(req);
+    return 0;
+  } /* if */
+  return request_submit(req);
+}
+
+/* fablockread(File: handle, size, const function[], payload=0) */
+static cell AMX_NATIVE_CALL n_fablockread(AMX *amx, const cell *params)
+{
+  FILEREQUEST *req;
+
+  if (params[1]==0 || params[2]<=0)
+    return 0;
+  if ((req=request_new(amx,ASYNC_BLOCKREAD,params[1],params[3],params[4]))==NULL)
+    return 0;
+  req->size=params[2];
+  if ((req->data=(cell*)malloc((size_t)req->size*sizeof(cell)))==NULL) {
+    request_free(req);
+    return 0;
+  } /* if */
+  return request_submit(req);
+}
+
+/* the data to write is copied when the request is made */
+static cell submit_write(AMX *amx,int op,cell handle,const cell *cptr,cell size,int packed,cell function,cell payload)
+{
+  FILEREQUEST *req;
+
+  if (handle==0 || cptr==NULL || size<=0)
+    return 0;
+  if ((req=request_new(amx,op,handle,function,payload))==NULL)
+    return 0;
+  req->size=size;
+  req->flag=packed;
+  if ((req->data=(cell*)malloc((size_t)size*sizeof(cell)))==NULL) {
+    request_free(req);
+    return 0;
+  } /* if */
+  memcpy(req->data,cptr,(size_t)size*sizeof(cell));
+  return request_submit(req);
+}
+
+/* fawrite(File: handle, const string[], const function[]="", payload=0) */
+static cell AMX_NATIVE_CALL n_fawrite(AMX *amx, const cell *params)
+{
+  cell *cptr;
+  int len,packed;
+
+  amx_GetAddr(amx,params[2],&cptr);
+  if (cptr==NULL)
+    return 0;
+  amx_StrLen(cptr,&len);
+  if (len==0)
+    return 0;
+  /* copy the string, including the terminator */
+  packed=((ucell)*cptr>UNPACKEDMAX);
+  if (packed)
+    len=(int)((len+sizeof(cell))/sizeof(cell));
+  else
+    len++;
+  return submit_write(amx,ASYNC_WRITE,params[1],cptr,len,packed,params[3],params[4]);
+}
+
+/* fablockwrite(File: handle, const buffer[], size=sizeof buffer, const function[]="", payload=0) */
+static cell AMX_NATIVE_CALL n_fablockwrite(AMX *amx, const cell *params)
+{
+  cell *cptr;
+
+  amx_GetAddr(amx,params[2],&cptr);
+  return submit_write(amx,ASYNC_BLOCKWRITE,params[1],cptr,params[3],0,params[4],params[5]);
+}
+
+/* faseek(File: handle, position, seek_whence: whence=seek_start, const function[]="", payload=0) */
+static cell AMX_NATIVE_CALL n_faseek(AMX *amx, const cell *params)
+{
+  FILEREQUEST *req;
+
+  if (params[1]==0 || seekwhence(params[3])<0)
+    return 0;
+  if ((req=request_new(amx,ASYNC_SEEK,params[1],params[4],params[5]))==NULL)
+    return 0;
+  req->size=params[2];
+  req->flag=(int)params[3];
+  return request_submit(req);
+}
+
+/* faclose(File: handle, const function[]="", payload=0) */
+static cell AMX_NATIVE_CALL n_faclose(AMX *amx, const cell *params)
+{
+  FILEREQUEST *req;
+
+  if (params[1]==0)
+    return 0;
+  if ((req=request_new(amx,ASYNC_CLOSE,params[1],params[2],params[3]))==NULL)
+    return 0;
+  return request_submit(req);
+}
+
+/* fapending()
+ * Returns the number of requests whose public function has not been called
+ * yet.
+ */
+static cell AMX_NATIVE_CALL n_fapending(AMX *amx, const cell *params)
+{
+  FILEINFO *info=getfileinfo(amx);
+  cell count=0;
+
+  UNUSED_PARAM(params);
+  if (info!=NULL && info->async) {
+    mutex_lock(&info->lock);
+    count=info->undelivered;
+    mutex_unlock(&info->lock);
+  } /* if */
+  return count;
+}
+
+/* The public functions have the signature:
+ *    fadone(request, File: handle, const data[], result, payload)
+ * where "data" holds the string or the block that was read (and is empty for
+ * the other requests) and "result" is the return value of the matching
+ * synchronous function.
+ */
+static int AMXAPI amx_FileIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
+{
+  FILEINFO *info;
+  FILEREQUEST *list,*req;
+  cell amx_addr,empty=0;
+  int err=AMX_ERR_NONE;
+
+  info=getfileinfo(amx);
+  assert(info!=NULL);
+
+  if (info->PrevIdle!=NULL)
+    info->PrevIdle(amx,Exec);
+
+  mutex_lock(&info->lock);
+  list=info->done;
+  info->done=NULL;
+  info->donetail=&info->done;
+  mutex_unlock(&info->lock);
+
+  while ((req=list)!=NULL) {
+    list=req->next;
+    mutex_lock(&info->lock);
+    info->undelivered--;
+    mutex_unlock(&info->lock);
+    if (req->index>=0 && err==AMX_ERR_NONE) {
+      amx_Push(amx,req->payload);
+      amx_Push(amx,req->result);
+      if (req->op==ASYNC_READ && req->flag)
+        amx_PushString(amx,&amx_addr,NULL,(char*)req->data,1,0);
+      else if (req->op==ASYNC_READ)
+        amx_PushArray(amx,&amx_addr,NULL,req->data,(int)req->result+1);
+      else if (req->op==ASYNC_BLOCKREAD && req->result>0)
+        amx_PushArray(amx,&amx_addr,NULL,req->data,(int)req->result);
+      else
+        amx_PushArray(amx,&amx_addr,NULL,&empty,1);
+      amx_Push(amx,(cell)(intptr_t)req->fp);
+      amx_Push(amx,req->id);
+      err=Exec(amx,NULL,req->index);
+      while (err==AMX_ERR_SLEEP || err==AMX_ERR_BUDGET)
+        err=Exec(amx,NULL,AMX_EXEC_CONT);
+      amx_Release(amx,amx_addr);
+    } /* if */
+    request_free(req);
+  } /* while */
+
+  return err;
+}
+
+static const char *async_names[] = {
+  "faopen", "faread", "fablockread", "fawrite", "fablockwrite", "faseek",
+  "faclose", "fapending", NULL
+};
+
+static int async_init(AMX *amx,FILEINFO *info)
+{
+  int err;
+
+  if ((err=pool_start())!=AMX_ERR_NONE)
+    return err;
+  info->donetail=&info->done;
+  mutex_init(&info->lock);
+  cond_init(&info->finished);
+  info->async=1;
+  if (amx_GetUserData(amx,AMX_USERTAG('I','d','l','e'),(void**)&info->PrevIdle)!=AMX_ERR_NONE)
+    info->PrevIdle=NULL;
+  amx_SetUserData(amx,AMX_USERTAG('I','d','l','e'),amx_FileIdle);
+  return AMX_ERR_NONE;
+}
+
+static void async_cleanup(FILEINFO *info)
+{
+  FILEREQUEST *req;
+
+  if (!info->async)
+    return;
+  /* wait for the requests that are still running */
+  mutex_lock(&info->lock);
+  while (info->pending>0)
+    cond_wait(&info->finished,&info->lock);
+  mutex_unlock(&info->lock);
+  while ((req=info->done)!=NULL) {
+    info->done=req->next;
+    if (req->op==ASYNC_OPEN && req->fp!=NULL)
+      fclose(req->fp);          /* nobody got the handle */
+    request_free(req);
+  } /* while */
+  pool_stop();
+  mutex_destroy(&info->lock);
+  cond_destroy(&info->finished);
+  info->async=0;
+}
+
+#endif /* AMXFILE_NOASYNC */
 
 #if defined __cplusplus
   extern "C"
@@ -782,16 +1758,80 @@ AMX_NATIVE_INFO file_Natives[] = {
   { "fremove",     n_fremove },
   { "fexist",      n_fexist },
   { "fmatch",      n_fmatch },
+  { "fmapopen",    n_fmapopen },
+  { "fmapclose",   n_fmapclose },
+  { "fmapread",    n_fmapread },
+  { "fmapblockread", n_fmapblockread },
+  { "fmapseek",    n_fmapseek },
+  { "fmaplength",  n_fmaplength },
+#if !defined AMXFILE_NOASYNC
+  { "faopen",      n_faopen },
+  { "faread",      n_faread },
+  { "fablockread", n_fablockread },
+  { "fawrite",     n_fawrite },
+  { "fablockwrite", n_fablockwrite },
+  { "faseek",      n_faseek },
+  { "faclose",     n_faclose },
+  { "fapending",   n_fapending },
+#endif
   { NULL, NULL }        /* terminator */
 };
 
+static int usesnatives(AMX *amx,const char *names[])
+{
+  int i,index;
+
+  for (i=0; names[i]!=NULL; i++)
+    if (amx_FindNative(amx,names[i],&index)==AMX_ERR_NONE)
+      return 1;
+  return 0;
+}
+
 int AMXEXPORT amx_FileInit(AMX *amx)
 {
+  static const char *map_names[] = { "fmapopen", NULL };
+  FILEINFO *info;
+  int async=0;
+
+  #if !defined AMXFILE_NOASYNC
+    async=usesnatives(amx,async_names);
+  #endif
+  if (async || usesnatives(amx,map_names)) {
+    if ((info=(FILEINFO*)malloc(sizeof(FILEINFO)))!=NULL) {
+      memset(info,0,sizeof(FILEINFO));
+      if (amx_SetUserData(amx,AMX_USERTAG('F','i','l','e'),info)!=AMX_ERR_NONE) {
+        free(info);
+      } else {
+        #if !defined AMXFILE_NOASYNC
+          /* the pool is only started for scripts that make asynchronous requests */
+          if (async)
+            async_init(amx,info);
+        #endif
+      } /* if */
+    } /* if */
+  } /* if */
+
+  /* the natives are registered even when the state cannot be set up: then
+   * only the functions for mapped files and asynchronous requests fail (they
+   * return 0)
+   */
   return amx_Register(amx, file_Natives, -1);
 }
 
 int AMXEXPORT amx_FileCleanup(AMX *amx)
 {
-  UNUSED_PARAM(amx);
+  FILEINFO *info;
+  int idx;
+
+  if ((info=getfileinfo(amx))!=NULL) {
+    #if !defined AMXFILE_NOASYNC
+      async_cleanup(info);
+    #endif
+    for (idx=0; idx<AMXFILE_MAPS; idx++)
+      if (info->maps[idx]!=NULL)
+        unmapfile(info->maps[idx]);
+    free(info);
+    amx_SetUserData(amx,AMX_USERTAG('F','i','l','e'),NULL);
+  } /* if */
   return AMX_ERR_NONE;
 }
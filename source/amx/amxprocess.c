@@ -42,6 +42,9 @@
 #if defined __WIN32__ || defined _WIN32 || defined WIN32 || defined _Windows
   #include <windows.h>
 #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <poll.h>
   #include <unistd.h>
   #include <dlfcn.h>
   #include <sys/types.h>
@@ -102,15 +105,59 @@ typedef struct tagPARAM {
 
 static MODLIST ModRoot = { NULL };
 
-/* pipes for I/O redirection */
-#if defined __WIN32__ || defined _WIN32 || defined WIN32
-  static HANDLE newstdin,newstdout,read_stdout,write_stdin;
-#elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-  static int pipe_to[2]={-1,-1};
-  static int pipe_from[2]={-1,-1};
+#if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
   void *inst_ffi=NULL;          /* open handle for libffi */
 #endif
 
+/* Child processes are kept per abstract machine (in its user data). The
+ * output of each child is read in blocks from a pipe that does not block. For
+ * procexec(), the output is buffered for procread(); for procstart(), it is
+ * passed in chunks to a public function of the script, from the idle function
+ * of this module. In the latter case, the script may hand a global array to
+ * procbuffer(), and the output is then read straight into that array.
+ */
+#define PROC_CHILDREN   16    /* maximum number of child processes per abstract machine */
+#define PROC_BUFSIZE    4096  /* size of the read buffer of each child, in bytes */
+#define PROC_ROUNDS     8     /* maximum number of reads per child per idle call */
+
+typedef struct tagCHILD {
+  cell pid;
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    HANDLE process;
+    HANDLE read_stdout,write_stdin;
+  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    int fd_in;                  /* write end of the pipe to the stdin of the child */
+    int fd_out;                 /* read end of the pipe from its stdout, non-blocking */
+  #endif
+  int eof;                      /* set when the child closed its stdout */
+  int exited;                   /* set when the child was waited for */
+  int busy;                     /* set while its public function runs */
+  int closed;                   /* procclose() was called while busy */
+  int index;                    /* public function for the output, -1 for none */
+  cell payload;
+  cell buffer;                  /* array from procbuffer() */
+  cell bufsize;                 /* size of that array in cells, 0 for none */
+  int start,length;             /* output waiting in "data" */
+  unsigned char data[PROC_BUFSIZE];
+} CHILD;
+
+/* the child processes and the prepared library calls of an abstract machine */
+typedef struct tagPROCINFO {
+  AMX_IDLE PrevIdle;
+  cell current;                 /* child of the most recent procexec() */
+  CHILD *children[PROC_CHILDREN];
+  struct tagLIBPLAN **plans;    /* see libprepare(), NULL for free entries */
+  int numplans;
+} PROCINFO;
+
+static PROCINFO *getprocinfo(AMX *amx)
+{
+  void *ptr;
+  if (amx_GetUserData(amx, AMX_USERTAG('P','r','o','c'), &ptr) != AMX_ERR_NONE)
+    return NULL;
+  return (PROCINFO*)ptr;
+}
+
 
 static const TCHAR *skippath(const TCHAR *name)
 {
@@ -204,7 +251,8 @@ static int freelib(MODLIST *root, AMX *amx, const TCHAR *name)
 
   ptr = (name != NULL) ? skippath(name) : NULL;
 
-  for (prev = root, item = prev->next; item != NULL; prev = item, item = prev->next) {
+  prev = root;
+  while ((item = prev->next) != NULL) {
     if ((amx == NULL || amx == item->amx) && (ptr == NULL || _tcscmp(item->name, ptr) == 0)) {
       prev->next = item->next;  /* unlink first */
       assert(item->inst != 0);
@@ -219,8 +267,10 @@ static int freelib(MODLIST *root, AMX *amx, const TCHAR *name)
       free(item->name);
       free(item);
       count++;
+    } else {
+      prev = item;
     } /* if */
-  } /* for */
+  } /* while */
   #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
     if (amx==NULL && name==NULL && inst_ffi!=NULL)
       dlclose(inst_ffi);
@@ -284,6 +334,22 @@ LIBFUNC SearchProcAddress(unsigned long inst, const char *functionname)
 
 #endif
 
+/* A call to a library function is "compiled" into a plan: the address of
+ * the function, the type, size and range of every parameter and (for libffi)
+ * the call interface. libcall() makes a plan on every call; libprepare()
+ * keeps it, so that libinvoke() only has to convert the arguments.
+ */
+typedef struct tagLIBPLAN {
+  MODLIST _FAR *lib;
+  LIBFUNC LibFunc;
+  int numparams;
+  PARAM ps[MAXPARAMS];          /* the values are filled in on every call */
+  #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    ffi_cif cif;
+    ffi_type *ptypes[MAXPARAMS];
+  #endif
+} LIBPLAN;
+
 static void *fillarray(AMX *amx, PARAM *param, cell *cptr)
 {
   int i;
@@ -305,127 +371,73 @@ static void *fillarray(AMX *amx, PARAM *param, cell *cptr)
     for (i = 0; i < param->range; i++)
       *ptr++ = (unsigned short)*cptr++;
   } else {
-    unsigned long *ptr = (unsigned long *)vptr;
+    uint32_t *ptr = (uint32_t *)vptr;
     for (i = 0; i < param->range; i++)
-      *ptr++ = (unsigned long)*cptr++;
+      *ptr++ = (uint32_t)*cptr++;
   } /* for */
 
   return vptr;
 }
 
-/* libcall(const libname[], const funcname[], const typestring[], ...)
- *
- * Loads the DLL or shared library if not yet loaded (the name comparison is
- * case sensitive).
- *
- * typestring format:
- *    Whitespace is permitted between the types, but not inside the type
- *    specification. The string "ii[4]&u16s" is equivalent to "i i[4] &u16 s",
- *    but easier on the eye.
- *
- * types:
- *    i = signed integer, 16-bit in Windows 3.x, else 32-bit in Win32 and Linux
- *    u = unsigned integer, 16-bit in Windows 3.x, else 32-bit in Win32 and Linux
- *    f = IEEE floating point, 32-bit
- *    p = packed string
- *    s = unpacked string
- *    The difference between packed and unpacked strings is only relevant when
- *    the parameter is passed by reference (see below).
- *
- * pass-by-value and pass-by-reference:
- *    By default, parameters are passed by value. To pass a parameter by
- *    reference, prefix the type letter with an "&":
- *    &i = signed integer passed by reference
- *    i = signed integer passed by value
- *    Same for '&u' versus 'u' and '&f' versus 'f'.
- *
- *    Arrays are passed by "copy & copy-back". That is, libcall() allocates a
- *    block of dynamic memory to copy the array into. On return from the foreign
- *    function, libcall() copies the array back to the abstract machine. The
- *    net effect is similar to pass by reference, but the foreign function does
- *    not work in the AMX stack directly. During the copy and the copy-back
- *    operations, libcall() may also transform the array elements, for example
- *    between 16-bit and 32-bit elements. This is done because Pawn only
- *    supports a single cell size, which may not fit the required integer size
- *    of the foreign function.
- *
- *    See "element ranges" for the syntax of passing an array.
- *
- *    Strings may either be passed by copy, or by "copy & copy-back". When the
- *    string is an output parameter (for the foreign function), the size of the
- *    array that will hold the return string must be indicated between square
- *    brackets behind the type letter (see "element ranges"). When the string
- *    is "input only", this is not needed --libcall() will determine the length
- *    of the input string itself.
- *
- *    The tokens 'p' and 's' are equivalent, but 'p[10]' and 's[10]' are not
- *    equivalent: the latter syntaxes determine whether the output from the
- *    foreign function will be stored as a packed or an unpacked string.
- *
- * element sizes:
- *    Add an integer behind the type letter; for example, 'i16' refers to a
- *    16-bit signed integer. Note that the value behind the type letter must
- *    be either 8, 16 or 32.
- *
- *    You should only use element size specifiers on the 'i' and 'u' types. That
- *    is, do not use these specifiers on 'f', 's' and 'p'.
- *
- * element ranges:
- *    For passing arrays, the size of the array may be given behind the type
- *    letter and optional element size. The token 'u[4]' indicates an array of
- *    four unsigned integers, which are typically 32-bit. The token 'i16[8]'
- *    is an array of 8 signed 16-bit integers. Arrays are always passed by
- *    "copy & copy-back"
- *
- * When compiled as Unicode, this library converts all strings to Unicode
- * strings.
- *
- * The calling convention for the foreign functions is assumed:
- * -  "__stdcall" for Win32,
- * -  "far pascal" for Win16
- * -  and the GCC default for Unix/Linux (_cdecl)
- *
- * C++ name mangling of the called function is not handled (there is no standard
- * convention for name mangling, so there is no portable way to convert C++
- * function names to mangled names). Win32 name mangling (used by default by
- * Microsoft compilers on functions declared as __stdcall) is also not handled.
- *
- * Returns the value of the called function.
+/* freevalues() frees the memory that was allocated for the parameters */
+static void freevalues(PARAM *ps, int count)
+{
+  int idx;
+
+  for (idx=0; idx<count; idx++) {
+    switch (ps[idx].type) {
+    case 'p':
+    case 's':
+    case 'p' | BYREF:
+    case 's' | BYREF:
+      free(ps[idx].v.ptr);
+      break;
+    case 'i' | BYREF:
+    case 'u' | BYREF:
+    case 'f' | BYREF:
+      if (ps[idx].range>1)
+        free(ps[idx].v.ptr);
+      break;
+    } /* switch */
+  } /* for */
+}
+
+/* findfunc() loads the library if it is not yet loaded, and looks up the
+ * function in it; it returns 0 on failure
  */
-static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
+static int findfunc(AMX *amx, cell libparam, cell funcparam, LIBPLAN *plan)
 {
-  const TCHAR *libname, *funcname, *typestring;
+  const TCHAR *libname, *funcname;
   MODLIST *item;
-  int paramidx, typeidx, idx;
-  PARAM ps[MAXPARAMS];
-  cell *cptr,result;
-  LIBFUNC LibFunc;
-  #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-    ffi_cif cif;
-    ffi_type *ptypes[MAXPARAMS];
-    void *pvalues[MAXPARAMS];
-  #endif
 
-  amx_StrParam(amx, params[1], libname);
+  amx_StrParam(amx, libparam, libname);
+  amx_StrParam(amx, funcparam, funcname);
+  if (libname == NULL || funcname == NULL)
+    return 0;
   item = findlib(&ModRoot, amx, libname);
   if (item == NULL)
     item = addlib(&ModRoot, amx, libname);
-  if (item == NULL) {
-    amx_RaiseError(amx, AMX_ERR_NATIVE);
+  if (item == NULL)
     return 0;
-  } /* if */
+  plan->lib = item;
+  plan->LibFunc = (LIBFUNC)SearchProcAddress(item->inst, funcname);
+  return plan->LibFunc != NULL;
+}
 
-  /* library is loaded, get the function */
-  amx_StrParam(amx, params[2], funcname);
-  LibFunc=(LIBFUNC)SearchProcAddress(item->inst, funcname);
-  if (LibFunc==NULL) {
-    amx_RaiseError(amx, AMX_ERR_NATIVE);
-    return 0;
-  } /* if */
+/* makeplan() decodes the type string (see libcall()) into the parameters of
+ * the plan; it returns 0 if the type string is invalid
+ */
+static int makeplan(LIBPLAN *plan, const TCHAR *typestring)
+{
+  PARAM *ps = plan->ps;
+  int paramidx, typeidx;
+  #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    int idx;
+  #endif
 
-  /* decode the parameters */
   paramidx=typeidx=0;
-  amx_StrParam(amx, params[3], typestring);
+  if (typestring == NULL)
+    typestring = __T("");       /* function without parameters */
   while (paramidx < MAXPARAMS && typestring[typeidx]!=__T('\0')) {
     /* skip white space */
     while (typestring[typeidx]!=__T('\0') && typestring[typeidx]<=__T(' '))
@@ -442,10 +454,10 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
     ps[paramidx].type |= (unsigned char)typestring[typeidx];
     typeidx++;
     /* set default size, then check for an explicit size */
-    #if defined __WIN32__ || defined _WIN32 || defined WIN32
-      ps[paramidx].size=32;
-    #elif defined _Windows
+    #if defined _Windows && !(defined __WIN32__ || defined _WIN32 || defined WIN32)
       ps[paramidx].size=16;
+    #else
+      ps[paramidx].size=32;
     #endif
     if (_istdigit(typestring[typeidx])) {
       ps[paramidx].size=(unsigned char)_tcstol(&typestring[typeidx],NULL,10);
@@ -461,51 +473,130 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
       ps[paramidx].type |= BYREF; /* arrays are always passed by reference */
       typeidx++;                  /* skip closing ']' too */
     } /* if */
+    switch (ps[paramidx].type & ~BYREF) {
+    case 'i': /* signed integer */
+    case 'u': /* unsigned integer */
+    case 'f': /* floating point */
+    case 'p': /* packed string */
+    case 's': /* unpacked string */
+      break;
+    default:
+      return 0;                 /* invalid parameter type */
+    } /* switch */
+    paramidx++;
+  } /* while */
+  plan->numparams=paramidx;
+
+  #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    /* set up the call interface of libffi */
+    for (idx = 0; idx < paramidx; idx++) {
+      switch (ps[idx].type) {
+      case 'i': /* signed integer */
+        switch (ps[idx].size) {
+        case 8:
+          plan->ptypes[idx] = &ffi_type_sint8;
+          break;
+        case 16:
+          plan->ptypes[idx] = &ffi_type_sint16;
+          break;
+        default:
+          plan->ptypes[idx] = &ffi_type_sint32;
+        } /* switch */
+        break;
+      case 'u': /* unsigned integer */
+        switch (ps[idx].size) {
+        case 8:
+          plan->ptypes[idx] = &ffi_type_uint8;
+          break;
+        case 16:
+          plan->ptypes[idx] = &ffi_type_uint16;
+          break;
+        default:
+          plan->ptypes[idx] = &ffi_type_uint32;
+        } /* switch */
+        break;
+      case 'f': /* floating point */
+        plan->ptypes[idx] = &ffi_type_float;
+        break;
+      default:  /* strings, arrays, fields passed by reference */
+        plan->ptypes[idx] = &ffi_type_pointer;
+        break;
+      } /* switch */
+    } /* for */
+    if (ffi_prep_cif(&plan->cif, FFI_DEFAULT_ABI, paramidx, &ffi_type_slong, plan->ptypes) != FFI_OK)
+      return 0;
+  #endif
+  return 1;
+}
+
+/* runplan() converts the arguments, which start at params[first], as the
+ * plan describes; then it calls the function and copies the output
+ * parameters back into the abstract machine
+ */
+static cell runplan(AMX *amx, LIBPLAN *plan, const cell *params, int first)
+{
+  PARAM ps[MAXPARAMS];
+  int paramidx, idx;
+  cell *cptr,result;
+  LIBFUNC LibFunc=plan->LibFunc;
+  #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    void *pvalues[MAXPARAMS];
+    ffi_arg rvalue;
+  #endif
+
+  paramidx=plan->numparams;
+  if ((int)(params[0]/sizeof(cell)) - (first-1) != paramidx)
+    return amx_RaiseError(amx, AMX_ERR_NATIVE); /* format string does not match number of parameters */
+  memcpy(ps, plan->ps, paramidx*sizeof(PARAM));
+
+  /* fill in the values */
+  for (idx=0; idx<paramidx; idx++) {
     /* get pointer to parameter */
-    amx_GetAddr(amx,params[paramidx+4],&cptr);
-    switch (ps[paramidx].type) {
+    amx_GetAddr(amx,params[first+idx],&cptr);
+    switch (ps[idx].type) {
     case 'i': /* signed integer */
     case 'u': /* unsigned integer */
     case 'f': /* floating point */
-      assert(ps[paramidx].range==1);
-      ps[paramidx].v.val=(int)*cptr;
+      assert(ps[idx].range==1);
+      ps[idx].v.val=(int)*cptr;
       break;
     case 'i' | BYREF:
     case 'u' | BYREF:
     case 'f' | BYREF:
-      ps[paramidx].v.ptr=cptr;
-      if (ps[paramidx].range>1) {
+      ps[idx].v.ptr=cptr;
+      if (ps[idx].range>1) {
         /* convert array and pass by address */
-        ps[paramidx].v.ptr = fillarray(amx, &ps[paramidx], cptr);
+        if ((ps[idx].v.ptr = fillarray(amx, &ps[idx], cptr)) == NULL) {
+          freevalues(ps, idx);
+          return 0;
+        } /* if */
       } /* if */
       break;
     case 'p':
     case 's':
     case 'p' | BYREF:
     case 's' | BYREF:
-      if (ps[paramidx].type=='s' || ps[paramidx].type=='p') {
+      if (ps[idx].type=='s' || ps[idx].type=='p') {
         int len;
         /* get length of input string */
         amx_StrLen(cptr,&len);
         len++;            /* include '\0' */
         /* check max. size */
-        if (len<ps[paramidx].range)
-          len=ps[paramidx].range;
-        ps[paramidx].range=len;
+        if (len<ps[idx].range)
+          len=ps[idx].range;
+        ps[idx].range=len;
       } /* if */
-      ps[paramidx].v.ptr=malloc(ps[paramidx].range*sizeof(TCHAR));
-      if (ps[paramidx].v.ptr==NULL)
+      ps[idx].v.ptr=malloc(ps[idx].range*sizeof(TCHAR));
+      if (ps[idx].v.ptr==NULL) {
+        freevalues(ps, idx);
         return amx_RaiseError(amx, AMX_ERR_NATIVE);
-      amx_GetString((char *)ps[paramidx].v.ptr,cptr,sizeof(TCHAR)>1,UNLIMITED);
+      } /* if */
+      amx_GetString((char *)ps[idx].v.ptr,cptr,sizeof(TCHAR)>1,UNLIMITED);
       break;
     default:
-      /* invalid parameter type */
-      return amx_RaiseError(amx, AMX_ERR_NATIVE);
+      assert(0);        /* checked in makeplan() */
     } /* switch */
-    paramidx++;
-  } /* while */
-  if ((params[0]/sizeof(cell)) - 3 != (size_t)paramidx)
-    return amx_RaiseError(amx, AMX_ERR_NATIVE); /* format string does not match number of parameters */
+  } /* for */
 
   #if defined __WIN32__ || defined _WIN32 || defined WIN32 || defined _Windows
     /* push the parameters to the stack (left-to-right in 16-bit; right-to-left
@@ -538,49 +629,10 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
     result=LibFunc();
   #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
     /* use libffi (foreign function interface) */
-    for (idx = 0; idx < paramidx; idx++) {
-      /* copy parameter types */
-        switch (ps[idx].type) {
-        case 'i': /* signed integer */
-          assert(ps[idx].range==1);
-          switch (ps[idx].size) {
-          case 8:
-            ptypes[idx] = &ffi_type_sint8;
-            break;
-          case 16:
-            ptypes[idx] = &ffi_type_sint16;
-            break;
-          default:
-            ptypes[idx] = &ffi_type_sint32;
-          } /* switch */
-          break;
-        case 'u': /* unsigned integer */
-          assert(ps[idx].range==1);
-          switch (ps[idx].size) {
-          case 8:
-            ptypes[idx] = &ffi_type_uint8;
-            break;
-          case 16:
-            ptypes[idx] = &ffi_type_uint16;
-            break;
-          default:
-            ptypes[idx] = &ffi_type_uint32;
-          } /* switch */
-          break;
-        case 'f': /* floating point */
-          assert(ps[idx].range==1);
-          ptypes[idx] = &ffi_type_float;
-          break;
-        default:  /* strings, arrays, fields passed by reference */
-          ptypes[idx] = &ffi_type_pointer;
-          break;
-        /* switch */
-      } /* if */
-      /* copy pointer to parameter values */
+    for (idx = 0; idx < paramidx; idx++)
       pvalues[idx] = &ps[idx].v;
-    } /* for */
-    ffi_prep_cif(&cif, FFI_DEFAULT_ABI, paramidx, &ffi_type_slong, ptypes);
-    ffi_call(&cif, FFI_FN(LibFunc), (void*)&result, pvalues);
+    ffi_call(&plan->cif, FFI_FN(LibFunc), &rvalue, pvalues);
+    result=(cell)rvalue;
   #endif
 
   /* store return values and free allocated memory */
@@ -592,7 +644,7 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
       break;
     case 'p' | BYREF:
     case 's' | BYREF:
-      amx_GetAddr(amx,params[idx+4],&cptr);
+      amx_GetAddr(amx,params[first+idx],&cptr);
       amx_SetString(cptr,(char *)ps[idx].v.ptr,ps[idx].type==('p'|BYREF),sizeof(TCHAR)>1,UNLIMITED);
       free(ps[idx].v.ptr);
       break;
@@ -604,15 +656,15 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
     case 'i' | BYREF:
     case 'u' | BYREF:
     case 'f' | BYREF:
-      amx_GetAddr(amx,params[idx+4],&cptr);
+      amx_GetAddr(amx,params[first+idx],&cptr);
       if (ps[idx].range==1) {
         /* modify directly in the AMX (no memory block was allocated */
         switch (ps[idx].size) {
         case 8:
-          *cptr= (ps[idx].type==('i' | BYREF)) ? (long)((signed char)*cptr) : (*cptr & 0xff);
+          *cptr= (ps[idx].type==('i' | BYREF)) ? (cell)((signed char)*cptr) : (*cptr & 0xff);
           break;
         case 16:
-          *cptr= (ps[idx].type==('i' | BYREF)) ? (long)((short)*cptr) : (*cptr & 0xffff);
+          *cptr= (ps[idx].type==('i' | BYREF)) ? (cell)((short)*cptr) : (*cptr & 0xffff);
           break;
         } /* switch */
       } else {
@@ -620,13 +672,13 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
         for (i=0; i<ps[idx].range; i++) {
           switch (ps[idx].size) {
           case 8:
-            *cptr= (ps[idx].type==('i' | BYREF)) ? ((signed char*)ps[idx].v.ptr)[i] : ((unsigned char*)ps[idx].v.ptr)[i];
+            cptr[i]= (ps[idx].type==('i' | BYREF)) ? ((signed char*)ps[idx].v.ptr)[i] : ((unsigned char*)ps[idx].v.ptr)[i];
             break;
           case 16:
-            *cptr= (ps[idx].type==('i' | BYREF)) ? ((short*)ps[idx].v.ptr)[i] : ((unsigned short*)ps[idx].v.ptr)[i];
+            cptr[i]= (ps[idx].type==('i' | BYREF)) ? ((short*)ps[idx].v.ptr)[i] : ((unsigned short*)ps[idx].v.ptr)[i];
             break;
           default:
-            *cptr= (ps[idx].type==('i' | BYREF)) ? ((long*)ps[idx].v.ptr)[i] : ((unsigned long*)ps[idx].v.ptr)[i];
+            cptr[i]= (cell)((uint32_t*)ps[idx].v.ptr)[i];
           } /* switch */
         } /* for */
         free((char *)ps[idx].v.ptr);
@@ -640,6 +692,163 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
   return result;
 }
 
+/* libcall(const libname[], const funcname[], const typestring[], ...)
+ *
+ * Loads the DLL or shared library if not yet loaded (the name comparison is
+ * case sensitive).
+ *
+ * typestring format:
+ *    Whitespace is permitted between the types, but not inside the type
+ *    specification. The string "ii[4]&u16s" is equivalent to "i i[4] &u16 s",
+ *    but easier on the eye.
+ *
+ * types:
+ *    i = signed integer, 16-bit in Windows 3.x, else 32-bit in Win32 and Linux
+ *    u = unsigned integer, 16-bit in Windows 3.x, else 32-bit in Win32 and Linux
+ *    f = IEEE floating point, 32-bit
+ *    p = packed string
+ *    s = unpacked string
+ *    The difference between packed and unpacked strings is only relevant when
+ *    the parameter is passed by reference (see below).
+ *
+ * pass-by-value and pass-by-reference:
+ *    By default, parameters are passed by value. To pass a parameter by
+ *    reference, prefix the type letter with an "&":
+ *    &i = signed integer passed by reference
+ *    i = signed integer passed by value
+ *    Same for '&u' versus 'u' and '&f' versus 'f'.
+ *
+ *    Arrays are passed by "copy & copy-back". That is, libcall() allocates a
+ *    block of dynamic memory to copy the array into. On return from the foreign
+ *    function, libcall() copies the array back to the abstract machine. The
+ *    net effect is similar to pass by reference, but the foreign function does
+ *    not work in the AMX stack directly. During the copy and the copy-back
+ *    operations, libcall() may also transform the array elements, for example
+ *    between 16-bit and 32-bit elements. This is done because Pawn only
+ *    supports a single cell size, which may not fit the required integer size
+ *    of the foreign function.
+ *
+ *    See "element ranges" for the syntax of passing an array.
+ *
+ *    Strings may either be passed by copy, or by "copy & copy-back". When the
+ *    string is an output parameter (for the foreign function), the size of the
+ *    array that will hold the return string must be indicated between square
+ *    brackets behind the type letter (see "element ranges"). When the string
+ *    is "input only", this is not needed --libcall() will determine the length
+ *    of the input string itself.
+ *
+ *    The tokens 'p' and 's' are equivalent, but 'p[10]' and 's[10]' are not
+ *    equivalent: the latter syntaxes determine whether the output from the
+ *    foreign function will be stored as a packed or an unpacked string.
+ *
+ * element sizes:
+ *    Add an integer behind the type letter; for example, 'i16' refers to a
+ *    16-bit signed integer. Note that the value behind the type letter must
+ *    be either 8, 16 or 32.
+ *
+ *    You should only use element size specifiers on the 'i' and 'u' types. That
+ *    is, do not use these specifiers on 'f', 's' and 'p'.
+ *
+ * element ranges:
+ *    For passing arrays, the size of the array may be given behind the type
+ *    letter and optional element size. The token 'u[4]' indicates an array of
+ *    four unsigned integers, which are typically 32-bit. The token 'i16[8]'
+ *    is an array of 8 signed 16-bit integers. Arrays are always passed by
+ *    "copy & copy-back"
+ *
+ * When compiled as Unicode, this library converts all strings to Unicode
+ * strings.
+ *
+ * The calling convention for the foreign functions is assumed:
+ * -  "__stdcall" for Win32,
+ * -  "far pascal" for Win16
+ * -  and the GCC default for Unix/Linux (_cdecl)
+ *
+ * C++ name mangling of the called function is not handled (there is no standard
+ * convention for name mangling, so there is no portable way to convert C++
+ * function names to mangled names). Win32 name mangling (used by default by
+ * Microsoft compilers on functions declared as __stdcall) is also not handled.
+ *
+ * Returns the value of the called function.
+ */
+static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
+{
+  const TCHAR *typestring;
+  LIBPLAN plan;
+
+  if (!findfunc(amx, params[1], params[2], &plan))
+    return amx_RaiseError(amx, AMX_ERR_NATIVE);
+  amx_StrParam(amx, params[3], typestring);
+  if (!makeplan(&plan, typestring))
+    return amx_RaiseError(amx, AMX_ERR_NATIVE);
+  return runplan(amx, &plan, params, 4);
+}
+
+/* LibCall: libprepare(const libname[], const funcname[], const typestring[])
+ * Loads the library, looks up the function and decodes the type string (see
+ * libcall()) only once. Returns a handle for libinvoke(), or 0 on failure.
+ * The handle stays valid until the library is freed with libfree().
+ */
+static cell AMX_NATIVE_CALL n_libprepare(AMX *amx, const cell *params)
+{
+  PROCINFO *info=getprocinfo(amx);
+  const TCHAR *typestring;
+  LIBPLAN *plan, **plans;
+  int idx;
+
+  if (info == NULL || (plan = (LIBPLAN*)malloc(sizeof(LIBPLAN))) == NULL)
+    return 0;
+  amx_StrParam(amx, params[3], typestring);
+  if (!findfunc(amx, params[1], params[2], plan) || !makeplan(plan, typestring)) {
+    free(plan);
+    return 0;
+  } /* if */
+  for (idx = 0; idx < info->numplans && info->plans[idx] != NULL; idx++)
+    /* nothing */;
+  if (idx == info->numplans) {
+    plans = (LIBPLAN**)realloc(info->plans, (info->numplans + 8) * sizeof(LIBPLAN*));
+    if (plans == NULL) {
+      free(plan);
+      return 0;
+    } /* if */
+    memset(plans + info->numplans, 0, 8 * sizeof(LIBPLAN*));
+    info->plans = plans;
+    info->numplans += 8;
+  } /* if */
+  info->plans[idx] = plan;
+  return idx + 1;
+}
+
+/* libinvoke(LibCall: handle, ...)
+ * Calls the function of a handle from libprepare(), with the parameters that
+ * follow the handle. Returns the value of the called function.
+ */
+static cell AMX_NATIVE_CALL n_libinvoke(AMX *amx, const cell *params)
+{
+  PROCINFO *info=getprocinfo(amx);
+  cell handle=params[1];
+
+  if (info == NULL || handle <= 0 || handle > info->numplans || info->plans[handle-1] == NULL)
+    return amx_RaiseError(amx, AMX_ERR_NATIVE);
+  return runplan(amx, info->plans[handle-1], params, 2);
+}
+
+/* freeplans() drops the prepared calls into a library (or into all
+ * libraries, if the name is NULL)
+ */
+static void freeplans(PROCINFO *info, const TCHAR *name)
+{
+  const TCHAR *ptr = (name != NULL) ? skippath(name) : NULL;
+  int idx;
+
+  for (idx = 0; idx < info->numplans; idx++) {
+    if (info->plans[idx] != NULL && (ptr == NULL || _tcscmp(info->plans[idx]->lib->name, ptr) == 0)) {
+      free(info->plans[idx]);
+      info->plans[idx] = NULL;
+    } /* if */
+  } /* for */
+}
+
 /* bool: libfree(const libname[]="")
  * When the name is an empty string, this function frees all libraries (for this
  * abstract machine). The name comparison is case sensitive.
@@ -647,78 +856,192 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
  */
 static cell AMX_NATIVE_CALL n_libfree(AMX *amx, const cell *params)
 {
+  PROCINFO *info=getprocinfo(amx);
   const TCHAR *libname;
   amx_StrParam(amx,params[1],libname);
+  if (info != NULL)
+    freeplans(info, libname);
   return freelib(&ModRoot,amx,libname) > 0;
 }
 
-static void closepipe(void)
+/* findchild() returns the slot of a child; a zero "pid" refers to the child
+ * that was started last
+ */
+static int findchild(PROCINFO *info,cell pid)
+{
+  int idx;
+
+  if (info==NULL)
+    return -1;
+  if (pid==0)
+    pid=info->current;
+  for (idx=0; idx<PROC_CHILDREN; idx++)
+    if (info->children[idx]!=NULL && info->children[idx]->pid==pid && !info->children[idx]->closed)
+      return idx;
+  return -1;
+}
+
+static void closestdin(CHILD *child)
 {
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
-    if (newstdin!=NULL) {
-      CloseHandle(newstdin);
-      newstdin=NULL;
-    } /* if */
-    if (newstdout!=NULL) {
-      CloseHandle(newstdout);
-      newstdout=NULL;
-    } /* if */
-    if (read_stdout!=NULL) {
-      CloseHandle(read_stdout);
-      read_stdout=NULL;
-    } /* if */
-    if (write_stdin!=NULL) {
-      CloseHandle(write_stdin);
-      write_stdin=NULL;
+    if (child->write_stdin!=NULL) {
+      CloseHandle(child->write_stdin);
+      child->write_stdin=NULL;
     } /* if */
   #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-    if (pipe_to[0]>=0) {
-      close(pipe_to[0]);
-      pipe_to[0]=-1;
+    if (child->fd_in>=0) {
+      close(child->fd_in);
+      child->fd_in=-1;
     } /* if */
-    if (pipe_to[1]>=0) {
-      close(pipe_to[1]);
-      pipe_to[1]=-1;
+  #endif
+}
+
+static void closepipe(CHILD *child)
+{
+  closestdin(child);
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    if (child->read_stdout!=NULL) {
+      CloseHandle(child->read_stdout);
+      child->read_stdout=NULL;
     } /* if */
-    if (pipe_from[0]>=0) {
-      close(pipe_from[0]);
-      pipe_from[0]=-1;
+  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    if (child->fd_out>=0) {
+      close(child->fd_out);
+      child->fd_out=-1;
     } /* if */
-    if (pipe_from[1]>=0) {
-      close(pipe_from[1]);
-      pipe_from[1]=-1;
+  #endif
+  child->eof=1;
+}
+
+/* freechild() closes the pipes of a child and releases its slot; the child
+ * itself keeps running (a child that has already stopped is reaped)
+ */
+static void freechild(PROCINFO *info,int idx)
+{
+  CHILD *child=info->children[idx];
+
+  assert(child!=NULL);
+  closepipe(child);
+  if (child->busy) {
+    child->closed=1;            /* the idle function frees it */
+    return;
+  } /* if */
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    if (child->process!=NULL)
+      CloseHandle(child->process);
+  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    if (!child->exited)
+      waitpid((pid_t)child->pid,NULL,WNOHANG);
+  #endif
+  free(child);
+  info->children[idx]=NULL;
+}
+
+/* readchild() reads the output of a child that is waiting in its pipe, up to
+ * "size" bytes; when "wait" is set, it blocks until there is output
+ * Returns the number of bytes read, 0 at the end of the output, or -1 if no
+ * output is waiting.
+ */
+static int readchild(CHILD *child,void *buffer,int size,int wait)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    DWORD avail,num;
+
+    if (child->read_stdout==NULL)
+      return 0;
+    if (!wait) {
+      if (!PeekNamedPipe(child->read_stdout,NULL,0,NULL,&avail,NULL))
+        return 0;               /* pipe is broken, the child has gone */
+      if (avail==0)
+        return -1;
+      if ((DWORD)size>avail)
+        size=(int)avail;
     } /* if */
+    if (!ReadFile(child->read_stdout,buffer,(DWORD)size,&num,NULL))
+      return 0;
+    return (int)num;
+  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    struct pollfd pfd;
+    ssize_t num;
+
+    if (child->fd_out<0)
+      return 0;
+    for ( ;; ) {
+      if ((num=read(child->fd_out,buffer,(size_t)size))>=0)
+        return (int)num;
+      if (errno!=EINTR && errno!=EAGAIN && errno!=EWOULDBLOCK)
+        return 0;               /* handle errors as the end of the output */
+      if (errno!=EINTR) {
+        if (!wait)
+          return -1;
+        pfd.fd=child->fd_out;
+        pfd.events=POLLIN;
+        poll(&pfd,1,-1);
+      } /* if */
+    } /* for */
+  #else
+    return 0;
   #endif
 }
 
-/* PID: procexec(const commandline[])
- * Executes a program. Returns an "id" representing the new process (or 0 on
- * failure).
+/* packbytes() turns the "size" bytes at the start of the array into a packed
+ * string, in place; the array must have room for the zero terminator
  */
-static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
+static void packbytes(cell *cptr,int size)
 {
-  TCHAR *pgmname;
+  unsigned char *bytes=(unsigned char*)cptr;
+  int cells=size/sizeof(cell)+1;
+  int i,j;
+  ucell c;
+
+  memset(bytes+size,0,cells*sizeof(cell)-size);
+  for (i=0; i<cells; i++, bytes+=sizeof(cell)) {
+    for (c=0, j=0; j<(int)sizeof(cell); j++)
+      c=(c<<8) | bytes[j];
+    cptr[i]=(cell)c;
+  } /* for */
+}
+
+#if defined __WIN32__ || defined _WIN32 || defined WIN32 || defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+/* startchild() runs a program with pipes to its stdin and stdout; the output
+ * goes to the public function with the given index, or it is buffered for
+ * procread() if the index is -1
+ */
+static cell startchild(AMX *amx,TCHAR *pgmname,int index,cell payload)
+{
+  PROCINFO *info=getprocinfo(amx);
+  CHILD *child;
+  int idx;
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    HANDLE newstdin=NULL,newstdout=NULL;
     BOOL IsWinNT;
     OSVERSIONINFO VerInfo;
     STARTUPINFO si;
     SECURITY_ATTRIBUTES sa;
     SECURITY_DESCRIPTOR sd;
     PROCESS_INFORMATION pi;
-  #elif defined _Windows
-    HINSTANCE hinst;
-  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-  	pid_t pid;
+  #else
+    int pipe_to[2]={-1,-1};
+    int pipe_from[2]={-1,-1};
+    pid_t pid;
   #endif
 
-  amx_StrParam(amx,params[1],pgmname);
+  if (info==NULL || pgmname==NULL)
+    return 0;
+  for (idx=0; idx<PROC_CHILDREN && info->children[idx]!=NULL; idx++)
+    /* nothing */;
+  if (idx>=PROC_CHILDREN)
+    return 0;                   /* too many child processes */
+  if ((child=(CHILD*)malloc(sizeof(CHILD)))==NULL)
+    return 0;
+  memset(child,0,sizeof(CHILD));
+  child->index=index;
+  child->payload=payload;
 
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
     /* most of this code comes from a "Borland Network" article, combined
      * with some knowledge gained from a CodeProject article
      */
-    closepipe();
-
     VerInfo.dwOSVersionInfoSize=sizeof(OSVERSIONINFO);
     GetVersionEx(&VerInfo);
     IsWinNT = VerInfo.dwPlatformId==VER_PLATFORM_WIN32_NT;
@@ -733,15 +1056,24 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
     sa.nLength = sizeof(SECURITY_ATTRIBUTES);
     sa.bInheritHandle = TRUE;         //allow inheritable handles
 
-    if (!CreatePipe(&newstdin,&write_stdin,&sa,0)) { //create stdin pipe
+    if (!CreatePipe(&newstdin,&child->write_stdin,&sa,0)) { //create stdin pipe
+      free(child);
       amx_RaiseError(amx, AMX_ERR_NATIVE);
       return 0;
     } /* if */
-    if (!CreatePipe(&read_stdout,&newstdout,&sa,0)) { //create stdout pipe
-      closepipe();
+    if (!CreatePipe(&child->read_stdout,&newstdout,&sa,0)) { //create stdout pipe
+      CloseHandle(newstdin);
+      closepipe(child);
+      free(child);
       amx_RaiseError(amx, AMX_ERR_NATIVE);
       return 0;
     } /* if */
+    /* the child must not inherit the ends of the pipes that this process
+     * keeps, or it would hold its own pipes (and those of the other children)
+     * open
+     */
+    SetHandleInformation(child->write_stdin,HANDLE_FLAG_INHERIT,0);
+    SetHandleInformation(child->read_stdout,HANDLE_FLAG_INHERIT,0);
 
     GetStartupInfo(&si);      //set startupinfo for the spawned process
     si.dwFlags = STARTF_USESTDHANDLES|STARTF_USESHOWWINDOW;
@@ -752,30 +1084,45 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
 
     /* spawn the child process */
     if (!CreateProcess(NULL,(TCHAR*)pgmname,NULL,NULL,TRUE,CREATE_NEW_CONSOLE,NULL,NULL,&si,&pi)) {
-      closepipe();
+      CloseHandle(newstdin);
+      CloseHandle(newstdout);
+      closepipe(child);
+      free(child);
       return 0;
     } /* if */
+    CloseHandle(newstdin);        //the child has its own copies now
+    CloseHandle(newstdout);
     CloseHandle(pi.hThread);
-    CloseHandle(pi.hProcess);
-    Sleep(100);
-    return pi.dwProcessId;
-  #elif defined _Windows
-    hinst=WinExec(pgmname,SW_SHOW);
-    if (hinst<=32)
-      hinst=0;
-    return (cell)hinst;
-  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-    /* set up communication pipes first */
-    closepipe();
+    child->process=pi.hProcess;
+    child->pid=pi.dwProcessId;
+  #else
+    /* set up communication pipes first; none of the pipes is passed on to
+     * other programs that this process starts (the child gets its ends of the
+     * pipes as stdin and stdout, which dup2() leaves open)
+     */
     if (pipe(pipe_to)!=0 || pipe(pipe_from)!=0) {
-      closepipe();
+      if (pipe_to[0]>=0) {
+        close(pipe_to[0]);
+        close(pipe_to[1]);
+      } /* if */
+      free(child);
       amx_RaiseError(amx, AMX_ERR_NATIVE);
       return 0;
     } /* if */
+    for (idx=0; idx<2; idx++) {
+      fcntl(pipe_to[idx],F_SETFD,FD_CLOEXEC);
+      fcntl(pipe_from[idx],F_SETFD,FD_CLOEXEC);
+    } /* for */
+    fcntl(pipe_from[0],F_SETFL,fcntl(pipe_from[0],F_GETFL) | O_NONBLOCK);
+    child->fd_in=pipe_to[1];
+    child->fd_out=pipe_from[0];
 
     /* attempt to fork */
     if ((pid=fork())<0) {
-      closepipe();
+      close(pipe_to[0]);
+      close(pipe_from[1]);
+      closepipe(child);
+      free(child);
       amx_RaiseError(amx, AMX_ERR_NATIVE);
       return 0;
     } /* if */
@@ -787,14 +1134,6 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
       int i;
       dup2(pipe_to[0],STDIN_FILENO);    /* replace stdin with the in side of the pipe */
       dup2(pipe_from[1],STDOUT_FILENO); /* replace stdout with the out side of the pipe */
-      close(pipe_to[0]);                /* the pipes are no longer needed */
-      close(pipe_to[1]);
-      close(pipe_from[0]);
-      close(pipe_from[1]);
-      pipe_to[0]=-1;
-      pipe_to[1]=-1;
-      pipe_from[0]=-1;
-      pipe_from[1]=-1;
       /* split off the option(s) */
       assert(MAX_ARGS>=2);              /* args[0] is reserved */
       memset(args,0,MAX_ARGS*sizeof(TCHAR*));
@@ -806,104 +1145,361 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
         } /* if */
       } /* for */
       /* replace the child fork with a new process */
-      if(execvp(pgmname,args)<0)
-        return 0;
-    } else {
-      close(pipe_to[0]);                /* close unused pipes */
-      close(pipe_from[1]);
-      pipe_to[0]=-1;
-      pipe_from[1]=-1;
+      execvp(pgmname,args);
+      _exit(127);                       /* the program could not be started */
     } /* if */
-    return pid;
+    close(pipe_to[0]);                  /* close the ends of the child */
+    close(pipe_from[1]);
+    child->pid=(cell)pid;
+  #endif
+
+  for (idx=0; info->children[idx]!=NULL; idx++)
+    /* nothing */;
+  info->children[idx]=child;
+  info->current=child->pid;
+  return child->pid;
+}
+#endif
+
+/* PID: procexec(const commandline[])
+ * Executes a program. Returns an "id" representing the new process (or 0 on
+ * failure). The output of the program is read with procread().
+ */
+static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
+{
+  TCHAR *pgmname;
+  #if defined _Windows && !(defined __WIN32__ || defined _WIN32 || defined WIN32)
+    HINSTANCE hinst;
+  #endif
+
+  amx_StrParam(amx,params[1],pgmname);
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32 || defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    return startchild(amx,pgmname,-1,0);
+  #elif defined _Windows
+    hinst=WinExec(pgmname,SW_SHOW);
+    if (hinst<=32)
+      hinst=0;
+    return (cell)hinst;
   #else
     return (system(pgmname)==0);
   #endif
 }
 
-/* bool: procwrite(const line[], bool:appendlf=false)
+/* PID: procstart(const commandline[], const function[], payload=0)
+ * Executes a program and passes its output to a public function, from the
+ * idle function of this module. The public function has the signature:
+ *    public function(PID: pid, const data[], size, payload)
+ * where "data" is a packed string of "size" bytes. At the end of the output,
+ * the function is called with a "size" of zero.
+ */
+static cell AMX_NATIVE_CALL n_procstart(AMX *amx, const cell *params)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32 || defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    TCHAR *pgmname;
+    char *funcname;
+    int index;
+
+    amx_StrParam(amx,params[1],pgmname);
+    amx_StrParam(amx,params[2],funcname);
+    if (funcname==NULL || amx_FindPublic(amx,funcname,&index)!=AMX_ERR_NONE)
+      return 0;
+    return startchild(amx,pgmname,index,params[3]);
+  #else
+    (void)amx;
+    (void)params;
+    return 0;
+  #endif
+}
+
+/* bool: procwrite(const line[], bool:appendlf=false, PID:pid=PID:0)
  */
 static cell AMX_NATIVE_CALL n_procwrite(AMX *amx, const cell *params)
 {
   const TCHAR *line;
-  unsigned long num;
+  int idx;
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    CHILD *child;
+    unsigned long num;
+  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    CHILD *child;
+  #endif
 
+  idx=findchild(getprocinfo(amx),(params[0]>=(cell)(3*sizeof(cell))) ? params[3] : 0);
+  if (idx<0)
+    return 0;
   amx_StrParam(amx,params[1],line);
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
-    if (write_stdin==NULL)
+    child=getprocinfo(amx)->children[idx];
+    if (child->write_stdin==NULL)
       return 0;
-    WriteFile(write_stdin,line,_tcslen(line),&num,NULL); //send it to stdin
+    if (line!=NULL)
+      WriteFile(child->write_stdin,line,_tcslen(line),&num,NULL); //send it to stdin
     if (params[2])
-      WriteFile(write_stdin,__T("\n"),1,&num,NULL);
+      WriteFile(child->write_stdin,__T("\n"),1,&num,NULL);
   #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-    if (pipe_to[1]<0)
+    child=getprocinfo(amx)->children[idx];
+    if (child->fd_in<0)
       return 0;
-    write(pipe_to[1],line,_tcslen(line));
+    if (line!=NULL)
+      write(child->fd_in,line,_tcslen(line));
     if (params[2])
-      write(pipe_to[1],__T("\n"),1);
+      write(child->fd_in,__T("\n"),1);
+  #else
+    (void)line;
   #endif
   return 1;
 }
 
-/* bool: procread(line[], size=sizeof line, bool:striplf=false, bool:packed=false)
+/* bool: procread(line[], size=sizeof line, bool:striplf=false, bool:packed=false, PID:pid=PID:0)
+ * Reads a line from the output of the child process (it blocks until a full
+ * line is available, or until the end of the output). Returns false at the
+ * end of the output, and for a child whose output goes to a public function.
  */
 static cell AMX_NATIVE_CALL n_procread(AMX *amx, const cell *params)
 {
-  TCHAR line[128];
+  PROCINFO *info=getprocinfo(amx);
+  CHILD *child;
+  char line[PROC_BUFSIZE+1];
+  unsigned char *ptr;
   cell *cptr;
-  unsigned long num;
-  int index;
+  int idx,max,length,num;
 
-  index=0;
-  #if defined __WIN32__ || defined _WIN32 || defined WIN32
-    if (read_stdout==NULL)
-      return 0;
-    do {
-      if (!ReadFile(read_stdout,line+index,1,&num,NULL))
-        break;
-      index++;
-    } while (index<sizeof(line)/sizeof(line[0])-1 && line[index-1]!=__T('\n'));
-  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-    if (pipe_from[0]<0)
-      return 0;
-    do {
-      if (read(pipe_from[0],line+index,1)<0)
-        break;
-      index++;
-    } while (index<sizeof(line)/sizeof(line[0])-1 && line[index-1]!=__T('\n'));
-  #endif
+  idx=findchild(info,(params[0]>=(cell)(5*sizeof(cell))) ? params[5] : 0);
+  if (idx<0 || info->children[idx]->index>=0 || params[2]<=0)
+    return 0;
+  child=info->children[idx];
+  max=(int)(params[4] ? params[2]*(cell)sizeof(cell) : params[2]) - 1;
+  if (max>PROC_BUFSIZE)
+    max=PROC_BUFSIZE;
+
+  /* fill the buffer until it holds a complete line */
+  for ( ;; ) {
+    length=(child->length<max) ? child->length : max;
+    ptr=(unsigned char*)memchr(child->data+child->start,'\n',length);
+    if (ptr!=NULL || child->length>=max || child->eof)
+      break;
+    if (child->start>0) {
+      memmove(child->data,child->data+child->start,child->length);
+      child->start=0;
+    } /* if */
+    num=readchild(child,child->data+child->length,PROC_BUFSIZE-child->length,1);
+    if (num<=0)
+      child->eof=1;
+    else
+      child->length+=num;
+  } /* for */
+  if (child->length==0)
+    return 0;                   /* end of the output */
+  if (ptr!=NULL)
+    length=(int)(ptr-(child->data+child->start))+1;
+  memcpy(line,child->data+child->start,length);
+  child->start+=length;
+  child->length-=length;
+  if (child->length==0)
+    child->start=0;
 
   if (params[3])
-    while (index>0 && (line[index-1]==__T('\r') || line[index-1]==__T('\n')))
-      index--;
-  line[index]=__T('\0');
+    while (length>0 && (line[length-1]=='\r' || line[length-1]=='\n'))
+      length--;
+  line[length]='\0';
 
   amx_GetAddr(amx,params[1],&cptr);
-  amx_SetString(cptr,line,params[4],sizeof(TCHAR)>1,params[2]);
+  amx_SetString(cptr,line,params[4],0,params[2]);
+  return 1;
+}
+
+/* bool: procbuffer(PID:pid, buffer[], size=sizeof buffer)
+ * Sets a global array for the output of a child that was started with a
+ * public function: the output is then read directly into this array, and
+ * the array is passed to the public function. The array must not be a local
+ * variable.
+ */
+static cell AMX_NATIVE_CALL n_procbuffer(AMX *amx, const cell *params)
+{
+  PROCINFO *info=getprocinfo(amx);
+  cell *cptr;
+  int idx;
+
+  idx=findchild(info,params[1]);
+  if (idx<0 || info->children[idx]->index<0 || params[3]<2)
+    return 0;
+  /* the array must lie in the global data, below the heap */
+  if (amx_GetAddr(amx,params[2],&cptr)!=AMX_ERR_NONE
+      || params[2]<0 || params[2]+params[3]*(cell)sizeof(cell)>amx->hlw)
+    return 0;
+  info->children[idx]->buffer=params[2];
+  info->children[idx]->bufsize=params[3];
   return 1;
 }
 
 /* procwait(PID:pid)
- * Waits until the process has terminated.
+ * Closes the input of the process and waits until the process has terminated.
+ * Returns the exit code of the process.
  */
 static cell AMX_NATIVE_CALL n_procwait(AMX *amx, const cell *params)
 {
+  PROCINFO *info=getprocinfo(amx);
+  CHILD *child;
+  int idx;
+  cell exitcode=0;
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
     HANDLE hProcess;
-    DWORD exitcode;
+    DWORD code;
+  #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    int status;
   #endif
 
-  (void)amx;
+  idx=findchild(info,params[1]);
+  child=(idx>=0) ? info->children[idx] : NULL;
+  if (child!=NULL) {
+    closestdin(child);
+    if (child->exited)
+      return 0;
+  } else if (params[1]<=0) {
+    return 0;                   /* no process started last, or not a single process */
+  } /* if */
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
-    hProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, (DWORD)params[1]);
-    if (hProcess != NULL) {
-      while (GetExitCodeProcess(hProcess,&exitcode) && exitcode==STILL_ACTIVE)
-        Sleep(100);
-      CloseHandle(hProcess);
+    if (child!=NULL) {
+      hProcess=child->process;
+    } else {
+      hProcess=OpenProcess(PROCESS_QUERY_INFORMATION|SYNCHRONIZE,FALSE,(DWORD)params[1]);
+      if (hProcess==NULL)
+        return 0;
     } /* if */
+    WaitForSingleObject(hProcess,INFINITE);
+    if (GetExitCodeProcess(hProcess,&code))
+      exitcode=(cell)code;
+    if (child==NULL)
+      CloseHandle(hProcess);
   #elif defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
-    waitpid((pid_t)params[1],NULL,WNOHANG);
+    while (waitpid((child!=NULL) ? (pid_t)child->pid : (pid_t)params[1],&status,0)<0)
+      if (errno!=EINTR)
+        return 0;
+    if (WIFEXITED(status))
+      exitcode=WEXITSTATUS(status);
+  #endif
+  if (child!=NULL) {
+    child->exited=1;
+    /* release the child once all of its output has been read */
+    if (child->eof && child->length==0)
+      freechild(info,idx);
+  } /* if */
+  return exitcode;
+}
+
+/* bool: procclose(PID:pid)
+ * Closes the pipes to a child process (the process itself keeps running).
+ */
+static cell AMX_NATIVE_CALL n_procclose(AMX *amx, const cell *params)
+{
+  PROCINFO *info=getprocinfo(amx);
+  int idx;
+
+  if ((idx=findchild(info,params[1]))<0)
+    return 0;
+  freechild(info,idx);
+  return 1;
+}
+
+/* readoutput() passes the output that is waiting for a child to its public
+ * function, in chunks; it stops after PROC_ROUNDS chunks (the remainder is
+ * handled on the next idle call)
+ */
+static int readoutput(AMX *amx, int AMXAPI Exec(AMX *, cell *, int), PROCINFO *info, int idx)
+{
+  CHILD *child=info->children[idx];
+  cell amx_addr,*cptr;
+  int round,num,zerocopy;
+  int err=AMX_ERR_NONE;
+
+  for (round=0; round<PROC_ROUNDS && err==AMX_ERR_NONE && !child->eof; round++) {
+    zerocopy=(child->bufsize>0 && amx_GetAddr(amx,child->buffer,&cptr)==AMX_ERR_NONE);
+    if (zerocopy)
+      num=readchild(child,cptr,(int)((child->bufsize-1)*sizeof(cell)),0);
+    else
+      num=readchild(child,child->data,PROC_BUFSIZE,0);
+    if (num<0)
+      break;                    /* nothing more waiting */
+    if (num==0)
+      child->eof=1;
+    if (zerocopy) {
+      amx_addr=child->buffer;
+    } else {
+      if ((err=amx_Allot(amx,num/sizeof(cell)+1,&amx_addr,&cptr))!=AMX_ERR_NONE)
+        break;
+      memcpy(cptr,child->data,num);
+    } /* if */
+    packbytes(cptr,num);
+    amx_Push(amx,child->payload);
+    amx_Push(amx,num);
+    amx_Push(amx,amx_addr);
+    amx_Push(amx,child->pid);
+    child->busy=1;
+    err=Exec(amx,NULL,child->index);
+    while (err==AMX_ERR_SLEEP || err==AMX_ERR_BUDGET)
+      err=Exec(amx,NULL,AMX_EXEC_CONT);
+    child->busy=0;
+    if (!zerocopy)
+      amx_Release(amx,amx_addr);
+    if (child->closed)
+      break;
+  } /* for */
+
+  if (child->closed) {
+    freechild(info,idx);
+  } else if (child->eof && !child->exited) {
+    #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+      /* reap the child if it has stopped, so that its slot can be re-used */
+      if (waitpid((pid_t)child->pid,NULL,WNOHANG)==(pid_t)child->pid) {
+        child->exited=1;
+        freechild(info,idx);
+      } /* if */
+    #endif
+  } /* if */
+  return err;
+}
+
+static int AMXAPI amx_ProcessIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
+{
+  PROCINFO *info;
+  int idx;
+  int err=AMX_ERR_NONE;
+  #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    struct pollfd fds[PROC_CHILDREN];
+    int slots[PROC_CHILDREN];
+    int i,count;
   #endif
-  return 0;
+
+  info=getprocinfo(amx);
+  assert(info!=NULL);
+
+  if (info->PrevIdle!=NULL)
+    info->PrevIdle(amx,Exec);
+
+  #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__
+    /* wait (without blocking) on the pipes of all children with a function */
+    for (count=0, idx=0; idx<PROC_CHILDREN; idx++) {
+      CHILD *child=info->children[idx];
+      if (child!=NULL && child->index>=0 && !child->eof) {
+        fds[count].fd=child->fd_out;
+        fds[count].events=POLLIN;
+        fds[count].revents=0;
+        slots[count++]=idx;
+      } else if (child!=NULL && child->index>=0 && !child->exited) {
+        err=readoutput(amx,Exec,info,idx);  /* only reaps the child */
+      } /* if */
+    } /* for */
+    if (count>0 && poll(fds,count,0)>0)
+      for (i=0; i<count && err==AMX_ERR_NONE; i++)
+        if (fds[i].revents!=0 && info->children[slots[i]]!=NULL)
+          err=readoutput(amx,Exec,info,slots[i]);
+  #else
+    for (idx=0; idx<PROC_CHILDREN && err==AMX_ERR_NONE; idx++)
+      if (info->children[idx]!=NULL && info->children[idx]->index>=0 && !info->children[idx]->eof)
+        err=readoutput(amx,Exec,info,idx);
+  #endif
+
+  return err;
 }
 
 
@@ -913,21 +1509,54 @@ static cell AMX_NATIVE_CALL n_procwait(AMX *amx, const cell *params)
 AMX_NATIVE_INFO ffi_Natives[] = {
   { "libcall",   n_libcall },
   { "libfree",   n_libfree },
+  { "libprepare", n_libprepare },
+  { "libinvoke", n_libinvoke },
   { "procexec",  n_procexec },
+  { "procstart", n_procstart },
   { "procread",  n_procread },
   { "procwrite", n_procwrite },
+  { "procbuffer", n_procbuffer },
   { "procwait",  n_procwait },
+  { "procclose", n_procclose },
   { NULL, NULL }        /* terminator */
 };
 
 int AMXEXPORT amx_ProcessInit(AMX *amx)
 {
+  PROCINFO *info;
+  int err,index;
+
+  if ((info=(PROCINFO*)malloc(sizeof(PROCINFO)))==NULL)
+    return AMX_ERR_MEMORY;
+  memset(info,0,sizeof(PROCINFO));
+  if ((err=amx_SetUserData(amx,AMX_USERTAG('P','r','o','c'),info))!=AMX_ERR_NONE) {
+    free(info);
+    return err;
+  } /* if */
+  /* the output of procstart() is handled in the idle function */
+  if (amx_FindNative(amx,"procstart",&index)==AMX_ERR_NONE) {
+    if (amx_GetUserData(amx,AMX_USERTAG('I','d','l','e'),(void**)&info->PrevIdle)!=AMX_ERR_NONE)
+      info->PrevIdle=NULL;
+    amx_SetUserData(amx,AMX_USERTAG('I','d','l','e'),amx_ProcessIdle);
+  } /* if */
   return amx_Register(amx, ffi_Natives, -1);
 }
 
 int AMXEXPORT amx_ProcessCleanup(AMX *amx)
 {
+  PROCINFO *info=getprocinfo(amx);
+  int idx;
+
   freelib(&ModRoot, amx, NULL);
-  closepipe();
+  if (info!=NULL) {
+    for (idx=0; idx<PROC_CHILDREN; idx++)
+      if (info->children[idx]!=NULL)
+        freechild(info,idx);
+    freeplans(info,NULL);
+    if (info->plans!=NULL)
+      free(info->plans);
+    free(info);
+    amx_SetUserData(amx,AMX_USERTAG('P','r','o','c'),NULL);
+  } /* if */
   return AMX_ERR_NONE;
 }
@@ -0,0 +1,740 @@
+/*  Multi-threaded scheduler for running many Pawn Abstract Machines
+ *
+ *  The scheduler runs a pool of worker threads, each with its own queue of
+ *  runnable abstract machines. A worker takes tasks from the head of its own
+ *  queue (so that tasks that yield are run round-robin) and, when that runs
+ *  dry, steals from the tail of the queues of the other workers. An abstract
+ *  machine that exits with AMX_ERR_SLEEP is parked on a timer heap and
+ *  resumed (with AMX_EXEC_CONT) when its delay expires;
+ *  meanwhile its idle function (see amx_TimeInit() and amx_ConsoleInit()) is
+ *  polled, so timer and event callbacks keep running. If the host tells when
+ *  the idle function has work next (see sched_SetNext()), the idle function
+ *  runs at that time instead.
+ *
+ *  The sleep value is taken from the "pri" register, like in the pawnrun
+ *  example: a positive value is a delay in milliseconds, zero yields to the
+ *  other tasks, and a negative value waits for sched_Wake(). An abstract
+ *  machine that has an instruction budget (see amx_SetBudget()) also yields
+ *  when the budget runs out.
+ *
+ *  This software is provided "as-is", without any express or implied warranty.
+ *  In no event will the authors be held liable for any damages arising from
+ *  the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1.  The origin of this software must not be misrepresented; you must not
+ *      claim that you wrote the original software. If you use this software in
+ *      a product, an acknowledgment in the product documentation would be
+ *      appreciated but is not required.
+ *  2.  Altered source versions must be plainly marked as such, and must not be
+ *      misrepresented as being the original software.
+ *  3.  This notice may not be removed or altered from any source distribution.
+ */
+
+#include <assert.h>
+#include <stdlib.h>     /* for malloc()/free() */
+#include <string.h>     /* for memset() */
+#include "amx.h"
+#include "amxsched.h"
+
+#if defined __WIN32__ || defined _WIN32 || defined WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+  typedef CRITICAL_SECTION    MUTEX;
+  typedef CONDITION_VARIABLE  CONDVAR;
+  typedef HANDLE              THREAD;
+  #define mutex_init(m)       InitializeCriticalSection(m)
+  #define mutex_destroy(m)    DeleteCriticalSection(m)
+  #define mutex_lock(m)       EnterCriticalSection(m)
+  #define mutex_unlock(m)     LeaveCriticalSection(m)
+  #define cond_init(c)        InitializeConditionVariable(c)
+  #define cond_destroy(c)     ((void)(c))
+  #define cond_wait(c,m)      SleepConditionVariableCS((c),(m),INFINITE)
+  #define cond_timedwait(c,m,ms) SleepConditionVariableCS((c),(m),(DWORD)(ms))
+  #define cond_signal(c)      WakeConditionVariable(c)
+  #define cond_broadcast(c)   WakeAllConditionVariable(c)
+#else
+  #include <pthread.h>
+  #include <time.h>
+  #include <unistd.h>
+  typedef pthread_mutex_t     MUTEX;
+  typedef pthread_cond_t      CONDVAR;
+  typedef pthread_t           THREAD;
+  #define mutex_init(m)       pthread_mutex_init((m),NULL)
+  #define mutex_destroy(m)    pthread_mutex_destroy(m)
+  #define mutex_lock(m)       pthread_mutex_lock(m)
+  #define mutex_unlock(m)     pthread_mutex_unlock(m)
+  #define cond_destroy(c)     pthread_cond_destroy(c)
+  #define cond_wait(c,m)      pthread_cond_wait((c),(m))
+  #define cond_signal(c)      pthread_cond_signal(c)
+  #define cond_broadcast(c)   pthread_cond_broadcast(c)
+#endif
+
+#define QUEUE_INITIAL   16
+#define HEAP_INITIAL    16
+
+enum {
+  TASK_RUN,             /* runnable, resumes with amx_Exec() */
+  TASK_SLEEP,           /* on the timer heap, or waiting for sched_Wake() */
+  TASK_EVENT,           /* main() has returned, only the idle function runs */
+};
+
+typedef struct tagTASK {
+  struct tagTASK *next; /* in the list of all tasks */
+  AMX *amx;
+  AMX_IDLE idlefunc;    /* idle function (from the 'Idle' user data) */
+  SCHED_DONE done;
+  int index;            /* entry point, AMX_EXEC_CONT after the first run */
+  int state;
+  int busy;             /* being run by a worker */
+  int inqueue;          /* in one of the worker queues */
+  int woken;            /* sched_Wake() was called while busy or queued */
+  int heappos;          /* position in the timer heap, -1 if not on the heap */
+  int timeout;          /* whether "deadline" is valid for a sleeping task */
+  unsigned long deadline; /* time stamp at which a sleeping task resumes */
+  unsigned long wakeup; /* time stamp at which the worker picks it up */
+  double cputime;
+  cell retval;
+} TASK;
+
+typedef struct tagQUEUE {
+  MUTEX lock;
+  TASK **items;         /* circular buffer */
+  int size;
+  int head;
+  int count;
+} QUEUE;
+
+static struct {
+  int numthreads;
+  THREAD *threads;
+  QUEUE *queues;
+  MUTEX lock;           /* protects all fields below */
+  CONDVAR work;         /* signalled when a task is queued or put on the heap */
+  CONDVAR finished;     /* signalled when a task finishes */
+  TASK *tasks;          /* all tasks that have not finished */
+  TASK **heap;          /* sleeping tasks, ordered on "wakeup" */
+  int heapsize;
+  int heapcount;
+  int queued;           /* number of tasks in all queues together */
+  int pending;          /* number of tasks that have not finished */
+  SCHED_NEXT next;      /* when the idle function must run next, NULL to poll */
+  int nextqueue;        /* queue for the next task added from outside */
+  int quit;
+} Sched;
+
+static unsigned long gettimestamp(void)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    return GetTickCount();
+  #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (unsigned long)ts.tv_sec*1000UL + (unsigned long)(ts.tv_nsec/1000000L);
+  #endif
+}
+
+/* processor time of the calling thread, in seconds */
+static double getcputime(void)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    FILETIME creation,exit,kernel,user;
+    ULARGE_INTEGER k,u;
+    if (!GetThreadTimes(GetCurrentThread(),&creation,&exit,&kernel,&user))
+      return 0.0;
+    k.LowPart=kernel.dwLowDateTime;
+    k.HighPart=kernel.dwHighDateTime;
+    u.LowPart=user.dwLowDateTime;
+    u.HighPart=user.dwHighDateTime;
+    return (double)(k.QuadPart+u.QuadPart)/1.0e7;
+  #elif defined CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts)!=0)
+      return 0.0;
+    return (double)ts.tv_sec+(double)ts.tv_nsec/1.0e9;
+  #else
+    return (double)clock()/CLOCKS_PER_SEC;  /* process time, a rough estimate */
+  #endif
+}
+
+static int numprocessors(void)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+  #elif defined _SC_NPROCESSORS_ONLN
+    long n=sysconf(_SC_NPROCESSORS_ONLN);
+    return (n>0) ? (int)n : 1;
+  #else
+    return 1;
+  #endif
+}
+
+/* ----- worker queues ------------------------------------------------------ */
+
+static int queue_push(QUEUE *queue,TASK *task)
+{
+  mutex_lock(&queue->lock);
+  if (queue->count==queue->size) {
+    int newsize=(queue->size==0) ? QUEUE_INITIAL : 2*queue->size;
+    TASK **items=(TASK**)malloc(newsize*sizeof(TASK*));
+    int i;
+    if (items==NULL) {
+      mutex_unlock(&queue->lock);
+      return AMX_ERR_MEMORY;
+    } /* if */
+    for (i=0; i<queue->count; i++)
+      items[i]=queue->items[(queue->head+i) % queue->size];
+    if (queue->items!=NULL)
+      free(queue->items);
+    queue->items=items;
+    queue->size=newsize;
+    queue->head=0;
+  } /* if */
+  queue->items[(queue->head+queue->count) % queue->size]=task;
+  queue->count++;
+  mutex_unlock(&queue->lock);
+  return AMX_ERR_NONE;
+}
+
+/* the owner of the queue pops from the head (least recently queued task) */
+static TASK *queue_pop(QUEUE *queue)
+{
+  TASK *task=NULL;
+  mutex_lock(&queue->lock);
+  if (queue->count>0) {
+    task=queue->items[queue->head];
+    queue->head=(queue->head+1) % queue->size;
+    queue->count--;
+  } /* if */
+  mutex_unlock(&queue->lock);
+  return task;
+}
+
+/* other workers steal from the tail (most recently queued task) */
+static TASK *queue_steal(QUEUE *queue)
+{
+  TASK *task=NULL;
+  mutex_lock(&queue->lock);
+  if (queue->count>0) {
+    queue->count--;
+    task=queue->items[(queue->head+queue->count) % queue->size];
+  } /* if */
+  mutex_unlock(&queue->lock);
+  return task;
+}
+
+/* ----- timer heap (Sched.lock must be held) ------------------------------- */
+
+static void heap_swap(int a,int b)
+{
+  TASK *t=Sched.heap[a];
+  Sched.heap[a]=Sched.heap[b];
+  Sched.heap[b]=t;
+  Sched.heap[a]->heappos=a;
+  Sched.heap[b]->heappos=b;
+}
+
+/* "wakeup" is compared with a wrap-around safe subtraction */
+#define EARLIER(a,b)    ((long)((a)->wakeup-(b)->wakeup)<0)
+
+static void heap_siftup(int pos)
+{
+  while (pos>0) {
+    int parent=(pos-1)/2;
+    if (!EARLIER(Sched.heap[pos],Sched.heap[parent]))
+      break;
+    heap_swap(pos,parent);
+    pos=parent;
+  } /* while */
+}
+
+static void heap_siftdown(int pos)
+{
+  for ( ;; ) {
+    int child=2*pos+1;
+    if (child>=Sched.heapcount)
+      break;
+    if (child+1<Sched.heapcount && EARLIER(Sched.heap[child+1],Sched.heap[child]))
+      child++;
+    if (!EARLIER(Sched.heap[child],Sched.heap[pos]))
+      break;
+    heap_swap(pos,child);
+    pos=child;
+  } /* for */
+}
+
+static int heap_insert(TASK *task)
+{
+  assert(task->heappos<0);
+  if (Sched.heapcount==Sched.heapsize) {
+    int newsize=(Sched.heapsize==0) ? HEAP_INITIAL : 2*Sched.heapsize;
+    TASK **heap=(TASK**)realloc(Sched.heap,newsize*sizeof(TASK*));
+    if (heap==NULL)
+      return AMX_ERR_MEMORY;
+    Sched.heap=heap;
+    Sched.heapsize=newsize;
+  } /* if */
+  task->heappos=Sched.heapcount;
+  Sched.heap[Sched.heapcount++]=task;
+  heap_siftup(task->heappos);
+  return AMX_ERR_NONE;
+}
+
+static void heap_remove(TASK *task)
+{
+  int pos=task->heappos;
+  assert(pos>=0 && pos<Sched.heapcount && Sched.heap[pos]==task);
+  Sched.heapcount--;
+  if (pos!=Sched.heapcount) {
+    heap_swap(pos,Sched.heapcount);
+    heap_siftdown(pos);
+    heap_siftup(pos);
+  } /* if */
+  task->heappos=-1;
+}
+
+/* ----- task management ---------------------------------------------------- */
+
+static TASK *gettask(AMX *amx)
+{
+  void *ptr;
+  if (amx_GetUserData(amx,AMX_USERTAG('S','c','h','d'),&ptr)!=AMX_ERR_NONE)
+    return NULL;
+  return (TASK*)ptr;
+}
+
+/* pushes the task on a worker queue and wakes up an idle worker; a "worker"
+ * of -1 selects the queues in turn
+ */
+static int task_queue(TASK *task,int worker)
+{
+  int err;
+
+  mutex_lock(&Sched.lock);
+  if (worker<0) {
+    worker=Sched.nextqueue;
+    Sched.nextqueue=(Sched.nextqueue+1) % Sched.numthreads;
+  } /* if */
+  task->state=TASK_RUN;
+  task->inqueue=1;
+  mutex_unlock(&Sched.lock);
+  if ((err=queue_push(&Sched.queues[worker],task))!=AMX_ERR_NONE)
+    return err;
+  mutex_lock(&Sched.lock);
+  Sched.queued++;
+  cond_signal(&Sched.work);
+  mutex_unlock(&Sched.lock);
+  return AMX_ERR_NONE;
+}
+
+/* puts the task on the timer heap; Sched.lock must be held */
+static int task_sleep(TASK *task,int state,unsigned long now)
+{
+  long idle=SCHED_IDLEINTERVAL;
+
+  task->state=state;
+  task->busy=0;
+  /* the idle function runs at the time that the "next" function gives (-1
+   * if it has nothing to do), or else it is polled
+   */
+  if (task->idlefunc!=NULL && Sched.next!=NULL
+      && Sched.next(task->amx,&idle)!=AMX_ERR_NONE)
+    idle=SCHED_IDLEINTERVAL;
+  if (state==TASK_SLEEP && task->timeout
+      && (task->idlefunc==NULL || idle<0 || (long)(task->deadline-now)<=idle))
+    task->wakeup=task->deadline;
+  else if (task->idlefunc!=NULL && idle>=0)
+    task->wakeup=now+(unsigned long)idle;
+  else
+    return AMX_ERR_NONE;  /* wait for sched_Wake() without polling */
+  cond_signal(&Sched.work);
+  return heap_insert(task);
+}
+
+/* moves tasks whose time has come from the heap to the worker's queue;
+ * Sched.lock must be held
+ */
+static void task_movedue(int worker)
+{
+  unsigned long now=gettimestamp();
+  while (Sched.heapcount>0 && (long)(Sched.heap[0]->wakeup-now)<=0) {
+    TASK *task=Sched.heap[0];
+    heap_remove(task);
+    if (queue_push(&Sched.queues[worker],task)==AMX_ERR_NONE) {
+      task->inqueue=1;
+      Sched.queued++;
+    } else {
+      task->wakeup=now+SCHED_IDLEINTERVAL;  /* try again later */
+      heap_insert(task);
+      break;
+    } /* if */
+  } /* while */
+}
+
+/* removes the task from the list and calls the "done" callback */
+static void task_finish(TASK *task,int error)
+{
+  TASK *cur;
+
+  mutex_lock(&Sched.lock);
+  if (task->heappos>=0)
+    heap_remove(task);
+  if (Sched.tasks==task) {
+    Sched.tasks=task->next;
+  } else {
+    for (cur=Sched.tasks; cur!=NULL && cur->next!=task; cur=cur->next)
+      /* nothing */;
+    if (cur!=NULL)
+      cur->next=task->next;
+  } /* if */
+  mutex_unlock(&Sched.lock);
+
+  if (task->done!=NULL)
+    task->done(task->amx,error,task->retval);
+  amx_SetUserData(task->amx,AMX_USERTAG('S','c','h','d'),NULL);
+  free(task);
+
+  mutex_lock(&Sched.lock);
+  Sched.pending--;
+  cond_broadcast(&Sched.finished);
+  mutex_unlock(&Sched.lock);
+}
+
+/* runs a single time slice of a task that was taken from a queue */
+static void task_run(TASK *task,int worker)
+{
+  AMX nested_amx;
+  unsigned long now;
+  double start;
+  cell sleepvalue;
+  int idle,err;
+
+  mutex_lock(&Sched.lock);
+  Sched.queued--;
+  task_movedue(worker);         /* so that sleepers are not starved */
+  now=gettimestamp();
+  task->inqueue=0;
+  task->busy=1;
+  if (task->woken && task->state==TASK_SLEEP) {
+    task->timeout=1;
+    task->deadline=now;
+  } /* if */
+  task->woken=0;
+  idle= task->state==TASK_EVENT
+        || (task->state==TASK_SLEEP && (!task->timeout || (long)(task->deadline-now)>0));
+  mutex_unlock(&Sched.lock);
+
+  start=getcputime();
+  if (idle) {
+    /* run the idle function on a copy of the abstract machine, so that the
+     * registers of the sleeping script are preserved
+     */
+    assert(task->idlefunc!=NULL);
+    nested_amx=*task->amx;
+    err=task->idlefunc(&nested_amx,amx_Exec);
+    mutex_lock(&Sched.lock);
+    task->cputime+=getcputime()-start;
+    if (err==AMX_ERR_NONE) {
+      now=gettimestamp();
+      if (task->woken && task->state==TASK_SLEEP) {
+        task->timeout=1;
+        task->deadline=now;
+      } /* if */
+      task->woken=0;
+      err=task_sleep(task,task->state,now);
+    } /* if */
+    mutex_unlock(&Sched.lock);
+    if (err!=AMX_ERR_NONE)
+      task_finish(task,err);
+    return;
+  } /* if */
+
+  err=amx_Exec(task->amx,&task->retval,task->index);
+  task->index=AMX_EXEC_CONT;
+  mutex_lock(&Sched.lock);
+  task->cputime+=getcputime()-start;
+  if (err==AMX_ERR_SLEEP) {
+    sleepvalue=task->amx->pri;
+    now=gettimestamp();
+    task->timeout=1;
+    if (sleepvalue>0)
+      task->deadline=now+(unsigned long)sleepvalue;
+    else if (sleepvalue<0 && !task->woken)
+      task->timeout=0;
+    else
+      task->deadline=now;
+    task->woken=0;
+    task->busy=0;
+    if (task->timeout && task->deadline==now) {
+      /* yield: go to the back of this worker's queue */
+      mutex_unlock(&Sched.lock);
+      err=task_queue(task,worker);
+    } else {
+      err=task_sleep(task,TASK_SLEEP,now);
+      mutex_unlock(&Sched.lock);
+    } /* if */
+  } else if (err==AMX_ERR_BUDGET) {
+    /* preempted (see amx_SetBudget()): go to the back of the queue */
+    task->busy=0;
+    mutex_unlock(&Sched.lock);
+    err=task_queue(task,worker);
+  } else if (err==AMX_ERR_NONE && task->idlefunc!=NULL) {
+    err=task_sleep(task,TASK_EVENT,gettimestamp());
+    mutex_unlock(&Sched.lock);
+  } else {
+    mutex_unlock(&Sched.lock);
+    task_finish(task,err);
+    return;
+  } /* if */
+  /* an error here means that the task was neither queued nor put on the heap */
+  if (err!=AMX_ERR_NONE)
+    task_finish(task,err);
+}
+
+#if defined __WIN32__ || defined _WIN32 || defined WIN32
+static DWORD WINAPI worker_main(LPVOID arg)
+#else
+static void *worker_main(void *arg)
+#endif
+{
+  int worker=(int)(intptr_t)arg;
+  TASK *task;
+  int i;
+
+  for ( ;; ) {
+    task=queue_pop(&Sched.queues[worker]);
+    for (i=1; task==NULL && i<Sched.numthreads; i++)
+      task=queue_steal(&Sched.queues[(worker+i) % Sched.numthreads]);
+    if (task!=NULL) {
+      task_run(task,worker);
+      continue;
+    } /* if */
+
+    mutex_lock(&Sched.lock);
+    if (Sched.quit) {
+      mutex_unlock(&Sched.lock);
+      break;
+    } /* if */
+    task_movedue(worker);
+    if (Sched.queued==0) {
+      if (Sched.heapcount>0) {
+        long delay=(long)(Sched.heap[0]->wakeup-gettimestamp());
+        if (delay>0) {
+          #if defined __WIN32__ || defined _WIN32 || defined WIN32
+            cond_timedwait(&Sched.work,&Sched.lock,delay);
+          #else
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME,&ts);
+            ts.tv_sec+=delay/1000;
+            ts.tv_nsec+=(delay%1000)*1000000L;
+            if (ts.tv_nsec>=1000000000L) {
+              ts.tv_sec++;
+              ts.tv_nsec-=1000000000L;
+            } /* if */
+            pthread_cond_timedwait(&Sched.work,&Sched.lock,&ts);
+          #endif
+        } /* if */
+      } else {
+        cond_wait(&Sched.work,&Sched.lock);
+      } /* if */
+    } /* if */
+    mutex_unlock(&Sched.lock);
+  } /* for */
+  return 0;
+}
+
+/* ----- public interface --------------------------------------------------- */
+
+int AMXAPI sched_Init(int numthreads)
+{
+  int i;
+
+  if (Sched.threads!=NULL)
+    return AMX_ERR_INIT;        /* already initialized */
+  if (numthreads<=0)
+    numthreads=numprocessors();
+  memset(&Sched,0,sizeof Sched);
+  Sched.threads=(THREAD*)malloc(numthreads*sizeof(THREAD));
+  Sched.queues=(QUEUE*)malloc(numthreads*sizeof(QUEUE));
+  if (Sched.threads==NULL || Sched.queues==NULL) {
+    if (Sched.threads!=NULL)
+      free(Sched.threads);
+    if (Sched.queues!=NULL)
+      free(Sched.queues);
+    Sched.threads=NULL;
+    return AMX_ERR_MEMORY;
+  } /* if */
+  memset(Sched.queues,0,numthreads*sizeof(QUEUE));
+  for (i=0; i<numthreads; i++)
+    mutex_init(&Sched.queues[i].lock);
+  mutex_init(&Sched.lock);
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    cond_init(&Sched.work);
+    cond_init(&Sched.finished);
+  #else
+    pthread_cond_init(&Sched.work,NULL);
+    pthread_cond_init(&Sched.finished,NULL);
+  #endif
+  Sched.numthreads=numthreads;
+
+  for (i=0; i<numthreads; i++) {
+    #if defined __WIN32__ || defined _WIN32 || defined WIN32
+      Sched.threads[i]=CreateThread(NULL,0,worker_main,(LPVOID)(intptr_t)i,0,NULL);
+      if (Sched.threads[i]==NULL)
+        break;
+    #else
+      if (pthread_create(&Sched.threads[i],NULL,worker_main,(void*)(intptr_t)i)!=0)
+        break;
+    #endif
+  } /* for */
+  if (i<numthreads) {
+    Sched.numthreads=i;         /* only stop the threads that were started */
+    sched_Cleanup();
+    return AMX_ERR_GENERAL;
+  } /* if */
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI sched_Cleanup(void)
+{
+  int i;
+
+  if (Sched.threads==NULL)
+    return AMX_ERR_INIT;
+  mutex_lock(&Sched.lock);
+  Sched.quit=1;
+  cond_broadcast(&Sched.work);
+  mutex_unlock(&Sched.lock);
+  for (i=0; i<Sched.numthreads; i++) {
+    #if defined __WIN32__ || defined _WIN32 || defined WIN32
+      WaitForSingleObject(Sched.threads[i],INFINITE);
+      CloseHandle(Sched.threads[i]);
+    #else
+      pthread_join(Sched.threads[i],NULL);
+    #endif
+  } /* for */
+
+  /* the workers are gone, so there is no more contention */
+  while (Sched.tasks!=NULL)
+    task_finish(Sched.tasks,AMX_ERR_EXIT);
+
+  for (i=0; i<Sched.numthreads; i++) {
+    if (Sched.queues[i].items!=NULL)
+      free(Sched.queues[i].items);
+    mutex_destroy(&Sched.queues[i].lock);
+  } /* for */
+  free(Sched.queues);
+  free(Sched.threads);
+  if (Sched.heap!=NULL)
+    free(Sched.heap);
+  cond_destroy(&Sched.work);
+  cond_destroy(&Sched.finished);
+  mutex_destroy(&Sched.lock);
+  memset(&Sched,0,sizeof Sched);
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI sched_Add(AMX *amx, int index, SCHED_DONE done)
+{
+  TASK *task;
+  void *ptr;
+  int err;
+
+  if (Sched.threads==NULL)
+    return AMX_ERR_INIT;
+  if (amx==NULL)
+    return AMX_ERR_PARAMS;
+  if (gettask(amx)!=NULL)
+    return AMX_ERR_PARAMS;      /* already scheduled */
+  if ((task=(TASK*)malloc(sizeof(TASK)))==NULL)
+    return AMX_ERR_MEMORY;
+  memset(task,0,sizeof(TASK));
+  task->amx=amx;
+  task->done=done;
+  task->index=index;
+  task->heappos=-1;
+  if (amx_GetUserData(amx,AMX_USERTAG('I','d','l','e'),&ptr)==AMX_ERR_NONE)
+    task->idlefunc=(AMX_IDLE)ptr;
+  if ((err=amx_SetUserData(amx,AMX_USERTAG('S','c','h','d'),task))!=AMX_ERR_NONE) {
+    free(task);
+    return err;
+  } /* if */
+
+  mutex_lock(&Sched.lock);
+  task->next=Sched.tasks;
+  Sched.tasks=task;
+  Sched.pending++;
+  mutex_unlock(&Sched.lock);
+  if ((err=task_queue(task,-1))!=AMX_ERR_NONE) {
+    task->done=NULL;            /* no callback, the error is returned instead */
+    task_finish(task,err);
+  } /* if */
+  return err;
+}
+
+int AMXAPI sched_Wake(AMX *amx)
+{
+  TASK *task=gettask(amx);
+  int push=0;
+
+  if (task==NULL)
+    return AMX_ERR_PARAMS;
+  mutex_lock(&Sched.lock);
+  if (task->busy || task->inqueue) {
+    task->woken=1;              /* handled by the worker that runs it next */
+  } else if (task->heappos>=0) {
+    /* sleeping with a time-out or polling the idle function: move the
+     * deadline forward and let a worker pick it up
+     */
+    task->timeout=1;
+    task->deadline=gettimestamp();
+    task->wakeup=task->deadline;
+    heap_siftup(task->heappos);
+    cond_signal(&Sched.work);
+  } else if (task->state==TASK_SLEEP || task->state==TASK_EVENT) {
+    task->inqueue=1;            /* so that a second sched_Wake() does not push it again */
+    push=1;
+  } /* if */
+  mutex_unlock(&Sched.lock);
+  if (push)
+    return task_queue(task,-1);
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI sched_SetNext(SCHED_NEXT next)
+{
+  if (Sched.threads==NULL)
+    return AMX_ERR_INIT;
+  mutex_lock(&Sched.lock);
+  Sched.next=next;
+  mutex_unlock(&Sched.lock);
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI sched_Wait(void)
+{
+  if (Sched.threads==NULL)
+    return AMX_ERR_INIT;
+  mutex_lock(&Sched.lock);
+  while (Sched.pending>0)
+    cond_wait(&Sched.finished,&Sched.lock);
+  mutex_unlock(&Sched.lock);
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI sched_CpuTime(AMX *amx, double *seconds)
+{
+  TASK *task=gettask(amx);
+
+  if (task==NULL || seconds==NULL)
+    return AMX_ERR_PARAMS;
+  mutex_lock(&Sched.lock);
+  *seconds=task->cputime;
+  mutex_unlock(&Sched.lock);
+  return AMX_ERR_NONE;
+}
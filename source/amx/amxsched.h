@@ -0,0 +1,83 @@
+/*  Multi-threaded scheduler for running many Pawn Abstract Machines
+ *
+ *  This software is provided "as-is", without any express or implied warranty.
+ *  In no event will the authors be held liable for any damages arising from
+ *  the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1.  The origin of this software must not be misrepresented; you must not
+ *      claim that you wrote the original software. If you use this software in
+ *      a product, an acknowledgment in the product documentation would be
+ *      appreciated but is not required.
+ *  2.  Altered source versions must be plainly marked as such, and must not be
+ *      misrepresented as being the original software.
+ *  3.  This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef AMXSCHED_H_INCLUDED
+#define AMXSCHED_H_INCLUDED
+
+#include "amx.h"
+
+#ifdef  __cplusplus
+extern  "C" {
+#endif
+
+/* interval (in milliseconds) at which the idle functions of sleeping and
+ * event-driven abstract machines are polled
+ */
+#if !defined SCHED_IDLEINTERVAL
+  #define SCHED_IDLEINTERVAL  10
+#endif
+
+/* called (on a worker thread) when an abstract machine has finished running */
+typedef void (AMXAPI *SCHED_DONE)(AMX *amx, int error, cell retval);
+
+/* stores in "milliseconds" the time until the idle function of the abstract
+ * machine has work to do (0 for now), or -1 if it has nothing to do until
+ * sched_Wake()
+ */
+typedef int (AMXAPI *SCHED_NEXT)(AMX *amx, long *milliseconds);
+
+int AMXAPI sched_Init(int numthreads);
+        /* Starts "numthreads" worker threads; when "numthreads" is zero, the
+         * number of processors is used.
+         */
+int AMXAPI sched_Cleanup(void);
+        /* Stops the worker threads. Abstract machines that have not finished
+         * get their "done" callback with AMX_ERR_EXIT.
+         */
+
+int AMXAPI sched_Add(AMX *amx, int index, SCHED_DONE done);
+        /* Queues the abstract machine to run from the entry point "index"
+         * (AMX_EXEC_MAIN or a public function index). The abstract machine
+         * must stay valid until its "done" callback returns.
+         */
+int AMXAPI sched_Wake(AMX *amx);
+        /* Resumes an abstract machine that went to sleep with a negative
+         * sleep value (a wait without time-out).
+         */
+int AMXAPI sched_SetNext(SCHED_NEXT next);
+        /* Sets the function that tells when the idle function of an abstract
+         * machine must run next; a sleeping or event-driven abstract machine
+         * then waits until that time, instead of polling its idle function
+         * every SCHED_IDLEINTERVAL milliseconds. The function is called with
+         * a lock held, and it must not call the scheduler.
+         */
+int AMXAPI sched_Wait(void);
+        /* Blocks until all abstract machines have finished. */
+
+int AMXAPI sched_CpuTime(AMX *amx, double *seconds);
+        /* Returns the processor time that was spent in the abstract machine,
+         * including its idle functions. The abstract machine is known to the
+         * scheduler until its "done" callback returns.
+         */
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* AMXSCHED_H_INCLUDED */
@@ -799,8 +799,13 @@ static cell AMX_NATIVE_CALL n_memcpy(AMX *amx,const cell *params)
 #if !defined AMX_NOSTRFMT
   static int str_putstr(void *dest,const TCHAR *str)
   {
-    if (_tcslen((TCHAR*)dest)+_tcslen(str)<MAX_FORMATSTR)
-      _tcscat((TCHAR*)dest,str);
+    size_t len=_tcslen((TCHAR*)dest);
+    size_t count=_tcslen(str);
+    /* copy the part that fits, as str_putchar() does for single characters */
+    if (len+count>=MAX_FORMATSTR)
+      count=MAX_FORMATSTR-1-len;
+    memcpy((TCHAR*)dest+len,str,count*sizeof(TCHAR));
+    ((TCHAR*)dest)[len+count]='\0';
     return 0;
   }
 
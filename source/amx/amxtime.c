@@ -23,7 +23,9 @@
 
 #include <time.h>
 #include <assert.h>
+#include <stdlib.h>     /* for malloc()/free() */
 #include "amx.h"
+#include "amxtime.h"
 #if defined __WIN32__ || defined _WIN32
   #include <windows.h>
   #include <mmsystem.h>
@@ -45,9 +47,64 @@
 #else
   #define INIT_TIMER()
 #endif
-static unsigned long timestamp;
-static unsigned long timelimit;
-static int timerepeat;
+
+/* The timers are kept in a hierarchical timing wheel with a resolution of one
+ * millisecond: the lowest level has a slot for each of the next 256 ticks and
+ * each higher level has 64 slots that each span all slots of the level below
+ * it. A timer is added to (or removed from) a slot in constant time; when the
+ * lowest level wraps around, the next slot of the level above it is emptied
+ * and its timers are spread out over the lower levels ("cascading").
+ */
+#define WHEEL_BITS0     8
+#define WHEEL_BITS      6
+#define WHEEL_LEVELS    5       /* 8 + 4*6 = 32 bits of milliseconds */
+#define WHEEL_SIZE0     (1 << WHEEL_BITS0)
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_SLOTS     (WHEEL_SIZE0 + (WHEEL_LEVELS-1)*WHEEL_SIZE)
+#define DUE_LIST        WHEEL_SLOTS     /* timers that fire in the current idle call */
+
+#define TIMER_INDEXBITS 20      /* timer id = serial number + index (+1) */
+#define TIMER_SERIALMASK 0x3ff  /* keeps the id positive in a 32-bit cell */
+#define TIMER_MAXDELAY  0x7fffffffL
+
+typedef struct tagTIMER {
+  int next,prev;        /* circular list of the timers in a slot (or free list) */
+  int list;             /* slot that the timer is in, -1 if the timer is free */
+  int index;            /* public function to call */
+  int noargs;           /* the @timer() callback of settimer() has no parameters */
+  int repeat;
+  unsigned long period;
+  unsigned long expires;
+  cell payload;
+  cell id;
+} TIMER;
+
+/* the timer state is kept per abstract machine (in its user data), so that
+ * multiple abstract machines may run concurrently
+ */
+typedef struct tagTIMERINFO {
+  TIMER *timers;
+  int size;             /* number of entries allocated in "timers" */
+  int freelist;
+  int active;           /* number of active timers */
+  int count0;           /* number of timers in the lowest level of the wheel */
+  int heads[WHEEL_SLOTS+1];
+  unsigned long wheeltime; /* next tick to process */
+  unsigned short serial;
+  cell legacy;          /* timer set with settimer() */
+  #if !defined AMXTIME_NOIDLE
+    AMX_IDLE PrevIdle;
+    int idxTimer;
+  #endif
+} TIMERINFO;
+
+static TIMERINFO *gettimerinfo(AMX *amx)
+{
+  void *ptr;
+  if (amx_GetUserData(amx, AMX_USERTAG('T','i','m','e'), &ptr) != AMX_ERR_NONE)
+    return NULL;
+  return (TIMERINFO*)ptr;
+}
 
 static const unsigned char monthdays[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
 
@@ -60,22 +117,194 @@ static int wrap(int value, int min, int max)
   return value;
 }
 
+#if !(defined __WIN32__ || defined _WIN32 || defined WIN32)
+/* Linux/Unix have clock_settime(); the C library of recent Linux versions no
+ * longer has stime(), but some DOS compilers only have stime()
+ */
+static void setsystime(time_t sec1970)
+{
+  #if defined CLOCK_REALTIME
+    struct timespec ts;
+    ts.tv_sec=sec1970;
+    ts.tv_nsec=0;
+    clock_settime(CLOCK_REALTIME,&ts);
+  #else
+    stime(&sec1970);
+  #endif
+}
+#endif
+
 static unsigned long gettimestamp(void)
 {
   unsigned long value;
 
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
     value=timeGetTime();        /* this value is already in milliseconds */
+  #elif defined CLOCK_MONOTONIC
+    /* clock() returns processor time, which stands still while the script
+     * sleeps (and runs faster when several threads run), so use wall time
+     */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    value=(unsigned long)ts.tv_sec*1000UL + (unsigned long)(ts.tv_nsec/1000000L);
   #else
-    value=(cell)clock();
-    #if CLOCKS_PER_SEC!=1000
-      /* convert to milliseconds */
-      value=(cell)((1000L * (value+CLOCKS_PER_SEC/2)) / CLOCKS_PER_SEC);
-    #endif
+    value=(unsigned long)clock();
+    if (CLOCKS_PER_SEC!=1000)   /* not a preprocessor test, it may be a function call */
+      value=(unsigned long)((1000.0 * value) / CLOCKS_PER_SEC + 0.5);  /* convert to milliseconds */
   #endif
   return value;
 }
 
+static void list_append(TIMERINFO *info, int list, int idx)
+{
+  TIMER *timer=&info->timers[idx];
+  int head=info->heads[list];
+
+  timer->list=list;
+  if (head<0) {
+    timer->next=timer->prev=idx;
+    info->heads[list]=idx;
+  } else {
+    timer->next=head;
+    timer->prev=info->timers[head].prev;
+    info->timers[timer->prev].next=idx;
+    info->timers[head].prev=idx;
+  } /* if */
+  if (list<WHEEL_SIZE0)
+    info->count0++;
+}
+
+static void list_remove(TIMERINFO *info, int idx)
+{
+  TIMER *timer=&info->timers[idx];
+  int list=timer->list;
+
+  assert(list>=0 && list<=DUE_LIST);
+  if (timer->next==idx) {
+    info->heads[list]=-1;
+  } else {
+    info->timers[timer->prev].next=timer->next;
+    info->timers[timer->next].prev=timer->prev;
+    if (info->heads[list]==idx)
+      info->heads[list]=timer->next;
+  } /* if */
+  if (list<WHEEL_SIZE0)
+    info->count0--;
+  timer->list=-1;
+}
+
+/* adds the timer to the slot for its expiry time, relative to the next tick
+ * that the wheel processes
+ */
+static void wheel_insert(TIMERINFO *info, int idx)
+{
+  TIMER *timer=&info->timers[idx];
+  unsigned long delta;
+  int level,slot;
+
+  if ((long)(timer->expires-info->wheeltime)<0)
+    timer->expires=info->wheeltime;     /* overdue, fire on the next tick */
+  delta=timer->expires-info->wheeltime;
+  if (delta<WHEEL_SIZE0) {
+    slot=(int)(timer->expires & (WHEEL_SIZE0-1));
+  } else {
+    for (level=1; level<WHEEL_LEVELS-1 && delta>=(1UL << (WHEEL_BITS0+level*WHEEL_BITS)); level++)
+      /* nothing */;
+    slot=WHEEL_SIZE0 + (level-1)*WHEEL_SIZE
+         + (int)((timer->expires >> (WHEEL_BITS0+(level-1)*WHEEL_BITS)) & (WHEEL_SIZE-1));
+  } /* if */
+  list_append(info,slot,idx);
+}
+
+static int timer_alloc(TIMERINFO *info)
+{
+  TIMER *timer;
+  int idx,newsize;
+
+  if (info->freelist<0) {
+    newsize=(info->size==0) ? 16 : 2*info->size;
+    if (newsize>(1 << TIMER_INDEXBITS))
+      return -1;
+    if ((timer=(TIMER*)realloc(info->timers,newsize*sizeof(TIMER)))==NULL)
+      return -1;
+    for (idx=info->size; idx<newsize; idx++) {
+      timer[idx].list=-1;
+      timer[idx].id=0;
+      timer[idx].next=(idx+1<newsize) ? idx+1 : -1;
+    } /* for */
+    info->freelist=info->size;
+    info->timers=timer;
+    info->size=newsize;
+  } /* if */
+  idx=info->freelist;
+  timer=&info->timers[idx];
+  info->freelist=timer->next;
+  info->serial=(unsigned short)((info->serial+1) & TIMER_SERIALMASK);
+  timer->id=((cell)info->serial << TIMER_INDEXBITS) | (idx+1);
+  info->active++;
+  return idx;
+}
+
+static void timer_free(TIMERINFO *info, int idx)
+{
+  TIMER *timer=&info->timers[idx];
+
+  assert(timer->list<0);
+  if (timer->id==info->legacy)
+    info->legacy=0;
+  timer->id=0;
+  timer->next=info->freelist;
+  info->freelist=idx;
+  info->active--;
+}
+
+static int findtimer(TIMERINFO *info, cell id)
+{
+  int idx=(int)(id & ((1 << TIMER_INDEXBITS)-1)) - 1;
+
+  if (id<=0 || idx<0 || idx>=info->size || info->timers[idx].list<0 || info->timers[idx].id!=id)
+    return -1;
+  return idx;
+}
+
+static cell addtimer(TIMERINFO *info, int index, int noargs, cell delay, int repeat, cell payload)
+{
+  TIMER *timer;
+  int idx;
+
+  INIT_TIMER();
+  if (info->active==0)
+    info->wheeltime=gettimestamp();     /* the wheel may have been idle for long */
+  if ((idx=timer_alloc(info))<0)
+    return 0;
+  if (delay<0)
+    delay=0;
+  #if PAWN_CELL_SIZE>32
+    else if (delay>TIMER_MAXDELAY)
+      delay=TIMER_MAXDELAY;     /* a 32-bit cell cannot exceed the maximum */
+  #endif
+  timer=&info->timers[idx];
+  timer->index=index;
+  timer->noargs=noargs;
+  timer->repeat=repeat;
+  timer->period=(repeat && delay==0) ? 1 : (unsigned long)delay;
+  timer->payload=payload;
+  timer->expires=gettimestamp()+(unsigned long)delay;
+  wheel_insert(info,idx);
+  return timer->id;
+}
+
+static int removetimer(TIMERINFO *info, cell id)
+{
+  int idx;
+
+  if ((idx=findtimer(info,id))<0)
+    return 0;
+  list_remove(info,idx);
+  timer_free(info,idx);
+  return 1;
+}
+
 /* settime(hour, minute, second)
  * Always returns 0
  */
@@ -93,9 +322,7 @@ static cell AMX_NATIVE_CALL n_settime(AMX *amx, const cell *params)
       systim.wSecond=(WORD)wrap((int)params[3],0,59);
     SetLocalTime(&systim);
   #else
-    /* Linux/Unix (and some DOS compilers) have stime(); on Linux/Unix, you
-     * must have "root" permission to call stime()
-     */
+    /* on Linux/Unix, you must have "root" permission to set the time */
     time_t sec1970;
     struct tm gtm;
 
@@ -109,7 +336,7 @@ static cell AMX_NATIVE_CALL n_settime(AMX *amx, const cell *params)
     if (params[3]!=CELLMIN)
       gtm.tm_sec=wrap((int)params[3],0,59);
     sec1970=mktime(&gtm);
-    stime(&sec1970);
+    setsystime(sec1970);
   #endif
   (void)amx;
   return 0;
@@ -168,9 +395,7 @@ static cell AMX_NATIVE_CALL n_setdate(AMX *amx, const cell *params)
       systim.wDay=(WORD)wrap((int)params[3],1,maxday);
     SetLocalTime(&systim);
   #else
-    /* Linux/Unix (and some DOS compilers) have stime(); on Linux/Unix, you
-     * must have "root" permission to call stime()
-     */
+    /* on Linux/Unix, you must have "root" permission to set the time */
     time_t sec1970;
     struct tm gtm;
 
@@ -184,7 +409,7 @@ static cell AMX_NATIVE_CALL n_setdate(AMX *amx, const cell *params)
     if (params[3]!=CELLMIN)
       gtm.tm_mday=params[3];
     sec1970=mktime(&gtm);
-    stime(&sec1970);
+    setsystime(sec1970);
   #endif
   (void)amx;
   return 0;
@@ -226,7 +451,7 @@ static cell AMX_NATIVE_CALL n_tickcount(AMX *amx, const cell *params)
   assert(params[0]==(int)sizeof(cell));
 
   INIT_TIMER();
-  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32 || defined CLOCK_MONOTONIC
     if (amx_GetAddr(amx,params[1],&cptr)==AMX_ERR_NONE)
       *cptr=1000;               /* granularity = 1 ms */
   #else
@@ -255,15 +480,24 @@ static cell AMX_NATIVE_CALL n_delay(AMX *amx, const cell *params)
 
 /* settimer(milliseconds, bool: singleshot = false)
  * Sets the delay until the @timer() callback is called. The timer may either
- * be single-shot or repetitive.
+ * be single-shot or repetitive. A delay of zero stops the timer.
  */
 static cell AMX_NATIVE_CALL n_settimer(AMX *amx, const cell *params)
 {
-  (void)amx;
+  TIMERINFO *info;
+  int index=-1;
+
   assert(params[0]==(int)(2*sizeof(cell)));
-  timestamp=gettimestamp();
-  timelimit=params[1];
-  timerepeat=(int)(params[2]==0);
+  if ((info=gettimerinfo(amx))==NULL) {
+    amx_RaiseError(amx, AMX_ERR_USERDATA);
+    return 0;
+  } /* if */
+  removetimer(info,info->legacy);
+  #if !defined AMXTIME_NOIDLE
+    index=info->idxTimer;
+  #endif
+  if (params[1]>0)
+    info->legacy=addtimer(info,index,1,params[1],params[2]==0,0);
   return 0;
 }
 
@@ -273,44 +507,249 @@ static cell AMX_NATIVE_CALL n_settimer(AMX *amx, const cell *params)
  */
 static cell AMX_NATIVE_CALL n_gettimer(AMX *amx, const cell *params)
 {
+  TIMERINFO *info;
+  TIMER *timer=NULL;
   cell *cptr;
+  int idx;
 
   assert(params[0]==(int)(2*sizeof(cell)));
+  if ((info=gettimerinfo(amx))==NULL) {
+    amx_RaiseError(amx, AMX_ERR_USERDATA);
+    return 0;
+  } /* if */
+  if ((idx=findtimer(info,info->legacy))>=0)
+    timer=&info->timers[idx];
   if (amx_GetAddr(amx,params[1],&cptr)==AMX_ERR_NONE)
-    *cptr=timelimit;
-  if (amx_GetAddr(amx,params[1],&cptr)==AMX_ERR_NONE)
-    *cptr=timerepeat;
-  return timelimit>0;
+    *cptr=(timer!=NULL) ? (cell)timer->period : 0;
+  if (amx_GetAddr(amx,params[2],&cptr)==AMX_ERR_NONE)
+    *cptr=(timer!=NULL) ? !timer->repeat : 0;
+  return timer!=NULL;
+}
+
+/* createtimer(const function[], milliseconds, bool: singleshot = false, payload = 0)
+ * Starts a timer that calls the public function with the timer id and the
+ * payload as its parameters. Any number of timers may run at the same time.
+ * Returns the timer id, or 0 if the function does not exist or the timer
+ * cannot be created.
+ */
+static cell AMX_NATIVE_CALL n_createtimer(AMX *amx, const cell *params)
+{
+  TIMERINFO *info;
+  char name[64];
+  cell *cstr;
+  int len,index;
+
+  assert(params[0]==(int)(4*sizeof(cell)));
+  if ((info=gettimerinfo(amx))==NULL) {
+    amx_RaiseError(amx, AMX_ERR_USERDATA);
+    return 0;
+  } /* if */
+  if (amx_GetAddr(amx,params[1],&cstr)!=AMX_ERR_NONE)
+    return 0;
+  amx_StrLen(cstr,&len);
+  if (len>=(int)sizeof name)
+    return 0;
+  amx_GetString(name,cstr,0,sizeof name);
+  if (amx_FindPublic(amx,name,&index)!=AMX_ERR_NONE)
+    return 0;
+  return addtimer(info,index,0,params[2],params[3]==0,params[4]);
+}
+
+/* bool: killtimer(timer)
+ * Stops a timer; returns false if the timer was not active.
+ */
+static cell AMX_NATIVE_CALL n_killtimer(AMX *amx, const cell *params)
+{
+  TIMERINFO *info;
+
+  assert(params[0]==(int)sizeof(cell));
+  if ((info=gettimerinfo(amx))==NULL) {
+    amx_RaiseError(amx, AMX_ERR_USERDATA);
+    return 0;
+  } /* if */
+  return removetimer(info,params[1]);
+}
+
+/* timerleft(timer)
+ * Returns the number of milliseconds until the timer fires next, or -1 if
+ * the timer is not active.
+ */
+static cell AMX_NATIVE_CALL n_timerleft(AMX *amx, const cell *params)
+{
+  TIMERINFO *info;
+  long left;
+  int idx;
+
+  assert(params[0]==(int)sizeof(cell));
+  if ((info=gettimerinfo(amx))==NULL) {
+    amx_RaiseError(amx, AMX_ERR_USERDATA);
+    return 0;
+  } /* if */
+  if ((idx=findtimer(info,params[1]))<0)
+    return -1;
+  left=(long)(info->timers[idx].expires-gettimestamp());
+  return (left>0) ? (cell)left : 0;
 }
 
 
 #if !defined AMXTIME_NOIDLE
-static AMX_IDLE PrevIdle = NULL;
-static int idxTimer = -1;
+/* when the lowest level wraps around, the timers in the next slot of the
+ * level above it move down (and so on, for every level that wraps)
+ */
+static void wheel_cascade(TIMERINFO *info)
+{
+  int level,slot,list,idx;
+
+  for (level=1; level<WHEEL_LEVELS; level++) {
+    slot=(int)((info->wheeltime >> (WHEEL_BITS0+(level-1)*WHEEL_BITS)) & (WHEEL_SIZE-1));
+    list=WHEEL_SIZE0 + (level-1)*WHEEL_SIZE + slot;
+    while ((idx=info->heads[list])>=0) {
+      list_remove(info,idx);
+      wheel_insert(info,idx);
+    } /* while */
+    if (slot!=0)
+      break;
+  } /* for */
+}
+
+/* moves the timers that are due at "now" to the due list */
+static void wheel_advance(TIMERINFO *info, unsigned long now)
+{
+  unsigned long next;
+  int slot,idx;
+
+  while ((long)(now-info->wheeltime)>=0) {
+    if ((info->wheeltime & (WHEEL_SIZE0-1))==0)
+      wheel_cascade(info);
+    if (info->count0==0) {
+      /* nothing in the lowest level: skip to the tick where the next level
+       * cascades, or to "now"
+       */
+      next=(info->wheeltime | (WHEEL_SIZE0-1)) + 1;
+      info->wheeltime= (info->active==0 || (long)(now-next)<0) ? now+1 : next;
+      continue;
+    } /* if */
+    slot=(int)(info->wheeltime & (WHEEL_SIZE0-1));
+    while ((idx=info->heads[slot])>=0) {
+      list_remove(info,idx);
+      list_append(info,DUE_LIST,idx);
+    } /* while */
+    info->wheeltime++;
+  } /* while */
+}
 
 static int AMXAPI amx_TimeIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
 {
-  int err=0;
+  TIMERINFO *info;
+  TIMER *timer;
+  int err=0,idx,index,noargs;
+  cell id,payload;
+
+  info=gettimerinfo(amx);
+  assert(info != NULL);
 
-  assert(idxTimer >= 0);
+  if (info->PrevIdle != NULL)
+    info->PrevIdle(amx, Exec);
 
-  if (PrevIdle != NULL)
-    PrevIdle(amx, Exec);
+  if (info->active==0)
+    return AMX_ERR_NONE;
+  wheel_advance(info,gettimestamp());
 
-  if (timelimit>0 && (gettimestamp()-timestamp)>=timelimit) {
-    if (timerepeat)
-      timestamp+=timelimit;
-    else
-      timelimit=0;      /* do not repeat single-shot timer */
-    err = Exec(amx, NULL, idxTimer);
-    while (err == AMX_ERR_SLEEP)
+  /* run the callbacks of all timers that are due; the callbacks may create
+   * and kill timers (and the timer array may move)
+   */
+  while ((idx=info->heads[DUE_LIST])>=0) {
+    timer=&info->timers[idx];
+    list_remove(info,idx);
+    index=timer->index;
+    noargs=timer->noargs;
+    payload=timer->payload;
+    id=timer->id;
+    if (timer->repeat) {
+      timer->expires+=timer->period;
+      wheel_insert(info,idx);
+    } else {
+      timer_free(info,idx);
+    } /* if */
+    if (index<0)
+      continue;                 /* settimer() without @timer() function */
+    if (!noargs) {
+      amx_Push(amx, payload);
+      amx_Push(amx, id);
+    } /* if */
+    err = Exec(amx, NULL, index);
+    while (err == AMX_ERR_SLEEP || err == AMX_ERR_BUDGET)
       err = Exec(amx, NULL, AMX_EXEC_CONT);
-  } /* if */
+    if (err != AMX_ERR_NONE)
+      break;
+  } /* while */
 
   return err;
 }
 #endif
 
+/* amx_TimeNext() returns the number of milliseconds until the next timer of
+ * the abstract machine is due (zero if a timer is overdue), or -1 if there
+ * are no active timers. A host can use it to sleep until the idle function
+ * must run.
+ */
+int AMXEXPORT amx_TimeNext(AMX *amx, long *milliseconds)
+{
+  TIMERINFO *info;
+  unsigned long earliest=0;
+  int found=0;
+  int level,first,size,start,i,list,idx,shift;
+  long left;
+
+  assert(milliseconds != NULL);
+  *milliseconds=-1;
+  if ((info=gettimerinfo(amx))==NULL)
+    return AMX_ERR_USERDATA;
+  if (info->active==0)
+    return AMX_ERR_NONE;
+  if (info->heads[DUE_LIST]>=0) {
+    *milliseconds=0;
+    return AMX_ERR_NONE;
+  } /* if */
+
+  /* in every level, the first slot (from the current position) that holds
+   * timers also holds the earliest timer of that level; in the higher levels,
+   * the current slot holds the timers that cascade down on the next tick if
+   * the wheel is at the start of that slot (these come first), and otherwise
+   * the timers that are a full turn of that level away (these come last)
+   */
+  for (level=0; level<WHEEL_LEVELS; level++) {
+    if (level==0) {
+      first=0;
+      size=WHEEL_SIZE0;
+      shift=0;
+      start=0;
+    } else {
+      first=WHEEL_SIZE0 + (level-1)*WHEEL_SIZE;
+      size=WHEEL_SIZE;
+      shift=WHEEL_BITS0+(level-1)*WHEEL_BITS;
+      start=((info->wheeltime & ((1UL << shift)-1))==0) ? 0 : 1;
+    } /* if */
+    for (i=0; i<size; i++) {
+      list=first + (int)(((info->wheeltime >> shift)+start+i) & (size-1));
+      if ((idx=info->heads[list])>=0) {
+        do {
+          if (!found || (long)(info->timers[idx].expires-earliest)<0)
+            earliest=info->timers[idx].expires;
+          found=1;
+          idx=info->timers[idx].next;
+        } while (idx!=info->heads[list]);
+        break;
+      } /* if */
+    } /* for */
+  } /* for */
+
+  assert(found);
+  left=(long)(earliest-gettimestamp());
+  *milliseconds=(left>0) ? left : 0;
+  return AMX_ERR_NONE;
+}
+
 
 #if defined __cplusplus
   extern "C"
@@ -323,17 +762,45 @@ const AMX_NATIVE_INFO time_Natives[] = {
   { "tickcount", n_tickcount },
   { "settimer",  n_settimer },
   { "gettimer",  n_gettimer },
+  { "createtimer", n_createtimer },
+  { "killtimer", n_killtimer },
+  { "timerleft", n_timerleft },
   { "delay",     n_delay },
   { NULL, NULL }        /* terminator */
 };
 
 int AMXEXPORT amx_TimeInit(AMX *amx)
 {
+  TIMERINFO *info;
+  int err,i;
+
+  if ((info=(TIMERINFO*)malloc(sizeof(TIMERINFO))) == NULL)
+    return AMX_ERR_MEMORY;
+  info->timers=NULL;
+  info->size=0;
+  info->freelist=-1;
+  info->active=0;
+  info->count0=0;
+  for (i=0; i<=DUE_LIST; i++)
+    info->heads[i]=-1;
+  info->wheeltime=gettimestamp();
+  info->serial=0;
+  info->legacy=0;
+  if ((err=amx_SetUserData(amx, AMX_USERTAG('T','i','m','e'), info)) != AMX_ERR_NONE) {
+    free(info);
+    return err;
+  } /* if */
+
   #if !defined AMXTIME_NOIDLE
-    /* see whether there is a @timer() function */
-    if (amx_FindPublic(amx,"@timer",&idxTimer) == AMX_ERR_NONE) {
-      if (amx_GetUserData(amx, AMX_USERTAG('I','d','l','e'), (void**)&PrevIdle) != AMX_ERR_NONE)
-        PrevIdle = NULL;
+    /* install the idle function if there is a @timer() function or if the
+     * script creates timers of its own
+     */
+    info->PrevIdle = NULL;
+    if (amx_FindPublic(amx,"@timer",&info->idxTimer) != AMX_ERR_NONE)
+      info->idxTimer = -1;
+    if (info->idxTimer >= 0 || amx_FindNative(amx,"createtimer",&i) == AMX_ERR_NONE) {
+      if (amx_GetUserData(amx, AMX_USERTAG('I','d','l','e'), (void**)&info->PrevIdle) != AMX_ERR_NONE)
+        info->PrevIdle = NULL;
       amx_SetUserData(amx, AMX_USERTAG('I','d','l','e'), amx_TimeIdle);
     } /* if */
   #endif
@@ -343,9 +810,12 @@ int AMXEXPORT amx_TimeInit(AMX *amx)
 
 int AMXEXPORT amx_TimeCleanup(AMX *amx)
 {
-  (void)amx;
-  #if !defined AMXTIME_NOIDLE
-    PrevIdle = NULL;
-  #endif
+  TIMERINFO *info=gettimerinfo(amx);
+
+  if (info != NULL) {
+    free(info->timers);
+    free(info);
+    amx_SetUserData(amx, AMX_USERTAG('T','i','m','e'), NULL);
+  } /* if */
   return AMX_ERR_NONE;
 }
@@ -0,0 +1,42 @@
+/*  Date/time module for the Pawn Abstract Machine
+ *
+ *  This software is provided "as-is", without any express or implied warranty.
+ *  In no event will the authors be held liable for any damages arising from
+ *  the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1.  The origin of this software must not be misrepresented; you must not
+ *      claim that you wrote the original software. If you use this software in
+ *      a product, an acknowledgment in the product documentation would be
+ *      appreciated but is not required.
+ *  2.  Altered source versions must be plainly marked as such, and must not be
+ *      misrepresented as being the original software.
+ *  3.  This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef AMXTIME_H_INCLUDED
+#define AMXTIME_H_INCLUDED
+
+#include "amx.h"
+
+#ifdef  __cplusplus
+extern  "C" {
+#endif
+
+int AMXEXPORT amx_TimeInit(AMX *amx);
+int AMXEXPORT amx_TimeCleanup(AMX *amx);
+int AMXEXPORT amx_TimeNext(AMX *amx, long *milliseconds);
+        /* Returns the number of milliseconds until the next timer of the
+         * abstract machine is due (zero if a timer is overdue), or -1 if
+         * there are no active timers. A host can sleep for that time before
+         * it calls the idle function again, instead of polling it.
+         */
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* AMXTIME_H_INCLUDED */
@@ -234,6 +234,7 @@ typedef struct tagBREAKPOINT {
   ucell addr;           /* address (in code or data segment) */
   const char *name;     /* name of the symbol (function) */
   int number;           /* sequential breakpoint number (to refer to the breakpoint) */
+  int patched;          /* BREAK instruction replaced by a trap */
 } BREAKPOINT;
 
 typedef struct tagNAMELIST {
@@ -257,6 +258,7 @@ enum {
   RUNNING,  /* just run */
 };
 static int runmode;     /* running or tracing */
+static AMX *curamx;     /* abstract machine being debugged (for the signal handler) */
 
 static char amx_filename[_MAX_PATH];
 static const char *curfilename; /* pointer to the name of the "active" file */
@@ -1631,20 +1633,22 @@ static int watch_count(void)
   return namelist_count(&watches);
 }
 
-static void break_init(void)
+static void break_init(AMX *amx)
 {
   BREAKPOINT *next;
 
   while (breakpoints.next!=NULL) {
     next=breakpoints.next;
     breakpoints.next=next->next;  /* unlink */
+    if (amx!=NULL && next->patched)
+      amx_ClearBreakpoint(amx,(cell)next->addr);
     free(next);                   /* then free */
   } /* while */
 }
 
-static int break_clear(int number)
+static int break_clear(AMX *amx,int number)
 {
-  BREAKPOINT *cur;
+  BREAKPOINT *cur,*next;
 
   /* find the breakpoint */
   cur=&breakpoints;
@@ -1653,12 +1657,30 @@ static int break_clear(int number)
   if (cur->next==NULL)
     return 0;                   /* breakpoint not found */
 
-  cur->next=cur->next->next;    /* unlink */
-  free(cur->next);              /* then free */
+  next=cur->next;
+  cur->next=next->next;         /* unlink */
+  if (next->patched)
+    amx_ClearBreakpoint(amx,(cell)next->addr);
+  free(next);                   /* then free */
+  return 1;
+}
+
+/* break_trapall() returns whether all breakpoints are patched into the code,
+ * so that the debug hook needs not to be called on every BREAK instruction
+ */
+static int break_trapall(void)
+{
+  BREAKPOINT *cur;
+
+  if (remote!=REMOTE_NONE)
+    return 0;
+  for (cur=breakpoints.next; cur!=NULL; cur=cur->next)
+    if (!cur->patched)
+      return 0;
   return 1;
 }
 
-static int break_set(AMX_DBG *amxdbg,const char *symaddr,int flags)
+static int break_set(AMX *amx,AMX_DBG *amxdbg,const char *symaddr,int flags)
 {
   BREAKPOINT *cur,*newbp, bp;
   int number,changed,err;
@@ -1683,7 +1705,7 @@ static int break_set(AMX_DBG *amxdbg,const char *symaddr,int flags)
   for (cur=breakpoints.next; cur!=NULL; cur=cur->next) {
     if (cur->addr==bp.addr) {
       if (flags & 2)
-        break_clear(cur->number); /* toggle the breakpoint */
+        break_clear(amx,cur->number); /* toggle the breakpoint */
       return AMX_ERR_NONE;
     } /* if */
   } /* for */
@@ -1711,6 +1733,10 @@ static int break_set(AMX_DBG *amxdbg,const char *symaddr,int flags)
   newbp->next=cur->next;
   cur->next=newbp;
   newbp->number=number;
+  /* a breakpoint that cannot be patched (e.g. in remote debugging) is still
+   * found by break_check(), but only if the debug hook runs on every BREAK
+   */
+  newbp->patched= remote==REMOTE_NONE && amx_SetBreakpoint(amx,(cell)newbp->addr)==AMX_ERR_NONE;
 
   return number;
 }
@@ -1754,7 +1780,7 @@ static int break_check(AMX *amx)
       if (cur->addr==cip) {
         int number=cur->number;
         if (number==0)
-          break_clear(number);
+          break_clear(amx,number);
         return number;
       } /* if */
     } /* if */
@@ -2136,7 +2162,7 @@ static char lastcommand[32] = "";
       exit(0);
     } else if (stricmp(command,"g")==0 || stricmp(command,"go")==0) {
       if (isdigit(*params))
-        break_set(amxdbg,params,0x1);
+        break_set(amx,amxdbg,params,0x1);
       recentline=-1;
       if (stricmp(params,"func")==0)
         return STEPOUT;
@@ -2221,7 +2247,7 @@ static char lastcommand[32] = "";
       if (*params=='\0') {
         break_list(amxdbg);
       } else {
-        result=break_set(amxdbg,params,stricmp(command,"tbreak")==0);
+        result=break_set(amx,amxdbg,params,stricmp(command,"tbreak")==0);
         if (result<0)
           amx_printf("Invalid breakpoint\n");
         else if (terminal>0)
@@ -2230,9 +2256,9 @@ static char lastcommand[32] = "";
     } else if (stricmp(command,"cbreak")==0) {
       if (*params=='*') {
         /* clear all breakpoints */
-        break_init();
+        break_init(amx);
       } else if (isdigit(*params)) {
-        if (!break_clear(atoi(params)))
+        if (!break_clear(amx,atoi(params)))
           amx_printf("\tUnknown breakpoint\n");
       } else {
         amx_printf("\tInvalid command\n");
@@ -2483,6 +2509,8 @@ void sigabort(int sig)
 {
   /* set "trace mode" */
   runmode=STEPPING;
+  if (curamx!=NULL)
+    curamx->flags&=~AMX_FLAG_DBGTRAP;
   signal(sig,sigabort); /* re-install the signal handler */
 }
 
@@ -2503,7 +2531,7 @@ static long lastline;
       cursource=NULL;
     } /* if */
     curfilename=NULL;
-    break_init();               /* frees all existing breakpoints */
+    break_init(NULL);           /* frees all existing breakpoints */
     watch_init();
     if (terminal==0 && amx_termctl(0,0)) {
       curtopline=0;
@@ -2610,6 +2638,11 @@ static long lastline;
   term_switch(0);     /* switch back to the program output */
   if (runmode==STEPOVER)
     lastfrm=amx->frm; /* step OVER functions (so save the stack frame) */
+  /* when just running, only the breakpoints need to invoke the debug hook */
+  if (runmode==RUNNING && break_trapall())
+    amx->flags|=AMX_FLAG_DBGTRAP;
+  else
+    amx->flags&=~AMX_FLAG_DBGTRAP;
 
   return AMX_ERR_NONE;
 }
@@ -2800,6 +2833,7 @@ extern AMX_NATIVE_INFO console_Natives[];
     return 1;
   } /* if */
   amx_SetDebugHook(&amx, amx_InternalDebugProc);
+  curamx=&amx;
   signal(SIGINT,sigabort);
   amx_InternalDebugProc(NULL);  /* initialize debug hook */
 
@@ -2827,6 +2861,7 @@ extern AMX_NATIVE_INFO console_Natives[];
       while (err == AMX_ERR_SLEEP) {
         amx_printf("Paused execution on \"sleep\"\n");
         runmode = STEPPING;       /* use the "sleep" as a "coded" break point */
+        amx.flags &= ~AMX_FLAG_DBGTRAP;
         err = amx_Exec(&amx, &ret, AMX_EXEC_CONT);
       } /* while */
     } else {
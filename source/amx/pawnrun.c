@@ -50,6 +50,7 @@
  * support for dynamic linking is enabled).
  */
 extern int AMXEXPORT amx_ConsoleInit(AMX *amx);
+extern int AMXEXPORT amx_ConsoleCleanup(AMX *amx);
 extern int AMXEXPORT amx_CoreInit(AMX *amx);
 
 AMX *global_amx;
@@ -185,8 +186,8 @@ static char *messages[] = {
       /* AMX_ERR_NATIVE    */ "Native function failed",
       /* AMX_ERR_DIVIDE    */ "Divide by zero",
       /* AMX_ERR_SLEEP     */ "(sleep mode)",
-      /* 13 */                "(reserved)",
-      /* 14 */                "(reserved)",
+      /* AMX_ERR_INVSTATE  */ "Invalid state for this access",
+      /* AMX_ERR_BUDGET    */ "(instruction budget used up)",
       /* 15 */                "(reserved)",
       /* AMX_ERR_MEMORY    */ "Out of memory",
       /* AMX_ERR_FORMAT    */ "Invalid/unsupported P-code file format",
@@ -214,6 +215,7 @@ void ExitOnError(AMX *amx, int error)
       const char *filename;
     #endif
 
+    amx_ConsoleCleanup(amx);    /* write any pending output first */
     printf("Run time error %d: \"%s\" on address %ld\n",
            error, aux_StrError(error), (long)amx->cip);
 
@@ -239,11 +241,98 @@ void PrintUsage(char *program)
   printf("Usage: %s <filename> [options]\n\n"
          "Options:\n"
          "\t-stack\tto monitor stack usage\n"
-         "\t...\tother options are passed to the script\n"
          , program);
+  #if defined AMX_OPCODESTATS
+    printf("\t-opcodes\tto print how often each opcode and opcode pair ran\n");
+  #endif
+  printf("\t...\tother options are passed to the script\n");
   exit(1);
 }
 
+#if defined AMX_OPCODESTATS
+#define MAX_PAIRS 40            /* number of opcode pairs that are printed */
+
+static const unsigned long *sortcounts;
+
+static int cmp_count(const void *a, const void *b)
+{
+  unsigned long ca = sortcounts[*(const int *)a];
+  unsigned long cb = sortcounts[*(const int *)b];
+  return (ca < cb) ? 1 : (ca > cb) ? -1 : 0;
+}
+
+/* PrintOpcodeStats()
+ * Prints the opcodes that ran, and the most frequent pairs of opcodes, with
+ * the highest counts first.
+ */
+static void PrintOpcodeStats(void)
+{
+  static const char *names[] = {
+    "none", "load.pri", "load.alt", "load.s.pri", "load.s.alt", "lref.pri",
+    "lref.alt", "lref.s.pri", "lref.s.alt", "load.i", "lodb.i", "const.pri",
+    "const.alt", "addr.pri", "addr.alt", "stor.pri", "stor.alt", "stor.s.pri",
+    "stor.s.alt", "sref.pri", "sref.alt", "sref.s.pri", "sref.s.alt", "stor.i",
+    "strb.i", "lidx", "lidx.b", "idxaddr", "idxaddr.b", "align.pri",
+    "align.alt", "lctrl", "sctrl", "move.pri", "move.alt", "xchg",
+    "push.pri", "push.alt", "push.r", "push.c", "push", "push.s",
+    "pop.pri", "pop.alt", "stack", "heap", "proc", "ret",
+    "retn", "call", "call.pri", "jump", "jrel", "jzer",
+    "jnz", "jeq", "jneq", "jless", "jleq", "jgrtr",
+    "jgeq", "jsless", "jsleq", "jsgrtr", "jsgeq", "shl",
+    "shr", "sshr", "shl.c.pri", "shl.c.alt", "shr.c.pri", "shr.c.alt",
+    "smul", "sdiv", "sdiv.alt", "umul", "udiv", "udiv.alt",
+    "add", "sub", "sub.alt", "and", "or", "xor",
+    "not", "neg", "invert", "add.c", "smul.c", "zero.pri",
+    "zero.alt", "zero", "zero.s", "sign.pri", "sign.alt", "eq",
+    "neq", "less", "leq", "grtr", "geq", "sless",
+    "sleq", "sgrtr", "sgeq", "eq.c.pri", "eq.c.alt", "inc.pri",
+    "inc.alt", "inc", "inc.s", "inc.i", "dec.pri", "dec.alt",
+    "dec", "dec.s", "dec.i", "movs", "cmps", "fill",
+    "halt", "bounds", "sysreq.pri", "sysreq.c", "file", "line",
+    "symbol", "srange", "jump.pri", "switch", "casetbl", "swap.pri",
+    "swap.alt", "push.adr", "nop", "sysreq.n", "symtag", "break",
+    "push2.c", "push2", "push2.s", "push2.adr", "push3.c", "push3",
+    "push3.s", "push3.adr", "push4.c", "push4", "push4.s", "push4.adr",
+    "push5.c", "push5", "push5.s", "push5.adr", "load.both", "load.s.both",
+    "const", "const.s", "sysreq.d", "sysreq.nd", "breakpt"
+  };
+  const unsigned long *counts, *pairs;
+  unsigned long total = 0;
+  int *order;
+  int number, i, n;
+
+  amx_OpcodeStats(&number, &counts, &pairs);
+  assert(number == sizeof names / sizeof names[0]);
+  if ((order = (int*)malloc(number * number * sizeof(int))) == NULL)
+    return;
+
+  for (i = 0; i < number; i++)
+    total += counts[i];
+  if (total == 0)
+    total = 1;                  /* avoid division by zero */
+  for (i = n = 0; i < number; i++)
+    if (counts[i] != 0)
+      order[n++] = i;
+  sortcounts = counts;
+  qsort(order, n, sizeof(int), cmp_count);
+  printf("\nOpcode             Count      %%\n");
+  for (i = 0; i < n; i++)
+    printf("%-12s %11lu %6.2f\n", names[order[i]], counts[order[i]],
+           100.0 * counts[order[i]] / total);
+
+  for (i = n = 0; i < number * number; i++)
+    if (pairs[i] != 0)
+      order[n++] = i;
+  sortcounts = pairs;
+  qsort(order, n, sizeof(int), cmp_count);
+  printf("\nOpcode pair                     Count      %%\n");
+  for (i = 0; i < n && i < MAX_PAIRS; i++)
+    printf("%-12s %-12s %11lu %6.2f\n", names[order[i] / number],
+           names[order[i] % number], pairs[order[i]], 100.0 * pairs[order[i]] / total);
+  free(order);
+}
+#endif
+
 
 int main(int argc,char *argv[])
 {
@@ -253,6 +342,9 @@ int main(int argc,char *argv[])
   clock_t start,end;
   STACKINFO stackinfo = { 0 };
   AMX_IDLE idlefunc;
+  #if defined AMX_OPCODESTATS
+    int opcodestats = 0;
+  #endif
 
   if (argc < 2)
     PrintUsage(argv[0]);        /* function "usage" aborts the program */
@@ -314,6 +406,10 @@ int main(int argc,char *argv[])
        * usage right from the beginning of the script.
        */
       amx_SetDebugHook(&amx, srun_Monitor);
+    #if defined AMX_OPCODESTATS
+    } else if (strcmp(argv[i],"-opcodes") == 0) {
+      opcodestats = 1;
+    #endif
     } /* if */
   } /* for */
 
@@ -367,6 +463,7 @@ int main(int argc,char *argv[])
   /* Free the compiled script and resources. This also unloads and DLLs or
    * shared libraries that were registered automatically by amx_Init().
    */
+  amx_ConsoleCleanup(&amx);
   aux_FreeProgram(&amx);
 
   /* Print the return code of the compiled script (often not very useful),
@@ -382,6 +479,10 @@ int main(int argc,char *argv[])
     printf("Heap usage:   %ld cells (%ld bytes)\n",
            stackinfo.maxheap / sizeof(cell), stackinfo.maxheap);
   } /* if */
+  #if defined AMX_OPCODESTATS
+    if (opcodestats)
+      PrintOpcodeStats();
+  #endif
 
   #if defined AMX_TERMINAL
     /* This is likely a graphical terminal, which should not be closed
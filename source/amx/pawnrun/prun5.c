@@ -336,6 +336,7 @@ int main(int argc,char *argv[])
   /* Free the compiled script and resources. This also unloads and DLLs or
    * shared libraries that were registered automatically by amx_Init().
    */
+  amx_ConsoleCleanup(&amx);
   aux_FreeProgram(&amx);
 
   /* Free the garbarge collector data and tables. */
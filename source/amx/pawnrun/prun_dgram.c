@@ -0,0 +1,161 @@
+/*  Loopback benchmark for the datagram module in AMXDGRAM.C: it sends bursts
+ *  of packets to the script and reports how many packets per second the
+ *  script handles. The time that is measured is the time spent in the idle
+ *  function of the abstract machine (which receives the packets and calls
+ *  the public functions of the script).
+ *
+ *  This file may be freely used. No warranties of any kind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>             /* for exit() */
+#include <string.h>             /* for memset() (on some compilers) */
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "amx.h"
+#include "amxaux.h"
+
+extern int AMXEXPORT amx_ConsoleInit(AMX *amx);
+extern int AMXEXPORT amx_ConsoleCleanup(AMX *amx);
+extern int AMXEXPORT amx_CoreInit(AMX *amx);
+extern int AMXEXPORT amx_DGramInit(AMX *amx);
+extern int AMXEXPORT amx_DGramCleanup(AMX *amx);
+
+static void ErrorExit(AMX *amx, int errorcode)
+{
+  printf("Run time error %d: \"%s\"\n", errorcode, aux_StrError(errorcode));
+  exit(1);
+}
+
+static void PrintUsage(char *program)
+{
+  printf("Usage: %s [-n<packets>] [-b<burst>] [-s<size>] [-p<port>] [-e] <filename>\n"
+         "<filename> is a compiled script that counts the received packets in\n"
+         "the public variable \"received\" (see examples/udpbench.p).\n"
+         "With -e, the script sends every packet back (the public variable\n"
+         "\"echo\" is set) and the replies are counted too.\n",
+         program);
+  exit(1);
+}
+
+static double timestamp(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc,char *argv[])
+{
+  AMX amx;
+  AMX_IDLE idle;
+  cell amx_addr, *received, *echo;
+  long packets = 1000000L, sent = 0, replies = 0;
+  int burst = 128, size = 64, port = 9930, doecho = 0;
+  int sock, err, i;
+  struct sockaddr_in addr;
+  char buffer[512];
+  double elapsed = 0.0, start;
+
+  while (argc >= 2 && argv[1][0] == '-') {
+    if (argv[1][1] == 'n')
+      packets = atol(argv[1] + 2);
+    else if (argv[1][1] == 'b')
+      burst = atoi(argv[1] + 2);
+    else if (argv[1][1] == 's')
+      size = atoi(argv[1] + 2);
+    else if (argv[1][1] == 'p')
+      port = atoi(argv[1] + 2);
+    else if (argv[1][1] == 'e')
+      doecho = 1;
+    else
+      PrintUsage(argv[0]);
+    argv++;
+    argc--;
+  } /* while */
+  if (argc != 2 || packets <= 0 || burst <= 0 || size <= 0 || size > (int)sizeof buffer)
+    PrintUsage(argv[0]);
+
+  err = aux_LoadProgram(&amx, argv[1], NULL);
+  /* the console module comes after the modules with an idle function, so
+   * that it can chain its own idle function (which flushes the output)
+   */
+  if (err == AMX_ERR_NONE && (err = amx_DGramInit(&amx)) == AMX_ERR_NOTFOUND)
+    err = AMX_ERR_NONE;
+  if (err == AMX_ERR_NONE && (err = amx_ConsoleInit(&amx)) == AMX_ERR_NOTFOUND)
+    err = AMX_ERR_NONE;
+  if (err == AMX_ERR_NONE)
+    err = amx_CoreInit(&amx);
+  if (err != AMX_ERR_NONE)
+    ErrorExit(&amx, err);
+  if (amx_FindPubVar(&amx, "received", &amx_addr) != AMX_ERR_NONE
+      || amx_GetAddr(&amx, amx_addr, &received) != AMX_ERR_NONE
+      || amx_GetUserData(&amx, AMX_USERTAG('I','d','l','e'), (void**)&idle) != AMX_ERR_NONE
+      || idle == NULL)
+  {
+    printf("%s: no public variable \"received\" or no receive function\n", argv[1]);
+    return 1;
+  } /* if */
+  if (doecho) {
+    if (amx_FindPubVar(&amx, "echo", &amx_addr) != AMX_ERR_NONE
+        || amx_GetAddr(&amx, amx_addr, &echo) != AMX_ERR_NONE)
+    {
+      printf("%s: no public variable \"echo\"\n", argv[1]);
+      return 1;
+    } /* if */
+    *echo = 1;
+  } /* if */
+
+  err = amx_Exec(&amx, NULL, AMX_EXEC_MAIN);
+  if (err != AMX_ERR_NONE)
+    ErrorExit(&amx, err);
+  /* the first call of the idle function binds the socket */
+  err = idle(&amx, amx_Exec);
+  if (err != AMX_ERR_NONE)
+    ErrorExit(&amx, err);
+
+  if ((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
+    printf("Cannot open a socket\n");
+    return 1;
+  } /* if */
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((unsigned short)port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  memset(buffer, 'x', sizeof buffer);
+
+  while (sent < packets) {
+    for (i = 0; i < burst && sent < packets; i++, sent++)
+      sendto(sock, buffer, size, 0, (struct sockaddr *)&addr, sizeof addr);
+    /* handle the burst; stop when the script has seen all packets so far, or
+     * when nothing arrives anymore (packets may have been dropped)
+     */
+    start = timestamp();
+    do {
+      long before = *received;
+      err = idle(&amx, amx_Exec);
+      if (err != AMX_ERR_NONE)
+        ErrorExit(&amx, err);
+      if (*received == before && timestamp() - start > 0.1)
+        break;
+    } while (*received < sent);
+    elapsed += timestamp() - start;
+    if (doecho)
+      while (recv(sock, buffer, sizeof buffer, MSG_DONTWAIT) > 0)
+        replies++;
+  } /* while */
+
+  printf("%ld packets sent, %ld received, %.0f packets/s\n",
+         sent, (long)*received, (elapsed > 0.0) ? (double)*received / elapsed : 0.0);
+  if (doecho)
+    printf("%ld replies received\n", replies);
+
+  close(sock);
+  amx_DGramCleanup(&amx);
+  amx_ConsoleCleanup(&amx);
+  aux_FreeProgram(&amx);
+  return 0;
+}
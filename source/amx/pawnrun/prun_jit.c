@@ -257,6 +257,7 @@ int main(int argc,char *argv[])
   end=clock();
   ExitOnError(&amx, err);
 
+  amx_ConsoleCleanup(&amx);
   aux_FreeProgram(&amx);
 
   if (ret!=0)
@@ -0,0 +1,104 @@
+/*  Load-time benchmark for the abstract machine: it initializes a compiled
+ *  script many times over and reports the time that amx_Init() takes. For a
+ *  script in compact encoding (the default of the Pawn compiler), most of
+ *  this time goes into expanding the code and data sections. Build it a
+ *  second time with AMX_COMPACTINPLACE defined to compare with the in-place
+ *  expansion.
+ *
+ *  This file may be freely used. No warranties of any kind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>             /* for exit() */
+#include <string.h>             /* for memcpy() and memset() */
+#include <time.h>
+#include "amx.h"
+#include "amxaux.h"
+
+static void ErrorExit(AMX *amx, int errorcode)
+{
+  printf("Run time error %d: \"%s\"\n", errorcode, aux_StrError(errorcode));
+  exit(1);
+}
+
+static void PrintUsage(char *program)
+{
+  printf("Usage: %s [-n<loads>] <filename>\n"
+         "<filename> is a compiled script; it is not run, only initialized.\n",
+         program);
+  exit(1);
+}
+
+static double timestamp(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc,char *argv[])
+{
+  AMX amx;
+  AMX_HEADER hdr;
+  FILE *fp;
+  unsigned char *image, *program;
+  long loads = 1000L, i;
+  double elapsed = 0.0, start, expanded;
+  int err;
+
+  while (argc >= 2 && argv[1][0] == '-') {
+    if (argv[1][1] == 'n')
+      loads = atol(argv[1] + 2);
+    else
+      PrintUsage(argv[0]);
+    argv++;
+    argc--;
+  } /* while */
+  if (argc != 2 || loads <= 0)
+    PrintUsage(argv[0]);
+
+  /* read the file once, it is copied into the program buffer for every load */
+  if ((fp = fopen(argv[1], "rb")) == NULL || fread(&hdr, sizeof hdr, 1, fp) != 1) {
+    printf("Cannot read %s\n", argv[1]);
+    return 1;
+  } /* if */
+  amx_Align16(&hdr.magic);
+  amx_Align16((uint16_t *)&hdr.flags);
+  amx_Align32((uint32_t *)&hdr.size);
+  amx_Align32((uint32_t *)&hdr.cod);
+  amx_Align32((uint32_t *)&hdr.hea);
+  amx_Align32((uint32_t *)&hdr.stp);
+  if (hdr.magic != AMX_MAGIC)
+    ErrorExit(&amx, AMX_ERR_FORMAT);
+  image = (unsigned char *)malloc(hdr.size);
+  program = (unsigned char *)malloc(hdr.stp);
+  if (image == NULL || program == NULL)
+    ErrorExit(&amx, AMX_ERR_MEMORY);
+  rewind(fp);
+  if (fread(image, 1, hdr.size, fp) != (size_t)hdr.size) {
+    printf("Cannot read %s\n", argv[1]);
+    return 1;
+  } /* if */
+  fclose(fp);
+
+  for (i = 0; i < loads; i++) {
+    memcpy(program, image, hdr.size);
+    memset(&amx, 0, sizeof amx);
+    start = timestamp();
+    err = amx_Init(&amx, program);
+    elapsed += timestamp() - start;
+    if (err != AMX_ERR_NONE)
+      ErrorExit(&amx, err);
+    amx_Cleanup(&amx);
+  } /* for */
+
+  expanded = (double)(hdr.hea - hdr.cod) * loads;
+  printf("%s: %ld bytes, %ld bytes code and data%s\n", argv[1], (long)hdr.size,
+         (long)(hdr.hea - hdr.cod), (hdr.flags & AMX_FLAG_COMPACT) ? " (compact encoding)" : "");
+  printf("%ld loads, %.1f us per load, %.0f MB/s\n",
+         loads, elapsed * 1e6 / loads, (elapsed > 0.0) ? expanded / elapsed / 1e6 : 0.0);
+
+  free(program);
+  free(image);
+  return 0;
+}
@@ -0,0 +1,92 @@
+/*  Console output benchmark: it runs a script that writes log lines, such as
+ *  examples/logbench.p, and reports the number of lines per second. Redirect
+ *  the standard output to a file or to /dev/null (or NUL); the result goes
+ *  to the standard error stream.
+ *
+ *  This file may be freely used. No warranties of any kind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>             /* for exit() */
+#include <time.h>
+#include "amx.h"
+#include "amxaux.h"
+
+extern int AMXEXPORT amx_ConsoleInit(AMX *amx);
+extern int AMXEXPORT amx_ConsoleCleanup(AMX *amx);
+extern int AMXEXPORT amx_CoreInit(AMX *amx);
+extern int AMXEXPORT amx_FloatInit(AMX *amx);
+
+static void ErrorExit(AMX *amx, int errorcode)
+{
+  fprintf(stderr, "Run time error %d: \"%s\"\n", errorcode, aux_StrError(errorcode));
+  exit(1);
+}
+
+static void PrintUsage(char *program)
+{
+  fprintf(stderr, "Usage: %s [-n<lines>] <filename>\n"
+          "<filename> is a compiled script that writes the number of lines that\n"
+          "is in the public variable \"lines\" (see examples/logbench.p).\n",
+          program);
+  exit(1);
+}
+
+static double timestamp(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc,char *argv[])
+{
+  AMX amx;
+  cell amx_addr, *lines;
+  long count = 0;
+  double elapsed;
+  int err;
+
+  while (argc >= 2 && argv[1][0] == '-') {
+    if (argv[1][1] == 'n')
+      count = atol(argv[1] + 2);
+    else
+      PrintUsage(argv[0]);
+    argv++;
+    argc--;
+  } /* while */
+  if (argc != 2 || count < 0)
+    PrintUsage(argv[0]);
+
+  err = aux_LoadProgram(&amx, argv[1], NULL);
+  if (err == AMX_ERR_NONE && (err = amx_ConsoleInit(&amx)) == AMX_ERR_NOTFOUND)
+    err = AMX_ERR_NONE;
+  if (err == AMX_ERR_NONE && (err = amx_FloatInit(&amx)) == AMX_ERR_NOTFOUND)
+    err = AMX_ERR_NONE;
+  if (err == AMX_ERR_NONE)
+    err = amx_CoreInit(&amx);
+  if (err != AMX_ERR_NONE)
+    ErrorExit(&amx, err);
+  if (amx_FindPubVar(&amx, "lines", &amx_addr) != AMX_ERR_NONE
+      || amx_GetAddr(&amx, amx_addr, &lines) != AMX_ERR_NONE)
+  {
+    fprintf(stderr, "%s: no public variable \"lines\"\n", argv[1]);
+    return 1;
+  } /* if */
+  if (count > 0)
+    *lines = (cell)count;
+  count = (long)*lines;
+
+  elapsed = timestamp();
+  err = amx_Exec(&amx, NULL, AMX_EXEC_MAIN);
+  amx_ConsoleCleanup(&amx);     /* flushes the output */
+  elapsed = timestamp() - elapsed;
+  if (err != AMX_ERR_NONE)
+    ErrorExit(&amx, err);
+
+  fprintf(stderr, "%ld lines in %.3f s, %.0f lines/s\n",
+          count, elapsed, (elapsed > 0.0) ? (double)count / elapsed : 0.0);
+
+  aux_FreeProgram(&amx);
+  return 0;
+}
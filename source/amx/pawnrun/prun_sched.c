@@ -0,0 +1,123 @@
+/*  Command-line shell for running several Pawn scripts concurrently, using
+ *  the multi-threaded scheduler in AMXSCHED.C.
+ *
+ *  This file may be freely used. No warranties of any kind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>             /* for exit() */
+#include <string.h>             /* for memset() (on some compilers) */
+#include "amx.h"
+#include "amxaux.h"
+#include "amxsched.h"
+#include "amxtime.h"
+
+extern int AMXEXPORT amx_ConsoleInit(AMX *amx);
+extern int AMXEXPORT amx_ConsoleCleanup(AMX *amx);
+extern int AMXEXPORT amx_CoreInit(AMX *amx);
+
+/* the timers tell when the idle function must run next, but when the script
+ * has an @keypressed() function, the console must still be polled
+ */
+static int AMXAPI NextEvent(AMX *amx, long *milliseconds)
+{
+  int err, index;
+
+  err = amx_TimeNext(amx, milliseconds);
+  if (err == AMX_ERR_NONE
+      && amx_FindPublic(amx, "@keypressed", &index) == AMX_ERR_NONE
+      && (*milliseconds < 0 || *milliseconds > SCHED_IDLEINTERVAL))
+    *milliseconds = SCHED_IDLEINTERVAL;
+  return err;
+}
+
+static void AMXAPI Done(AMX *amx, int error, cell retval)
+{
+  double seconds;
+
+  if (sched_CpuTime(amx, &seconds) != AMX_ERR_NONE)
+    seconds = 0.0;
+  if (error != AMX_ERR_NONE)
+    printf("Script %p: run time error %d: \"%s\" (%.3f s)\n",
+           (void*)amx, error, aux_StrError(error), seconds);
+  else
+    printf("Script %p returns %ld (%.3f s)\n", (void*)amx, (long)retval, seconds);
+}
+
+static void PrintUsage(char *program)
+{
+  printf("Usage: %s [-t<threads>] [-b<budget>] <filename> [<filename> ...]\n"
+         "<filename> is a compiled script; a script may be given more than once.\n"
+         "<budget> is the number of calls and backward jumps after which a\n"
+         "script yields to the other scripts.\n",
+         program);
+  exit(1);
+}
+
+int main(int argc,char *argv[])
+{
+  AMX *amx;
+  int numthreads = 0;
+  long budget = 0;
+  int count, i, err;
+
+  while (argc >= 2 && argv[1][0] == '-') {
+    if (argv[1][1] == 't')
+      numthreads = atoi(argv[1] + 2);
+    else if (argv[1][1] == 'b')
+      budget = atol(argv[1] + 2);
+    else
+      PrintUsage(argv[0]);
+    argv++;
+    argc--;
+  } /* while */
+  if (argc < 2)
+    PrintUsage(argv[0]);
+  count = argc - 1;
+  if ((amx = (AMX*)malloc(count * sizeof(AMX))) == NULL) {
+    printf("Insufficient memory\n");
+    return 1;
+  } /* if */
+
+  err = sched_Init(numthreads);
+  if (err != AMX_ERR_NONE) {
+    printf("Failed to start the scheduler: %s\n", aux_StrError(err));
+    return 1;
+  } /* if */
+  sched_SetNext(NextEvent);
+
+  /* every abstract machine gets its own copy of the script, with its own
+   * timer and console state (these are kept in the user data of the AMX)
+   */
+  for (i = 0; i < count; i++) {
+    err = aux_LoadProgram(&amx[i], argv[i + 1], NULL);
+    /* only the last of the extension modules reports whether all native
+     * functions are now registered
+     */
+    if (err == AMX_ERR_NONE && (err = amx_TimeInit(&amx[i])) == AMX_ERR_NOTFOUND)
+      err = AMX_ERR_NONE;
+    if (err == AMX_ERR_NONE && (err = amx_ConsoleInit(&amx[i])) == AMX_ERR_NOTFOUND)
+      err = AMX_ERR_NONE;
+    if (err == AMX_ERR_NONE)
+      err = amx_CoreInit(&amx[i]);
+    if (err == AMX_ERR_NONE)
+      err = amx_SetBudget(&amx[i], budget);
+    if (err == AMX_ERR_NONE)
+      err = sched_Add(&amx[i], AMX_EXEC_MAIN, Done);
+    if (err != AMX_ERR_NONE) {
+      printf("%s: %s\n", argv[i + 1], aux_StrError(err));
+      exit(1);
+    } /* if */
+  } /* for */
+
+  sched_Wait();
+  sched_Cleanup();
+
+  for (i = 0; i < count; i++) {
+    amx_TimeCleanup(&amx[i]);
+    amx_ConsoleCleanup(&amx[i]);
+    aux_FreeProgram(&amx[i]);
+  } /* for */
+  free(amx);
+  return 0;
+}
@@ -0,0 +1,215 @@
+#!/usr/bin/env python
+
+import argparse
+import glob
+import json
+import math
+import os.path
+import subprocess
+import sys
+
+parser = argparse.ArgumentParser()
+parser.add_argument('-c', '--compiler',
+                    required=True,
+                    help='path to compiler executable (pawncc)')
+parser.add_argument('-i', '--include',
+                    dest='include_dirs',
+                    action='append',
+                    help='add custom include directories for the benchmarks')
+parser.add_argument('-r', '--runner',
+                    dest='runners',
+                    action='append',
+                    required=True,
+                    metavar='NAME=PATH',
+                    help='add a benchmark runner (pawnbench), for example '
+                         'one for every interpreter variant or JIT')
+parser.add_argument('-n', '--runs',
+                    type=int,
+                    default=10,
+                    help='number of timed runs per benchmark (default: 10)')
+parser.add_argument('-f', '--format',
+                    choices=['json', 'csv'],
+                    default='json',
+                    help='format of the report (default: json)')
+parser.add_argument('-o', '--output',
+                    help='write the report to a file instead of stdout')
+parser.add_argument('-b', '--baseline',
+                    help='compare against a JSON report of an earlier run')
+parser.add_argument('-t', '--threshold',
+                    type=float,
+                    default=10.0,
+                    help='slowdown (in percent of the mean time per '
+                         'operation) that the comparison with the baseline '
+                         'reports as a regression (default: 10)')
+parser.add_argument('benchmarks', metavar='benchmark_name', nargs='*')
+options = parser.parse_args(sys.argv[1:])
+
+def run_command(args, executable=None):
+  process = subprocess.Popen(args,
+                             executable=executable,
+                             stdout=subprocess.PIPE,
+                             stderr=subprocess.STDOUT,
+                             universal_newlines=True)
+  stdout, stderr = process.communicate()
+  return (process, stdout)
+
+def run_compiler(args):
+  final_args = [';+', '-(+']
+  if options.include_dirs is not None:
+    for dir in options.include_dirs:
+      final_args.append('-i' + dir)
+  final_args += args
+  return run_command(executable=options.compiler, args=final_args)
+
+def statistics(samples):
+  mean = sum(samples) / len(samples)
+  if len(samples) > 1:
+    variance = sum((x - mean) ** 2 for x in samples) / (len(samples) - 1)
+  else:
+    variance = 0.0
+  return {
+    'mean': mean,
+    'stddev': math.sqrt(variance),
+    'min': min(samples),
+    'max': max(samples)
+  }
+
+class BenchmarkError(Exception):
+  pass
+
+class Benchmark:
+  def __init__(self, name):
+    self.name = name
+
+  def compile(self):
+    process, output = run_compiler([self.name + '.pwn'])
+    if process.returncode != 0:
+      raise BenchmarkError(
+        'Compiler exited with status {}\n\nOutput:\n\n{}'.format(
+          process.returncode, output))
+
+  def run(self, runner_name, runner):
+    process, output = run_command([
+      runner, '-n' + str(options.runs), self.name + '.amx'
+    ])
+    if process.returncode != 0:
+      raise BenchmarkError(
+        'Runner {} exited with status {}\n\nOutput:\n\n{}'.format(
+          runner_name, process.returncode, output))
+    ops = None
+    core = None
+    ns_per_op = []
+    for line in output.splitlines():
+      fields = line.split()
+      if len(fields) == 2 and fields[0] == 'core:':
+        core = fields[1]
+        continue
+      if len(fields) != 2:
+        continue
+      ops = int(fields[0])
+      ns_per_op.append(float(fields[1]) / ops)
+    if not ns_per_op:
+      raise BenchmarkError(
+        'Runner {} printed no timings\n\nOutput:\n\n{}'.format(
+          runner_name, output))
+    result = {
+      'benchmark': self.name,
+      'runner': runner_name,
+      'core': core,
+      'ops': ops,
+      'runs': len(ns_per_op),
+      'ns_per_op': statistics(ns_per_op)
+    }
+    return result
+
+def parse_runner(spec):
+  if '=' in spec:
+    name, path = spec.split('=', 1)
+  else:
+    path = spec
+    name = os.path.splitext(os.path.basename(spec))[0]
+  return (name, path)
+
+def write_report(results, file):
+  if options.format == 'json':
+    json.dump({'results': results}, file, indent=2, sort_keys=True)
+    file.write('\n')
+  else:
+    file.write('benchmark,runner,core,ops,runs,mean,stddev,min,max\n')
+    for result in results:
+      stats = result['ns_per_op']
+      file.write('{},{},{},{},{},{:.3f},{:.3f},{:.3f},{:.3f}\n'.format(
+        result['benchmark'], result['runner'], result['core'], result['ops'],
+        result['runs'],
+        stats['mean'], stats['stddev'], stats['min'], stats['max']))
+
+def compare_baseline(results):
+  with open(options.baseline, 'r') as baseline_file:
+    baseline = json.load(baseline_file)['results']
+  previous = {}
+  for result in baseline:
+    previous[(result['benchmark'], result['runner'])] = result
+  num_regressions = 0
+  for result in results:
+    old = previous.get((result['benchmark'], result['runner']))
+    if old is None:
+      continue
+    old_mean = old['ns_per_op']['mean']
+    new_mean = result['ns_per_op']['mean']
+    change = (new_mean - old_mean) * 100.0 / old_mean
+    regression = change > options.threshold
+    if regression:
+      num_regressions += 1
+    sys.stderr.write('{:<12} {:<16} {:10.3f} -> {:10.3f} ns/op {:+7.1f}%{}\n'.format(
+      result['benchmark'], result['runner'], old_mean, new_mean, change,
+      '  REGRESSION' if regression else ''))
+  return num_regressions
+
+benchmarks = []
+for source_file in sorted(glob.glob('*.pwn')):
+  name = os.path.splitext(source_file)[0]
+  if options.benchmarks and name not in options.benchmarks:
+    continue
+  benchmarks.append(Benchmark(name))
+
+runners = [parse_runner(spec) for spec in options.runners]
+results = []
+num_failed = 0
+for benchmark in benchmarks:
+  try:
+    benchmark.compile()
+  except BenchmarkError as error:
+    sys.stderr.write('Benchmark {} failed: {}\n'.format(benchmark.name, error))
+    num_failed += 1
+    continue
+  for runner_name, runner in runners:
+    sys.stderr.write('Running {} with {}...\n'.format(
+      benchmark.name, runner_name))
+    try:
+      result = benchmark.run(runner_name, runner)
+      if runner_name in ('labels', 'switch') and result['core'] != runner_name:
+        sys.stderr.write('Warning: runner {} ran the {} core\n'.format(
+          runner_name, result['core']))
+      results.append(result)
+    except BenchmarkError as error:
+      sys.stderr.write('Benchmark {} failed: {}\n'.format(
+        benchmark.name, error))
+      num_failed += 1
+
+if options.output:
+  with open(options.output, 'w') as output_file:
+    write_report(results, output_file)
+else:
+  write_report(results, sys.stdout)
+
+num_regressions = 0
+if options.baseline:
+  num_regressions = compare_baseline(results)
+  if num_regressions > 0:
+    sys.stderr.write('\n{} REGRESSION{}\n'.format(
+      num_regressions, '' if num_regressions == 1 else 'S'))
+if num_failed > 0:
+  sys.stderr.write('\n{} BENCHMARK{} FAILED\n'.format(
+    num_failed, '' if num_failed == 1 else 'S'))
+if num_regressions > 0 or num_failed > 0:
+  sys.exit(1)
@@ -162,7 +162,7 @@ static char *prefix[3]={ "error", "fatal error", "warning" };
  */
 void *pc_opensrc(char *filename)
 {
-  return fopen(filename,"rt");
+  return sfopen(filename);
 }
 
 /* pc_createsrc()
@@ -179,7 +179,7 @@ void *pc_opensrc(char *filename)
  */
 void *pc_createsrc(char *filename)
 {
-  return fopen(filename,"wt");
+  return sfcreate(fopen(filename,"wt"));
 }
 
 /* pc_createtmpsrc()
@@ -215,7 +215,7 @@ void *pc_createtmpsrc(char **filename)
   #endif
   if (filename!=NULL)
     *filename=tname;
-  return ftmp;
+  return sfcreate(ftmp);
 }
 
 /* pc_closesrc()
@@ -225,7 +225,7 @@ void *pc_createtmpsrc(char **filename)
 void pc_closesrc(void *handle)
 {
   assert(handle!=NULL);
-  fclose((FILE*)handle);
+  sfclose((SRCFILE*)handle);
 }
 
 /* pc_resetsrc()
@@ -235,7 +235,7 @@ void pc_closesrc(void *handle)
 void pc_resetsrc(void *handle,void *position)
 {
   assert(handle!=NULL);
-  fsetpos((FILE*)handle,(fpos_t *)position);
+  sfsetpos((SRCFILE*)handle,position);
 }
 
 /* pc_readsrc()
@@ -244,7 +244,7 @@ void pc_resetsrc(void *handle,void *position)
  */
 char *pc_readsrc(void *handle,unsigned char *target,int maxchars)
 {
-  return fgets((char*)target,maxchars,(FILE*)handle);
+  return sfgets((SRCFILE*)handle,target,maxchars);
 }
 
 /* pc_writesrc()
@@ -253,20 +253,17 @@ char *pc_readsrc(void *handle,unsigned char *target,int maxchars)
  */
 int pc_writesrc(void *handle,unsigned char *source)
 {
-  return fputs((char*)source,(FILE*)handle) >= 0;
+  return sfputs((SRCFILE*)handle,source);
 }
 
 void *pc_getpossrc(void *handle)
 {
-  static fpos_t lastpos;  /* may need to have a LIFO stack of such positions */
-
-  fgetpos((FILE*)handle,&lastpos);
-  return &lastpos;
+  return sfgetpos((SRCFILE*)handle);
 }
 
 int pc_eofsrc(void *handle)
 {
-  return feof((FILE*)handle);
+  return sfeof((SRCFILE*)handle);
 }
 
 /* should return a pointer, which is used as a "magic cookie" to all I/O
@@ -0,0 +1,117 @@
+/*  A benchmark runner based on pawnruns.c: it runs the main() function of a
+ *  script a number of times and prints, for every run, the number of
+ *  operations that main() returned and the time that it took.
+ *
+ *  This file may be freely used. No warranties of any kind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>             /* for exit() */
+#include <string.h>             /* for memset() (on some compilers) */
+#if defined __WIN32__ || defined _WIN32 || defined WIN32
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+#include "../amx/amx.h"
+#include "../amx/amxaux.h"
+
+/* the same test that amx.c uses to choose the interpreter core */
+#if defined __64BIT__ && PAWN_CELL_SIZE!=64
+  #define BENCH_CORE  "switch"  /* a pointer does not fit in a cell */
+#elif (defined __GNUC__ || defined __ICC) && !defined AMX_NO_LABELS
+  #define BENCH_CORE  "labels"
+#else
+  #define BENCH_CORE  "switch"
+#endif
+
+static void ErrorExit(AMX *amx, int errorcode)
+{
+  (void)amx;
+  printf("Run time error %d: \"%s\"\n", errorcode, aux_StrError(errorcode));
+  exit(1);
+}
+
+static void PrintUsage(char *program)
+{
+  printf("Usage: %s [-n<runs>] <filename>\n"
+         "<filename> is a compiled script, whose main() returns the number of\n"
+         "operations that it performed.\n"
+         "The first line names the interpreter core (\"core: labels\" or\n"
+         "\"core: switch\"), then every run prints a line with the operations\n"
+         "and the nanoseconds.\n",
+         program);
+  exit(1);
+}
+
+static double timestamp(void)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER count;
+    if (frequency.QuadPart == 0)
+      QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart * 1e9 / (double)frequency.QuadPart;
+  #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+  #endif
+}
+
+int main(int argc,char *argv[])
+{
+  extern AMX_NATIVE_INFO console_Natives[];
+  extern AMX_NATIVE_INFO core_Natives[];
+  extern AMX_NATIVE_INFO string_Natives[];
+
+  AMX amx;
+  cell ret = 0;
+  int runs = 10;
+  int err, run;
+  double start, stop;
+
+  while (argc >= 2 && argv[1][0] == '-') {
+    if (argv[1][1] == 'n')
+      runs = atoi(argv[1] + 2);
+    else
+      PrintUsage(argv[0]);
+    argv++;
+    argc--;
+  } /* while */
+  if (argc != 2 || runs <= 0)
+    PrintUsage(argv[0]);
+
+  err = aux_LoadProgram(&amx, argv[1], NULL);
+  if (err != AMX_ERR_NONE)
+    ErrorExit(&amx, err);
+
+  amx_Register(&amx, console_Natives, -1);
+  amx_Register(&amx, string_Natives, -1);
+  err = amx_Register(&amx, core_Natives, -1);
+  if (err != AMX_ERR_NONE)
+    ErrorExit(&amx, err);
+
+  printf("core: %s\n", BENCH_CORE);
+
+  /* the first run is not reported: it warms up the caches and it patches
+   * the native function calls (if the abstract machine does so)
+   */
+  for (run = -1; run < runs; run++) {
+    start = timestamp();
+    err = amx_Exec(&amx, &ret, AMX_EXEC_MAIN);
+    stop = timestamp();
+    if (err != AMX_ERR_NONE)
+      ErrorExit(&amx, err);
+    if (ret <= 0) {
+      printf("%s: main() returned %ld, the benchmark failed\n", argv[1], (long)ret);
+      exit(1);
+    } /* if */
+    if (run >= 0)
+      printf("%ld %.0f\n", (long)ret, stop - start);
+  } /* for */
+
+  aux_FreeProgram(&amx);
+  return 0;
+}
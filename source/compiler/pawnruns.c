@@ -28,6 +28,8 @@ int main(int argc,char *argv[])
 {
   extern AMX_NATIVE_INFO console_Natives[];
   extern AMX_NATIVE_INFO core_Natives[];
+  extern int AMXEXPORT amx_FileInit(AMX *amx);
+  extern int AMXEXPORT amx_FileCleanup(AMX *amx);
 
   AMX amx;
   cell ret = 0;
@@ -40,6 +42,10 @@ int main(int argc,char *argv[])
   if (err != AMX_ERR_NONE)
     ErrorExit(&amx, err);
 
+  /* the file module is initialized before the other natives are registered,
+   * as amx_Init() does with the extension modules that it loads
+   */
+  amx_FileInit(&amx);
   amx_Register(&amx, console_Natives, -1);
   err = amx_Register(&amx, core_Natives, -1);
   if (err != AMX_ERR_NONE)
@@ -50,6 +56,7 @@ int main(int argc,char *argv[])
     ErrorExit(&amx, err);
   printf("%s returns %ld\n", argv[1], (long)ret);
 
+  amx_FileCleanup(&amx);
   aux_FreeProgram(&amx);
   return 0;
 }
@@ -247,6 +247,7 @@ typedef struct s_symbol {
 
 #define flagDEPRECATED 0x01  /* symbol is deprecated (avoid use) */
 #define flagNAKED     0x10  /* function is naked */
+#define flagNOINLINE  0x40  /* function may not be inlined */
 #define flagPREDEF    0x20  /* symbol is pre-defined; successor of uPREDEF */
 
 #define uTAGOF    0x40  /* set in the "hasdefault" field of the arginfo struct */
@@ -292,6 +293,31 @@ enum {
   statSKIP,     /* skipping output */
 };
 
+enum {
+  pchNONE,      /* not recording a precompiled header */
+  pchRECORD,    /* recording, inside a declaration */
+  pchBOUNDARY,  /* recording, between two declarations */
+};
+
+enum {
+  tmOTHER,      /* set-up and clean-up, outside the passes */
+  tmPARSE,      /* parsing and code generation */
+  tmPREPROCESS, /* reading lines and handling directives */
+  tmSUBST,      /* macro substitution */
+  tmOPTIMIZE,   /* peephole optimizer */
+  tmASSEMBLE,   /* assembling the binary file */
+  tmDEBUGINFO,  /* writing the debug information */
+  tmNUMBER      /* number of phases */
+};
+
+enum {
+  tcMACRO,      /* macro expansions */
+  tcSTAGED,     /* instructions written to the staging buffer */
+  tcPEEPHOLE,   /* sequences replaced by the peephole optimizer */
+  tcLINES,      /* source lines read */
+  tcNUMBER      /* number of counters */
+};
+
 typedef struct s_stringlist {
   char **data;
   char **strings;
@@ -306,12 +332,65 @@ typedef struct s_stringpair {
   int matchlength;
 } stringpair;
 
+/* memory pool for items of a single size (see sclist.c) */
+typedef struct s_mempool {
+  struct s_memblock *blocks;    /* blocks taken from the heap */
+  void *freelist;               /* released items, kept for re-use */
+  int itemsize;
+  int used;                     /* items handed out from the newest block */
+  long count;                   /* items in use */
+  long peak;                    /* maximum number of items in use */
+} mempool;
+
+#define REFER_POOLS 7           /* referrer lists of 1, 2, 4, ... 64 entries */
+
 typedef struct s_valuepair {
   struct s_valuepair *next;
   long first;
   long second;
 } valuepair;
 
+/* debug information, collected in the final pass (see sclist.c) */
+typedef struct s_dbgfilerec {
+  ucell address;
+  int name;                     /* offset of the file name in the name pool */
+} dbgfilerec;
+
+typedef struct s_dbglinerec {
+  ucell address;
+  int line;                     /* zero-based */
+} dbglinerec;
+
+typedef struct s_dbgsymrec {
+  ucell address;
+  ucell codestart;
+  ucell codeend;
+  int tag;
+  int name;                     /* offset of the symbol name in the name pool */
+  char ident;
+  char vclass;
+  short dim;                    /* number of dimensions */
+  int dimindex;                 /* index of the first dimension in "dims" */
+} dbgsymrec;
+
+typedef struct s_dbgdimrec {
+  int tag;
+  cell size;
+} dbgdimrec;
+
+typedef struct s_dbginfo {
+  dbgfilerec *files;
+  int numfiles, maxfiles;
+  dbglinerec *lines;
+  int numlines, maxlines;
+  dbgsymrec *symbols;
+  int numsymbols, maxsymbols;
+  dbgdimrec *dims;
+  int numdims, maxdims;
+  char *names;                  /* name pool, zero-terminated strings */
+  int namesize, maxnames;
+} dbginfo;
+
 /* macros for code generation */
 #define opcodes(n)      ((n)*sizeof(cell))      /* opcode size */
 #define opargs(n)       ((n)*sizeof(cell))      /* size of typical argument */
@@ -474,6 +553,7 @@ enum {
   sOPTIMIZE_NONE,               /* no optimization */
   sOPTIMIZE_NOMACRO,            /* no macro instructions */
   sOPTIMIZE_DEFAULT,            /* full optimization */
+  sOPTIMIZE_INLINE,             /* full optimization, plus inlining of small functions */
   /* ----- */
   sOPTIMIZE_NUMBER
 };
@@ -628,6 +708,7 @@ SC_FUNC void check_index_tagmismatch(char *symname,int expectedtag,int actualtag
 SC_FUNC void check_tagmismatch(int formaltag,int actualtag,int allowcoerce,int errline);
 SC_FUNC void check_tagmismatch_multiple(int formaltags[],int numtags,int actualtag,int errline);
 SC_FUNC char *funcdisplayname(char *dest,char *funcname);
+SC_FUNC int index_inrange(symbol *sym,cell length);
 SC_FUNC int constexpr(cell *val,int *tag,symbol **symptr);
 SC_FUNC constvalue *append_constval(constvalue_root *table,const char *name,cell val,int index);
 SC_FUNC constvalue *find_constval(constvalue_root *table,char *name,int index);
@@ -661,6 +742,7 @@ SC_FUNC void litadd(cell value);
 SC_FUNC void litinsert(cell value,int pos);
 SC_FUNC int alphanum(char c);
 SC_FUNC int ishex(char c);
+SC_FUNC int forloop_range(char *name,cell *low,cell *high);
 SC_FUNC void delete_symbol(symbol *root,symbol *sym);
 SC_FUNC void delete_symbols(symbol *root,int level,int del_labels,int delete_functions);
 SC_FUNC int refer_symbol(symbol *entry,symbol *bywhom);
@@ -781,6 +863,7 @@ SC_FUNC void outinstr(const char *name,emit_outval params[],int numparams);
 SC_FUNC int error(long number,...);
 SC_FUNC void errorset(int code,int line);
 SC_FUNC int error_suggest(int error,const char *name,const char *name2,int type,int subtype);
+SC_FUNC void delete_suggestindex(void);
 
 /* function prototypes in SC6.C */
 SC_FUNC int assemble(FILE *fout,FILE *fin);
@@ -798,9 +881,14 @@ SC_FUNC int phopt_cleanup(void);
 
 /* function prototypes in SCLIST.C */
 SC_FUNC char* duplicatestring(const char* sourcestring);
+SC_FUNC void *pool_alloc(mempool *pool);
+SC_FUNC void pool_free(mempool *pool,void *item);
+SC_FUNC void pool_release(mempool *pool);
+SC_FUNC long pool_peakmemory(mempool *pool);
 SC_FUNC stringpair *insert_alias(char *name,char *alias);
 SC_FUNC stringpair *find_alias(char *name);
 SC_FUNC int lookup_alias(char *target,char *name);
+SC_FUNC int get_alias(int index,char **name,char **alias);
 SC_FUNC void delete_aliastable(void);
 SC_FUNC stringlist *insert_path(char *path);
 SC_FUNC char *get_path(int index);
@@ -823,11 +911,11 @@ SC_FUNC void delete_autolisttable(void);
 SC_FUNC valuepair *push_heaplist(long first, long second);
 SC_FUNC int popfront_heaplist(long *first, long *second);
 SC_FUNC void delete_heaplisttable(void);
-SC_FUNC stringlist *insert_dbgfile(const char *filename);
-SC_FUNC stringlist *insert_dbgline(int linenr);
-SC_FUNC stringlist *insert_dbgsymbol(symbol *sym);
-SC_FUNC char *get_dbgstring(int index);
-SC_FUNC void delete_dbgstringtable(void);
+SC_FUNC void insert_dbgfile(const char *filename);
+SC_FUNC void insert_dbgline(int linenr);
+SC_FUNC void insert_dbgsymbol(symbol *sym);
+SC_FUNC dbginfo *get_dbginfo(void);
+SC_FUNC void delete_dbginfo(void);
 
 /* function prototypes in SCMEMFILE.C */
 #if !defined tMEMFILE
@@ -843,6 +931,15 @@ unsigned int mfwrite(MEMFILE *mf,const unsigned char *buffer,unsigned int size);
 unsigned int mfread(MEMFILE *mf,unsigned char *buffer,unsigned int size);
 char *mfgets(MEMFILE *mf,char *string,unsigned int size);
 int mfputs(MEMFILE *mf,const char *string);
+typedef struct tagSRCFILE SRCFILE;
+SRCFILE *sfopen(const char *filename);
+SRCFILE *sfcreate(FILE *fp);
+void sfclose(SRCFILE *sf);
+char *sfgets(SRCFILE *sf,unsigned char *string,int size);
+int sfputs(SRCFILE *sf,const unsigned char *string);
+void *sfgetpos(SRCFILE *sf);
+void sfsetpos(SRCFILE *sf,void *position);
+int sfeof(SRCFILE *sf);
 
 /* function prototypes in SCI18N.C */
 #define MAXCODEPAGE 12
@@ -852,6 +949,141 @@ SC_FUNC cell cp_translate(const unsigned char *string,const unsigned char **endp
 SC_FUNC cell get_utf8_char(const unsigned char *string,const unsigned char **endptr);
 SC_FUNC int scan_utf8(FILE *fp,const char *filename);
 
+/* the assembler text of the final pass, as parsed by SCASM.C for the control
+ * flow optimizer (SCFLOW.C) and for inlining (SCINLINE.C)
+ */
+#define sMAXOPERANDS  5       /* push5.c has the most operands */
+
+/* flow of control, for the control flow optimizer */
+enum {
+  flPLAIN,      /* no effect on the flow of control */
+  flJUMP,       /* conditional jump to a label */
+  flGOTO,       /* unconditional jump to a label */
+  flSWITCH,     /* jump to a case table */
+  flCASETBL,    /* start of a case table */
+  flCASE,       /* record in a case table */
+  flEXIT,       /* return from the function, or abort the program */
+  flBREAK,      /* line information for a debugger */
+  flCTRL,       /* read a special register ("lctrl 6" reads CIP) */
+  flUNSAFE,     /* flow of control that cannot be followed */
+};
+
+/* effects on the registers and on memory, for the control flow optimizer */
+#define fxPRI     0x01  /* changes PRI */
+#define fxALT     0x02  /* changes ALT */
+#define fxSTACK   0x04  /* writes to the stack, or releases stack space */
+#define fxMEMORY  0x08  /* may write to any memory */
+#define fxGLOBAL  0x10  /* writes to the global variable in the first operand */
+#define fxLOCAL   0x20  /* writes to the local variable in the first operand */
+#define fxCALL    (fxPRI | fxALT | fxMEMORY)
+
+/* instructions whose effect on PRI and ALT the control flow optimizer tracks exactly */
+enum {
+  trNONE,       /* only the effects flags apply */
+  trLOAD,       /* load a register from a global variable */
+  trLOADS,      /* load a register from a local variable */
+  trLOADBOTH,   /* load PRI and ALT from two global variables */
+  trLOADSBOTH,  /* load PRI and ALT from two local variables */
+  trCONST,      /* load a register with a constant */
+  trZERO,       /* set a register to zero */
+  trSTOR,       /* store a register in a global variable */
+  trSTORS,      /* store a register in a local variable */
+  trMOVE,       /* copy the other register into a register */
+  trXCHG,       /* exchange PRI and ALT */
+};
+
+/* effects on the stack and frame-relative operands, for inlining */
+enum {
+  opPLAIN,      /* no effect on the stack, no frame-relative operands */
+  opFRAME,      /* all operands are offsets relative to the frame */
+  opFRAME1,     /* only the first operand is relative to the frame */
+  opPUSH,       /* pushes one cell per operand (or one cell, if no operands) */
+  opPUSHFRAME,  /* pushes one cell per operand, operands relative to the frame */
+  opPOP,        /* pops one cell */
+  opSTACK,      /* adjusts the stack */
+  opJUMP,       /* conditional jump to a label */
+  opGOTO,       /* unconditional jump to a label */
+  opCALL,       /* call a function, which removes its arguments */
+  opSYSREQN,    /* call a native function and remove its arguments */
+  opRET,        /* return from a function */
+  opHALT,       /* abort the program */
+  opPROC,       /* start of a function (the stack frame) */
+  opSWITCH,     /* jump to a case table */
+  opCASE,       /* record in a case table */
+  opBREAK,      /* line information for a debugger */
+  opCTRL,       /* access to special registers */
+  opUNKNOWN,    /* anything that makes the stack depth unknown */
+};
+
+typedef struct s_asmopcode {
+  char *name;
+  int flow;       /* flXXX */
+  int effects;    /* fxXXX flags */
+  int track;      /* trXXX */
+  int reg;        /* the register for the tracked instructions */
+  int inltype;    /* opXXX */
+  int inlinable;  /* may appear in an inlined function */
+} asmopcode;
+
+enum {
+  asmOTHER,     /* comment or empty line */
+  asmDIRECTIVE, /* a directive, such as "CODE" or "dump" */
+  asmLABEL,
+  asmINSTR,
+};
+
+/* a parsed line of assembler text */
+typedef struct s_asmline {
+  int kind;             /* asmOTHER, asmDIRECTIVE, asmLABEL or asmINSTR */
+  int label;            /* label number, for a label */
+  const asmopcode *op;  /* instruction, NULL if the line is not an instruction */
+  int numoperands;
+  cell operands[sMAXOPERANDS];
+  int unparsed;         /* an operand is not a number, e.g. the name in "call" */
+  const char *name;     /* start of the first operand */
+  int namelength;
+} asmline;
+
+/* function prototypes in SCASM.C */
+SC_FUNC const asmopcode *asm_findopcode(const char *name,int length);
+SC_FUNC int asm_hexdigit(int c);
+SC_FUNC int asm_parseline(const char *text,asmline *line);
+
+/* function prototypes in SCFLOW.C */
+SC_FUNC void flow_begin(void);
+SC_FUNC int flow_collect(const char *str);
+SC_FUNC void flow_end(void);
+SC_FUNC void flow_cleanup(void);
+
+/* function prototypes in SCINLINE.C */
+SC_FUNC void inline_track(const char *str);
+SC_FUNC void inline_begin(symbol *sym);
+SC_FUNC void inline_end(void);
+SC_FUNC int inline_expand(char *start,char *end,char **result,int *length);
+SC_FUNC void inline_cleanup(void);
+
+/* function prototypes in SCPCH.C */
+SC_FUNC int pch_load(char *filename,char *prefixname);
+SC_FUNC int pch_uptodate(char *filename,char *prefixname);
+SC_FUNC void pch_record(char *filename,char *prefixname,int retry);
+SC_FUNC int pch_retry(void);
+SC_FUNC void pch_plunge(char *name,char *path);
+SC_FUNC void pch_missing(char *path);
+SC_FUNC void pch_leave(void);
+SC_FUNC void pch_discard(void);
+SC_FUNC void pch_reject(const char *reason);
+SC_FUNC const char *pch_finish(void);
+
+/* function prototypes in SCTIMER.C */
+SC_FUNC void timer_init(void);
+SC_FUNC void timer_enter(int phase);
+SC_FUNC void timer_leave(void);
+SC_FUNC void timer_pass(const char *label);
+SC_FUNC void timer_file(const char *name);
+SC_FUNC void timer_count(int counter);
+SC_FUNC void timer_report(const char *filename);
+SC_FUNC void timer_cleanup(void);
+
 /* function prototypes in SCSTATE.C */
 SC_FUNC constvalue *automaton_add(const char *name);
 SC_FUNC constvalue *automaton_find(const char *name);
@@ -874,6 +1106,12 @@ SC_FUNC int state_conflict_id(int listid1,int listid2);
 SC_VDECL symbol loctab;       /* local symbol table */
 SC_VDECL symbol glbtab;       /* global symbol table */
 SC_VDECL struct hashtable_t symbol_cache_ht;
+SC_VDECL struct hashtable_t local_cache_ht;
+SC_VDECL unsigned int glbtab_version;/* changes when a global symbol is added, removed or renamed */
+SC_VDECL mempool symbol_pool; /* memory for symbols */
+SC_VDECL mempool refer_pool[REFER_POOLS];/* memory for referrer lists */
+SC_VDECL mempool constvalue_pool;/* memory for constant lists */
+SC_VDECL mempool stringpair_pool;/* memory for aliases and text substitutions */
 SC_VDECL symbol *line_sym;
 SC_VDECL cell *litq;          /* the literal queue */
 SC_VDECL unsigned char pline[]; /* the line read from the input file */
@@ -933,8 +1171,11 @@ SC_VDECL int sc_curstates;    /* ID of the current state list */
 SC_VDECL int pc_optimize;     /* (peephole) optimization level */
 SC_VDECL int pc_memflags;     /* special flags for the stack/heap usage */
 SC_VDECL int pc_naked;        /* if true mark following function as naked */
+SC_VDECL int pc_noinline;     /* if true mark following function as not to be inlined */
 SC_VDECL int pc_compat;       /* running in compatibility mode? */
 SC_VDECL int pc_recursion;    /* enable detailed recursion report? */
+SC_VDECL int sc_pchrecord;    /* recording a precompiled header? */
+SC_VDECL int sc_timing;       /* collect timing information? */
 
 SC_VDECL constvalue_root sc_automaton_tab; /* automaton table */
 SC_VDECL constvalue_root sc_state_tab;     /* state table */
@@ -81,6 +81,8 @@ static char *get_extension(char *filename);
 static void setopt(int argc,char **argv,char *oname,char *ename,char *pname,
                    char *rname,char *codepage);
 static void setconfig(char *root);
+static int plungeprefix(char *incfname,int loadpch);
+static int usepch(void);
 static void setcaption(void);
 static void about(void);
 static void setconstants(void);
@@ -161,8 +163,18 @@ static int optproccall = TRUE;  /* support "procedure call" */
 static int verbosity  = 1;      /* verbosity level, 0=quiet, 1=normal, 2=verbose */
 static int sc_reparse = 0;      /* needs 3th parse because of changed prototypes? */
 static int sc_parsenum = 0;     /* number of the extra parses */
+static char pchfname[_MAX_PATH];/* precompiled header for the "prefix" file */
+static const char *pchfailure;  /* why the "prefix" file was not precompiled */
+static char timefname[_MAX_PATH];/* JSON file for the timing report */
 static int wq[wqTABSZ];         /* "while queue", internal stack for nested loops */
 static int *wqptr;              /* pointer to next entry */
+static constvalue_root loopvar_tab = { NULL, NULL }; /* "for" loops with a known range, per position */
+static struct {                 /* ranges of the loop variables in the active "for" loops */
+  symbol *sym;
+  cell low,high;
+} looprange[wqTABSZ/wqSIZE];
+static int looprangeidx;
+static int numlabels;           /* number of labels defined (to detect labels in a loop body) */
 #if !defined SC_LIGHT
   static char sc_rootpath[_MAX_PATH];
   static char *sc_documentation=NULL;/* main documentation */
@@ -248,7 +260,7 @@ static char *prefix[3]={ "error", "fatal error", "warning" };
  */
 void *pc_opensrc(char *filename)
 {
-  return fopen(filename,"r");
+  return sfopen(filename);
 }
 
 /* pc_createsrc()
@@ -265,7 +277,7 @@ void *pc_opensrc(char *filename)
  */
 void *pc_createsrc(char *filename)
 {
-  return fopen(filename,"w");
+  return sfcreate(fopen(filename,"w"));
 }
 
 /* pc_createtmpsrc()
@@ -301,7 +313,7 @@ void *pc_createtmpsrc(char **filename)
   #endif
   if (filename!=NULL)
     *filename=tname;
-  return ftmp;
+  return sfcreate(ftmp);
 }
 
 /* pc_closesrc()
@@ -311,7 +323,7 @@ void *pc_createtmpsrc(char **filename)
 void pc_closesrc(void *handle)
 {
   assert(handle!=NULL);
-  fclose((FILE*)handle);
+  sfclose((SRCFILE*)handle);
 }
 
 /* pc_resetsrc()
@@ -321,7 +333,7 @@ void pc_closesrc(void *handle)
 void pc_resetsrc(void *handle,void *position)
 {
   assert(handle!=NULL);
-  fsetpos((FILE*)handle,(fpos_t *)position);
+  sfsetpos((SRCFILE*)handle,position);
 }
 
 /* pc_readsrc()
@@ -330,7 +342,7 @@ void pc_resetsrc(void *handle,void *position)
  */
 char *pc_readsrc(void *handle,unsigned char *target,int maxchars)
 {
-  return fgets((char*)target,maxchars,(FILE*)handle);
+  return sfgets((SRCFILE*)handle,target,maxchars);
 }
 
 /* pc_writesrc()
@@ -339,20 +351,17 @@ char *pc_readsrc(void *handle,unsigned char *target,int maxchars)
  */
 int pc_writesrc(void *handle,unsigned char *source)
 {
-  return fputs((char*)source,(FILE*)handle) >= 0;
+  return sfputs((SRCFILE*)handle,source);
 }
 
 void *pc_getpossrc(void *handle)
 {
-  static fpos_t lastpos;  /* may need to have a LIFO stack of such positions */
-
-  fgetpos((FILE*)handle,&lastpos);
-  return &lastpos;
+  return sfgetpos((SRCFILE*)handle);
 }
 
 int pc_eofsrc(void *handle)
 {
-  return feof((FILE*)handle);
+  return sfeof((SRCFILE*)handle);
 }
 
 /* should return a pointer, which is used as a "magic cookie" to all I/O
@@ -466,6 +475,7 @@ int pc_compile(int argc, char *argv[])
   char incfname[_MAX_PATH];
   char reportname[_MAX_PATH];
   char codepage[MAXCODEPAGE+1];
+  char passname[32];
   FILE *binf;
   void *inpfmark;
   int lcl_packstr,lcl_needsemicolon,lcl_tabsize;
@@ -478,6 +488,7 @@ int pc_compile(int argc, char *argv[])
   /* set global variables to their initial value */
   binf=NULL;
   initglobals();
+  timer_init();
   errorset(sRESET,0);
   errorset(sEXPRRELEASE,0);
   lexinit();
@@ -498,6 +509,7 @@ int pc_compile(int argc, char *argv[])
   /* inptfname may be used in error(), fill it with zeros */
   memset(inpfname,0,_MAX_PATH);
 
+  pc_enablewarning(240,0);      /* off by default, enable with -w240+ */
   setopt(argc,argv,outfname,errfname,incfname,reportname,codepage);
   strcpy(binfname,outfname);
   ptr=get_extension(binfname);
@@ -575,6 +587,50 @@ int pc_compile(int argc, char *argv[])
       fline++;                  /* keep line number up to date */
   skipinput=fline;
   sc_status=statFIRST;
+  /* make the precompiled header for the "prefix" file, if it is missing or
+   * out of date; this parses only the "prefix" file, a second time if the
+   * first parse changes settings that are kept between passes
+   */
+  pchfailure=NULL;
+  if (!strempty(incfname) && usepch() && pch_uptodate(pchfname,incfname)) {
+    if (verbosity>=2)
+      pc_printf("Note: the \"prefix\" file is restored from \"%s\"\n",pchfname);
+  } else if (!strempty(incfname) && usepch()) {
+    int retry=FALSE,found=TRUE;
+    do {
+      delete_symbols(&glbtab,0,TRUE,TRUE);
+      #if !defined NO_DEFINE
+        delete_substtable();
+      #endif
+      resetglobals();
+      sc_ctrlchar=sc_ctrlchar_org;
+      sc_packstr=lcl_packstr;
+      sc_needsemicolon=lcl_needsemicolon;
+      sc_tabsize=lcl_tabsize;
+      errorset(sRESET,0);
+      inpf=NULL;                /* no main source file, only the "prefix" file */
+      freading=TRUE;
+      fline=0;
+      sc_status=statFIRST;
+      setstringconstants();
+      setfileconst(inpfname);
+      pch_record(pchfname,incfname,retry);
+      timer_pass("precompiled header");
+      timer_file(incfname);
+      if (!(found=plungeprefix(incfname,FALSE)))
+        break;                  /* error is reported in the first pass */
+      preprocess();
+      parse();
+      timer_pass(NULL);
+      retry=!retry && pch_retry() && !pch_uptodate(pchfname,incfname);
+    } while (retry);
+    pchfailure=pch_finish();
+    if (!found)
+      pchfailure=NULL;
+    else if (pchfailure==NULL && verbosity>=2)
+      pc_printf("Note: the \"prefix\" file is precompiled in \"%s\"\n",pchfname);
+    delete_symbols(&glbtab,0,TRUE,TRUE);
+  } /* if */
   /* do the first pass through the file (or possibly two or more "first passes") */
   sc_parsenum=0;
   inpfmark=pc_getpossrc(inpf_org);
@@ -601,16 +657,16 @@ int pc_compile(int argc, char *argv[])
     sc_status=statFIRST;        /* resetglobals() resets it to IDLE */
     setstringconstants();
     setfileconst(inpfname);
+    sprintf(passname,"first pass %d",sc_parsenum+1);
+    timer_pass(passname);
+    timer_file(inpfname);
     if (!strempty(incfname)) {
-      if (strcmp(incfname,sDEF_PREFIX)==0) {
-        plungefile(incfname,FALSE,TRUE);    /* parse "default.inc" */
-      } else {
-        if (!plungequalifiedfile(incfname)) /* parse "prefix" include file */
-          error(100,incfname);          /* cannot read from ... (fatal error) */
-      } /* if */
+      if (!plungeprefix(incfname,usepch()) && strcmp(incfname,sDEF_PREFIX)!=0)
+        error(100,incfname);            /* cannot read from ... (fatal error) */
     } /* if */
     preprocess();                       /* fetch first line */
     parse();                            /* process all input */
+    timer_pass(NULL);
     sc_parsenum++;
   } while (sc_reparse);
 
@@ -690,11 +746,12 @@ int pc_compile(int argc, char *argv[])
   setstringconstants();
   setfileconst(inpfname);
   insert_dbgfile(inpfname);
+  timer_pass(sc_listing ? "list pass" : "write pass");
+  timer_file(inpfname);
   if (!strempty(incfname)) {
-    if (strcmp(incfname,sDEF_PREFIX)==0)
-      plungefile(incfname,FALSE,TRUE);  /* parse "default.inc" (again) */
-    else
-      plungequalifiedfile(incfname);    /* parse implicit include file (again) */
+    plungeprefix(incfname,usepch());    /* parse "prefix" include file (again) */
+    if (pchfailure!=NULL)
+      error(241,pchfailure);            /* "prefix" file is not precompiled */
   } /* if */
   preprocess();                         /* fetch first line */
   parse();                              /* process all input */
@@ -707,8 +764,10 @@ int pc_compile(int argc, char *argv[])
                                              * functions and variables */
   if (!entry)
     error(13);                  /* no entry point (no public functions) */
+  timer_pass(NULL);
 
 cleanup:
+  pch_discard();
   if (inpf!=NULL) {             /* main source file is not closed, do it now */
     pc_closesrc(inpf);
     inpf=NULL;
@@ -717,10 +776,14 @@ cleanup:
   if (!(sc_asmfile || sc_listing) && errnum==0 && jmpcode==0) {
     assert(binf!=NULL);
     pc_resetasm(outf);          /* flush and loop back, for reading */
+    timer_pass(NULL);           /* in case the write pass ended with a fatal error */
+    timer_file(NULL);
+    timer_enter(tmASSEMBLE);
     #if !defined SC_LIGHT
       hdrsize=
     #endif
     assemble(binf,outf);        /* assembler file is now input */
+    timer_leave();
   } /* if */
   if (outf!=NULL) {
     pc_closeasm(outf,!(sc_asmfile || sc_listing));
@@ -759,11 +822,27 @@ cleanup:
           pc_printf("=%ld cells (%ld bytes)\n",stacksize,stacksize*sizeof(cell));
         pc_printf("Total requirements:%8ld bytes\n", (long)hdrsize+(long)code_idx+(long)glb_declared*sizeof(cell)+(long)pc_stksize*sizeof(cell));
       } /* if */
+      if (verbosity>=2) {
+        long refersize=0;
+        for (i=0; i<REFER_POOLS; i++)
+          refersize+=pool_peakmemory(&refer_pool[i]);
+        pc_printf("\nPeak compiler memory for:\n");
+        pc_printf("  symbols:         %8ld bytes (%ld symbols)\n", pool_peakmemory(&symbol_pool), symbol_pool.peak);
+        pc_printf("  referrer lists:  %8ld bytes\n", refersize);
+        pc_printf("  constant lists:  %8ld bytes (%ld entries)\n", pool_peakmemory(&constvalue_pool), constvalue_pool.peak);
+        pc_printf("  names & macros:  %8ld bytes (%ld entries)\n", pool_peakmemory(&stringpair_pool), stringpair_pool.peak);
+      } /* if */
       if (flag_exceed)
         error(106,pc_amxlimit+pc_amxram); /* this causes a jump back to label "cleanup" */
     } /* if */
   #endif
 
+  /* the timing report uses the statistics of the memory pools, so it must
+   * come before the pools are released
+   */
+  timer_report(timefname);
+  timer_cleanup();
+
   if (get_sourcefile(1)!=NULL && tname!=NULL) {
     remove(tname);         /* the "input file" was in fact a temporary file */
     free(tname);
@@ -771,6 +850,8 @@ cleanup:
   free(inpfname);
   free(litq);
   stgbuffer_cleanup();
+  inline_cleanup();
+  flow_cleanup();
   clearstk();
   assert(jmpcode!=0 || loctab.next==NULL);/* on normal flow, local symbols
                                            * should already have been deleted */
@@ -779,15 +860,18 @@ cleanup:
   delete_symbols(&glbtab,0,TRUE,TRUE);
   line_sym=NULL;
   hashtable_term(&symbol_cache_ht);
+  hashtable_term(&local_cache_ht);
+  delete_suggestindex();
   delete_consttable(&tagname_tab);
   delete_consttable(&libname_tab);
   delete_consttable(&sc_automaton_tab);
   delete_consttable(&sc_state_tab);
+  delete_consttable(&loopvar_tab);
   state_deletetable();
   delete_aliastable();
   delete_pathtable();
   delete_sourcefiletable();
-  delete_dbgstringtable();
+  delete_dbginfo();
   #if !defined NO_DEFINE
     delete_substtable();
   #endif
@@ -797,6 +881,12 @@ cleanup:
   #endif
   delete_autolisttable();
   delete_heaplisttable();
+  /* all symbols and lists are deleted, return the memory pools to the heap */
+  pool_release(&symbol_pool);
+  for (i=0; i<REFER_POOLS; i++)
+    pool_release(&refer_pool[i]);
+  pool_release(&constvalue_pool);
+  pool_release(&stringpair_pool);
   if (errnum!=0) {
     if (strempty(errfname))
       pc_printf("\n%d Error%s.\n",errnum,(errnum>1) ? "s" : "");
@@ -882,6 +972,8 @@ static void resetglobals(void)
   staging=0;            /* true if staging output */
   declared=0;           /* number of local cells declared */
   glb_declared=0;       /* number of global cells declared */
+  looprangeidx=0;       /* no active loops with a known range */
+  numlabels=0;          /* number of labels defined */
   code_idx=0;           /* number of bytes with generated code */
   ntv_funcid=0;         /* incremental number of native function */
   curseg=0;             /* 1 if currently parsing CODE, 2 if parsing DATA */
@@ -903,6 +995,7 @@ static void resetglobals(void)
   sc_curstates=0;
   pc_memflags=0;
   pc_naked=FALSE;
+  pc_noinline=FALSE;
   emit_flags=0;
   emit_stgbuf_idx=-1;
 }
@@ -939,6 +1032,9 @@ static void initglobals(void)
 
   outfname[0]='\0';      /* output file name */
   errfname[0]='\0';      /* error file name */
+  pchfname[0]='\0';      /* precompiled header file name */
+  timefname[0]='\0';     /* JSON file for the timing report */
+  sc_timing=FALSE;       /* no timing report */
   inpf=NULL;             /* file read from */
   inpfname=NULL;         /* pointer to name of the file currently read from */
   outf=NULL;             /* file written to */
@@ -946,6 +1042,7 @@ static void initglobals(void)
   glbtab.next=NULL;      /* clear global variables/constants table */
   loctab.next=NULL;      /*   "   local      "    /    "       "   */
   hashtable_init(&symbol_cache_ht, sizeof(symbol *),(16384/3*2),NULL); /* 16384 slots */
+  hashtable_init(&local_cache_ht, sizeof(symbol *),(1024/3*2),NULL); /* 1024 slots */
   tagname_tab.first=tagname_tab.last=NULL; /* tagname table */
   libname_tab.first=libname_tab.last=NULL; /* library table (#pragma library "..." syntax) */
 
@@ -962,6 +1059,37 @@ static void initglobals(void)
 #endif
 }
 
+/* plungeprefix()
+ * Parses the "prefix" file, or restores the state after parsing it from the
+ * precompiled header.
+ */
+static int plungeprefix(char *incfname,int loadpch)
+{
+  int result;
+
+  assert(!strempty(incfname));
+  if (loadpch && pch_load(pchfname,incfname))
+    return TRUE;
+  if (strcmp(incfname,sDEF_PREFIX)==0)
+    result=plungefile(incfname,FALSE,TRUE);
+  else
+    result=plungequalifiedfile(incfname);
+  if (!result)
+    pch_discard();
+  return result;
+}
+
+static int usepch(void)
+{
+  if (strempty(pchfname) || sc_listing)
+    return FALSE;
+  #if !defined SC_LIGHT
+    if (sc_makereport)
+      return FALSE;     /* the report needs the documentation comments */
+  #endif
+  return TRUE;
+}
+
 static char *get_extension(char *filename)
 {
   char *ptr;
@@ -1137,6 +1265,9 @@ static void parseoptions(int argc,char **argv,char *oname,char *ename,char *pnam
         if (pc_optimize<sOPTIMIZE_NONE || pc_optimize>=sOPTIMIZE_NUMBER)
           about();
         break;
+      case 'P':
+        strlcpy(pchfname,option_value(ptr),_MAX_PATH); /* set name of precompiled header */
+        break;
       case 'p':
         if (pname)
           strlcpy(pname,option_value(ptr),_MAX_PATH); /* set name of implicit include file */
@@ -1175,6 +1306,10 @@ static void parseoptions(int argc,char **argv,char *oname,char *ename,char *pnam
       case 's':
         skipinput=atoi(option_value(ptr));
         break;
+      case 'T':
+        strlcpy(timefname,option_value(ptr),_MAX_PATH); /* set name of timing report */
+        sc_timing=TRUE;
+        break;
       case 't':
         i=atoi(option_value(ptr));
         if (i>0)
@@ -1498,7 +1633,11 @@ static void about(void)
     pc_printf("         -O<num>  optimization level (default=-O%d)\n",pc_optimize);
     pc_printf("             0    no optimization\n");
     pc_printf("             1    JIT-compatible optimizations only\n");
-    pc_printf("             2    full optimizations\n");
+    pc_printf("             2    full optimizations, also over the flow of whole functions\n");
+    pc_printf("             3    full optimizations, plus inlining of small functions\n");
+    pc_printf("         -P<name> set name of precompiled header for the \"prefix\" file\n");
+    pc_printf("                  (only a \"prefix\" file with just declarations, without\n");
+    pc_printf("                  functions or variables, is precompiled)\n");
     pc_printf("         -p<name> set name of \"prefix\" file\n");
     pc_printf("         -R[+/-]  add detailed recursion report with call chains (default=%c)\n",pc_recursion ? '+' : '-');
 #if !defined SC_LIGHT
@@ -1506,6 +1645,7 @@ static void about(void)
 #endif
     pc_printf("         -S<num>  stack/heap size in cells (default=%d)\n",(int)pc_stksize);
     pc_printf("         -s<num>  skip lines from the input file\n");
+    pc_printf("         -T[name] write timing report to console or as JSON to specified file\n");
     pc_printf("         -t<num>  TAB indent size (in character positions, default=%d)\n",sc_tabsize);
     pc_printf("         -v<num>  verbosity level; 0=quiet, 1=normal, 2=verbose (default=%d)\n",verbosity);
     pc_printf("         -w<num>  disable a specific warning by its number\n");
@@ -1687,8 +1827,15 @@ static void parse(void)
   char *str;
 
   while (freading){
+    /* a precompiled header can only be made if the "prefix" file ends
+     * between two declarations
+     */
+    if (sc_pchrecord!=pchNONE)
+      sc_pchrecord=pchBOUNDARY;
     /* first try whether a declaration possibly is native or public */
     tok=lex(&val,&str);  /* read in (new) token */
+    if (sc_pchrecord!=pchNONE)
+      sc_pchrecord=pchRECORD;
     switch (tok) {
     case 0:
       /* ignore zero's */
@@ -3171,7 +3318,7 @@ SC_FUNC symbol *fetchfunc(char *name,int tag)
   if (pc_deprecate!=NULL) {
     assert(sym!=NULL);
     sym->flags|=flagDEPRECATED;
-    if (sc_status==statWRITE) {
+    if (sc_status==statWRITE || sc_pchrecord!=pchNONE) {
       if (sym->documentation!=NULL) {
         free(sym->documentation);
         sym->documentation=NULL;
@@ -3799,6 +3946,10 @@ static int newfunc(char *firstname,int firsttag,int fpublic,int fstatic,int stoc
     sym->flags|=flagNAKED;
     pc_naked=FALSE;
   } /* if */
+  if (pc_noinline) {
+    sym->flags|=flagNOINLINE;
+    pc_noinline=FALSE;
+  } /* if */
   begcseg();
   sym->usage|=uDEFINE;  /* set the definition flag */
   if (stock)
@@ -3817,6 +3968,9 @@ static int newfunc(char *firstname,int firsttag,int fpublic,int fstatic,int stoc
       ptr=ptr->next;
     } /* while */
   } /* if */
+  if ((stock || fstatic) && !fpublic && state_id==0 && (sym->flags & (flagNAKED | flagNOINLINE))==0)
+    inline_begin(sym);  /* collect the code, for inlining it in later calls */
+  flow_begin();
   startfunc(sym->name,(sym->flags & flagNAKED)==0); /* creates stack frame */
   insert_dbgline(funcline);
   setline(FALSE);
@@ -3866,6 +4020,8 @@ static int newfunc(char *firstname,int firsttag,int fpublic,int fstatic,int stoc
     } /* if */
   } /* if */
   endfunc();
+  flow_end();           /* optimize the function as a whole */
+  inline_end();
   sym->codeaddr=code_idx;
   sc_attachdocumentation(sym);  /* attach collected documenation to the function */
   if (litidx) {                 /* if there are literals defined */
@@ -5068,7 +5224,7 @@ static constvalue *insert_constval(constvalue *prev,constvalue *next,
 {
   constvalue *cur;
 
-  if ((cur=(constvalue*)malloc(sizeof(constvalue)))==NULL)
+  if ((cur=(constvalue*)pool_alloc(&constvalue_pool))==NULL)
     error(103);       /* insufficient memory (fatal error) */
   memset(cur,0,sizeof(constvalue));
   if (name!=NULL) {
@@ -5136,7 +5292,7 @@ static int delete_constval(constvalue_root *table,char *name)
         table->first=cur->next;
       if (table->last==cur)
         table->last=prev;
-      free(cur);
+      pool_free(&constvalue_pool,cur);
       return TRUE;
     } /* if */
     prev=cur;
@@ -5152,7 +5308,7 @@ SC_FUNC void delete_consttable(constvalue_root *table)
 
   while (cur!=NULL) {
     next=cur->next;
-    free(cur);
+    pool_free(&constvalue_pool,cur);
     cur=next;
   } /* while */
   memset(table,0,sizeof(constvalue_root));
@@ -5730,6 +5886,11 @@ static int dofor(void)
   int save_nestlevel,save_endlessloop;
   int index,endtok;
   int *ptr;
+  char varname[sNAMEMAX+1],key[2*sizeof(int)+2*sizeof(long)+2];
+  cell low,high;
+  symbol *var;
+  constvalue *loop;
+  int save_written,save_numlabels,inrange,keycol;
 
   save_decl=declared;
   save_nestlevel=nestlevel;
@@ -5738,6 +5899,21 @@ static int dofor(void)
   addwhile(wq);
   skiplab=getlabel();
   endtok= matchtoken('(') ? ')' : tDO;
+  /* check for a loop whose variable stays within a known range, so that the
+   * run-time bounds checks on arrays indexed by that variable may be dropped
+   */
+  inrange=FALSE;
+  if (endtok==')' && (sc_debug & sCHKBOUNDS)!=0 && pc_optimize>sOPTIMIZE_NONE)
+    inrange=forloop_range(varname,&low,&high);
+  /* the loop is identified by its file and line (the name of the entry in
+   * loopvar_tab, which must fit in sNAMEMAX) and by its column (the index)
+   */
+  assert(sizeof key<=sNAMEMAX+1);
+  keycol=0;
+  if (inrange) {
+    sprintf(key,"%x:%lx",fcurrent,(long)fline);
+    keycol=(int)(lptr-pline);
+  } /* if */
   if (matchtoken(';')==0) {
     /* new variable declarations are allowed here */
     if (matchtoken(tNEW)) {
@@ -5788,7 +5964,47 @@ static int dofor(void)
   stgmark(sENDREORDER);             /* mark end of reversed evaluation */
   stgout(index);
   stgset(FALSE);                    /* stop staging */
+  /* the range of the loop variable holds in the loop body only if the body
+   * does not change the variable (and has no labels to jump into); this is
+   * found in the first pass and used in the pass that generates code
+   */
+  var=NULL;
+  if (inrange) {
+    var=findloc(varname);
+    if (var==NULL || var->ident!=iVARIABLE || var->vclass!=sLOCAL || var->tag!=0)
+      var=NULL;
+  } /* if */
+  save_written=save_numlabels=0;
+  if (var!=NULL && sc_status==statFIRST) {
+    save_written=var->usage & uWRITTEN;
+    var->usage&=~uWRITTEN;
+    save_numlabels=numlabels;
+  } else if (var!=NULL && sc_status==statWRITE) {
+    loop=find_constval(&loopvar_tab,key,keycol);
+    if (loop!=NULL && loop->value==0) {
+      assert(looprangeidx<sizeof looprange / sizeof looprange[0]);
+      looprange[looprangeidx].sym=var;
+      looprange[looprangeidx].low=low;
+      looprange[looprangeidx].high=high;
+      looprangeidx++;
+    } else {
+      var=NULL;
+    } /* if */
+  } else {
+    var=NULL;
+  } /* if */
   statement(NULL,FALSE);
+  if (var!=NULL && sc_status==statFIRST) {
+    int changed=(var->usage & uWRITTEN)!=0 || numlabels!=save_numlabels;
+    if ((loop=find_constval(&loopvar_tab,key,keycol))==NULL)
+      append_constval(&loopvar_tab,key,changed,keycol);
+    else
+      loop->value|=changed;
+    var->usage|=save_written;
+  } else if (var!=NULL) {
+    assert(looprangeidx>0 && looprange[looprangeidx-1].sym==var);
+    looprangeidx--;
+  } /* if */
   jumplabel(wq[wqLOOP]);
   setlabel(wq[wqEXIT]);
   delwhile();
@@ -5811,6 +6027,21 @@ static int dofor(void)
   return index;
 }
 
+/*  index_inrange
+ *
+ *  Returns TRUE if the variable "sym" is the variable of an active "for" loop
+ *  whose values all lie in the range 0..length-1.
+ */
+SC_FUNC int index_inrange(symbol *sym,cell length)
+{
+  int i;
+
+  for (i=0; i<looprangeidx; i++)
+    if (looprange[i].sym==sym)
+      return looprange[i].low>=0 && looprange[i].high<length;
+  return FALSE;
+}
+
 /* The switch statement is incompatible with its C sibling:
  * 1. the cases are not drop through
  * 2. only one instruction may appear below each case, use a compound
@@ -6033,6 +6264,7 @@ static void dolabel(void)
    */
   setstk(-declared*sizeof(cell));
   sym->usage|=uDEFINE;  /* label is now defined */
+  numlabels++;
 }
 
 /*  fetchlab
@@ -168,6 +168,8 @@ static char extensions[][6] = { "", ".inc", ".p", ".pawn" };
     if (!S_ISDIR(st.st_mode))   /* ignore directories with the same name */
       fp=(FILE*)pc_opensrc(real_path);
     if (fp==NULL) {
+      if (sc_pchrecord!=pchNONE)
+        pch_missing(real_path);
       *ext='\0';                /* on failure, restore filename */
       found=FALSE;
     } /* if */
@@ -202,6 +204,9 @@ static char extensions[][6] = { "", ".inc", ".p", ".pawn" };
   setfileconst(inpfname);
   listline=-1;              /* force a #line directive when changing the file */
   sc_is_utf8=(short)scan_utf8(inpf,real_path);
+  if (sc_pchrecord!=pchNONE)
+    pch_plunge(inpfname,real_path);
+  timer_file(inpfname);
   free(real_path);
   return TRUE;
 }
@@ -350,7 +355,7 @@ static void doinclude(int silent)
  */
 static void readline(unsigned char *line)
 {
-  int i,num,cont;
+  int i,num,cont,len;
   unsigned char *ptr;
 
   if (lptr==term_expr)
@@ -391,27 +396,38 @@ static void readline(unsigned char *line)
       insert_dbgfile(inpfname);
       setfiledirect(inpfname);
       listline=-1;              /* force a #line directive when changing the file */
+      if (sc_pchrecord!=pchNONE)
+        pch_leave();
+      timer_file(inpfname);
     } /* if */
 
-    if (pc_readsrc(inpf,line,num)==NULL) {
+    if (inpf==NULL || pc_readsrc(inpf,line,num)==NULL) {
       *line='\0';     /* delete line */
       cont=FALSE;
     } else {
+      len=(int)strlen((char*)line);
       /* check whether to erase leading spaces */
       if (cont) {
         unsigned char *ptr=line;
         while (*ptr<=' ' && *ptr!='\0')
           ptr++;
-        if (ptr!=line)
-          memmove(line,ptr,strlen((char*)ptr)+1);
+        if (ptr!=line) {
+          len-=(int)(ptr-line);
+          memmove(line,ptr,len+1);
+        } /* if */
       } /* if */
       cont=FALSE;
-      /* check whether a full line was read */
-      if (strchr((char*)line,'\n')==NULL && !pc_eofsrc(inpf))
-        error(75);      /* line too long */
-      /* check if the next line must be concatenated to this line */
-      if ((ptr=(unsigned char*)strchr((char*)line,'\n'))==NULL)
+      /* check whether a full line was read (a '\n' can only be the last
+       * character that was read)
+       */
+      if (len>0 && line[len-1]=='\n') {
+        ptr=line+len-1;
+      } else {
+        if (!pc_eofsrc(inpf))
+          error(75);    /* line too long */
         ptr=(unsigned char*)strchr((char*)line,'\r');
+      } /* if */
+      /* check if the next line must be concatenated to this line */
       if (ptr!=NULL && ptr>line) {
         assert(*(ptr+1)=='\0'); /* '\n' or '\r' should be last in the string */
         while (ptr>line && *ptr<=' ')
@@ -423,13 +439,15 @@ static void readline(unsigned char *line)
            */
           *ptr++='\a';
           *ptr='\0';    /* erase '\n' (and any trailing whitespace) */
+          len=(int)(ptr-line);
         } /* if */
       } /* if */
-      num-=strlen((char*)line);
-      line+=strlen((char*)line);
+      num-=len;
+      line+=len;
     } /* if */
     fline+=1;
     setlineconst(fline);
+    timer_count(tcLINES);
   } while (num>=0 && cont);
 }
 
@@ -1093,6 +1111,8 @@ static int command(void)
       char pathname[_MAX_PATH];
       lptr=getstring((unsigned char*)pathname,sizeof pathname,lptr);
       if (!strempty(pathname)) {
+        if (sc_pchrecord!=pchNONE)
+          pch_reject("it has a #file directive");
         free(inpfname);
         inpfname=duplicatestring(pathname);
         if (inpfname==NULL)
@@ -1141,6 +1161,8 @@ static int command(void)
           } /* if */
           if (!cp_set(name))
             error(108);         /* codepage mapping file not found */
+          if (sc_pchrecord!=pchNONE)
+            pch_reject("it sets a codepage");
         } else if (strcmp(str,"compress")==0) {
           cell val;
           preproc_expr(&val,NULL);
@@ -1302,8 +1324,12 @@ static int command(void)
           } while (comma);
         } else if (strcmp(str,"naked")==0) {
           pc_naked=TRUE;
+        } else if (strcmp(str,"noinline")==0) {
+          pc_noinline=TRUE;
         } else if (strcmp(str,"warning")==0) {
           int ok=lex(&val,&str)==tSYMBOL;
+          if (sc_pchrecord!=pchNONE)
+            pch_reject("it changes the warning settings");
           if (ok) {
             if (strcmp(str,"enable")==0) {
               cell val;
@@ -1345,6 +1371,8 @@ static int command(void)
           for (i=0; i<sNAMEMAX && *lptr>' '; i++,lptr++)
             name[i]=*lptr;
           name[i]='\0';
+          if (sc_pchrecord!=pchNONE)
+            pch_reject("it sets compiler options");
           parsesingleoption(name);
         } else {
           error(207);           /* unknown #pragma */
@@ -1860,6 +1888,7 @@ static void substallpatterns(unsigned char *line,int buffersize)
   int prefixlen;
   stringpair *subst;
 
+  timer_enter(tmSUBST);
   start=line;
   while (*start!='\0') {
     /* find the start of a prefix (skip all non-alphabetic characters),
@@ -1901,6 +1930,8 @@ static void substallpatterns(unsigned char *line,int buffersize)
       /* properly match the pattern and substitute */
       if (!substpattern(start,buffersize-(int)(start-line),subst->first,subst->second))
         start=end;      /* match failed, skip this prefix */
+      else
+        timer_count(tcMACRO);
       /* match succeeded: do not update "start", because the substitution text
        * may be matched by other macros
        */
@@ -1908,6 +1939,7 @@ static void substallpatterns(unsigned char *line,int buffersize)
       start=end;        /* no macro with this prefix, skip this prefix */
     } /* if */
   } /* while */
+  timer_leave();
 }
 
 #endif
@@ -1930,6 +1962,7 @@ SC_FUNC void preprocess(void)
 
   if (!freading)
     return;
+  timer_enter(tmPREPROCESS);
   do {
     readline(pline);
     stripcomment(pline);  /* ??? no need for this when reading back from list file (in the second pass) */
@@ -1958,6 +1991,7 @@ SC_FUNC void preprocess(void)
         pc_writeasm(outf,(char*)pline);
     } /* if */
   } while (iscommand!=CMD_NONE && iscommand!=CMD_TERM && freading); /* enddo */
+  timer_leave();
 }
 
 static const unsigned char *unpackedstring(const unsigned char *lptr,int *flags)
@@ -2118,8 +2152,8 @@ static const unsigned char *packedstring(const unsigned char *lptr,int *flags)
 /*  lex(lexvalue,lexsym)        Lexical Analysis
  *
  *  lex() first deletes leading white space, then checks for multi-character
- *  operators, keywords (including most compiler directives), numbers,
- *  labels, symbols and literals (literal characters are converted to a number
+ *  operators, keywords (including most compiler directives), labels, symbols,
+ *  numbers and literals (literal characters are converted to a number
  *  and are returned as such). If every check fails, the line must contain
  *  a single-character operator. So, lex() returns this character. In the other
  *  case (something did match), lex() returns the number of the token. All
@@ -2156,8 +2190,103 @@ static cell _lexval;
 static char _lexstr[sLINEMAX+1];
 static int _lexnewline;
 
+/* Tables for the recognition of multi-character operators and keywords:
+ * - the operators are chained per first character, in the order in which they
+ *   appear in sc_tokens[] (so that a longer operator is still tried before a
+ *   shorter one with the same prefix);
+ * - the reserved words and the directives are stored in a hash table whose
+ *   seed is chosen such that no two keywords collide, so that a symbol needs
+ *   only a single comparison to find out whether it is a keyword.
+ */
+#define OPERATORS       (tMIDDLE-tFIRST+1)
+#define KEYWORD_HASHSIZE 512    /* must be a power of 2 */
+#define KEYWORD_MAXLEN  16
+static short opfirst[256];      /* first operator for a leading character */
+static short opnext[OPERATORS]; /* next operator with the same leading character */
+static short kwtable[KEYWORD_HASHSIZE];
+static unsigned int kwseed;
+static int lextables=FALSE;
+
+static unsigned int keyword_hash(const unsigned char *str,int len,unsigned int seed)
+{
+  unsigned int h=seed ^ 2166136261u;
+  while (len-->0)
+    h=(h ^ *str++)*16777619u;   /* FNV-1a */
+  return (h ^ (h>>15)) & (KEYWORD_HASHSIZE-1);
+}
+
+static void lextables_init(void)
+{
+  extern char *sc_tokens[];
+  int i,last[256];
+  unsigned int h;
+  const unsigned char *tok;
+
+  for (i=0; i<256; i++)
+    opfirst[i]=last[i]=-1;
+  for (i=0; i<OPERATORS; i++) {
+    tok=(const unsigned char*)sc_tokens[i];
+    opnext[i]=-1;
+    if (last[*tok]<0)
+      opfirst[*tok]=(short)i;
+    else
+      opnext[last[*tok]]=(short)i;
+    last[*tok]=i;
+  } /* for */
+
+  /* find a seed for which the hash function is collision-free on the keyword
+   * list (the list is fixed, so this always ends at the same seed)
+   */
+  for (kwseed=0; ; kwseed++) {
+    memset(kwtable,0,sizeof kwtable);
+    for (i=tMIDDLE+1; i<=tLAST; i++) {
+      tok=(const unsigned char*)sc_tokens[i-tFIRST];
+      assert(strlen((const char*)tok)<KEYWORD_MAXLEN);
+      h=keyword_hash(tok,(int)strlen((const char*)tok),kwseed);
+      if (kwtable[h]!=0)
+        break;
+      kwtable[h]=(short)i;
+    } /* for */
+    if (i>tLAST)
+      break;
+  } /* for */
+  lextables=TRUE;
+}
+
+/*  findkeyword
+ *
+ *  Checks whether the text at "ptr" is a reserved word or a directive. These
+ *  start with a letter, with "#" (directives) or with "*" (the "*begin",
+ *  "*end" and "*then" tokens) and, like in match(), they must be followed by
+ *  a non-alphanumeric character. Returns the token, or 0 if there is no match;
+ *  on a match, "len" is set to the length of the keyword.
+ */
+static int findkeyword(const unsigned char *ptr,int *len)
+{
+  extern char *sc_tokens[];
+  const unsigned char *start=ptr;
+  int tok;
+
+  if (*ptr=='#' || *ptr=='*')
+    ptr++;
+  if (!alpha(*ptr))
+    return 0;
+  while (alphanum(*ptr) && ptr-start<KEYWORD_MAXLEN)
+    ptr++;
+  if (alphanum(*ptr))
+    return 0;   /* too long to be a keyword */
+  *len=(int)(ptr-start);
+  tok=kwtable[keyword_hash(start,*len,kwseed)];
+  if (tok==0 || strncmp(sc_tokens[tok-tFIRST],(const char*)start,*len)!=0
+      || sc_tokens[tok-tFIRST][*len]!='\0')
+    return 0;
+  return tok;
+}
+
 SC_FUNC void lexinit(void)
 {
+  if (!lextables)
+    lextables_init();
   stkidx=0;             /* index for pushstk() and popstk() */
   iflevel=0;            /* preprocessor: nesting of "#if" is currently 0 */
   skiplevel=0;          /* preprocessor: not currently skipping */
@@ -2185,7 +2314,7 @@ char *sc_tokens[] = {
 
 SC_FUNC int lex(cell *lexvalue,char **lexsym)
 {
-  int i,toolong,newline,stringflags;
+  int i,len,toolong,newline,stringflags;
   char **tokptr;
   const unsigned char *starttoken;
 
@@ -2229,40 +2358,30 @@ SC_FUNC int lex(cell *lexvalue,char **lexsym)
         stmtindent++;
   } /* if */
 
-  i=tFIRST;
-  tokptr=sc_tokens;
-  while (i<=tMIDDLE) {  /* match multi-character operators */
-    if (*lptr==**tokptr && match(*tokptr,FALSE)) {
-      _lextok=i;
-      if (pc_docexpr)   /* optionally concatenate to documentation string */
-        insert_autolist(*tokptr);
-      return _lextok;
-    } /* if */
-    i+=1;
-    tokptr+=1;
-  } /* while */
-  while (i<=tLAST) {    /* match reserved words and compiler directives */
-    if (*lptr==**tokptr && match(*tokptr,TRUE)) {
-      _lextok=i;
-      errorset(sRESET,0); /* reset error flag (clear the "panic mode")*/
+  /* match multi-character operators, only those that start with the
+   * current character are tried
+   */
+  for (i=opfirst[*lptr]; i>=0; i=opnext[i]) {
+    tokptr=&sc_tokens[i];
+    if (match(*tokptr,FALSE)) {
+      _lextok=i+tFIRST;
       if (pc_docexpr)   /* optionally concatenate to documentation string */
         insert_autolist(*tokptr);
       return _lextok;
     } /* if */
-    i+=1;
-    tokptr+=1;
-  } /* while */
+  } /* for */
+  /* match reserved words and compiler directives */
+  if ((i=findkeyword(lptr,&len))!=0) {
+    lptr+=len;
+    _lextok=i;
+    errorset(sRESET,0); /* reset error flag (clear the "panic mode")*/
+    if (pc_docexpr)     /* optionally concatenate to documentation string */
+      insert_autolist(sc_tokens[i-tFIRST]);
+    return _lextok;
+  } /* if */
 
   starttoken=lptr;      /* save start pointer (for concatenating to documentation string) */
-  if ((i=number(&_lexval,lptr))!=0) {   /* number */
-    _lextok=tNUMBER;
-    *lexvalue=_lexval;
-    lptr+=i;
-  } else if ((i=ftoi(&_lexval,lptr))!=0) {
-    _lextok=tRATIONAL;
-    *lexvalue=_lexval;
-    lptr+=i;
-  } else if (alpha(*lptr)) {            /* symbol or label */
+  if (alpha(*lptr)) {   /* symbol or label */
     /*  Note: only sNAMEMAX characters are significant. The compiler
      *        generates a warning if a symbol exceeds this length.
      */
@@ -2297,7 +2416,15 @@ SC_FUNC int lex(cell *lexvalue,char **lexsym)
         error(220);
       } /* if */
     } /* if */
-    } else if (*lptr=='\"' || *lptr=='#' || (*lptr==sc_ctrlchar && (*(lptr+1)=='\"' || *(lptr+1)=='#')))
+  } else if (isdigit(*lptr) && (i=number(&_lexval,lptr))!=0) {  /* number */
+    _lextok=tNUMBER;
+    *lexvalue=_lexval;
+    lptr+=i;
+  } else if (isdigit(*lptr) && (i=ftoi(&_lexval,lptr))!=0) {
+    _lextok=tRATIONAL;
+    *lexvalue=_lexval;
+    lptr+=i;
+  } else if (*lptr=='\"' || *lptr=='#' || (*lptr==sc_ctrlchar && (*(lptr+1)=='\"' || *(lptr+1)=='#')))
   {                                     /* unpacked string literal */
     _lextok=tSTRING;
     stringflags=(*lptr==sc_ctrlchar) ? RAWMODE : 0;
@@ -2511,6 +2638,120 @@ static int match(char *st,int end)
   return 1;
 }
 
+static const unsigned char *skipspace(const unsigned char *ptr)
+{
+  while (*ptr<=' ' && *ptr!='\0')
+    ptr++;
+  return ptr;
+}
+
+static const unsigned char *peekname(const unsigned char *ptr,char *name)
+{
+  int i;
+
+  ptr=skipspace(ptr);
+  if (!alpha(*ptr))
+    return NULL;
+  for (i=0; alphanum(*ptr); ptr++)
+    if (i<sNAMEMAX)
+      name[i++]=*ptr;
+  name[i]='\0';
+  return skipspace(ptr);
+}
+
+/* peekvalue() accepts a number, an untagged constant or "sizeof array" */
+static const unsigned char *peekvalue(const unsigned char *ptr,cell *val)
+{
+  char name[sNAMEMAX+1];
+  symbol *sym;
+  int i,paranthese,cmptag;
+
+  ptr=skipspace(ptr);
+  if (isdigit(*ptr)) {
+    if ((i=number(val,ptr))==0)
+      return NULL;
+    return skipspace(ptr+i);
+  } /* if */
+  if (strncmp((const char*)ptr,"sizeof",6)==0 && !alphanum(ptr[6])) {
+    ptr=skipspace(ptr+6);
+    if ((paranthese= (*ptr=='('))!=0)
+      ptr++;
+    if ((ptr=peekname(ptr,name))==NULL || (paranthese && *ptr++!=')'))
+      return NULL;
+    if ((sym=findloc(name))==NULL)
+      sym=findglb(name,sSTATEVAR);
+    if (sym==NULL || (sym->ident!=iARRAY && sym->ident!=iREFARRAY)
+        || (sym->usage & uDEFINE)==0 || sym->dim.array.length<=0)
+      return NULL;
+    *val=sym->dim.array.length;
+    return skipspace(ptr);
+  } /* if */
+  if ((ptr=peekname(ptr,name))==NULL)
+    return NULL;
+  cmptag=0;
+  if ((sym=findconst(name,&cmptag))==NULL || cmptag>1 || sym->tag!=0)
+    return NULL;
+  *val=sym->addr;
+  return ptr;
+}
+
+/*  forloop_range
+ *
+ *  Looks ahead in the current line, without reading any tokens, for the
+ *  header of a "for" loop in the form
+ *      for ([new] var = low; var < limit; var++)
+ *  where the test may also use "<=", the increment may also be "++var" or
+ *  "var += step" and where "low", "limit" and "step" are numbers, untagged
+ *  constants or "sizeof array". On success, the name of the loop variable
+ *  and the range of values that the variable has in the loop body are
+ *  returned (provided that the loop body does not change the variable).
+ *
+ *  The header must be on a single line and "lptr" must point behind the
+ *  opening parenthesis.
+ */
+SC_FUNC int forloop_range(char *name,cell *low,cell *high)
+{
+  const unsigned char *ptr;
+  char str[sNAMEMAX+1];
+  cell limit,step;
+  int inclusive;
+
+  assert(!_pushed);
+  ptr=skipspace(lptr);
+  if (strncmp((const char*)ptr,"new",3)==0 && !alphanum(ptr[3]))
+    ptr+=3;
+  /* initialization, "var = low" */
+  if ((ptr=peekname(ptr,name))==NULL || *ptr!='=' || *(ptr+1)=='=')
+    return FALSE;
+  if ((ptr=peekvalue(ptr+1,low))==NULL || *ptr!=';')
+    return FALSE;
+  /* test, "var < limit" or "var <= limit" */
+  if ((ptr=peekname(ptr+1,str))==NULL || strcmp(str,name)!=0 || *ptr!='<' || *(ptr+1)=='<')
+    return FALSE;
+  inclusive= (*(ptr+1)=='=');
+  if ((ptr=peekvalue(ptr+(inclusive ? 2 : 1),&limit))==NULL || *ptr!=';')
+    return FALSE;
+  /* increment, "var++", "++var" or "var += step" */
+  ptr=skipspace(ptr+1);
+  step=1;
+  if (*ptr=='+' && *(ptr+1)=='+') {
+    if ((ptr=peekname(ptr+2,str))==NULL)
+      return FALSE;
+  } else {
+    if ((ptr=peekname(ptr,str))==NULL || *ptr!='+')
+      return FALSE;
+    if (*(ptr+1)=='+')
+      ptr=skipspace(ptr+2);
+    else if (*(ptr+1)!='=' || (ptr=peekvalue(ptr+2,&step))==NULL)
+      return FALSE;
+  } /* if */
+  if (strcmp(str,name)!=0 || *ptr!=')')
+    return FALSE;
+  *high= inclusive ? limit : limit-1;
+  /* the variable must stay non-negative, and the increment may not overflow */
+  return *low>=0 && *low<=*high && step>0 && step<=(cell)(~(ucell)0>>1)-*high;
+}
+
 static void chk_grow_litq(void)
 {
   if (litidx>=litmax) {
@@ -2825,17 +3066,36 @@ static uint32_t murmurhash2_aligned(const void *key,int len,uint32_t seed)
 #define namehash(name) \
         (HASHTABLE_U64)murmurhash2_aligned(name,strlen(name),0)
 
+/* Global and local symbols each have a hash table, keyed on the name; the
+ * symbols with the same key are chained through "htnext". Local symbols are
+ * searched newest first (so that a variable in a nested compound statement
+ * shadows one in an enclosing statement), so they are added at the head of
+ * the chain; global symbols are added at the tail.
+ */
+static struct hashtable_t *symbol_cache(const symbol *sym)
+{
+  return (sym->vclass==sGLOBAL) ? &symbol_cache_ht : &local_cache_ht;
+}
+
 static void symbol_cache_add(symbol *sym)
 {
   const HASHTABLE_U64 key=namehash(sym->name);
-  symbol **pcache_sym=(symbol **)hashtable_find(&symbol_cache_ht,key);
+  struct hashtable_t *cache=symbol_cache(sym);
+  symbol **pcache_sym=(symbol **)hashtable_find(cache,key);
   symbol *cache_sym;
 
+  if (cache==&symbol_cache_ht)
+    glbtab_version++;
   if (pcache_sym==NULL) {
-    if (hashtable_insert(&symbol_cache_ht,key,&sym)==0)
+    if (hashtable_insert(cache,key,&sym)==0)
       error(103);       /* insufficient memory */
     return;
   } /* if */
+  if (cache==&local_cache_ht) {
+    sym->htnext=*pcache_sym;
+    *pcache_sym=sym;
+    return;
+  } /* if */
   cache_sym=*pcache_sym;
   while (cache_sym->htnext!=NULL)
     cache_sym=cache_sym->htnext;
@@ -2845,11 +3105,14 @@ static void symbol_cache_add(symbol *sym)
 static void symbol_cache_remove(symbol *sym)
 {
   const HASHTABLE_U64 key=namehash(sym->name);
+  struct hashtable_t *cache=symbol_cache(sym);
   symbol **pcache_sym;
   symbol *cache_sym=NULL;
   symbol *parent_cache_sym=NULL;
 
-  pcache_sym=(symbol **)hashtable_find(&symbol_cache_ht,key);
+  if (cache==&symbol_cache_ht)
+    glbtab_version++;
+  pcache_sym=(symbol **)hashtable_find(cache,key);
   if (pcache_sym!=NULL)
     cache_sym=*pcache_sym;
   for ( ;; ) {
@@ -2863,7 +3126,7 @@ static void symbol_cache_remove(symbol *sym)
 
   if (parent_cache_sym==NULL) {
     if (cache_sym->htnext==NULL)
-      hashtable_remove(&symbol_cache_ht,key);
+      hashtable_remove(cache,key);
     else
       *pcache_sym=cache_sym->htnext;
   } else {
@@ -2871,6 +3134,39 @@ static void symbol_cache_remove(symbol *sym)
   } /* if */
 }
 
+/* Referrer lists have a power-of-two size (they start with one entry and
+ * double in size when full); lists of up to 64 entries come from a pool per
+ * size.
+ */
+static mempool *refer_sizepool(int size)
+{
+  int index;
+
+  assert(size>0 && (size & (size-1))==0);
+  for (index=0; index<REFER_POOLS && (1<<index)<size; index++)
+    /* nothing */;
+  return (index<REFER_POOLS) ? &refer_pool[index] : NULL;
+}
+
+static symbol **refer_alloc(int size)
+{
+  mempool *pool=refer_sizepool(size);
+
+  if (pool!=NULL)
+    return (symbol**)pool_alloc(pool);
+  return (symbol**)malloc(size*sizeof(symbol*));
+}
+
+static void refer_free(symbol **refer,int size)
+{
+  mempool *pool=refer_sizepool(size);
+
+  if (pool!=NULL)
+    pool_free(pool,refer);
+  else
+    free(refer);
+}
+
 /* The local variable table must be searched backwards, so that the deepest
  * nesting of local variables is searched first. The simplest way to do
  * this is to insert all new items at the head of the list.
@@ -2885,7 +3181,7 @@ static symbol *add_symbol(symbol *root,symbol *entry,int sort)
     while (root->next!=NULL && strcmp(entry->name,root->next->name)>0)
       root=root->next;
 
-  if ((newsym=(symbol *)malloc(sizeof(symbol)))==NULL) {
+  if ((newsym=(symbol *)pool_alloc(&symbol_pool))==NULL) {
     error(103);
     return NULL;
   } /* if */
@@ -2893,8 +3189,7 @@ static symbol *add_symbol(symbol *root,symbol *entry,int sort)
   newsym->next=root->next;
   root->next=newsym;
   newsym->htnext=NULL;
-  if (newsym->vclass==sGLOBAL)
-    symbol_cache_add(newsym);
+  symbol_cache_add(newsym);
   return newsym;
 }
 
@@ -2936,11 +3231,10 @@ static void free_symbol(symbol *sym)
     free(sym->dim.enumlist);
   } /* if */
   assert(sym->refer!=NULL);
-  free(sym->refer);
+  refer_free(sym->refer,sym->numrefers);
   free(sym->documentation);
-  if (sym->vclass==sGLOBAL)
-    symbol_cache_remove(sym);
-  free(sym);
+  symbol_cache_remove(sym);
+  pool_free(&symbol_pool,sym);
 }
 
 SC_FUNC void delete_symbol(symbol *root,symbol *sym)
@@ -3044,30 +3338,25 @@ SC_FUNC void delete_symbols(symbol *root,int level,int delete_labels,int delete_
 
 SC_FUNC void rename_symbol(symbol *sym,const char *newname)
 {
-  const int isglobal=(sym->vclass==sGLOBAL);
-
-  if (isglobal)
-    symbol_cache_remove(sym);
+  symbol_cache_remove(sym);
   strcpy(sym->name,newname);
-  if (isglobal)
-    symbol_cache_add(sym);
+  symbol_cache_add(sym);
 }
 
 static symbol *find_symbol(const symbol *root,const char *name,int fnumber,int automaton,int *cmptag)
 {
   symbol *firstmatch=NULL;
-  symbol *sym=root->next;
+  symbol *sym;
+  symbol **pcache_sym;
   int count=0;
-  const int is_global=(root==&glbtab);
 
-  if (is_global) {
-    symbol **pcache_sym=(symbol **)hashtable_find(&symbol_cache_ht,namehash(name));
-    sym=(pcache_sym!=NULL) ? *pcache_sym : NULL;
-  } /* if */
+  /* the hash chain holds the symbols with the same name hash, in search order */
+  assert(root==&glbtab || root==&loctab);
+  pcache_sym=(symbol **)hashtable_find((root==&glbtab) ? &symbol_cache_ht : &local_cache_ht,namehash(name));
+  sym=(pcache_sym!=NULL) ? *pcache_sym : NULL;
 
   while (sym!=NULL) {
-    if ( (is_global || strcmp(name,sym->name)==0)           /* check name */
-        && (sym->parent==NULL || sym->ident==iCONSTEXPR)    /* sub-types (hierarchical types) are skipped, except for enum fields */
+    if ( (sym->parent==NULL || sym->ident==iCONSTEXPR)    /* sub-types (hierarchical types) are skipped, except for enum fields */
         && (sym->fnumber<0 || sym->fnumber==fnumber))       /* check file number for scope */
     {
       assert(sym->states==NULL || sym->states->first!=NULL); /* first element of the state list is the "root" */
@@ -3089,7 +3378,7 @@ static symbol *find_symbol(const symbol *root,const char *name,int fnumber,int a
         } /* if */
       } /* if */
     } /* if */
-    sym=(is_global) ? sym->htnext : sym->next;
+    sym=sym->htnext;
   } /* while */
   if (cmptag!=NULL && firstmatch!=NULL) {
     if (*cmptag==0)
@@ -3136,10 +3425,12 @@ SC_FUNC int refer_symbol(symbol *entry,symbol *bywhom)
     int newsize=2*entry->numrefers;
     assert(newsize>0);
     /* grow the referrer list */
-    refer=(symbol**)realloc(entry->refer,newsize*sizeof(symbol*));
+    refer=refer_alloc(newsize);
     if (refer==NULL)
       return FALSE;             /* insufficient memory */
-    /* initialize the new entries */
+    /* copy the old entries and initialize the new entries */
+    memcpy(refer,entry->refer,entry->numrefers*sizeof(symbol*));
+    refer_free(entry->refer,entry->numrefers);
     entry->refer=refer;
     for (count=entry->numrefers; count<newsize; count++)
       entry->refer[count]=NULL;
@@ -3250,7 +3541,7 @@ SC_FUNC symbol *addsym(const char *name,cell addr,int ident,int vclass,int tag,i
   assert(ident!=iLABEL || findloc(name)==NULL);
 
   /* create an empty referrer list */
-  if ((refer=(symbol**)malloc(sizeof(symbol*)))==NULL) {
+  if ((refer=refer_alloc(1))==NULL) {
     error(103);         /* insufficient memory */
     return NULL;
   } /* if */
@@ -1241,6 +1241,7 @@ static int hier2(value *lval)
     assert(lval->sym!=NULL);
     if ((lval->sym->usage & uCONST)!=0)
       return error(22);         /* assignment to const argument */
+    markusage(lval->sym,uWRITTEN);
     if (!check_userop(user_inc,lval->tag,0,1,lval,&lval->tag))
       inc(lval);                /* increase variable first */
     rvalue(lval);               /* and read the result into PRI */
@@ -1252,6 +1253,7 @@ static int hier2(value *lval)
     assert(lval->sym!=NULL);
     if ((lval->sym->usage & uCONST)!=0)
       return error(22);         /* assignment to const argument */
+    markusage(lval->sym,uWRITTEN);
     if (!check_userop(user_dec,lval->tag,0,1,lval,&lval->tag))
       dec(lval);                /* decrease variable first */
     rvalue(lval);               /* and read the result into PRI */
@@ -1598,6 +1600,7 @@ static int hier2(value *lval)
         assert(lval->sym!=NULL);
         if ((lval->sym->usage & uCONST)!=0)
           return error(22);     /* assignment to const argument */
+        markusage(lval->sym,uWRITTEN);
         /* on incrementing array cells, the address in PRI must be saved for
          * incremening the value, whereas the current value must be in PRI
          * on exit.
@@ -1620,6 +1623,7 @@ static int hier2(value *lval)
         assert(lval->sym!=NULL);
         if ((lval->sym->usage & uCONST)!=0)
           return error(22);     /* assignment to const argument */
+        markusage(lval->sym,uWRITTEN);
         saveresult= (lval->ident==iARRAYCELL || lval->ident==iARRAYCHAR);
         if (saveresult)
           pushreg(sPRI);        /* save address in PRI */
@@ -1665,7 +1669,7 @@ static int hier2(value *lval)
 static int hier1(value *lval1)
 {
   int lvalue,index,tok,symtok;
-  cell val,cidx;
+  cell val,cidx,length;
   value lval2={0};
   char *st;
   char close;
@@ -1763,15 +1767,17 @@ restart:
       } else {
         /* array index is not constant */
         lval1->arrayidx=NULL;           /* reset, so won't be checked */
-        if (close==']') {
-          if (sym->dim.array.length!=0)
-            ffbounds(sym->dim.array.length-1);  /* run time check for array bounds */
+        length=sym->dim.array.length;
+        if (close!=']')
+          length*=(sizeof(cell)*8)/sCHARBITS;
+        if (length!=0 && lval2.ident==iVARIABLE && index_inrange(lval2.sym,length))
+          error(240,lval2.sym->name,sym->name); /* index always in range, no run time check */
+        else if (length!=0)
+          ffbounds(length-1);   /* run time check for array bounds */
+        if (close==']')
           cell2addr();  /* normal array index */
-        } else {
-          if (sym->dim.array.length!=0)
-            ffbounds(sym->dim.array.length*((sizeof(cell)*8)/sCHARBITS)-1);
+        else
           char2addr();  /* character array index */
-        } /* if */
         popreg(sALT);
         ob_add();       /* base address was popped into secondary register */
         if (close!=']')
@@ -196,7 +196,9 @@ static char *warnmsg[] = {
 /*236*/  "unknown parameter in substitution (incorrect #define pattern)\n",
 /*237*/  "user warning: %s\n",
 /*238*/  "meaningless combination of class specifiers (%s)\n",
-/*239*/  "literal array/string passed to a non-const parameter\n"
+/*239*/  "literal array/string passed to a non-const parameter\n",
+/*240*/  "index \"%s\" is always within the bounds of array \"%s\", run-time check removed\n",
+/*241*/  "the \"prefix\" file is not precompiled, %s\n"
 };
 
 static char *noticemsg[] = {
@@ -237,6 +239,10 @@ static short lastfile;
   char string[128];
   int notice;
 
+  /* a "prefix" file that causes errors or warnings is not precompiled */
+  if (sc_pchrecord!=pchNONE)
+    pch_reject("it causes errors or warnings");
+
   /* split the error field between the real error/warning number and an optional
    * "notice" number
    */
@@ -462,33 +468,39 @@ static int minimum(int a,int b,int c)
   return min;
 }
 
-static int levenshtein_distance(const char *s,const char*t)
+/* levenshtein_distance()
+ * Returns the edit distance between the two names (ignoring case), or
+ * "limit"+1 if the distance exceeds "limit". Names whose lengths differ by
+ * more than "limit" are rejected without comparing them, and the comparison
+ * stops as soon as every path through the matrix exceeds the limit.
+ */
+static int levenshtein_distance(const char *s,const char *t,int limit)
 {
-  //Step 1
-  int k,i,j,cost,*d,distance;
+  int prev[2*sNAMEMAX+17],cur[2*sNAMEMAX+17];
+  int i,j,rowmin;
   int n=strlen(s);
   int m=strlen(t);
+
   assert(n>0 && m>0);
-  d=(int*)malloc((sizeof(int))*(m+1)*(n+1));
-  m++;
-  n++;
-  //Step 2
-  for (k=0;k<n;k++)
-    d[k]=k;
-  for (k=0;k<m;k++)
-    d[k*n]=k;
-  //Step 3 and 4
-  for (i=1;i<n;i++) {
-    for (j=1;j<m;j++) {
-      //Step 5
-      cost= (tolower(s[i-1])!=tolower(t[j-1]));
-      //Step 6
-      d[j*n+i]=minimum(d[(j-1)*n+i]+1,d[j*n+i-1]+1,d[(j-1)*n+i-1]+cost);
+  if (n-m>limit || m-n>limit)
+    return limit+1;
+  if (m>=(int)(sizeof prev/sizeof prev[0]))
+    m=sizeof prev/sizeof prev[0]-1; /* cannot happen for symbol names */
+  for (j=0; j<=m; j++)
+    prev[j]=j;
+  for (i=1; i<=n; i++) {
+    cur[0]=rowmin=i;
+    for (j=1; j<=m; j++) {
+      int cost=(tolower(s[i-1])!=tolower(t[j-1]));
+      cur[j]=minimum(prev[j]+1,cur[j-1]+1,prev[j-1]+cost);
+      if (cur[j]<rowmin)
+        rowmin=cur[j];
     } /* for */
+    if (rowmin>limit)
+      return limit+1;
+    memcpy(prev,cur,(m+1)*sizeof(int));
   } /* for */
-  distance=d[n*m-1];
-  free(d);
-  return distance;
+  return (prev[m]>limit) ? limit+1 : prev[m];
 }
 
 static int get_max_dist(const char *name)
@@ -499,6 +511,43 @@ static int get_max_dist(const char *name)
   return max_dist;
 }
 
+/* is_suggestion()
+ * Returns TRUE if the symbol may be suggested for a misspelled name of one
+ * of the kinds in "symboltype".
+ */
+static int is_suggestion(const symbol *sym,int symboltype)
+{
+  if (sym->fnumber!=-1 && sym->fnumber!=fcurrent)
+    return FALSE;
+  if ((sym->usage & uDEFINE)==0 && (sym->ident!=iFUNCTN || (sym->usage & (uNATIVE | uPROTOTYPED))!=uPROTOTYPED))
+    return FALSE;
+  switch (sym->ident)
+  {
+  case iLABEL:
+    return (symboltype & esfLABEL)!=0;
+  case iCONSTEXPR:
+    return (symboltype & esfCONST)!=0;
+  case iVARIABLE:
+  case iREFERENCE:
+    return (symboltype & esfVARIABLE)!=0;
+  case iARRAY:
+  case iREFARRAY:
+    return (symboltype & esfARRAY)!=0;
+  case iFUNCTN:
+  case iREFFUNC:
+    return (symboltype & (((sym->usage & uNATIVE)!=0) ? esfNATIVE : esfFUNCTION))!=0;
+  default:
+    assert(0);
+  } /* switch */
+  return FALSE;
+}
+
+/* The closest match is the first symbol (in the order of the table) at a
+ * distance of 1 or less; if there is none, it is the first symbol at the
+ * smallest distance. suggestion_rank() orders the matches in this way.
+ */
+#define suggestion_rank(dist)   (((dist)<=1) ? 0 : (dist))
+
 static int find_closest_symbol_table(const char *name,const symbol *root,int symboltype,symbol **closest_sym)
 {
   int dist,max_dist,closest_dist=INT_MAX;
@@ -509,42 +558,12 @@ static int find_closest_symbol_table(const char *name,const symbol *root,int sym
   assert(name!=NULL);
   max_dist=get_max_dist(name);
   for (sym=root->next; sym!=NULL; sym=sym->next) {
-    if (sym->fnumber!=-1 && sym->fnumber!=fcurrent)
-      continue;
-    if ((sym->usage & uDEFINE)==0 && (sym->ident!=iFUNCTN || (sym->usage & (uNATIVE | uPROTOTYPED))!=uPROTOTYPED))
+    if (!is_suggestion(sym,symboltype))
       continue;
-    switch (sym->ident)
-    {
-    case iLABEL:
-      if ((symboltype & esfLABEL)==0)
-        continue;
-      break;
-    case iCONSTEXPR:
-      if ((symboltype & esfCONST)==0)
-        continue;
-      break;
-    case iVARIABLE:
-    case iREFERENCE:
-      if ((symboltype & esfVARIABLE)==0)
-        continue;
-      break;
-    case iARRAY:
-    case iREFARRAY:
-      if ((symboltype & esfARRAY)==0)
-        continue;
-      break;
-    case iFUNCTN:
-    case iREFFUNC:
-      if ((symboltype & (((sym->usage & uNATIVE)!=0) ? esfNATIVE : esfFUNCTION))==0)
-        continue;
-      break;
-    default:
-      assert(0);
-    } /* switch */
     funcdisplayname(symname,sym->name);
     if (symname[0] == '\0')
       continue;
-    dist=levenshtein_distance(name,symname);
+    dist=levenshtein_distance(name,symname,max_dist);
     if (dist>max_dist || dist>=closest_dist)
       continue;
     *closest_sym=sym;
@@ -555,6 +574,106 @@ static int find_closest_symbol_table(const char *name,const symbol *root,int sym
   return closest_dist;
 }
 
+/* The global symbols are indexed on the length of their names, because only
+ * names with a length that is close to that of the misspelled name can be
+ * within the maximum edit distance. The index is built when the first
+ * suggestion is needed, and it is rebuilt after the global symbol table has
+ * changed (see "glbtab_version").
+ */
+typedef struct s_suggestentry {
+  symbol *sym;
+  int order;            /* position of the symbol in the global table */
+} suggestentry;
+
+#define SUGGEST_MAXLENGTH (2*sNAMEMAX+16)
+
+static suggestentry *suggest_index=NULL;
+static int suggest_bucket[SUGGEST_MAXLENGTH+2]; /* start of each length in the index */
+static unsigned int suggest_version;
+
+static int display_length(symbol *sym)
+{
+  char symname[2*sNAMEMAX+16];
+  int length=strlen(funcdisplayname(symname,sym->name));
+  return (length<=SUGGEST_MAXLENGTH) ? length : SUGGEST_MAXLENGTH;
+}
+
+static int build_suggestindex(void)
+{
+  symbol *sym;
+  int count,length,order;
+
+  if (suggest_index!=NULL && suggest_version==glbtab_version)
+    return TRUE;
+  delete_suggestindex();
+  /* count the names per length, then sort them on length (counting sort,
+   * which keeps the table order within each length)
+   */
+  memset(suggest_bucket,0,sizeof suggest_bucket);
+  count=0;
+  for (sym=glbtab.next; sym!=NULL; sym=sym->next) {
+    suggest_bucket[display_length(sym)+1]++;
+    count++;
+  } /* for */
+  for (length=1; length<=SUGGEST_MAXLENGTH+1; length++)
+    suggest_bucket[length]+=suggest_bucket[length-1];
+  if ((suggest_index=(suggestentry*)malloc((count+1)*sizeof(suggestentry)))==NULL)
+    return FALSE;
+  order=0;
+  for (sym=glbtab.next; sym!=NULL; sym=sym->next) {
+    suggestentry *entry=&suggest_index[suggest_bucket[display_length(sym)]++];
+    entry->sym=sym;
+    entry->order=order++;
+  } /* for */
+  /* the loop above moved each start to the start of the next length */
+  for (length=SUGGEST_MAXLENGTH+1; length>0; length--)
+    suggest_bucket[length]=suggest_bucket[length-1];
+  suggest_bucket[0]=0;
+  suggest_version=glbtab_version;
+  return TRUE;
+}
+
+SC_FUNC void delete_suggestindex(void)
+{
+  free(suggest_index);
+  suggest_index=NULL;
+}
+
+static int find_closest_global(const char *name,int symboltype,symbol **closest_sym)
+{
+  int dist,max_dist,closest_dist=INT_MAX,closest_order=INT_MAX;
+  int length,minlength,maxlength,idx;
+  char symname[2*sNAMEMAX+16];
+
+  if (!build_suggestindex())
+    return find_closest_symbol_table(name,&glbtab,symboltype,closest_sym);
+  *closest_sym=NULL;
+  max_dist=get_max_dist(name);
+  length=strlen(name);
+  minlength=(length-max_dist>1) ? length-max_dist : 1;
+  maxlength=(length+max_dist<SUGGEST_MAXLENGTH) ? length+max_dist : SUGGEST_MAXLENGTH;
+  for (length=minlength; length<=maxlength; length++) {
+    for (idx=suggest_bucket[length]; idx<suggest_bucket[length+1]; idx++) {
+      suggestentry *entry=&suggest_index[idx];
+      if (closest_dist<=1 && entry->order>closest_order)
+        break;  /* the later symbols of this length cannot be better */
+      if (!is_suggestion(entry->sym,symboltype))
+        continue;
+      dist=levenshtein_distance(name,funcdisplayname(symname,entry->sym->name),max_dist);
+      if (dist>max_dist)
+        continue;
+      if (suggestion_rank(dist)<suggestion_rank(closest_dist)
+          || (suggestion_rank(dist)==suggestion_rank(closest_dist) && entry->order<closest_order))
+      {
+        *closest_sym=entry->sym;
+        closest_dist=dist;
+        closest_order=entry->order;
+      } /* if */
+    } /* for */
+  } /* for */
+  return closest_dist;
+}
+
 static symbol *find_closest_symbol(const char *name,int symboltype)
 {
   symbol *symloc,*symglb;
@@ -569,7 +688,7 @@ static symbol *find_closest_symbol(const char *name,int symboltype)
   if (distloc<=1)
     distglb=INT_MAX; /* don't bother searching in the global table */
   else
-    distglb=find_closest_symbol_table(name,&glbtab,symboltype,&symglb);
+    distglb=find_closest_global(name,symboltype,&symglb);
   return (distglb<distloc) ? symglb : symloc;
 }
 
@@ -583,7 +702,7 @@ static constvalue *find_closest_automaton(const char *name)
   max_dist=get_max_dist(name);
   while (ptr!=NULL) {
     if (ptr->name[0]!='\0') {
-      dist=levenshtein_distance(name,ptr->name);
+      dist=levenshtein_distance(name,ptr->name,max_dist);
       if (dist<closest_dist && dist<=max_dist) {
         closest_match=ptr;
         closest_dist=dist;
@@ -606,7 +725,7 @@ static constvalue *find_closest_state(const char *name,int fsa)
   max_dist=get_max_dist(name);
   while (ptr!=NULL) {
     if (ptr->index==fsa && ptr->name[0]!='\0') {
-      dist=levenshtein_distance(name,ptr->name);
+      dist=levenshtein_distance(name,ptr->name,max_dist);
       if (dist<closest_dist && dist<=max_dist) {
         closest_match=ptr;
         closest_dist=dist;
@@ -636,7 +755,7 @@ static constvalue *find_closest_automaton_for_state(const char *statename,int fs
     if (fsa!=ptr->index && ptr->name[0]!='\0' && strcmp(statename,ptr->name)==0) {
       automaton=automaton_findid(ptr->index);
       assert(automaton!=NULL);
-      dist=levenshtein_distance(fsaname,automaton->name);
+      dist=levenshtein_distance(fsaname,automaton->name,max_dist);
       if (dist<closest_dist && dist<=max_dist) {
         closest_match=automaton;
         closest_dist=dist;
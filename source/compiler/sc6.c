@@ -1094,8 +1094,11 @@ SC_FUNC int assemble(FILE *fout,FILE *fin)
 
   if (sc_compress)
     hdr.size=pc_lengthbin(fout);/* get this value before appending debug info */
-  if (!writeerror && (sc_debug & sSYMBOLIC)!=0)
+  if (!writeerror && (sc_debug & sSYMBOLIC)!=0) {
+    timer_enter(tmDEBUGINFO);
     append_dbginfo(fout);       /* optionally append debug file */
+    timer_leave();
+  } /* if */
 
   if (writeerror)
     error(101,"disk full");
@@ -1133,15 +1136,18 @@ static void append_dbginfo(FILE *fout)
   AMX_DBG_HDR dbghdr;
   AMX_DBG_LINE dbgline;
   AMX_DBG_SYMBOL dbgsym;
-  AMX_DBG_SYMDIM dbgidxtag[sDIMEN_MAX];
-  int index,dim,dbgsymdim;
-  char *str,*prevstr,*name,*prevname;
-  ucell codeidx,previdx;
+  AMX_DBG_SYMDIM dbgidxtag;
+  dbginfo *info;
+  const dbgsymrec *sym;
+  const dbgdimrec *dim;
+  char *name;
+  int index,count;
   constvalue *constptr;
-  char symname[2*sNAMEMAX+16];
   int16_t id1,id2;
   ucell address;
 
+  info=get_dbginfo();
+
   /* header with general information */
   memset(&dbghdr, 0, sizeof dbghdr);
   dbghdr.size=sizeof dbghdr;
@@ -1151,59 +1157,26 @@ static void append_dbginfo(FILE *fout)
 
   /* first pass: collect the number of items in various tables */
 
-  /* file table */
-  previdx=0;
-  prevstr=NULL;
-  prevname=NULL;
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='F') {
-      codeidx=hex2long(str+2,&name);
-      if (codeidx!=previdx) {
-        if (prevstr!=NULL) {
-          assert(prevname!=NULL);
-          dbghdr.files++;
-          dbghdr.size+=sizeof(AMX_DBG_FILE)+strlen(prevname);
-        } /* if */
-        previdx=codeidx;
-      } /* if */
-      prevstr=str;
-      prevname=skipwhitespace(name);
-    } /* if */
-  } /* for */
-  if (prevstr!=NULL) {
-    assert(prevname!=NULL);
+  /* file table; of a run of files that start at the same address, only the
+   * last one is kept
+   */
+  for (index=0; index<info->numfiles; index++) {
+    if (index+1<info->numfiles && info->files[index+1].address==info->files[index].address)
+      continue;
     dbghdr.files++;
-    dbghdr.size+=sizeof(AMX_DBG_FILE)+strlen(prevname);
-  } /* if */
+    dbghdr.size+=sizeof(AMX_DBG_FILE)+strlen(info->names+info->files[index].name);
+  } /* for */
 
   /* line number table */
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='L') {
-      dbghdr.lines++;
-      dbghdr.size+=sizeof(AMX_DBG_LINE);
-    } /* if */
-  } /* for */
+  dbghdr.lines=(int16_t)info->numlines;
+  dbghdr.size+=info->numlines*sizeof(AMX_DBG_LINE);
 
   /* symbol table */
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='S') {
-      dbghdr.symbols++;
-      name=skipwhitespace(strchr(str+2,':')+1);
-      assert(name!=NULL);
-      str=strchr(name,' ');
-      assert(str!=NULL);
-      assert((int)(str-name)<sizeof symname);
-      dbghdr.size+=sizeof(AMX_DBG_SYMBOL)+(str-name);
-      if ((prevstr=strchr(name,'['))!=NULL)
-        while ((prevstr=strchr(prevstr+1,':'))!=NULL)
-          dbghdr.size+=sizeof(AMX_DBG_SYMDIM);
-    } /* if */
+  dbghdr.symbols=(int16_t)info->numsymbols;
+  for (index=0; index<info->numsymbols; index++) {
+    sym=&info->symbols[index];
+    dbghdr.size+=sizeof(AMX_DBG_SYMBOL)+strlen(info->names+sym->name)
+                 +sym->dim*sizeof(AMX_DBG_SYMDIM);
   } /* for */
 
   /* tag table */
@@ -1243,100 +1216,59 @@ static void append_dbginfo(FILE *fout)
   writeerror |= !pc_writebin(fout,&dbghdr,sizeof dbghdr);
 
   /* file table */
-  previdx=0;
-  prevstr=NULL;
-  prevname=NULL;
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='F') {
-      codeidx=hex2long(str+2,&name);
-      if (codeidx!=previdx) {
-        if (prevstr!=NULL) {
-          assert(prevname!=NULL);
-          #if BYTE_ORDER==BIG_ENDIAN
-            aligncell(&previdx);
-          #endif
-          writeerror |= !pc_writebin(fout,&previdx,sizeof previdx);
-          writeerror |= !pc_writebin(fout,prevname,strlen(prevname)+1);
-        } /* if */
-        previdx=codeidx;
-      } /* if */
-      prevstr=str;
-      prevname=skipwhitespace(name);
-    } /* if */
-  } /* for */
-  if (prevstr!=NULL) {
-    assert(prevname!=NULL);
+  for (index=0; index<info->numfiles; index++) {
+    if (index+1<info->numfiles && info->files[index+1].address==info->files[index].address)
+      continue;
+    address=info->files[index].address;
+    name=info->names+info->files[index].name;
     #if BYTE_ORDER==BIG_ENDIAN
-      aligncell(&previdx);
+      aligncell(&address);
     #endif
-    writeerror |= !pc_writebin(fout,&previdx,sizeof previdx);
-    writeerror |= !pc_writebin(fout,prevname,strlen(prevname)+1);
-  } /* if */
+    writeerror |= !pc_writebin(fout,&address,sizeof address);
+    writeerror |= !pc_writebin(fout,name,strlen(name)+1);
+  } /* for */
 
   /* line number table */
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='L') {
-      dbgline.address=hex2long(str+2,&str);
-      dbgline.line=(int32_t)hex2long(str,NULL);
-      #if BYTE_ORDER==BIG_ENDIAN
-        aligncell(&dbgline.address);
-        align32(&dbgline.line);
-      #endif
-      writeerror |= !pc_writebin(fout,&dbgline,sizeof dbgline);
-    } /* if */
+  for (index=0; index<info->numlines; index++) {
+    dbgline.address=info->lines[index].address;
+    dbgline.line=(int32_t)info->lines[index].line;
+    #if BYTE_ORDER==BIG_ENDIAN
+      aligncell(&dbgline.address);
+      align32(&dbgline.line);
+    #endif
+    writeerror |= !pc_writebin(fout,&dbgline,sizeof dbgline);
   } /* for */
 
   /* symbol table */
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='S') {
-      dbgsym.address=hex2long(str+2,&str);
-      dbgsym.tag=(int16_t)hex2long(str,&str);
-      str=skipwhitespace(str);
-      assert(*str==':');
-      name=skipwhitespace(str+1);
-      str=strchr(name,' ');
-      assert(str!=NULL);
-      assert((int)(str-name)<sizeof symname);
-      strlcpy(symname,name,(int)(str-name)+1);
-      dbgsym.codestart=hex2long(str,&str);
-      dbgsym.codeend=hex2long(str,&str);
-      dbgsym.ident=(char)hex2long(str,&str);
-      dbgsym.vclass=(char)hex2long(str,&str);
-      dbgsym.dim=0;
-      str=skipwhitespace(str);
-      if (*str=='[') {
-        while (*(str=skipwhitespace(str+1))!=']') {
-          dbgidxtag[dbgsym.dim].tag=(int16_t)hex2long(str,&str);
-          str=skipwhitespace(str);
-          assert(*str==':');
-          dbgidxtag[dbgsym.dim].size=hex2long(str+1,&str);
-          dbgsym.dim++;
-        } /* while */
-      } /* if */
-      dbgsymdim = dbgsym.dim;
+  for (index=0; index<info->numsymbols; index++) {
+    sym=&info->symbols[index];
+    dbgsym.address=sym->address;
+    dbgsym.tag=(int16_t)sym->tag;
+    dbgsym.codestart=sym->codestart;
+    dbgsym.codeend=sym->codeend;
+    dbgsym.ident=sym->ident;
+    dbgsym.vclass=sym->vclass;
+    dbgsym.dim=sym->dim;
+    #if BYTE_ORDER==BIG_ENDIAN
+      aligncell(&dbgsym.address);
+      align16(&dbgsym.tag);
+      aligncell(&dbgsym.codestart);
+      aligncell(&dbgsym.codeend);
+      align16(&dbgsym.dim);
+    #endif
+    name=info->names+sym->name;
+    writeerror |= !pc_writebin(fout,&dbgsym,offsetof(AMX_DBG_SYMBOL, name));
+    writeerror |= !pc_writebin(fout,name,strlen(name)+1);
+    dim=&info->dims[sym->dimindex];
+    for (count=0; count<sym->dim; count++, dim++) {
+      dbgidxtag.tag=(int16_t)dim->tag;
+      dbgidxtag.size=(ucell)dim->size;
       #if BYTE_ORDER==BIG_ENDIAN
-        aligncell(&dbgsym.address);
-        align16(&dbgsym.tag);
-        aligncell(&dbgsym.codestart);
-        aligncell(&dbgsym.codeend);
-        align16(&dbgsym.dim);
+        align16(&dbgidxtag.tag);
+        aligncell(&dbgidxtag.size);
       #endif
-      writeerror |= !pc_writebin(fout,&dbgsym,offsetof(AMX_DBG_SYMBOL, name));
-      writeerror |= !pc_writebin(fout,symname,strlen(symname)+1);
-      for (dim=0; dim<dbgsymdim; dim++) {
-        #if BYTE_ORDER==BIG_ENDIAN
-          align16(&dbgidxtag[dim].tag);
-          aligncell(&dbgidxtag[dim].size);
-        #endif
-        writeerror |= !pc_writebin(fout,&dbgidxtag[dim],sizeof dbgidxtag[dim]);
-      } /* for */
-    } /* if */
+      writeerror |= !pc_writebin(fout,&dbgidxtag,sizeof dbgidxtag);
+    } /* for */
   } /* for */
 
   /* tag table */
@@ -1379,5 +1311,5 @@ static void append_dbginfo(FILE *fout)
     writeerror |= !pc_writebin(fout,constptr->name,strlen(constptr->name)+1);
   } /* for */
 
-  delete_dbgstringtable();
+  delete_dbginfo();
 }
@@ -1342,8 +1342,12 @@ static int rebuffer(char *str)
 
 static int filewrite(char *str)
 {
-  if (sc_status==statWRITE)
+  if (sc_status==statWRITE) {
+    inline_track(str);
+    if (flow_collect(str))
+      return TRUE;      /* written when the function is complete */
     return pc_writeasm(outf,str);
+  } /* if */
   return TRUE;
 }
 
@@ -1378,6 +1382,8 @@ SC_FUNC void stgwrite(const char *st)
     memcpy(stgbuf+stgidx,st,st_len+1);  /* copy to staging buffer */
     stgidx+=st_len+1;
     stglen+=st_len;
+    if (st_len>0 && st[st_len-1]=='\n')
+      timer_count(tcSTAGED);            /* an instruction is complete */
   } else {
     len=(stgbuf!=NULL) ? stglen : 0;
     CHECK_STGBUFFER(len+st_len+1);
@@ -1419,7 +1425,13 @@ SC_FUNC void stgout(int index)
 
   /* second pass: optimize the buffer created in the first pass */
   if (sc_status==statWRITE) {
-    if (reordered) {
+    char *inlined;
+    int length;
+    if (emit_stgbuf_idx==-1 && inline_expand(stgpipe,stgpipe+pipeidx,&inlined,&length)) {
+      /* optimize again, the inlined code may combine with the code around it */
+      stgopt(inlined,inlined+length,filewrite);
+      free(inlined);
+    } else if (reordered) {
       stgopt(stgpipe,stgpipe+pipeidx,filewrite);
     } else {
       /* there is no sense in re-optimizing if the order of the sub-expressions
@@ -1765,6 +1777,7 @@ static void stgopt(char *start,char *end,int (*outputfunc)(char *str))
   assert(sequences!=NULL);
   /* do not match anything if debug-level is maximum */
   if (pc_optimize>sOPTIMIZE_NONE && sc_status==statWRITE && emit_stgbuf_idx==-1) {
+    timer_enter(tmOPTIMIZE);
     do {
       matches=0;
       start=debut;
@@ -1798,6 +1811,7 @@ static void stgopt(char *start,char *end,int (*outputfunc)(char *str))
               code_idx-=sequences[seq].savesize;
               seq=0;                      /* restart search for matches */
               matches++;
+              timer_count(tcPEEPHOLE);
             } else {
               /* actually, we should never get here (match_length<repl_length) */
               assert(0);
@@ -1811,6 +1825,7 @@ static void stgopt(char *start,char *end,int (*outputfunc)(char *str))
         start += strlen(start) + 1;       /* to next string */
       } /* while (start<end) */
     } while (matches>0);
+    timer_leave();
   } /* if (pc_optimize>sOPTIMIZE_NONE && sc_status==statWRITE) */
 
   for (start=debut; start<end; start+=strlen(start)+1)
@@ -0,0 +1,287 @@
+/*  Pawn compiler - parsing of the assembler text
+ *
+ *  The control flow optimizer (SCFLOW.C) and the inlining of small functions
+ *  (SCINLINE.C) both work on the assembler text of the final pass. This file
+ *  holds the list of opcodes that they recognize, with the properties of each
+ *  opcode for both, and the routine that parses a line of the text.
+ *
+ *  This software is provided "as-is", without any express or implied warranty.
+ *  In no event will the authors be held liable for any damages arising from
+ *  the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1.  The origin of this software must not be misrepresented; you must not
+ *      claim that you wrote the original software. If you use this software in
+ *      a product, an acknowledgment in the product documentation would be
+ *      appreciated but is not required.
+ *  2.  Altered source versions must be plainly marked as such, and must not be
+ *      misrepresented as being the original software.
+ *  3.  This notice may not be removed or altered from any source distribution.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sc.h"
+
+#if defined FORTIFY
+  #include <alloc/fortify.h>
+#endif
+
+/* sorted on name, for a binary search; an opcode that is missing is never
+ * touched by the optimizers
+ */
+static asmopcode opcodelist[] = {
+  { "add",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "add.c",       flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "addr.alt",    flPLAIN,   fxALT,           trNONE,      0,    opFRAME,     TRUE },
+  { "addr.pri",    flPLAIN,   fxPRI,           trNONE,      0,    opFRAME,     TRUE },
+  { "align.alt",   flPLAIN,   fxALT,           trNONE,      0,    opPLAIN,     TRUE },
+  { "align.pri",   flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "and",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "bounds",      flPLAIN,   0,               trNONE,      0,    opPLAIN,     TRUE },
+  { "break",       flBREAK,   0,               trNONE,      0,    opBREAK,     TRUE },
+  { "call",        flPLAIN,   fxCALL,          trNONE,      0,    opCALL,      FALSE },
+  { "call.pri",    flPLAIN,   fxCALL,          trNONE,      0,    opUNKNOWN,   FALSE },
+  { "case",        flCASE,    0,               trNONE,      0,    opCASE,      FALSE },
+  { "casetbl",     flCASETBL, 0,               trNONE,      0,    opPLAIN,     FALSE },
+  { "cmps",        flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "const",       flPLAIN,   fxGLOBAL,        trNONE,      0,    opPLAIN,     TRUE },
+  { "const.alt",   flPLAIN,   fxALT,           trCONST,     sALT, opPLAIN,     TRUE },
+  { "const.pri",   flPLAIN,   fxPRI,           trCONST,     sPRI, opPLAIN,     TRUE },
+  { "const.s",     flPLAIN,   fxLOCAL,         trNONE,      0,    opFRAME1,    TRUE },
+  { "dec",         flPLAIN,   fxGLOBAL,        trNONE,      0,    opPLAIN,     TRUE },
+  { "dec.alt",     flPLAIN,   fxALT,           trNONE,      0,    opPLAIN,     TRUE },
+  { "dec.i",       flPLAIN,   fxMEMORY,        trNONE,      0,    opPLAIN,     TRUE },
+  { "dec.pri",     flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "dec.s",       flPLAIN,   fxLOCAL,         trNONE,      0,    opFRAME,     TRUE },
+  { "eq",          flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "eq.c.alt",    flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "eq.c.pri",    flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "fill",        flPLAIN,   fxMEMORY,        trNONE,      0,    opPLAIN,     TRUE },
+  { "geq",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "grtr",        flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "halt",        flEXIT,    0,               trNONE,      0,    opHALT,      TRUE },
+  { "heap",        flPLAIN,   fxALT,           trNONE,      0,    opPLAIN,     TRUE },
+  { "idxaddr",     flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "idxaddr.b",   flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "inc",         flPLAIN,   fxGLOBAL,        trNONE,      0,    opPLAIN,     TRUE },
+  { "inc.alt",     flPLAIN,   fxALT,           trNONE,      0,    opPLAIN,     TRUE },
+  { "inc.i",       flPLAIN,   fxMEMORY,        trNONE,      0,    opPLAIN,     TRUE },
+  { "inc.pri",     flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "inc.s",       flPLAIN,   fxLOCAL,         trNONE,      0,    opFRAME,     TRUE },
+  { "invert",      flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "jeq",         flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jgeq",        flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jgrtr",       flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jleq",        flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jless",       flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jneq",        flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jnz",         flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jrel",        flUNSAFE,  0,               trNONE,      0,    opUNKNOWN,   FALSE },
+  { "jsgeq",       flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jsgrtr",      flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jsleq",       flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jsless",      flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "jump",        flGOTO,    0,               trNONE,      0,    opGOTO,      TRUE },
+  { "jump.pri",    flUNSAFE,  0,               trNONE,      0,    opUNKNOWN,   FALSE },
+  { "jzer",        flJUMP,    0,               trNONE,      0,    opJUMP,      TRUE },
+  { "lctrl",       flCTRL,    fxPRI,           trNONE,      0,    opCTRL,      FALSE },
+  { "leq",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "less",        flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "lidx",        flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "lidx.b",      flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "load.alt",    flPLAIN,   fxALT,           trLOAD,      sALT, opPLAIN,     TRUE },
+  { "load.both",   flPLAIN,   fxPRI | fxALT,   trLOADBOTH,  0,    opPLAIN,     TRUE },
+  { "load.i",      flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "load.pri",    flPLAIN,   fxPRI,           trLOAD,      sPRI, opPLAIN,     TRUE },
+  { "load.s.alt",  flPLAIN,   fxALT,           trLOADS,     sALT, opFRAME,     TRUE },
+  { "load.s.both", flPLAIN,   fxPRI | fxALT,   trLOADSBOTH, 0,    opFRAME,     TRUE },
+  { "load.s.pri",  flPLAIN,   fxPRI,           trLOADS,     sPRI, opFRAME,     TRUE },
+  { "lodb.i",      flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "lref.alt",    flPLAIN,   fxALT,           trNONE,      0,    opPLAIN,     TRUE },
+  { "lref.pri",    flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "lref.s.alt",  flPLAIN,   fxALT,           trNONE,      0,    opFRAME,     TRUE },
+  { "lref.s.pri",  flPLAIN,   fxPRI,           trNONE,      0,    opFRAME,     TRUE },
+  { "move.alt",    flPLAIN,   fxALT,           trMOVE,      sALT, opPLAIN,     TRUE },
+  { "move.pri",    flPLAIN,   fxPRI,           trMOVE,      sPRI, opPLAIN,     TRUE },
+  { "movs",        flPLAIN,   fxMEMORY,        trNONE,      0,    opPLAIN,     TRUE },
+  { "neg",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "neq",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "nop",         flPLAIN,   0,               trNONE,      0,    opPLAIN,     TRUE },
+  { "not",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "or",          flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "pop.alt",     flPLAIN,   fxALT,           trNONE,      0,    opPOP,       TRUE },
+  { "pop.pri",     flPLAIN,   fxPRI,           trNONE,      0,    opPOP,       TRUE },
+  { "proc",        flPLAIN,   fxSTACK,         trNONE,      0,    opPROC,      TRUE },
+  { "push",        flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push.adr",    flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "push.alt",    flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push.c",      flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push.pri",    flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push.r",      flPLAIN,   fxSTACK,         trNONE,      0,    opUNKNOWN,   FALSE },
+  { "push.s",      flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "push2",       flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push2.adr",   flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "push2.c",     flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push2.s",     flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "push3",       flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push3.adr",   flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "push3.c",     flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push3.s",     flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "push4",       flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push4.adr",   flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "push4.c",     flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push4.s",     flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "push5",       flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push5.adr",   flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "push5.c",     flPLAIN,   fxSTACK,         trNONE,      0,    opPUSH,      TRUE },
+  { "push5.s",     flPLAIN,   fxSTACK,         trNONE,      0,    opPUSHFRAME, TRUE },
+  { "ret",         flEXIT,    0,               trNONE,      0,    opRET,       FALSE },
+  { "retn",        flEXIT,    0,               trNONE,      0,    opRET,       TRUE },
+  { "sctrl",       flUNSAFE,  0,               trNONE,      0,    opCTRL,      FALSE },
+  { "sdiv",        flPLAIN,   fxPRI | fxALT,   trNONE,      0,    opPLAIN,     TRUE },
+  { "sdiv.alt",    flPLAIN,   fxPRI | fxALT,   trNONE,      0,    opPLAIN,     TRUE },
+  { "sgeq",        flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "sgrtr",       flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "shl",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "shl.c.alt",   flPLAIN,   fxALT,           trNONE,      0,    opPLAIN,     TRUE },
+  { "shl.c.pri",   flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "shr",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "shr.c.alt",   flPLAIN,   fxALT,           trNONE,      0,    opPLAIN,     TRUE },
+  { "shr.c.pri",   flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "sign.alt",    flPLAIN,   fxALT,           trNONE,      0,    opPLAIN,     TRUE },
+  { "sign.pri",    flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "sleq",        flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "sless",       flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "smul",        flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "smul.c",      flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "sref.alt",    flPLAIN,   fxMEMORY,        trNONE,      0,    opPLAIN,     TRUE },
+  { "sref.pri",    flPLAIN,   fxMEMORY,        trNONE,      0,    opPLAIN,     TRUE },
+  { "sref.s.alt",  flPLAIN,   fxMEMORY,        trNONE,      0,    opFRAME,     TRUE },
+  { "sref.s.pri",  flPLAIN,   fxMEMORY,        trNONE,      0,    opFRAME,     TRUE },
+  { "sshr",        flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "stack",       flPLAIN,   fxALT | fxSTACK, trNONE,      0,    opSTACK,     FALSE },
+  { "stor.alt",    flPLAIN,   fxGLOBAL,        trSTOR,      sALT, opPLAIN,     TRUE },
+  { "stor.i",      flPLAIN,   fxMEMORY,        trNONE,      0,    opPLAIN,     TRUE },
+  { "stor.pri",    flPLAIN,   fxGLOBAL,        trSTOR,      sPRI, opPLAIN,     TRUE },
+  { "stor.s.alt",  flPLAIN,   fxLOCAL,         trSTORS,     sALT, opFRAME,     TRUE },
+  { "stor.s.pri",  flPLAIN,   fxLOCAL,         trSTORS,     sPRI, opFRAME,     TRUE },
+  { "strb.i",      flPLAIN,   fxMEMORY,        trNONE,      0,    opPLAIN,     TRUE },
+  { "sub",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "sub.alt",     flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "swap.alt",    flPLAIN,   fxALT | fxSTACK, trNONE,      0,    opPLAIN,     TRUE },
+  { "swap.pri",    flPLAIN,   fxPRI | fxSTACK, trNONE,      0,    opPLAIN,     TRUE },
+  { "switch",      flSWITCH,  0,               trNONE,      0,    opSWITCH,    FALSE },
+  { "sysreq.c",    flPLAIN,   fxCALL,          trNONE,      0,    opPLAIN,     TRUE },
+  { "sysreq.n",    flPLAIN,   fxCALL,          trNONE,      0,    opSYSREQN,   TRUE },
+  { "sysreq.pri",  flPLAIN,   fxCALL,          trNONE,      0,    opPLAIN,     TRUE },
+  { "udiv",        flPLAIN,   fxPRI | fxALT,   trNONE,      0,    opPLAIN,     TRUE },
+  { "udiv.alt",    flPLAIN,   fxPRI | fxALT,   trNONE,      0,    opPLAIN,     TRUE },
+  { "umul",        flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "xchg",        flPLAIN,   fxPRI | fxALT,   trXCHG,      0,    opPLAIN,     TRUE },
+  { "xor",         flPLAIN,   fxPRI,           trNONE,      0,    opPLAIN,     TRUE },
+  { "zero",        flPLAIN,   fxGLOBAL,        trNONE,      0,    opPLAIN,     TRUE },
+  { "zero.alt",    flPLAIN,   fxALT,           trZERO,      sALT, opPLAIN,     TRUE },
+  { "zero.pri",    flPLAIN,   fxPRI,           trZERO,      sPRI, opPLAIN,     TRUE },
+  { "zero.s",      flPLAIN,   fxLOCAL,         trNONE,      0,    opFRAME,     TRUE },
+};
+
+SC_FUNC const asmopcode *asm_findopcode(const char *name,int length)
+{
+  int low,high,mid,cmp;
+
+  low=0;
+  high=(sizeof opcodelist / sizeof opcodelist[0])-1;
+  while (low<=high) {
+    mid=(low+high)/2;
+    cmp=strncmp(name,opcodelist[mid].name,length);
+    if (cmp==0 && opcodelist[mid].name[length]!='\0')
+      cmp=-1;           /* "name" is a prefix of this opcode, so it is smaller */
+    if (cmp==0)
+      return &opcodelist[mid];
+    if (cmp<0)
+      high=mid-1;
+    else
+      low=mid+1;
+  } /* while */
+  return NULL;
+}
+
+SC_FUNC int asm_hexdigit(int c)
+{
+  if (c>='0' && c<='9')
+    return c-'0';
+  if (c>='a' && c<='f')
+    return c-'a'+10;
+  if (c>='A' && c<='F')
+    return c-'A'+10;
+  return -1;
+}
+
+/* asm_parseline()
+ * Parses a single line of assembler text (up to the '\n' or the end of the
+ * string). Operands that are not hexadecimal numbers, such as the function
+ * name in "call" or a label address from #emit, set the "unparsed" field.
+ * Returns FALSE if the line holds an unknown instruction or too many
+ * operands.
+ */
+SC_FUNC int asm_parseline(const char *text,asmline *line)
+{
+  const char *ptr;
+  int length;
+
+  memset(line,0,sizeof(asmline));
+  line->label=-1;
+  if (text[0]=='l' && text[1]=='.') {
+    line->kind=asmLABEL;
+    line->label=0;
+    for (ptr=text+2; asm_hexdigit(*ptr)>=0; ptr++)
+      line->label=(line->label<<4) | asm_hexdigit(*ptr);
+    return TRUE;
+  } /* if */
+  if (*text!='\t' && *text!=' ' && *text!='\n' && *text!='\0') {
+    line->kind=asmDIRECTIVE;
+    return TRUE;
+  } /* if */
+  line->kind=asmOTHER;
+  for (ptr=text; *ptr==' ' || *ptr=='\t'; ptr++)
+    /* nothing */;
+  if (*ptr==';' || *ptr=='\n' || *ptr=='\0')
+    return TRUE;        /* comment or empty line */
+  for (length=0; ptr[length]>' ' && ptr[length]!=';'; length++)
+    /* nothing */;
+  if ((line->op=asm_findopcode(ptr,length))==NULL)
+    return FALSE;
+  line->kind=asmINSTR;
+  ptr+=length;
+  for ( ;; ) {
+    ucell value;
+    int digits;
+    while (*ptr==' ' || *ptr=='\t')
+      ptr++;
+    if (*ptr==';' || *ptr=='\n' || *ptr=='\0')
+      break;
+    if (line->numoperands>=sMAXOPERANDS)
+      return FALSE;
+    if (line->numoperands==0) {
+      line->name=ptr;
+      for (line->namelength=0; ptr[line->namelength]>' ' && ptr[line->namelength]!=';'; line->namelength++)
+        /* nothing */;
+    } /* if */
+    value=0;
+    for (digits=0; asm_hexdigit(*ptr)>=0; digits++,ptr++)
+      value=(value<<4) | asm_hexdigit(*ptr);
+    if (digits==0 || (*ptr>' ' && *ptr!=';')) {
+      line->unparsed=TRUE;
+      while (*ptr>' ' && *ptr!=';')
+        ptr++;
+    } /* if */
+    line->operands[line->numoperands++]=(cell)value;
+  } /* for */
+  return TRUE;
+}
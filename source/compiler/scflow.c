@@ -0,0 +1,840 @@
+/*  Pawn compiler - control flow optimizer
+ *
+ *  At optimization level 2 and up, the code of each function is collected in
+ *  the final pass and optimized as a whole, after the peephole optimizer has
+ *  processed the separate expressions and statements. The optimizer follows
+ *  the labels and jumps in the function, and it does:
+ *  o  jump threading: a jump to a "jump" goes to the final destination, and
+ *     a "jump" to a "retn" becomes a "retn";
+ *  o  removal of jumps to the next instruction;
+ *  o  branch inversion: a conditional jump over a "jump" becomes a single
+ *     jump with the inverse condition;
+ *  o  removal of code that cannot be reached;
+ *  o  removal of a load of a value that is already in PRI or ALT, and of a
+ *     store of a value that the variable already holds, across statements
+ *     up to the next label that is a jump target.
+ *
+ *  A function with instructions whose flow the optimizer cannot follow, or
+ *  that depend on the layout of the code ("jump.pri", "jrel", "sctrl" and
+ *  "lctrl 6", or a label address as an operand, which all come from #emit),
+ *  is left as is.
+ *
+ *  The code addresses that were recorded while the function was generated,
+ *  in the debug information and in the local symbols, are relocated to the
+ *  optimized code. In the assembler file, a comment at the end of each
+ *  function tells what the optimizer did.
+ *
+ *  This software is provided "as-is", without any express or implied warranty.
+ *  In no event will the authors be held liable for any damages arising from
+ *  the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1.  The origin of this software must not be misrepresented; you must not
+ *      claim that you wrote the original software. If you use this software in
+ *      a product, an acknowledgment in the product documentation would be
+ *      appreciated but is not required.
+ *  2.  Altered source versions must be plainly marked as such, and must not be
+ *      misrepresented as being the original software.
+ *  3.  This notice may not be removed or altered from any source distribution.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sc.h"
+
+#if defined FORTIFY
+  #include <alloc/fortify.h>
+#endif
+
+#define MAX_THREADING   8   /* max. number of jumps that a jump is threaded through */
+#define MAX_FLOWPASSES  8   /* max. number of passes over the flow of a function */
+
+/* conditional jumps and the jumps with the inverse condition */
+static const char *inversions[][2] = {
+  { "jeq",    "jneq" },
+  { "jgeq",   "jless" },
+  { "jgrtr",  "jleq" },
+  { "jnz",    "jzer" },
+  { "jsgeq",  "jsless" },
+  { "jsgrtr", "jsleq" },
+};
+
+enum {
+  lnOTHER,      /* comment, empty line or directive */
+  lnLABEL,
+  lnINSTR,
+};
+
+typedef struct s_flowline {
+  char *text;           /* the original line, without the '\n' */
+  int kind;
+  const asmopcode *op;
+  int numoperands;
+  cell operands[sMAXOPERANDS];
+  int label;            /* label number for a label, target label for a jump */
+  int deleted;
+  int modified;         /* the text must be regenerated */
+  int reached;
+  cell oldaddr,newaddr; /* address of the line, relative to the function */
+} flowline;
+
+/* the state of a register: the variable and/or the constant that it holds */
+typedef struct s_regvalue {
+  int memory;           /* vNONE, vGLOBAL or vLOCAL */
+  cell address;
+  int isconst;
+  cell value;
+} regvalue;
+
+enum {
+  vNONE,
+  vGLOBAL,
+  vLOCAL,
+};
+
+static int collecting=FALSE;
+static char *flowtext=NULL;   /* the text of the function */
+static int textlen=0,textmax=0;
+static cell startaddr;        /* code address of the function */
+static int dbgfiles;          /* indices of the first debug records of the function */
+static int dbglines;
+static int dbgsymbols;
+
+static flowline *lines=NULL;
+static int numlines=0,maxlines=0;
+static int *labeltab=NULL;    /* line of each label, indexed on label - labelbase */
+static int *labelrefs=NULL;   /* number of references to each label */
+static int labelbase,labelcount,labelmax=0;
+
+static struct {
+  int threaded;         /* jumps redirected or replaced by a return */
+  int inverted;         /* branches inverted */
+  int removed;          /* unreachable instructions and jumps to the next instruction */
+  int loads;            /* redundant loads and stores */
+} stats;
+
+static const asmopcode *find_inversion(const char *name)
+{
+  int i;
+
+  for (i=0; i<(int)(sizeof inversions / sizeof inversions[0]); i++) {
+    if (strcmp(name,inversions[i][0])==0)
+      return asm_findopcode(inversions[i][1],(int)strlen(inversions[i][1]));
+    if (strcmp(name,inversions[i][1])==0)
+      return asm_findopcode(inversions[i][0],(int)strlen(inversions[i][0]));
+  } /* for */
+  return NULL;
+}
+
+/* parseline()
+ * Parses a line of the function. Returns FALSE if the line has something that
+ * the optimizer cannot handle.
+ */
+static int parseline(char *text,flowline *line)
+{
+  asmline parsed;
+
+  memset(line,0,sizeof(flowline));
+  line->text=text;
+  line->label=-1;
+  if (!asm_parseline(text,&parsed))
+    return FALSE;
+  if (parsed.kind==asmLABEL) {
+    line->kind=lnLABEL;
+    line->label=parsed.label;
+    return TRUE;
+  } /* if */
+  line->kind=lnOTHER;
+  if (parsed.kind!=asmINSTR)
+    return TRUE;        /* a directive, a comment or an empty line */
+  /* the only operand that need not be a number is the name of a function */
+  if (parsed.unparsed
+      && (strcmp(parsed.op->name,"call")!=0 || parsed.numoperands!=1 || parsed.name[0]!='.'))
+    return FALSE;       /* a label address (from #emit), or something unknown */
+  line->kind=lnINSTR;
+  line->op=parsed.op;
+  line->numoperands=parsed.numoperands;
+  memcpy(line->operands,parsed.operands,sizeof line->operands);
+  switch (line->op->flow) {
+  case flJUMP:
+  case flGOTO:
+  case flSWITCH:
+    if (line->numoperands!=1)
+      return FALSE;
+    line->label=(int)line->operands[0];
+    break;
+  case flCASE:
+    if (line->numoperands!=2)
+      return FALSE;
+    line->label=(int)line->operands[1];
+    break;
+  case flCTRL:
+    if (line->numoperands!=1 || line->operands[0]==6)
+      return FALSE;     /* the code address is used */
+    break;
+  case flUNSAFE:
+    return FALSE;
+  } /* switch */
+  return TRUE;
+}
+
+static cell linesize(const flowline *line)
+{
+  if (line->kind!=lnINSTR)
+    return 0;
+  if (line->op->flow==flCASE)
+    return opargs(2);   /* a case record has no opcode */
+  return opcodes(1)+opargs(line->numoperands);
+}
+
+static int labelline(int label)
+{
+  if (label<labelbase || label>=labelbase+labelcount)
+    return -1;
+  return labeltab[label-labelbase];
+}
+
+/* splitfunction()
+ * Splits the collected text in lines, and builds the label table. Returns
+ * FALSE if the function cannot be optimized.
+ */
+static int splitfunction(char *text)
+{
+  char *ptr,*next;
+  int i,minlabel,maxlabel;
+  cell addr;
+
+  numlines=0;
+  minlabel=maxlabel=-1;
+  addr=0;
+  for (ptr=text; *ptr!='\0'; ptr=next) {
+    if ((next=strchr(ptr,'\n'))!=NULL)
+      *next++='\0';
+    else
+      next=ptr+strlen(ptr);
+    if (numlines>=maxlines) {
+      int newmax=(maxlines+64)*2;
+      flowline *list=(flowline *)realloc(lines,newmax*sizeof(flowline));
+      if (list==NULL)
+        error(103);     /* insufficient memory */
+      lines=list;
+      maxlines=newmax;
+    } /* if */
+    if (!parseline(ptr,&lines[numlines]))
+      return FALSE;
+    lines[numlines].oldaddr=addr;
+    addr+=linesize(&lines[numlines]);
+    if (lines[numlines].label>=0) {
+      if (minlabel<0 || lines[numlines].label<minlabel)
+        minlabel=lines[numlines].label;
+      if (lines[numlines].label>maxlabel)
+        maxlabel=lines[numlines].label;
+    } /* if */
+    numlines++;
+  } /* for */
+  if (addr!=code_idx-startaddr)
+    return FALSE;       /* the size of the code is not understood */
+
+  labelbase=minlabel;
+  labelcount=maxlabel-minlabel+1;
+  if (labelcount>labelmax) {
+    int *table=(int *)realloc(labeltab,labelcount*sizeof(int));
+    int *refs=(int *)realloc(labelrefs,labelcount*sizeof(int));
+    if (table!=NULL)
+      labeltab=table;
+    if (refs!=NULL)
+      labelrefs=refs;
+    if (table==NULL || refs==NULL)
+      error(103);       /* insufficient memory */
+    labelmax=labelcount;
+  } /* if */
+  for (i=0; i<labelcount; i++)
+    labeltab[i]=-1;
+  for (i=0; i<numlines; i++) {
+    if (lines[i].kind==lnLABEL) {
+      if (labeltab[lines[i].label-labelbase]>=0)
+        return FALSE;   /* label defined twice */
+      labeltab[lines[i].label-labelbase]=i;
+    } /* if */
+  } /* for */
+  for (i=0; i<numlines; i++)
+    if (lines[i].kind==lnINSTR && lines[i].label>=0 && labelline(lines[i].label)<0)
+      return FALSE;     /* jump to a label outside the function */
+  return TRUE;
+}
+
+static int isbreak(int index)
+{
+  return lines[index].kind==lnINSTR && lines[index].op->flow==flBREAK;
+}
+
+/* target()
+ * Returns the first instruction at or after a line, skipping labels and
+ * "break" instructions, or -1 if there is none.
+ */
+static int target(int index)
+{
+  while (index<numlines && (lines[index].deleted || lines[index].kind!=lnINSTR || isbreak(index)))
+    index++;
+  return (index<numlines) ? index : -1;
+}
+
+static void settarget(flowline *line,int label)
+{
+  line->label=label;
+  line->operands[(line->op->flow==flCASE) ? 1 : 0]=label;
+  line->modified=TRUE;
+}
+
+static void deleteline(int index)
+{
+  assert(!lines[index].deleted);
+  lines[index].deleted=TRUE;
+}
+
+/* threadjumps()
+ * Redirects jumps to a "jump" to the final destination, and replaces a "jump"
+ * to a "retn" by the "retn".
+ */
+static int threadjumps(void)
+{
+  int i,j,hops,label,changes=0;
+
+  for (i=0; i<numlines; i++) {
+    flowline *line=&lines[i];
+    if (line->deleted || line->kind!=lnINSTR)
+      continue;
+    if (line->op->flow!=flJUMP && line->op->flow!=flGOTO && line->op->flow!=flCASE)
+      continue;
+    label=line->label;
+    for (hops=0; hops<MAX_THREADING; hops++) {
+      j=target(labelline(label));
+      if (j<0 || lines[j].op->flow!=flGOTO || lines[j].label==label)
+        break;
+      label=lines[j].label;
+    } /* for */
+    if (label!=line->label) {
+      settarget(line,label);
+      stats.threaded++;
+      changes++;
+    } /* if */
+    j=target(labelline(label));
+    if (line->op->flow==flGOTO && j>=0 && lines[j].op->flow==flEXIT && lines[j].numoperands==0) {
+      line->op=lines[j].op;
+      line->numoperands=0;
+      line->label=-1;
+      line->modified=TRUE;
+      stats.threaded++;
+      changes++;
+    } /* if */
+  } /* for */
+  return changes;
+}
+
+/* nextlabel()
+ * Checks whether a label follows a line, with only labels, comments and
+ * "break" instructions in between.
+ */
+static int nextlabel(int index,int label)
+{
+  for (index++; index<numlines; index++) {
+    if (lines[index].deleted || lines[index].kind==lnOTHER || isbreak(index))
+      continue;
+    if (lines[index].kind!=lnLABEL)
+      return FALSE;
+    if (lines[index].label==label)
+      return TRUE;
+  } /* for */
+  return FALSE;
+}
+
+/* simplifyjumps()
+ * Removes jumps to the next instruction, and inverts a conditional jump over
+ * a "jump".
+ */
+static int simplifyjumps(void)
+{
+  const asmopcode *inverse;
+  int i,j,k,changes=0;
+
+  for (i=0; i<numlines; i++) {
+    flowline *line=&lines[i];
+    if (line->deleted || line->kind!=lnINSTR || (line->op->flow!=flJUMP && line->op->flow!=flGOTO))
+      continue;
+    if (nextlabel(i,line->label)) {
+      deleteline(i);
+      stats.removed++;
+      changes++;
+      continue;
+    } /* if */
+    if (line->op->flow!=flJUMP || (inverse=find_inversion(line->op->name))==NULL)
+      continue;
+    for (j=i+1; j<numlines && (lines[j].deleted || lines[j].kind==lnOTHER || isbreak(j)); j++)
+      /* nothing */;
+    if (j<numlines && lines[j].kind==lnINSTR && lines[j].op->flow==flGOTO && nextlabel(j,line->label)) {
+      /* "jcc L1; jump L2; L1:" becomes "jncc L2; L1:"; a "break" before the
+       * "jump" would now be on the path to L1, so it is dropped
+       */
+      for (k=i+1; k<j; k++)
+        if (!lines[k].deleted && isbreak(k))
+          deleteline(k);
+      line->op=inverse;
+      settarget(line,lines[j].label);
+      deleteline(j);
+      stats.inverted++;
+      changes++;
+    } /* if */
+  } /* for */
+  return changes;
+}
+
+static void reach(int index)
+{
+  int *stack;
+  int top=0;
+
+  stack=(int *)malloc(numlines*sizeof(int));
+  if (stack==NULL)
+    error(103);         /* insufficient memory */
+  stack[top++]=index;
+  while (top>0) {
+    int stop=FALSE;
+    for (index=stack[--top]; !stop && index<numlines && !lines[index].reached; index++) {
+      flowline *line=&lines[index];
+      if (line->deleted)
+        continue;
+      line->reached=TRUE;
+      if (line->kind!=lnINSTR)
+        continue;
+      switch (line->op->flow) {
+      case flJUMP:
+      case flCASE:
+        assert(top<numlines);
+        stack[top++]=labelline(line->label);
+        if (line->op->flow==flCASE) {
+          int next=target(index+1);
+          stop=(next<0 || lines[next].op->flow!=flCASE);
+        } /* if */
+        break;
+      case flGOTO:
+      case flSWITCH:
+        assert(top<numlines);
+        stack[top++]=labelline(line->label);
+        stop=TRUE;
+        break;
+      case flEXIT:
+        stop=TRUE;
+        break;
+      } /* switch */
+    } /* for */
+  } /* while */
+  free(stack);
+}
+
+/* removeunreachable()
+ * Removes the instructions that cannot be reached from the start of the
+ * function, and the labels that are not used.
+ */
+static int removeunreachable(void)
+{
+  int i,changes=0;
+
+  for (i=0; i<numlines; i++)
+    lines[i].reached=FALSE;
+  reach(0);
+  for (i=0; i<labelcount; i++)
+    labelrefs[i]=0;
+  for (i=0; i<numlines; i++) {
+    if (lines[i].deleted || lines[i].kind==lnOTHER)
+      continue;
+    if (!lines[i].reached) {
+      deleteline(i);
+      if (lines[i].kind==lnINSTR)
+        stats.removed++;
+      changes++;
+    } else if (lines[i].kind==lnINSTR && lines[i].label>=0) {
+      labelrefs[lines[i].label-labelbase]++;
+    } /* if */
+  } /* for */
+  for (i=0; i<numlines; i++) {
+    if (!lines[i].deleted && lines[i].kind==lnLABEL && labelrefs[lines[i].label-labelbase]==0) {
+      deleteline(i);    /* an unused label may block branch inversion */
+      changes++;
+    } /* if */
+  } /* for */
+  return changes;
+}
+
+static void forget(regvalue *reg)
+{
+  reg->memory=vNONE;
+  reg->isconst=FALSE;
+}
+
+static void forgetmemory(regvalue regs[2],int memory,cell address,int all)
+{
+  int r;
+
+  for (r=sPRI; r<=sALT; r++)
+    if (regs[r].memory==memory && (all || regs[r].address==address))
+      regs[r].memory=vNONE;
+}
+
+static int sameaddress(const regvalue *reg,int memory,cell address)
+{
+  return reg->memory==memory && reg->address==address;
+}
+
+static int samevalue(const regvalue *a,const regvalue *b)
+{
+  if (a->memory!=vNONE && a->memory==b->memory && a->address==b->address)
+    return TRUE;
+  return a->isconst && b->isconst && a->value==b->value;
+}
+
+/* redundant()
+ * Updates the contents of the registers for an instruction, and returns TRUE
+ * if the instruction has no effect.
+ */
+static int redundant(regvalue regs[2],const flowline *line)
+{
+  const asmopcode *op=line->op;
+  int r=op->reg;
+  int memory=vGLOBAL;
+  regvalue tmp;
+
+  switch (op->track) {
+  case trLOADS:
+    memory=vLOCAL;
+    /* fallthrough */
+  case trLOAD:
+    if (sameaddress(&regs[r],memory,line->operands[0]))
+      return TRUE;
+    forget(&regs[r]);
+    regs[r].memory=memory;
+    regs[r].address=line->operands[0];
+    return FALSE;
+  case trLOADSBOTH:
+    memory=vLOCAL;
+    /* fallthrough */
+  case trLOADBOTH:
+    if (sameaddress(&regs[sPRI],memory,line->operands[0]) && sameaddress(&regs[sALT],memory,line->operands[1]))
+      return TRUE;
+    forget(&regs[sPRI]);
+    forget(&regs[sALT]);
+    regs[sPRI].memory=regs[sALT].memory=memory;
+    regs[sPRI].address=line->operands[0];
+    regs[sALT].address=line->operands[1];
+    return FALSE;
+  case trCONST:
+  case trZERO:
+    tmp.memory=vNONE;
+    tmp.isconst=TRUE;
+    tmp.value=(op->track==trCONST) ? line->operands[0] : 0;
+    if (regs[r].isconst && regs[r].value==tmp.value)
+      return TRUE;
+    regs[r]=tmp;
+    return FALSE;
+  case trSTORS:
+    memory=vLOCAL;
+    /* fallthrough */
+  case trSTOR:
+    if (sameaddress(&regs[r],memory,line->operands[0]))
+      return TRUE;      /* the variable already holds the value */
+    forgetmemory(regs,memory,line->operands[0],FALSE);
+    regs[r].memory=memory;
+    regs[r].address=line->operands[0];
+    return FALSE;
+  case trMOVE:
+    if (samevalue(&regs[sPRI],&regs[sALT]))
+      return TRUE;
+    regs[r]=regs[(r==sPRI) ? sALT : sPRI];
+    return FALSE;
+  case trXCHG:
+    tmp=regs[sPRI];
+    regs[sPRI]=regs[sALT];
+    regs[sALT]=tmp;
+    return FALSE;
+  } /* switch */
+
+  if ((op->effects & fxPRI)!=0)
+    forget(&regs[sPRI]);
+  if ((op->effects & fxALT)!=0)
+    forget(&regs[sALT]);
+  if ((op->effects & fxMEMORY)!=0) {
+    forgetmemory(regs,vGLOBAL,0,TRUE);
+    forgetmemory(regs,vLOCAL,0,TRUE);
+  } /* if */
+  if ((op->effects & fxSTACK)!=0)
+    forgetmemory(regs,vLOCAL,0,TRUE);
+  if ((op->effects & fxGLOBAL)!=0)
+    forgetmemory(regs,vGLOBAL,line->operands[0],FALSE);
+  if ((op->effects & fxLOCAL)!=0)
+    forgetmemory(regs,vLOCAL,line->operands[0],FALSE);
+  return FALSE;
+}
+
+/* removeloads()
+ * Removes loads of values that are already in a register, and stores of
+ * values that are already in the variable. The contents of the registers
+ * are only known up to a label that is the target of a jump.
+ */
+static void removeloads(void)
+{
+  regvalue regs[2];
+  int i,known;
+
+  forget(&regs[sPRI]);
+  forget(&regs[sALT]);
+  for (i=0; i<numlines; i++) {
+    flowline *line=&lines[i];
+    if (line->deleted || line->kind==lnOTHER)
+      continue;
+    if (line->kind==lnLABEL) {
+      known=FALSE;      /* a jump target (unused labels were removed) */
+    } else {
+      switch (line->op->flow) {
+      case flPLAIN:
+      case flJUMP:
+      case flCTRL:
+        known=TRUE;
+        break;
+      case flBREAK:
+        /* the debugger may change variables when it stops on a "break" */
+        known=((sc_debug & sSYMBOLIC)==0);
+        break;
+      default:
+        known=FALSE;    /* end of the flow, or a case table */
+      } /* switch */
+    } /* if */
+    if (!known) {
+      forget(&regs[sPRI]);
+      forget(&regs[sALT]);
+    } else if (redundant(regs,line)) {
+      deleteline(i);
+      stats.loads++;
+    } /* if */
+  } /* for */
+}
+
+/* relocate()
+ * Returns the address in the optimized code for an address in the original
+ * code.
+ */
+static cell relocate(cell address)
+{
+  int low,high,mid;
+  cell rel=address-startaddr;
+
+  if (rel<0 || numlines==0)
+    return address;
+  /* find the first line at or after the address */
+  low=0;
+  high=numlines;
+  while (low<high) {
+    mid=(low+high)/2;
+    if (lines[mid].oldaddr<rel)
+      low=mid+1;
+    else
+      high=mid;
+  } /* while */
+  if (low==numlines) {
+    const flowline *last=&lines[numlines-1];
+    cell oldend=last->oldaddr+linesize(last);
+    cell newend=last->newaddr+(last->deleted ? 0 : linesize(last));
+    return startaddr+newend+(rel-oldend);
+  } /* if */
+  return startaddr+lines[low].newaddr;
+}
+
+/* relocatedebug()
+ * Adjusts the code addresses in the debug information that was recorded for
+ * the function, and in the local symbols.
+ */
+static void relocatedebug(void)
+{
+  dbginfo *info;
+  symbol *sym;
+  int i;
+
+  info=get_dbginfo();
+  for (i=dbgfiles; i<info->numfiles; i++)
+    info->files[i].address=relocate(info->files[i].address);
+  for (i=dbglines; i<info->numlines; i++)
+    info->lines[i].address=relocate(info->lines[i].address);
+  for (i=dbgsymbols; i<info->numsymbols; i++) {
+    info->symbols[i].codestart=relocate(info->symbols[i].codestart);
+    info->symbols[i].codeend=relocate(info->symbols[i].codeend);
+  } /* for */
+  for (sym=loctab.next; sym!=NULL; sym=sym->next)
+    sym->codeaddr=relocate(sym->codeaddr);
+}
+
+static void writeline(const flowline *line)
+{
+  char str[sLINEMAX];
+  const char *comment;
+
+  comment=strchr(line->text,';');
+  if (line->modified) {
+    assert(line->kind==lnINSTR);
+    sprintf(str,"\t%s",line->op->name);
+    if (line->op->flow==flCASE) {
+      strcat(str," ");
+      strcat(str,itoh(line->operands[0]));
+    } /* if */
+    if (line->label>=0) {
+      strcat(str," ");
+      strcat(str,itoh(line->label));
+    } /* if */
+    strcat(str,"\n");
+  } else if (comment!=NULL && line->newaddr!=line->oldaddr
+             && (line->kind==lnLABEL || isbreak((int)(line-lines))))
+  {
+    /* update the address in the comment */
+    int length=(int)(comment-line->text);
+    if (length+40>=(int)sizeof str)
+      length=(int)sizeof str-40;
+    memcpy(str,line->text,length);
+    sprintf(str+length,"; %s\n",itoh(startaddr+line->newaddr));
+  } else {
+    pc_writeasm(outf,line->text);
+    strcpy(str,"\n");
+  } /* if */
+  pc_writeasm(outf,str);
+}
+
+static void writefunction(cell oldsize,cell newsize)
+{
+  char str[sLINEMAX];
+  int i,last;
+
+  /* the summary goes after the last instruction, before the empty line
+   * that separates the functions
+   */
+  for (last=numlines-1; last>0 && (lines[last].deleted || lines[last].text[0]=='\0'); last--)
+    /* nothing */;
+  for (i=0; i<numlines; i++) {
+    if (!lines[i].deleted)
+      writeline(&lines[i]);
+    if (i==last) {
+      sprintf(str,"\t; flow optimizer: %ld bytes saved (%d jumps threaded, %d inverted, "
+                  "%d instructions and %d loads/stores removed)\n",
+              (long)(oldsize-newsize),stats.threaded,stats.inverted,stats.removed,stats.loads);
+      pc_writeasm(outf,str);
+    } /* if */
+  } /* for */
+}
+
+/* flow_begin()
+ * Starts collecting the code of a function. Called before the "proc".
+ */
+SC_FUNC void flow_begin(void)
+{
+  collecting=(pc_optimize>=sOPTIMIZE_DEFAULT && sc_status==statWRITE);
+  if (!collecting)
+    return;
+  textlen=0;
+  if (flowtext!=NULL)
+    flowtext[0]='\0';
+  startaddr=code_idx;
+  dbgfiles=get_dbginfo()->numfiles;
+  dbglines=get_dbginfo()->numlines;
+  dbgsymbols=get_dbginfo()->numsymbols;
+}
+
+/* flow_collect()
+ * Called for all text written to the output file in the final pass. Returns
+ * TRUE if the text is held for the optimizer, and FALSE if it should be
+ * written to the file.
+ */
+SC_FUNC int flow_collect(const char *str)
+{
+  int length;
+
+  if (!collecting)
+    return FALSE;
+  length=(int)strlen(str);
+  if (textlen+length+1>textmax) {
+    int newmax=(textlen+length+1)*2;
+    char *buffer=(char *)realloc(flowtext,newmax);
+    if (buffer==NULL)
+      error(103);       /* insufficient memory */
+    flowtext=buffer;
+    textmax=newmax;
+  } /* if */
+  memcpy(flowtext+textlen,str,length+1);
+  textlen+=length;
+  return TRUE;
+}
+
+/* flow_end()
+ * Optimizes the collected code of the function and writes it to the output
+ * file. Called after endfunc(), so that "code_idx" is the end of the function.
+ */
+SC_FUNC void flow_end(void)
+{
+  char *copy;
+  cell oldsize,addr;
+  int optimized,pass,i;
+
+  if (!collecting)
+    return;
+  collecting=FALSE;
+  if (textlen==0)
+    return;
+  timer_enter(tmOPTIMIZE);
+  memset(&stats,0,sizeof stats);
+  /* the lines are split in a copy, so that the original text can still be
+   * written if the function cannot be optimized
+   */
+  if ((copy=duplicatestring(flowtext))==NULL)
+    error(103);         /* insufficient memory */
+  oldsize=code_idx-startaddr;
+  addr=oldsize;
+  optimized=splitfunction(copy);
+  if (optimized) {
+    for (pass=0; pass<MAX_FLOWPASSES; pass++)
+      if (threadjumps()+simplifyjumps()+removeunreachable()==0)
+        break;
+    removeloads();
+    addr=0;
+    for (i=0; i<numlines; i++) {
+      lines[i].newaddr=addr;
+      if (!lines[i].deleted)
+        addr+=linesize(&lines[i]);
+    } /* for */
+    optimized=(addr!=oldsize || stats.threaded>0 || stats.inverted>0);
+    if (optimized) {
+      relocatedebug();
+      code_idx=startaddr+addr;
+    } /* if */
+  } /* if */
+  if (optimized)
+    writefunction(oldsize,addr);
+  else
+    pc_writeasm(outf,flowtext);
+  free(copy);
+  timer_leave();
+}
+
+SC_FUNC void flow_cleanup(void)
+{
+  collecting=FALSE;
+  free(flowtext);
+  flowtext=NULL;
+  textlen=textmax=0;
+  free(lines);
+  lines=NULL;
+  numlines=maxlines=0;
+  free(labeltab);
+  labeltab=NULL;
+  free(labelrefs);
+  labelrefs=NULL;
+  labelmax=0;
+}
@@ -0,0 +1,562 @@
+/*  Pawn compiler - inlining of small functions
+ *
+ *  At optimization level 3, a call to a small stock or static function is
+ *  replaced by a copy of the code of that function. The caller still pushes
+ *  the arguments on the stack, but the "call", the stack frame of the called
+ *  function (the "proc" and "retn" instructions) and the argument count are
+ *  removed. The inlined code accesses the arguments relative to the frame of
+ *  the caller, and a "stack" instruction removes the arguments afterwards.
+ *
+ *  Inlining works on the assembler text, in the final pass. The text of each
+ *  candidate function is collected while it is written to the output file;
+ *  a function qualifies if it has no local variables, does not call other
+ *  (non-native) functions, does not use the argument count, and if its code
+ *  is not larger than sINLINE_MAXSIZE cells. As the text is collected in the
+ *  final pass, only the calls that follow the definition of the function are
+ *  inlined.
+ *
+ *  To map the argument offsets to the frame of the caller, the stack depth
+ *  (relative to the frame pointer) must be known at the point of the call.
+ *  This depth is tracked over all instructions written to the output file;
+ *  at labels, it is taken from the jumps to that label. Where the depth is
+ *  not known (for example, after #emit code that changes the stack pointer),
+ *  the function is called as usual.
+ *
+ *  The "break" instructions of the inlined function are dropped, so the line
+ *  information of the inlined code refers to the line of the call.
+ *
+ *  This software is provided "as-is", without any express or implied warranty.
+ *  In no event will the authors be held liable for any damages arising from
+ *  the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1.  The origin of this software must not be misrepresented; you must not
+ *      claim that you wrote the original software. If you use this software in
+ *      a product, an acknowledgment in the product documentation would be
+ *      appreciated but is not required.
+ *  2.  Altered source versions must be plainly marked as such, and must not be
+ *      misrepresented as being the original software.
+ *  3.  This notice may not be removed or altered from any source distribution.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sc.h"
+
+#if defined FORTIFY
+  #include <alloc/fortify.h>
+#endif
+
+#define sINLINE_MAXSIZE 16  /* max. size of the code of an inlined function, in cells */
+#define MAX_INLINELABELS 16 /* max. number of labels in an inlined function */
+#define INLINE_BUCKETS  64
+#define NODEPTH         1   /* stack depths are <= 0, this value means "unknown" */
+
+typedef struct s_inlinefunc {
+  struct s_inlinefunc *next;
+  char *name;           /* function name, as used in the "call" instruction */
+  char *code;           /* lines separated by '\n', without "proc" and the final "retn" */
+  int numargs;
+  int size;             /* size of the inlined code, in cells */
+} inlinefunc;
+
+static inlinefunc *inlinetab[INLINE_BUCKETS];
+
+/* the stack depth (in cells, relative to FRM) at the current output position */
+typedef struct s_stackstate {
+  cell depth;           /* NODEPTH if unknown */
+  cell lastpush;        /* operand of the "push.c" just before, -1 if none */
+  cell switchdepth;     /* depth at the most recent "switch" (for case tables) */
+} stackstate;
+
+static stackstate outstate = { NODEPTH, -1, NODEPTH };
+static cell *labeldepth=NULL; /* depth at each label, NODEPTH if unknown */
+static int labelmax=0;
+
+/* the function whose code is being collected */
+static symbol *capturesym=NULL;
+static char *capture=NULL;
+static int capturelen=0,capturemax=0;
+static int capturefail=FALSE;
+
+static unsigned int namehash(const char *name,int length)
+{
+  unsigned int hash=0;
+  while (length-->0)
+    hash=(hash<<5)+hash+(unsigned char)*name++;
+  return hash % INLINE_BUCKETS;
+}
+
+static inlinefunc *find_inlinefunc(const char *name,int length)
+{
+  inlinefunc *func;
+  for (func=inlinetab[namehash(name,length)]; func!=NULL; func=func->next)
+    if (strncmp(func->name,name,length)==0 && func->name[length]=='\0')
+      return func;
+  return NULL;
+}
+
+/* parseline()
+ * Parses a single line of assembler text. Returns FALSE if the line is not
+ * an instruction, a label, or white space with a comment.
+ */
+static int parseline(const char *text,asmline *line)
+{
+  return asm_parseline(text,line) && line->kind!=asmDIRECTIVE;
+}
+
+static void set_labeldepth(int label,cell depth)
+{
+  if (label>=labelmax) {
+    int newmax=(label+64)*2;
+    cell *table=(cell *)realloc(labeldepth,newmax*sizeof(cell));
+    if (table==NULL)
+      return;           /* not an error, the label simply gets an unknown depth */
+    while (labelmax<newmax)
+      table[labelmax++]=NODEPTH;
+    labeldepth=table;
+  } /* if */
+  if (labeldepth[label]==NODEPTH)
+    labeldepth[label]=depth;
+}
+
+static cell get_labeldepth(int label)
+{
+  return (label<labelmax) ? labeldepth[label] : NODEPTH;
+}
+
+/* trackline()
+ * Updates the stack depth for a line of assembler text.
+ */
+static void trackline(stackstate *state,const asmline *line,int valid)
+{
+  cell lastpush=state->lastpush;
+  int count;
+
+  state->lastpush=-1;
+  if (!valid) {
+    state->depth=NODEPTH;
+    return;
+  } /* if */
+  if (line->kind==asmLABEL) {
+    if (state->depth==NODEPTH)
+      state->depth=get_labeldepth(line->label);
+    else
+      set_labeldepth(line->label,state->depth);
+    return;
+  } /* if */
+  if (line->op==NULL) {
+    state->lastpush=lastpush;   /* comments do not separate a push and a call */
+    return;
+  } /* if */
+  if (line->op->inltype==opPROC) {
+    state->depth=0;
+    return;
+  } /* if */
+  if (state->depth==NODEPTH) {
+    if (line->op->inltype==opCASE && state->switchdepth!=NODEPTH && line->numoperands==2)
+      set_labeldepth((int)line->operands[1],state->switchdepth);
+    return;
+  } /* if */
+  count=(line->numoperands>0) ? line->numoperands : 1;
+  switch (line->op->inltype) {
+  case opPUSH:
+  case opPUSHFRAME:
+    state->depth-=count;
+    if (strcmp(line->op->name,"push.c")==0 && line->numoperands==1)
+      state->lastpush=line->operands[0];
+    break;
+  case opPOP:
+    state->depth+=1;
+    break;
+  case opSTACK:
+    state->depth+=line->operands[0]/(cell)sizeof(cell);
+    break;
+  case opJUMP:
+  case opGOTO:
+    if (line->unparsed)
+      state->depth=NODEPTH;
+    else
+      set_labeldepth((int)line->operands[0],state->depth);
+    if (line->op->inltype==opGOTO)
+      state->depth=NODEPTH;     /* the depth at the next label is taken from the jumps */
+    break;
+  case opCALL:
+    /* the called function removes the arguments and the argument count */
+    if (lastpush>=0)
+      state->depth+=lastpush/(cell)sizeof(cell)+1;
+    else
+      state->depth=NODEPTH;
+    break;
+  case opSYSREQN:
+    state->depth+=line->operands[1]/(cell)sizeof(cell)+1;
+    break;
+  case opSWITCH:
+    state->switchdepth=state->depth;
+    if (!line->unparsed)
+      set_labeldepth((int)line->operands[0],state->depth);
+    state->depth=NODEPTH;
+    break;
+  case opCTRL:
+    if (strcmp(line->op->name,"sctrl")==0)
+      state->depth=NODEPTH;     /* STK, FRM or CIP changed */
+    break;
+  case opRET:
+  case opHALT:
+  case opUNKNOWN:
+    state->depth=NODEPTH;
+    break;
+  } /* switch */
+  if (state->depth>0)
+    state->depth=NODEPTH;       /* stack above the frame, the code is not understood */
+}
+
+/* tracktext()
+ * Runs the tracker over a string, which may hold several lines.
+ */
+static void tracktext(stackstate *state,const char *text)
+{
+  asmline line;
+
+  while (*text!='\0') {
+    int valid=parseline(text,&line);
+    trackline(state,&line,valid);
+    text=strchr(text,'\n');
+    if (text==NULL)
+      break;
+    text++;
+  } /* while */
+}
+
+static void capture_append(const char *str)
+{
+  int length=(int)strlen(str);
+  if (capturelen+length+1>capturemax) {
+    int newmax=(capturelen+length+1)*2;
+    char *buffer=(char *)realloc(capture,newmax);
+    if (buffer==NULL) {
+      capturefail=TRUE;
+      return;
+    } /* if */
+    capture=buffer;
+    capturemax=newmax;
+  } /* if */
+  memcpy(capture+capturelen,str,length+1);
+  capturelen+=length;
+}
+
+/* inline_track()
+ * Called for all text written to the output file in the final pass.
+ */
+SC_FUNC void inline_track(const char *str)
+{
+  if (pc_optimize<sOPTIMIZE_INLINE)
+    return;
+  tracktext(&outstate,str);
+  if (capturesym!=NULL && !capturefail)
+    capture_append(str);
+}
+
+/* inline_begin()
+ * Starts collecting the code of a function that is a candidate for inlining;
+ * the caller has already checked the kind of function and the #pragma.
+ */
+SC_FUNC void inline_begin(symbol *sym)
+{
+  arginfo *arg;
+
+  assert(sym!=NULL && sym->ident==iFUNCTN);
+  capturesym=NULL;
+  if (pc_optimize<sOPTIMIZE_INLINE || sc_status!=statWRITE)
+    return;
+  for (arg=sym->dim.arglist; arg!=NULL && arg->ident!=0; arg++)
+    if (arg->ident==iVARARGS)
+      return;           /* the argument count varies per call */
+  if (finddepend(sym)!=NULL)
+    return;             /* returns an array, via a hidden parameter */
+  capturesym=sym;
+  capturelen=0;
+  capturefail=FALSE;
+  if (capture!=NULL)
+    capture[0]='\0';
+}
+
+/* inline_end()
+ * Checks the collected code of the function and stores it if the function
+ * can be inlined.
+ */
+SC_FUNC void inline_end(void)
+{
+  symbol *sym=capturesym;
+  char *code,*ptr;
+  const char *line;
+  int numargs,size,lastret,codelen,i;
+  arginfo *arg;
+  asmline parsed;
+  inlinefunc *func;
+  unsigned int hash;
+
+  capturesym=NULL;
+  if (sym==NULL || capturefail || capture==NULL)
+    return;
+  numargs=0;
+  for (arg=sym->dim.arglist; arg!=NULL && arg->ident!=0; arg++)
+    numargs++;
+
+  /* first check the code and find the final "retn" */
+  size=0;
+  lastret=-1;
+  for (line=capture; *line!='\0'; line=(ptr!=NULL) ? ptr+1 : line+strlen(line)) {
+    ptr=strchr(line,'\n');
+    if (!parseline(line,&parsed))
+      return;
+    if (parsed.kind==asmLABEL) {
+      lastret=-1;       /* there is code after the "retn" */
+      continue;
+    } /* if */
+    if (parsed.op==NULL || parsed.op->inltype==opPROC || parsed.op->inltype==opBREAK)
+      continue;
+    if (!parsed.op->inlinable || (parsed.unparsed && parsed.op->inltype!=opPLAIN))
+      return;
+    if (parsed.op->inltype==opFRAME || parsed.op->inltype==opFRAME1 || parsed.op->inltype==opPUSHFRAME) {
+      int count=(parsed.op->inltype==opFRAME1) ? 1 : parsed.numoperands;
+      for (i=0; i<count; i++) {
+        cell offset=parsed.operands[i];
+        /* only the arguments, no local variables and no argument count */
+        if (offset<3*(cell)sizeof(cell) || offset>=(numargs+3)*(cell)sizeof(cell))
+          return;
+      } /* for */
+    } /* if */
+    if (parsed.op->inltype==opRET) {
+      lastret=(int)(line-capture);
+      size+=2;          /* a "retn" before the end becomes a "jump" */
+    } else {
+      lastret=-1;
+      size+=1+parsed.numoperands;
+    } /* if */
+  } /* for */
+  if (lastret<0)
+    return;             /* the function does not end with "retn" */
+  size-=2;              /* the final "retn" is removed */
+  if (size>sINLINE_MAXSIZE)
+    return;
+
+  /* store the code, skipping comments, "proc", "break" and the final "retn" */
+  code=(char *)malloc(capturelen+1);
+  if (code==NULL)
+    return;
+  codelen=0;
+  for (line=capture; line-capture<lastret; line=ptr+1) {
+    ptr=strchr(line,'\n');
+    assert(ptr!=NULL);
+    parseline(line,&parsed);
+    if (parsed.kind!=asmLABEL && (parsed.op==NULL || parsed.op->inltype==opPROC || parsed.op->inltype==opBREAK))
+      continue;
+    memcpy(code+codelen,line,ptr-line+1);
+    codelen+=(int)(ptr-line+1);
+  } /* for */
+  code[codelen]='\0';
+
+  if (find_inlinefunc(sym->name,(int)strlen(sym->name))!=NULL) {
+    free(code);         /* two static functions with the same name */
+    return;
+  } /* if */
+  func=(inlinefunc *)malloc(sizeof(inlinefunc));
+  if (func==NULL || (func->name=duplicatestring(sym->name))==NULL) {
+    free(func);
+    free(code);
+    return;
+  } /* if */
+  func->code=code;
+  func->numargs=numargs;
+  func->size=size;
+  hash=namehash(sym->name,(int)strlen(sym->name));
+  func->next=inlinetab[hash];
+  inlinetab[hash]=func;
+}
+
+typedef struct s_outbuffer {
+  char *text;
+  int length,size;
+} outbuffer;
+
+static int out_append(outbuffer *buf,const char *str,int length)
+{
+  if (buf->length+length+1>buf->size) {
+    int newsize=(buf->length+length+1)*2;
+    char *text=(char *)realloc(buf->text,newsize);
+    if (text==NULL)
+      return FALSE;
+    buf->text=text;
+    buf->size=newsize;
+  } /* if */
+  memcpy(buf->text+buf->length,str,length);
+  buf->length+=length;
+  return TRUE;
+}
+
+/* out_line()
+ * Appends a line to the output buffer, as a separate string.
+ */
+static int out_line(outbuffer *buf,const char *str)
+{
+  return out_append(buf,str,(int)strlen(str)) && out_append(buf,"",1);
+}
+
+/* expand()
+ * Appends the code of the function to the output buffer, with the frame
+ * offsets adjusted to the frame of the caller, and the labels renumbered.
+ * "depth" is the stack depth at the "call", with the argument count pushed.
+ */
+static int expand(outbuffer *buf,const inlinefunc *func,cell depth)
+{
+  int labels[MAX_INLINELABELS][2];
+  int numlabels=0,endlabel=-1;
+  const char *line,*ptr;
+  asmline parsed;
+  char str[sLINEMAX];
+  int i,k;
+
+  for (line=func->code; *line!='\0'; line=ptr+1) {
+    ptr=strchr(line,'\n');
+    assert(ptr!=NULL);
+    parseline(line,&parsed);
+    if (parsed.kind==asmLABEL || (parsed.op!=NULL && (parsed.op->inltype==opJUMP || parsed.op->inltype==opGOTO))) {
+      /* renumber the label */
+      int label=(parsed.kind==asmLABEL) ? parsed.label : (int)parsed.operands[0];
+      for (i=0; i<numlabels && labels[i][0]!=label; i++)
+        /* nothing */;
+      if (i==numlabels) {
+        if (numlabels>=MAX_INLINELABELS)
+          return FALSE;
+        labels[i][0]=label;
+        labels[i][1]=getlabel();
+        numlabels++;
+      } /* if */
+      if (parsed.kind==asmLABEL)
+        sprintf(str,"l.%s\n",itoh(labels[i][1]));
+      else
+        sprintf(str,"\t%s %s\n",parsed.op->name,itoh(labels[i][1]));
+    } else if (parsed.op->inltype==opRET) {
+      if (endlabel<0)
+        endlabel=getlabel();
+      sprintf(str,"\tjump %s\n",itoh(endlabel));
+    } else if (parsed.op->inltype==opFRAME || parsed.op->inltype==opFRAME1 || parsed.op->inltype==opPUSHFRAME) {
+      int count=(parsed.op->inltype==opFRAME1) ? 1 : parsed.numoperands;
+      /* the arguments start at FRM+12 in the inlined function, and just above
+       * the argument count in the caller
+       */
+      sprintf(str,"\t%s",parsed.op->name);
+      for (k=0; k<parsed.numoperands; k++) {
+        cell value=parsed.operands[k];
+        if (k<count)
+          value+=depth*(cell)sizeof(cell)-2*(cell)sizeof(cell);
+        strcat(str," ");
+        strcat(str,itoh(value));
+      } /* for */
+      strcat(str,"\n");
+    } else {
+      if ((int)(ptr-line+1)>=(int)sizeof str)
+        return FALSE;
+      memcpy(str,line,ptr-line+1);
+      str[ptr-line+1]='\0';
+    } /* if */
+    if (!out_line(buf,str))
+      return FALSE;
+  } /* for */
+  if (endlabel>=0) {
+    sprintf(str,"l.%s\n",itoh(endlabel));
+    if (!out_line(buf,str))
+      return FALSE;
+  } /* if */
+  /* remove the arguments; the argument count was never pushed */
+  sprintf(str,"\tstack %s\n",itoh(func->numargs*sizeof(cell)));
+  return out_line(buf,str);
+}
+
+/* inline_expand()
+ * Looks for calls to inlinable functions in the text between "start" and
+ * "end" (strings, each holding a line, as in the staging buffer). If any are
+ * found, the function returns TRUE and a new text in "result", which the
+ * caller must free.
+ */
+SC_FUNC int inline_expand(char *start,char *end,char **result,int *length)
+{
+  stackstate state=outstate;
+  outbuffer buf={NULL,0,0};
+  char *str,*next;
+  int count=0;
+  asmline parsed;
+  inlinefunc *func;
+
+  if (pc_optimize<sOPTIMIZE_INLINE || sc_status!=statWRITE)
+    return FALSE;
+  for (str=start; str<end; str=next) {
+    next=str+strlen(str)+1;
+    tracktext(&state,str);
+    /* look for a "push.c" with the argument count, followed by a "call" */
+    func=NULL;
+    if (state.lastpush>=0 && state.depth!=NODEPTH && next<end
+        && parseline(str,&parsed) && parsed.op!=NULL && strcmp(parsed.op->name,"push.c")==0
+        && strchr(str,'\n')==str+strlen(str)-1
+        && parseline(next,&parsed) && parsed.op!=NULL && parsed.op->inltype==opCALL
+        && strchr(next,'\n')==next+strlen(next)-1
+        && parsed.namelength>1 && parsed.name[0]=='.')
+    {
+      func=find_inlinefunc(parsed.name+1,parsed.namelength-1);
+      if (func!=NULL && state.lastpush!=func->numargs*(cell)sizeof(cell))
+        func=NULL;      /* argument count mismatch */
+    } /* if */
+    if (func!=NULL) {
+      if ((count==0 && !out_append(&buf,start,(int)(str-start))) || !expand(&buf,func,state.depth)) {
+        free(buf.text);
+        return FALSE;
+      } /* if */
+      /* "push.c" and "call" are replaced by the code plus a "stack" */
+      code_idx+=opcodes(func->size+2)-opcodes(2)-opargs(2);
+      count++;
+      tracktext(&state,next);   /* the stack depth after the "call" */
+      next+=strlen(next)+1;
+    } else if (count>0) {
+      if (!out_append(&buf,str,(int)(next-str))) {
+        free(buf.text);
+        return FALSE;
+      } /* if */
+    } /* if */
+  } /* for */
+  if (count==0)
+    return FALSE;
+  *result=buf.text;
+  *length=buf.length;
+  return TRUE;
+}
+
+SC_FUNC void inline_cleanup(void)
+{
+  int i;
+
+  for (i=0; i<INLINE_BUCKETS; i++) {
+    while (inlinetab[i]!=NULL) {
+      inlinefunc *next=inlinetab[i]->next;
+      free(inlinetab[i]->name);
+      free(inlinetab[i]->code);
+      free(inlinetab[i]);
+      inlinetab[i]=next;
+    } /* while */
+  } /* for */
+  free(capture);
+  capture=NULL;
+  capturelen=capturemax=0;
+  capturesym=NULL;
+  free(labeldepth);
+  labeldepth=NULL;
+  labelmax=0;
+  outstate.depth=NODEPTH;
+  outstate.lastpush=-1;
+  outstate.switchdepth=NODEPTH;
+}
@@ -49,6 +49,91 @@ SC_FUNC char* duplicatestring(const char* sourcestring)
 }
 
 
+/* ----- memory pools -------------------------------------------- */
+/* Symbols, referrer lists, constant lists and name pairs are allocated from
+ * pools: items of a single size are carved out of large blocks, and released
+ * items are kept in a list for re-use. The symbols of a compound statement,
+ * or of a pass, thereby reuse the memory that the previous one released,
+ * without a round trip through the heap. The blocks are only returned to the
+ * heap when the pool is released, at the end of the compile.
+ */
+#define POOL_ALIGN      8       /* alignment of the items in a block */
+#define POOL_BLOCKSIZE  16384   /* size of a block, in bytes */
+
+typedef struct s_memblock {
+  struct s_memblock *next;
+} memblock;
+
+#define POOL_HEADER     ((sizeof(memblock)+POOL_ALIGN-1) & ~(POOL_ALIGN-1))
+
+static int pool_itemsize(const mempool *pool)
+{
+  assert(pool->itemsize>=(int)sizeof(void*));
+  return (pool->itemsize+POOL_ALIGN-1) & ~(POOL_ALIGN-1);
+}
+
+SC_FUNC void *pool_alloc(mempool *pool)
+{
+  int size=pool_itemsize(pool);
+  int perblock=(POOL_BLOCKSIZE-(int)POOL_HEADER)/size;
+  void *item;
+
+  if (perblock<1)
+    perblock=1;
+  if (pool->freelist!=NULL) {
+    item=pool->freelist;
+    pool->freelist=*(void**)item;
+  } else {
+    if (pool->blocks==NULL || pool->used==perblock) {
+      memblock *block=(memblock*)malloc(POOL_HEADER+perblock*size);
+      if (block==NULL)
+        return NULL;
+      block->next=pool->blocks;
+      pool->blocks=block;
+      pool->used=0;
+    } /* if */
+    item=(unsigned char*)pool->blocks+POOL_HEADER+pool->used*size;
+    pool->used++;
+  } /* if */
+  if (++pool->count>pool->peak)
+    pool->peak=pool->count;
+  return item;
+}
+
+SC_FUNC void pool_free(mempool *pool,void *item)
+{
+  if (item==NULL)
+    return;
+  assert(pool->count>0);
+  *(void**)item=pool->freelist;
+  pool->freelist=item;
+  pool->count--;
+}
+
+/* pool_release
+ * Returns all blocks of the pool to the heap; any items that are still in
+ * use become invalid.
+ */
+SC_FUNC void pool_release(mempool *pool)
+{
+  memblock *block,*next;
+
+  for (block=pool->blocks; block!=NULL; block=next) {
+    next=block->next;
+    free(block);
+  } /* for */
+  pool->blocks=NULL;
+  pool->freelist=NULL;
+  pool->used=0;
+  pool->count=0;
+  pool->peak=0;
+}
+
+SC_FUNC long pool_peakmemory(mempool *pool)
+{
+  return pool->peak*pool_itemsize(pool);
+}
+
 static stringpair *insert_stringpair(stringpair *root,char *first,char *second,int matchlength)
 {
   stringpair *cur,*pred;
@@ -57,7 +142,7 @@ static stringpair *insert_stringpair(stringpair *root,char *first,char *second,i
   assert(first!=NULL);
   assert(second!=NULL);
   /* create a new node, and check whether all is okay */
-  if ((cur=(stringpair*)malloc(sizeof(stringpair)))==NULL)
+  if ((cur=(stringpair*)pool_alloc(&stringpair_pool))==NULL)
     return NULL;
   cur->first=duplicatestring(first);
   cur->second=duplicatestring(second);
@@ -65,7 +150,7 @@ static stringpair *insert_stringpair(stringpair *root,char *first,char *second,i
   if (cur->first==NULL || cur->second==NULL) {
     free(cur->first);
     free(cur->second);
-    free(cur);
+    pool_free(&stringpair_pool,cur);
     return NULL;
   } /* if */
   /* link the node to the tree, find the position */
@@ -88,7 +173,7 @@ static void delete_stringpairtable(stringpair *root)
     assert(cur->second!=NULL);
     free(cur->first);
     free(cur->second);
-    free(cur);
+    pool_free(&stringpair_pool,cur);
     cur=next;
   } /* while */
   memset(root,0,sizeof(stringpair));
@@ -125,7 +210,7 @@ static int delete_stringpair(stringpair *root,stringpair *item)
       assert(item->second!=NULL);
       free(item->first);
       free(item->second);
-      free(item);
+      pool_free(&stringpair_pool,item);
       return TRUE;
     } /* if */
     cur=cur->next;
@@ -227,6 +312,20 @@ SC_FUNC int lookup_alias(char *target,char *name)
   return cur!=NULL;
 }
 
+SC_FUNC int get_alias(int index,char **name,char **alias)
+{
+  stringpair *cur;
+
+  assert(index>=0);
+  for (cur=alias_tab.next; cur!=NULL && index>0; cur=cur->next,index--)
+    /* nothing */;
+  if (cur==NULL)
+    return FALSE;
+  *name=cur->first;
+  *alias=cur->second;
+  return TRUE;
+}
+
 SC_FUNC void delete_aliastable(void)
 {
   delete_stringpairtable(&alias_tab);
@@ -281,6 +380,20 @@ SC_FUNC stringpair *insert_subst(char *pattern,char *substitution,int prefixlen)
   return cur;
 }
 
+SC_FUNC int get_subst(int index,char **pattern,char **substitution)
+{
+  stringpair *cur;
+
+  assert(index>=0);
+  for (cur=substpair.next; cur!=NULL && index>0; cur=cur->next,index--)
+    /* nothing */;
+  if (cur==NULL)
+    return FALSE;
+  *pattern=cur->first;
+  *substitution=cur->second;
+  return TRUE;
+}
+
 SC_FUNC stringpair *find_subst(char *name,int length)
 {
   stringpair *item;
@@ -435,72 +548,120 @@ SC_FUNC void delete_heaplisttable(void)
 
 
 /* ----- debug information --------------------------------------- */
-static stringlist dbgstrings = {NULL, NULL, 0, 0};
+/* The debug records are kept in growable arrays, in the order in which they
+ * are generated; names go into a separate pool. The flow optimizer adjusts
+ * the code addresses in these records, and append_dbginfo() (sc6.c) writes
+ * them to the output file as they are.
+ */
+static dbginfo dbgrecords = {NULL, 0, 0, NULL, 0, 0, NULL, 0, 0, NULL, 0, 0, NULL, 0, 0};
+
+static void *grow_dbgtable(void *table,int *size,int count,int itemsize)
+{
+  if (count>=*size) {
+    int newsize=(*size==0) ? 64 : 2*(*size);
+    while (count>=newsize)
+      newsize*=2;
+    if ((table=realloc(table,(size_t)newsize*itemsize))==NULL)
+      error(103);       /* insufficient memory (fatal error) */
+    *size=newsize;
+  } /* if */
+  return table;
+}
 
-SC_FUNC stringlist *insert_dbgfile(const char *filename)
+static int insert_dbgname(const char *name)
+{
+  int length=(int)strlen(name)+1;
+  int offset=dbgrecords.namesize;
+  dbgrecords.names=(char*)grow_dbgtable(dbgrecords.names,&dbgrecords.maxnames,
+                                        dbgrecords.namesize+length,sizeof(char));
+  memcpy(dbgrecords.names+offset,name,length);
+  dbgrecords.namesize+=length;
+  return offset;
+}
+
+SC_FUNC void insert_dbgfile(const char *filename)
 {
   if (sc_status==statWRITE && (sc_debug & sSYMBOLIC)!=0) {
-    char string[_MAX_PATH+40];
+    dbgfilerec *file;
     assert(filename!=NULL);
-    assert(strlen(filename)+40<sizeof string);
-    sprintf(string,"F:%" PRIxC " %s",code_idx,filename);
-    return insert_string(&dbgstrings,string);
+    dbgrecords.files=(dbgfilerec*)grow_dbgtable(dbgrecords.files,&dbgrecords.maxfiles,
+                                                dbgrecords.numfiles,sizeof(dbgfilerec));
+    file=&dbgrecords.files[dbgrecords.numfiles++];
+    file->address=code_idx;
+    file->name=insert_dbgname(filename);
   } /* if */
-  return NULL;
 }
 
-SC_FUNC stringlist *insert_dbgline(int linenr)
+SC_FUNC void insert_dbgline(int linenr)
 {
   if (sc_status==statWRITE && (sc_debug & sSYMBOLIC)!=0) {
-    char string[40];
+    dbglinerec *line;
     if (linenr>0)
       linenr--;         /* line numbers are zero-based in the debug information */
-    sprintf(string,"L:%" PRIxC " %x",code_idx,linenr);
-    return insert_string(&dbgstrings,string);
+    dbgrecords.lines=(dbglinerec*)grow_dbgtable(dbgrecords.lines,&dbgrecords.maxlines,
+                                                dbgrecords.numlines,sizeof(dbglinerec));
+    line=&dbgrecords.lines[dbgrecords.numlines++];
+    line->address=code_idx;
+    line->line=linenr;
   } /* if */
-  return NULL;
 }
 
-SC_FUNC stringlist *insert_dbgsymbol(symbol *sym)
+SC_FUNC void insert_dbgsymbol(symbol *sym)
 {
   if (sc_status==statWRITE && (sc_debug & sSYMBOLIC)!=0) {
-    char string[2*sNAMEMAX+128];
     char symname[2*sNAMEMAX+16];
+    dbgsymrec *rec;
+    int name;
 
     funcdisplayname(symname,sym->name);
-    /* address tag:name codestart codeend ident vclass [tag:dim ...] */
+    name=insert_dbgname(symname);
+    dbgrecords.symbols=(dbgsymrec*)grow_dbgtable(dbgrecords.symbols,&dbgrecords.maxsymbols,
+                                                 dbgrecords.numsymbols,sizeof(dbgsymrec));
+    rec=&dbgrecords.symbols[dbgrecords.numsymbols++];
+    rec->address=sym->addr;
+    rec->tag=sym->tag;
+    rec->name=name;
     if (sym->ident==iFUNCTN) {
-      sprintf(string,"S:%" PRIxC " %x:%s %" PRIxC " %" PRIxC " %x %x",
-              sym->addr,sym->tag,symname,sym->addr,sym->codeaddr,sym->ident,sym->vclass);
+      rec->codestart=sym->addr;
+      rec->codeend=sym->codeaddr;
     } else {
-      sprintf(string,"S:%" PRIxC " %x:%s %" PRIxC " %" PRIxC " %x %x",
-              sym->addr,sym->tag,symname,sym->codeaddr,code_idx,sym->ident,sym->vclass);
+      rec->codestart=sym->codeaddr;
+      rec->codeend=code_idx;
     } /* if */
+    rec->ident=(char)sym->ident;
+    rec->vclass=(char)sym->vclass;
+    rec->dim=0;
+    rec->dimindex=dbgrecords.numdims;
     if (sym->ident==iARRAY || sym->ident==iREFARRAY) {
       #if !defined NDEBUG
         int count=sym->dim.array.level;
       #endif
       symbol *sub;
-      strcat(string," [ ");
+      dbgdimrec *dim;
       for (sub=sym; sub!=NULL; sub=finddepend(sub)) {
         assert(sub->dim.array.level==count--);
-        sprintf(string+strlen(string),"%x:%x ",sub->x.tags.index,sub->dim.array.length);
+        dbgrecords.dims=(dbgdimrec*)grow_dbgtable(dbgrecords.dims,&dbgrecords.maxdims,
+                                                  dbgrecords.numdims,sizeof(dbgdimrec));
+        dim=&dbgrecords.dims[dbgrecords.numdims++];
+        dim->tag=sub->x.tags.index;
+        dim->size=sub->dim.array.length;
+        rec->dim++;
       } /* for */
-      strcat(string,"]");
     } /* if */
-
-    return insert_string(&dbgstrings,string);
   } /* if */
-  return NULL;
 }
 
-SC_FUNC char *get_dbgstring(int index)
+SC_FUNC dbginfo *get_dbginfo(void)
 {
-  return get_string(&dbgstrings,index);
+  return &dbgrecords;
 }
 
-SC_FUNC void delete_dbgstringtable(void)
+SC_FUNC void delete_dbginfo(void)
 {
-  delete_stringtable(&dbgstrings);
-  assert(dbgstrings.strings==NULL);
+  free(dbgrecords.files);
+  free(dbgrecords.lines);
+  free(dbgrecords.symbols);
+  free(dbgrecords.dims);
+  free(dbgrecords.names);
+  memset(&dbgrecords,0,sizeof dbgrecords);
 }
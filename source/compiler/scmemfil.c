@@ -27,6 +27,7 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include "memfile.h"
 
@@ -163,3 +164,139 @@ int mfputs(MEMFILE *mf,const char *string)
   written=mfwrite(mf,(unsigned char *)string,length);
   return written==length;
 }
+
+/* Source files are read into memory as a whole when they are opened, so that
+ * reading a line is a copy from the buffer and returning to a position that
+ * was marked earlier is a pointer assignment. The end-of-file flag follows
+ * the rules of feof(): it is set only when a read reaches the end of the
+ * file. A file that is created for writing wraps a FILE pointer instead.
+ */
+struct tagSRCFILE {
+  unsigned char *base;  /* file contents (NULL for a file that is written) */
+  unsigned char *pos;   /* current read position */
+  unsigned char *end;
+  int eof;
+  FILE *fp;             /* file that is written (NULL for a file that is read) */
+};
+
+SRCFILE *sfopen(const char *filename)
+{
+  SRCFILE *sf;
+  FILE *fp;
+  long size;
+  size_t length,read;
+  unsigned char *buffer;
+
+  if ((fp=fopen(filename,"r"))==NULL)
+    return NULL;
+  /* the size of the file is only an estimate for the buffer size, because
+   * in text mode, fewer characters may be read than the file holds
+   */
+  if (fseek(fp,0L,SEEK_END)!=0 || (size=ftell(fp))<0)
+    size=0;
+  rewind(fp);
+  length=(size_t)size+1;
+  read=0;
+  buffer=(unsigned char*)malloc(length+1);
+  while (buffer!=NULL) {
+    unsigned char *grown;
+    read+=fread(buffer+read,1,length-read,fp);
+    if (read<length)
+      break;            /* end of file (or read error) */
+    /* the file turned out to be larger than estimated, grow the buffer */
+    length*=2;
+    if ((grown=(unsigned char*)realloc(buffer,length+1))==NULL)
+      free(buffer);
+    buffer=grown;
+  } /* while */
+  fclose(fp);
+  if (buffer==NULL || (sf=(SRCFILE*)malloc(sizeof(SRCFILE)))==NULL) {
+    free(buffer);
+    return NULL;
+  } /* if */
+  buffer[read]='\0';
+  sf->base=sf->pos=buffer;
+  sf->end=buffer+read;
+  sf->eof=0;
+  sf->fp=NULL;
+  return sf;
+}
+
+SRCFILE *sfcreate(FILE *fp)
+{
+  SRCFILE *sf;
+
+  if (fp==NULL)
+    return NULL;
+  if ((sf=(SRCFILE*)malloc(sizeof(SRCFILE)))==NULL) {
+    fclose(fp);
+    return NULL;
+  } /* if */
+  sf->base=sf->pos=sf->end=NULL;
+  sf->eof=0;
+  sf->fp=fp;
+  return sf;
+}
+
+void sfclose(SRCFILE *sf)
+{
+  assert(sf!=NULL);
+  if (sf->fp!=NULL)
+    fclose(sf->fp);
+  free(sf->base);
+  free(sf);
+}
+
+/* sfgets() has the semantics of fgets(): it reads up to and including the
+ * next '\n', but at most size-1 characters
+ */
+char *sfgets(SRCFILE *sf,unsigned char *string,int size)
+{
+  size_t avail,length;
+  unsigned char *eol;
+
+  assert(sf!=NULL && sf->base!=NULL);
+  assert(size>0);
+  if (sf->pos>=sf->end) {
+    sf->eof=1;
+    return NULL;
+  } /* if */
+  avail=(size_t)(sf->end-sf->pos);
+  length=(size_t)size-1;
+  if (length>avail)
+    length=avail;
+  if ((eol=(unsigned char*)memchr(sf->pos,'\n',length))!=NULL)
+    length=(size_t)(eol-sf->pos)+1;
+  else if (avail<(size_t)size-1)
+    sf->eof=1;          /* fgets() would have hit the end of the file */
+  memcpy(string,sf->pos,length);
+  string[length]='\0';
+  sf->pos+=length;
+  return (char*)string;
+}
+
+int sfputs(SRCFILE *sf,const unsigned char *string)
+{
+  assert(sf!=NULL && sf->fp!=NULL);
+  return fputs((const char*)string,sf->fp)>=0;
+}
+
+void *sfgetpos(SRCFILE *sf)
+{
+  assert(sf!=NULL && sf->base!=NULL);
+  return sf->pos;
+}
+
+void sfsetpos(SRCFILE *sf,void *position)
+{
+  assert(sf!=NULL && sf->base!=NULL);
+  assert((unsigned char*)position>=sf->base && (unsigned char*)position<=sf->end);
+  sf->pos=(unsigned char*)position;
+  sf->eof=0;
+}
+
+int sfeof(SRCFILE *sf)
+{
+  assert(sf!=NULL);
+  return sf->eof;
+}
@@ -0,0 +1,1226 @@
+/*  Pawn compiler - precompiled headers
+ *
+ *  A precompiled header is a snapshot of the state of the compiler after it
+ *  has parsed the "prefix" file (and the files that this file includes): the
+ *  global symbols, the text substitutions (#define), the tag names, the
+ *  library names and the aliases of native functions, and the settings of
+ *  the #pragma directives. Later compiles restore this state instead of
+ *  parsing the prefix file, in every pass.
+ *
+ *  Only a prefix file that holds just declarations can be stored: constants,
+ *  enumerations, native functions, forward declarations, macros and #pragma
+ *  directives. Functions and variables need code generation in every pass,
+ *  so a prefix file with these (or with states, or one that causes any error
+ *  or warning) is parsed as usual, and warning 241 says why. This includes
+ *  prefix files that include float.inc or string.inc, since these hold stock
+ *  functions; the default prefix file (with core.inc and console.inc) is
+ *  stored. As a result, the automaton and state tables and the literal pool
+ *  are always empty at the end of the prefix file; these are verified, but
+ *  need not be stored. The snapshot is made in a separate pass over just the
+ *  prefix file, before the first pass over the source file.
+ *
+ *  The snapshot is stored in a binary file with a version number. It records
+ *  the size and a hash of every file that was read; if any of these files
+ *  changed, the snapshot is ignored and it is made anew. The snapshot is also
+ *  ignored when the compiler starts parsing the prefix file in a different
+ *  state (a different prefix file or include path, different options, or
+ *  different predefined constants).
+ *
+ *  This software is provided "as-is", without any express or implied warranty.
+ *  In no event will the authors be held liable for any damages arising from
+ *  the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1.  The origin of this software must not be misrepresented; you must not
+ *      claim that you wrote the original software. If you use this software in
+ *      a product, an acknowledgment in the product documentation would be
+ *      appreciated but is not required.
+ *  2.  Altered source versions must be plainly marked as such, and must not be
+ *      misrepresented as being the original software.
+ *  3.  This notice may not be removed or altered from any source distribution.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "sc.h"
+#include "version.h"
+
+#if defined FORTIFY
+  #include <alloc/fortify.h>
+#endif
+
+#if defined __WIN32__ || defined _WIN32 || defined _Windows
+  #if !defined S_ISDIR
+    #define S_ISDIR(m) (((m) & _S_IFDIR) == _S_IFDIR)
+  #endif
+#endif
+
+#define PCH_MAGIC     "PAWNPCH"   /* 8 bytes, including the zero terminator */
+#define PCH_VERSION   2
+
+#define FNV_OFFSET    ((HASHTABLE_U64)0xcbf29ce484222325uLL)
+#define FNV_PRIME     ((HASHTABLE_U64)0x100000001b3uLL)
+
+/* sticky settings: these are not reset at the start of a pass */
+enum {
+  stSTKSIZE,
+  stAMXLIMIT,
+  stAMXRAM,
+  stCOMPRESS,
+  stCOMPAT,
+  stRATIONALTAG,
+  stRATIONALDIGITS,
+  /* --- */
+  stNUMBER
+};
+
+/* events: a file is entered (with "name" and "path"), a file is left (both
+ * NULL), or a file was not found ("name" is NULL)
+ */
+typedef struct s_pchevent {
+  struct s_pchevent *next;
+  char *name;           /* name of the file that is entered */
+  char *path;           /* path that the file was read from, or looked for */
+} pchevent;
+
+typedef struct s_pchreader {
+  const unsigned char *pos,*end;
+  int error;
+} pchreader;
+
+static pchevent pchevents = { NULL };   /* files that the prefix file opens */
+static pchevent *lastevent = &pchevents;
+static char pchname[_MAX_PATH];         /* name of the precompiled header to write */
+static HASHTABLE_U64 pchenv;            /* state of the compiler at the start */
+static cell pchsticky[stNUMBER];
+static int pchdepth;                    /* nesting level of include files */
+static int pchautomata,pchstates;
+static const char *pchreason;           /* why it was not written, NULL if it was */
+
+static HASHTABLE_U64 hash_bytes(HASHTABLE_U64 hash,const void *data,size_t size)
+{
+  const unsigned char *ptr=(const unsigned char *)data;
+
+  while (size-->0) {
+    hash^=*ptr++;
+    hash*=FNV_PRIME;
+  } /* while */
+  return hash;
+}
+
+static int hash_file(const char *path,long *size,HASHTABLE_U64 *hash)
+{
+  unsigned char buffer[4096];
+  FILE *fp;
+  size_t count;
+
+  if ((fp=fopen(path,"rb"))==NULL)
+    return FALSE;
+  *size=0;
+  *hash=FNV_OFFSET;
+  while ((count=fread(buffer,1,sizeof buffer,fp))>0) {
+    *hash=hash_bytes(*hash,buffer,count);
+    *size+=(long)count;
+  } /* while */
+  fclose(fp);
+  return TRUE;
+}
+
+static int file_exists(const char *path)
+{
+  struct stat st;
+  FILE *fp;
+
+  /* same test as plungequalifiedfile() */
+  if (stat(path,&st)!=0 || S_ISDIR(st.st_mode))
+    return FALSE;
+  if ((fp=fopen(path,"rb"))==NULL)
+    return FALSE;
+  fclose(fp);
+  return TRUE;
+}
+
+static int count_constval(const constvalue_root *table)
+{
+  constvalue *ptr;
+  int count=0;
+
+  for (ptr=table->first; ptr!=NULL; ptr=ptr->next)
+    count++;
+  return count;
+}
+
+static void get_sticky(cell *sticky)
+{
+  sticky[stSTKSIZE]=pc_stksize;
+  sticky[stAMXLIMIT]=pc_amxlimit;
+  sticky[stAMXRAM]=pc_amxram;
+  sticky[stCOMPRESS]=sc_compress;
+  sticky[stCOMPAT]=pc_compat;
+  sticky[stRATIONALTAG]=sc_rationaltag;
+  sticky[stRATIONALDIGITS]=rational_digits;
+}
+
+/* environment()
+ * Returns a hash of everything that the result of parsing the prefix file
+ * depends on, apart from the contents of the files.
+ */
+static HASHTABLE_U64 environment(const char *prefixname)
+{
+  HASHTABLE_U64 hash=FNV_OFFSET;
+  symbol *sym;
+  char *path;
+  int i;
+  int settings[11];
+
+  hash=hash_bytes(hash,prefixname,strlen(prefixname)+1);
+  for (i=0; (path=get_path(i))!=NULL; i++)
+    hash=hash_bytes(hash,path,strlen(path)+1);
+  settings[0]=PAWN_CELL_SIZE;
+  settings[1]=sc_ctrlchar;
+  settings[2]=sc_packstr;
+  settings[3]=sc_needsemicolon;
+  settings[4]=sc_tabsize;
+  settings[5]=pc_compat;
+  settings[6]=pc_addlibtable;
+  settings[7]=sc_alignnext;
+  settings[8]=pc_naked;
+  settings[9]=fnumber;
+  settings[10]=pc_noinline;
+  hash=hash_bytes(hash,settings,sizeof settings);
+  /* at the start of a pass, the only constants are the predefined ones */
+  for (sym=glbtab.next; sym!=NULL; sym=sym->next) {
+    if (sym->ident!=iCONSTEXPR || sym==line_sym)
+      continue;
+    hash=hash_bytes(hash,sym->name,strlen(sym->name)+1);
+    hash=hash_bytes(hash,&sym->addr,sizeof sym->addr);
+    hash=hash_bytes(hash,&sym->tag,sizeof sym->tag);
+  } /* for */
+  return hash;
+}
+
+/* ----- recording ----------------------------------------------- */
+
+/* pch_record()
+ * Starts recording what the prefix file does, for writing the precompiled
+ * header once the prefix file has been parsed completely. This must be
+ * called just before the prefix file is opened. On a second attempt
+ * ("retry" set), the sticky settings are compared to those at the start of
+ * the first attempt.
+ */
+SC_FUNC void pch_record(char *filename,char *prefixname,int retry)
+{
+  pch_discard();
+  assert(strlen(filename)<sizeof pchname);
+  strcpy(pchname,filename);
+  pchenv=environment(prefixname);
+  if (!retry)
+    get_sticky(pchsticky);
+  pchautomata=count_constval(&sc_automaton_tab);
+  pchstates=count_constval(&sc_state_tab);
+  pchdepth=0;
+  pchreason="it does not end between two declarations";
+  sc_pchrecord=pchBOUNDARY;
+}
+
+/* pch_retry()
+ * Returns TRUE if parsing the prefix file changed any of the settings that
+ * are kept between passes (such as "#pragma rational"). If the precompiled
+ * header could not be made, parsing the prefix file once more (with these
+ * settings, as in the later passes) may succeed.
+ */
+SC_FUNC int pch_retry(void)
+{
+  cell sticky[stNUMBER];
+
+  get_sticky(sticky);
+  return memcmp(sticky,pchsticky,sizeof sticky)!=0;
+}
+
+/* pch_discard()
+ * Stops recording, without writing the precompiled header; this is also
+ * the routine to call when something in the prefix file cannot be stored.
+ */
+SC_FUNC void pch_discard(void)
+{
+  pchevent *cur,*next;
+
+  for (cur=pchevents.next; cur!=NULL; cur=next) {
+    next=cur->next;
+    free(cur->name);
+    free(cur->path);
+    free(cur);
+  } /* for */
+  pchevents.next=NULL;
+  lastevent=&pchevents;
+  sc_pchrecord=pchNONE;
+}
+
+/* pch_reject()
+ * Stops recording, because something in the prefix file cannot be stored;
+ * the reason is what pch_finish() returns.
+ */
+SC_FUNC void pch_reject(const char *reason)
+{
+  if (sc_pchrecord!=pchNONE) {
+    pchreason=reason;
+    pch_discard();
+  } /* if */
+}
+
+/* pch_finish()
+ * Stops recording and undoes the changes that parsing the prefix file made
+ * to the settings and tables that are kept between passes, so that the first
+ * pass starts as it would without a precompiled header. The library table is
+ * rebuilt in the first pass (its "usage" counts must start at zero).
+ * Returns NULL if the last attempt wrote the precompiled header, and the
+ * reason why it did not otherwise.
+ */
+SC_FUNC const char *pch_finish(void)
+{
+  pch_discard();
+  pc_stksize=pchsticky[stSTKSIZE];
+  pc_amxlimit=pchsticky[stAMXLIMIT];
+  pc_amxram=pchsticky[stAMXRAM];
+  sc_compress=(int)pchsticky[stCOMPRESS];
+  pc_compat=(int)pchsticky[stCOMPAT];
+  sc_rationaltag=(int)pchsticky[stRATIONALTAG];
+  rational_digits=(int)pchsticky[stRATIONALDIGITS];
+  delete_consttable(&libname_tab);
+  curlibrary=NULL;
+  return pchreason;
+}
+
+static void add_event(char *name,char *path)
+{
+  pchevent *cur;
+
+  if ((cur=(pchevent*)malloc(sizeof(pchevent)))==NULL) {
+    pch_discard();
+    return;
+  } /* if */
+  cur->next=NULL;
+  cur->name= (name!=NULL) ? duplicatestring(name) : NULL;
+  cur->path= (path!=NULL) ? duplicatestring(path) : NULL;
+  lastevent->next=cur;
+  lastevent=cur;
+}
+
+/* pch_missing()
+ * Records that an include file was looked for, but not found. If the file
+ * appears later, the precompiled header is out of date.
+ */
+SC_FUNC void pch_missing(char *path)
+{
+  assert(sc_pchrecord!=pchNONE);
+  add_event(NULL,path);
+}
+
+/* pch_plunge()
+ * Records that a file is entered; "name" is the name as the compiler
+ * reports it and "path" is the path that the file was read from.
+ */
+SC_FUNC void pch_plunge(char *name,char *path)
+{
+  assert(sc_pchrecord!=pchNONE);
+  add_event(name,path);
+  pchdepth++;
+}
+
+static int storable(symbol *sym)
+{
+  assert(sym!=NULL);
+  if (sym->states!=NULL)
+    return FALSE;
+  switch (sym->ident) {
+  case iCONSTEXPR:
+    return TRUE;
+  case iFUNCTN:
+    if (sym->child!=NULL)
+      return FALSE;             /* function returns an array */
+    if ((sym->usage & uNATIVE)!=0)
+      return TRUE;
+    /* a forward declaration; operators lose their "prototyped" flag between
+     * passes, so these must be parsed as usual
+     */
+    return (sym->usage & uDEFINE)==0 && alphanum(*sym->name);
+  } /* switch */
+  return FALSE;
+}
+
+static int ispredefined(symbol *sym)
+{
+  return (sym->flags & flagPREDEF)!=0
+         || (sym->ident==iCONSTEXPR && (sym->usage & uPREDEF)!=0);
+}
+
+#define WRITEVAL(fp,v)  fwrite(&(v),sizeof(v),1,(fp))
+
+static void write_string(FILE *fp,const char *string)
+{
+  int length= (string!=NULL) ? (int)strlen(string)+1 : 0;
+
+  WRITEVAL(fp,length);
+  if (length>0)
+    fwrite(string,1,length,fp);
+}
+
+static void write_constvals(FILE *fp,const constvalue_root *table)
+{
+  constvalue *ptr;
+  int count=count_constval(table);
+
+  WRITEVAL(fp,count);
+  for (ptr=table->first; ptr!=NULL; ptr=ptr->next) {
+    write_string(fp,ptr->name);
+    WRITEVAL(fp,ptr->value);
+    WRITEVAL(fp,ptr->index);
+  } /* for */
+}
+
+static void write_args(FILE *fp,const arginfo *arglist)
+{
+  const arginfo *arg;
+  int count;
+
+  for (count=0; arglist[count].ident!=0; count++)
+    /* nothing */;
+  WRITEVAL(fp,count);
+  for (arg=arglist; arg->ident!=0; arg++) {
+    write_string(fp,arg->name);
+    WRITEVAL(fp,arg->ident);
+    WRITEVAL(fp,arg->usage);
+    WRITEVAL(fp,arg->numtags);
+    fwrite(arg->tags,sizeof(int),arg->numtags,fp);
+    WRITEVAL(fp,arg->dim);
+    WRITEVAL(fp,arg->idxtag);
+    WRITEVAL(fp,arg->numdim);
+    WRITEVAL(fp,arg->hasdefault);
+    WRITEVAL(fp,arg->defvalue_tag);
+    if (arg->ident==iREFARRAY && arg->hasdefault) {
+      WRITEVAL(fp,arg->defvalue.array.size);
+      fwrite(arg->defvalue.array.data,sizeof(cell),arg->defvalue.array.size,fp);
+      WRITEVAL(fp,arg->defvalue.array.arraysize);
+      WRITEVAL(fp,arg->defvalue.array.addr);
+    } else if (arg->ident==iVARIABLE
+               && ((arg->hasdefault & uSIZEOF)!=0 || (arg->hasdefault & uTAGOF)!=0)) {
+      write_string(fp,arg->defvalue.size.symname);
+      WRITEVAL(fp,arg->defvalue.size.level);
+    } else {
+      WRITEVAL(fp,arg->defvalue.val);
+    } /* if */
+  } /* for */
+}
+
+static int symbol_index(symbol **table,int count,symbol *sym)
+{
+  static int last=0;
+  int index;
+
+  if (sym==NULL)
+    return -1;
+  if (last<count && table[last]==sym)
+    return last;
+  for (index=0; index<count && table[index]!=sym; index++)
+    /* nothing */;
+  assert(index<count);
+  last=index;
+  return index;
+}
+
+static void write_symbols(FILE *fp,symbol **table,int count)
+{
+  symbol *sym;
+  int index,link;
+
+  WRITEVAL(fp,count);
+  for (index=0; index<count; index++) {
+    sym=table[index];
+    write_string(fp,sym->name);
+    WRITEVAL(fp,sym->addr);
+    WRITEVAL(fp,sym->ident);
+    WRITEVAL(fp,sym->flags);
+    WRITEVAL(fp,sym->usage);
+    WRITEVAL(fp,sym->tag);
+    WRITEVAL(fp,sym->fnumber);
+    WRITEVAL(fp,sym->lnumber);
+    link=symbol_index(table,count,sym->parent);
+    WRITEVAL(fp,link);
+    link=symbol_index(table,count,sym->child);
+    WRITEVAL(fp,link);
+    write_string(fp,sym->documentation);
+    if (sym->ident==iCONSTEXPR) {
+      WRITEVAL(fp,sym->x.tags.index);
+      WRITEVAL(fp,sym->x.tags.field);
+      if ((sym->usage & uENUMROOT)!=0) {
+        write_constvals(fp,sym->dim.enumlist);
+      } else {
+        WRITEVAL(fp,sym->dim.array.length);
+        WRITEVAL(fp,sym->dim.array.level);
+      } /* if */
+    } else {
+      assert(sym->ident==iFUNCTN);
+      write_string(fp,((sym->usage & uNATIVE)!=0 && sym->x.lib!=NULL) ? sym->x.lib->name : NULL);
+      write_args(fp,sym->dim.arglist);
+    } /* if */
+  } /* for */
+}
+
+static int first_event(const pchevent *event)
+{
+  const pchevent *cur;
+
+  assert(event->path!=NULL);
+  for (cur=pchevents.next; cur!=event; cur=cur->next)
+    if (cur->path!=NULL && (cur->name!=NULL)==(event->name!=NULL) && strcmp(cur->path,event->path)==0)
+      return FALSE;
+  return TRUE;
+}
+
+static void write_header(void)
+{
+  static char magic[8]=PCH_MAGIC;
+  int header[3]={ PCH_VERSION, sizeof(cell), VERSION_INT };
+  symbol **table;
+  symbol *sym;
+  pchevent *cur;
+  cell sticky[stNUMBER];
+  int settings[8];
+  char *pattern,*substitution;
+  FILE *fp;
+  long size;
+  HASHTABLE_U64 hash;
+  int count,i,ok;
+
+  /* collect the symbols to store, and verify that all symbols can be stored */
+  count=0;
+  for (sym=glbtab.next; sym!=NULL; sym=sym->next) {
+    if (ispredefined(sym))
+      continue;
+    if (!storable(sym)) {
+      pchreason= (sym->states!=NULL) ? "it declares states"
+                                     : "it defines functions or variables";
+      return;
+    } /* if */
+    count++;
+  } /* for */
+  pchreason="the file cannot be written";
+  if ((table=(symbol**)malloc((count+1)*sizeof(symbol*)))==NULL)
+    return;
+  count=0;
+  for (sym=glbtab.next; sym!=NULL; sym=sym->next)
+    if (!ispredefined(sym))
+      table[count++]=sym;
+
+  if ((fp=fopen(pchname,"wb"))==NULL) {
+    free(table);
+    return;
+  } /* if */
+  fwrite(magic,1,sizeof magic,fp);
+  WRITEVAL(fp,header);
+  WRITEVAL(fp,pchenv);
+
+  /* the files that were read (each file only once), the files that were
+   * not found, then the order in which the files are entered and left
+   */
+  ok=TRUE;
+  for (i=0; i<2; i++) {
+    count=0;
+    for (cur=pchevents.next; cur!=NULL; cur=cur->next)
+      if (cur->path!=NULL && (cur->name!=NULL)==(i==0) && first_event(cur))
+        count++;
+    WRITEVAL(fp,count);
+    for (cur=pchevents.next; cur!=NULL; cur=cur->next) {
+      if (cur->path==NULL || (cur->name!=NULL)!=(i==0) || !first_event(cur))
+        continue;
+      write_string(fp,cur->path);
+      if (i==0) {
+        if (!hash_file(cur->path,&size,&hash))
+          ok=FALSE;
+        WRITEVAL(fp,size);
+        WRITEVAL(fp,hash);
+      } /* if */
+    } /* for */
+  } /* for */
+  count=0;
+  for (cur=pchevents.next; cur!=NULL; cur=cur->next)
+    if (cur->name!=NULL || cur->path==NULL)
+      count++;
+  WRITEVAL(fp,count);
+  for (cur=pchevents.next; cur!=NULL; cur=cur->next)
+    if (cur->name!=NULL || cur->path==NULL)
+      write_string(fp,cur->name);
+
+  /* the settings of #pragma directives; a sticky setting is only restored
+   * if the prefix file changes it
+   */
+  settings[0]=sc_ctrlchar;
+  settings[1]=sc_packstr;
+  settings[2]=sc_needsemicolon;
+  settings[3]=sc_tabsize;
+  settings[4]=pc_addlibtable;
+  settings[5]=sc_alignnext;
+  settings[6]=pc_naked;
+  settings[7]=pc_noinline;
+  WRITEVAL(fp,settings);
+  get_sticky(sticky);
+  for (i=0; i<stNUMBER; i++) {
+    int changed= (sticky[i]!=pchsticky[i]);
+    WRITEVAL(fp,changed);
+    WRITEVAL(fp,sticky[i]);
+  } /* for */
+
+  write_constvals(fp,&tagname_tab);
+  write_constvals(fp,&libname_tab);
+  for (count=0; get_alias(count,&pattern,&substitution); count++)
+    /* nothing */;
+  WRITEVAL(fp,count);
+  for (i=0; i<count; i++) {
+    get_alias(i,&pattern,&substitution);
+    write_string(fp,pattern);
+    write_string(fp,substitution);
+  } /* for */
+  #if !defined NO_DEFINE
+    for (count=0; get_subst(count,&pattern,&substitution); count++)
+      /* nothing */;
+  #else
+    count=0;
+  #endif
+  WRITEVAL(fp,count);
+  for (i=0; i<count; i++) {
+    get_subst(i,&pattern,&substitution);
+    write_string(fp,pattern);
+    write_string(fp,substitution);
+  } /* for */
+
+  for (count=0, sym=glbtab.next; sym!=NULL; sym=sym->next)
+    if (!ispredefined(sym))
+      count++;
+  write_symbols(fp,table,count);
+  fwrite(magic,1,sizeof magic,fp);
+  free(table);
+
+  if (ferror(fp))
+    ok=FALSE;
+  if (fclose(fp)!=0)
+    ok=FALSE;
+  if (!ok)
+    remove(pchname);
+  else
+    pchreason=NULL;
+}
+
+/* pch_leave()
+ * Records that a file is left. When the prefix file itself is left at the
+ * start of a statement, the precompiled header is written.
+ */
+SC_FUNC void pch_leave(void)
+{
+  assert(sc_pchrecord!=pchNONE);
+  add_event(NULL,NULL);
+  if (--pchdepth>0 || sc_pchrecord==pchNONE)
+    return;
+  /* the prefix file must end between two declarations, it must not have
+   * created code or data, and it must not be in the middle of a #pragma
+   * deprecated
+   */
+  if (code_idx!=0 || glb_declared!=0 || loctab.next!=NULL)
+    pchreason="it defines functions or variables";
+  else if (count_constval(&sc_automaton_tab)!=pchautomata
+           || count_constval(&sc_state_tab)!=pchstates)
+    pchreason="it declares states";
+  else if (litidx!=0)
+    pchreason="it has literal strings or arrays";
+  else if (sc_pchrecord==pchBOUNDARY && pc_deprecate==NULL)
+    write_header();
+  pch_discard();
+}
+
+/* ----- restoring ----------------------------------------------- */
+
+static void read_bytes(pchreader *rd,void *data,size_t size)
+{
+  if (rd->error || (size_t)(rd->end-rd->pos)<size) {
+    rd->error=TRUE;
+    memset(data,0,size);
+    return;
+  } /* if */
+  memcpy(data,rd->pos,size);
+  rd->pos+=size;
+}
+
+#define READVAL(rd,v)   read_bytes((rd),&(v),sizeof(v))
+
+static const char *read_string(pchreader *rd)
+{
+  const char *string;
+  int length;
+
+  READVAL(rd,length);
+  if (rd->error || length==0)
+    return NULL;
+  if (length<0 || rd->end-rd->pos<length || rd->pos[length-1]!='\0') {
+    rd->error=TRUE;
+    return NULL;
+  } /* if */
+  string=(const char *)rd->pos;
+  rd->pos+=length;
+  return string;
+}
+
+static char *read_name(pchreader *rd)
+{
+  const char *name=read_string(rd);
+
+  if (name==NULL || strlen(name)>sNAMEMAX) {
+    rd->error=TRUE;
+    return "";
+  } /* if */
+  return (char *)name;
+}
+
+static constvalue_root *read_constvals(pchreader *rd,int apply)
+{
+  constvalue_root *table=NULL;
+  char *name;
+  cell value;
+  int count,index;
+
+  READVAL(rd,count);
+  if (apply) {
+    if ((table=(constvalue_root*)malloc(sizeof(constvalue_root)))==NULL)
+      error(103);               /* insufficient memory (fatal error) */
+    memset(table,0,sizeof(constvalue_root));
+  } /* if */
+  while (count-->0 && !rd->error) {
+    name=read_name(rd);
+    READVAL(rd,value);
+    READVAL(rd,index);
+    if (apply)
+      append_constval(table,name,value,index);
+  } /* while */
+  return table;
+}
+
+static arginfo *read_args(pchreader *rd,int apply)
+{
+  arginfo *arglist=NULL;
+  arginfo arg;
+  const char *name;
+  int count,i;
+
+  READVAL(rd,count);
+  if (count<0 || count>sMAXARGS+1) {
+    rd->error=TRUE;
+    return NULL;
+  } /* if */
+  if (apply && (arglist=(arginfo*)calloc(count+1,sizeof(arginfo)))==NULL)
+    error(103);                 /* insufficient memory (fatal error) */
+  for (i=0; i<count && !rd->error; i++) {
+    memset(&arg,0,sizeof arg);
+    name=read_string(rd);
+    if (name!=NULL && strlen(name)<=sNAMEMAX)
+      strcpy(arg.name,name);
+    READVAL(rd,arg.ident);
+    READVAL(rd,arg.usage);
+    READVAL(rd,arg.numtags);
+    if (arg.numtags<=0 || (size_t)(rd->end-rd->pos)<arg.numtags*sizeof(int)) {
+      rd->error=TRUE;
+      break;
+    } /* if */
+    if (apply) {
+      if ((arg.tags=(int*)malloc(arg.numtags*sizeof(int)))==NULL)
+        error(103);             /* insufficient memory (fatal error) */
+      read_bytes(rd,arg.tags,arg.numtags*sizeof(int));
+    } else {
+      rd->pos+=arg.numtags*sizeof(int);
+    } /* if */
+    READVAL(rd,arg.dim);
+    READVAL(rd,arg.idxtag);
+    READVAL(rd,arg.numdim);
+    READVAL(rd,arg.hasdefault);
+    READVAL(rd,arg.defvalue_tag);
+    if (arg.ident==iREFARRAY && arg.hasdefault) {
+      READVAL(rd,arg.defvalue.array.size);
+      if (arg.defvalue.array.size<0
+          || (size_t)(rd->end-rd->pos)<arg.defvalue.array.size*sizeof(cell)) {
+        rd->error=TRUE;
+        break;
+      } /* if */
+      if (apply) {
+        arg.defvalue.array.data=(cell*)malloc((arg.defvalue.array.size+1)*sizeof(cell));
+        if (arg.defvalue.array.data==NULL)
+          error(103);           /* insufficient memory (fatal error) */
+        read_bytes(rd,arg.defvalue.array.data,arg.defvalue.array.size*sizeof(cell));
+      } else {
+        rd->pos+=arg.defvalue.array.size*sizeof(cell);
+      } /* if */
+      READVAL(rd,arg.defvalue.array.arraysize);
+      READVAL(rd,arg.defvalue.array.addr);
+    } else if (arg.ident==iVARIABLE
+               && ((arg.hasdefault & uSIZEOF)!=0 || (arg.hasdefault & uTAGOF)!=0)) {
+      name=read_name(rd);
+      if (apply)
+        arg.defvalue.size.symname=duplicatestring(name);
+      READVAL(rd,arg.defvalue.size.level);
+    } else {
+      READVAL(rd,arg.defvalue.val);
+    } /* if */
+    if (apply)
+      arglist[i]=arg;
+  } /* for */
+  return arglist;
+}
+
+/* read_symbol()
+ * Reads a symbol and, if "apply" is set, adds it to the global symbol table
+ * or merges it with an existing forward declaration. When only checking,
+ * the routine verifies that parsing the declaration would not conflict with
+ * a symbol that is already in the table (in the second pass, the functions
+ * and global variables of the first pass are still there).
+ */
+static symbol *read_symbol(pchreader *rd,int apply,int *parent,int *child)
+{
+  symbol *sym;
+  char *name,*libname;
+  const char *doc;
+  cell addr;
+  char ident,flags;
+  short usage;
+  int tag,fnumber,lnumber;
+  constvalue *lib;
+
+  name=read_name(rd);
+  READVAL(rd,addr);
+  READVAL(rd,ident);
+  READVAL(rd,flags);
+  READVAL(rd,usage);
+  READVAL(rd,tag);
+  READVAL(rd,fnumber);
+  READVAL(rd,lnumber);
+  READVAL(rd,*parent);
+  READVAL(rd,*child);
+  doc=read_string(rd);
+  if (rd->error)
+    return NULL;
+
+  sym=findglb(name,sGLOBAL);
+  if (ident==iFUNCTN && (usage & uNATIVE)==0 && sym!=NULL) {
+    /* a forward declaration of a function that is already known */
+    if (sym->ident!=iFUNCTN || (sym->usage & uNATIVE)!=0
+        || (sym->usage & uPROTOTYPED)==0 || sym->tag!=tag)
+      rd->error=TRUE;           /* let the parser report the conflict */
+    libname=(char *)read_string(rd);
+    read_args(rd,FALSE);
+    if (!apply || rd->error)
+      return NULL;
+    if ((sym->usage & uDEFINE)==0 && sym->states==NULL)
+      sym->addr=code_idx;
+    sym->usage|=(short)(usage & (uPUBLIC | uFORWARD | uPROTOTYPED));
+  } else {
+    if (sym!=NULL)
+      rd->error=TRUE;           /* let the parser report the conflict */
+    if (!apply) {
+      symbol dummy;
+      if (ident==iCONSTEXPR) {
+        READVAL(rd,dummy.x.tags.index);
+        READVAL(rd,dummy.x.tags.field);
+        if ((usage & uENUMROOT)!=0) {
+          read_constvals(rd,FALSE);
+        } else {
+          READVAL(rd,dummy.dim.array.length);
+          READVAL(rd,dummy.dim.array.level);
+        } /* if */
+      } else if (ident==iFUNCTN) {
+        read_string(rd);
+        read_args(rd,FALSE);
+      } else {
+        rd->error=TRUE;
+      } /* if */
+      return NULL;
+    } /* if */
+    sym=addsym(name,addr,ident,sGLOBAL,tag,0);
+    sym->usage=usage;
+    sym->flags=(char)(flags & ~flagDEPRECATED);
+    sym->fnumber=fnumber;
+    sym->lnumber=lnumber;
+    if (ident==iCONSTEXPR) {
+      READVAL(rd,sym->x.tags.index);
+      READVAL(rd,sym->x.tags.field);
+      if ((usage & uENUMROOT)!=0) {
+        sym->dim.enumlist=read_constvals(rd,TRUE);
+      } else {
+        READVAL(rd,sym->dim.array.length);
+        READVAL(rd,sym->dim.array.level);
+      } /* if */
+    } else {
+      assert(ident==iFUNCTN);
+      libname=(char *)read_string(rd);
+      lib=NULL;
+      if (libname!=NULL)
+        lib=find_constval(&libname_tab,libname,0);
+      if ((usage & uNATIVE)!=0)
+        sym->x.lib=lib;
+      else
+        sym->x.stacksize=1;     /* 1 for PROC opcode */
+      sym->dim.arglist=read_args(rd,TRUE);
+    } /* if */
+  } /* if */
+
+  /* the message of "#pragma deprecated" is only kept in the final pass (see
+   * fetchfunc())
+   */
+  if ((flags & flagDEPRECATED)!=0) {
+    sym->flags|=flagDEPRECATED;
+    if (sc_status==statWRITE && doc!=NULL) {
+      free(sym->documentation);
+      sym->documentation=duplicatestring(doc);
+    } /* if */
+  } /* if */
+  return sym;
+}
+
+static void restore_files(pchreader *rd,int count)
+{
+  char **names;
+  short *files;
+  char *name;
+  int depth;
+
+  names=(char**)malloc((count+1)*sizeof(char*));
+  files=(short*)malloc((count+1)*sizeof(short));
+  if (names==NULL || files==NULL)
+    error(103);                 /* insufficient memory (fatal error) */
+  depth=0;
+  while (count-->0) {
+    name=(char *)read_string(rd);
+    if (name!=NULL) {
+      /* same as plungequalifiedfile() */
+      names[depth]=name;
+      files[depth]=fcurrent;
+      depth++;
+      fnumber++;
+      fcurrent=fnumber;
+      insert_dbgfile(name);
+      setfiledirect(name);
+      setfileconst(name);
+    } else {
+      /* same as readline(), when it pops a file off the stack */
+      assert(depth>0);
+      depth--;
+      fcurrent=files[depth];
+      name= (depth>0) ? names[depth-1] : inpfname;
+      insert_dbgfile(name);
+      setfiledirect(name);
+    } /* if */
+  } /* while */
+  free(names);
+  free(files);
+}
+
+/* restore()
+ * Walks through the precompiled header (after the list of files), and either
+ * verifies that it can be restored, or restores it.
+ */
+static int restore(pchreader *rd,int apply,const unsigned char **symbols)
+{
+  int settings[8];
+  int changed[stNUMBER];
+  cell sticky[stNUMBER];
+  constvalue *ptr;
+  symbol **table;
+  int *links;
+  char *name,*pattern,*substitution;
+  const unsigned char *start;
+  cell value;
+  int count,index,i,last,tag,depth;
+
+  /* the files that are entered and left */
+  READVAL(rd,count);
+  if (rd->error || count<0)
+    return FALSE;
+  start=rd->pos;
+  for (i=0, depth=0; i<count && !rd->error; i++) {
+    if (read_string(rd)!=NULL)
+      depth++;
+    else if (--depth<0)
+      rd->error=TRUE;
+  } /* for */
+  if (rd->error || depth!=0)
+    return FALSE;
+  if (apply) {
+    rd->pos=start;
+    restore_files(rd,count);
+  } /* if */
+
+  /* settings */
+  READVAL(rd,settings);
+  for (i=0; i<stNUMBER; i++) {
+    READVAL(rd,changed[i]);
+    READVAL(rd,sticky[i]);
+  } /* for */
+  if (changed[stRATIONALTAG] && sc_rationaltag!=0
+      && (sc_rationaltag!=sticky[stRATIONALTAG] || rational_digits!=sticky[stRATIONALDIGITS]))
+    return FALSE;               /* let the parser report the conflict */
+  if (apply) {
+    sc_ctrlchar=(char)settings[0];
+    sc_packstr=settings[1];
+    sc_needsemicolon=settings[2];
+    sc_tabsize=settings[3];
+    pc_addlibtable=settings[4];
+    sc_alignnext=settings[5];
+    pc_naked=settings[6];
+    pc_noinline=settings[7];
+    if (changed[stSTKSIZE])
+      pc_stksize=sticky[stSTKSIZE];
+    if (changed[stAMXLIMIT])
+      pc_amxlimit=sticky[stAMXLIMIT];
+    if (changed[stAMXRAM])
+      pc_amxram=sticky[stAMXRAM];
+    if (changed[stCOMPRESS])
+      sc_compress=(int)sticky[stCOMPRESS];
+    if (changed[stRATIONALTAG] || changed[stRATIONALDIGITS]) {
+      sc_rationaltag=(int)sticky[stRATIONALTAG];
+      rational_digits=(int)sticky[stRATIONALDIGITS];
+    } /* if */
+    if (changed[stCOMPAT]) {
+      symbol *sym;
+      pc_compat=(int)sticky[stCOMPAT];
+      if ((sym=findconst("__compat",NULL))!=NULL)
+        sym->addr=pc_compat;
+    } /* if */
+  } /* if */
+
+  /* tag names: the tags that already exist must have the same id, the new
+   * tags must get the same id as when parsing the prefix file
+   */
+  last=0;
+  for (ptr=tagname_tab.first; ptr!=NULL; ptr=ptr->next) {
+    tag=(int)(ptr->value & TAGMASK) & (int)~FIXEDTAG;
+    if (tag>last)
+      last=tag;
+  } /* for */
+  READVAL(rd,count);
+  while (count-->0 && !rd->error) {
+    name=read_name(rd);
+    READVAL(rd,value);
+    READVAL(rd,index);
+    for (ptr=tagname_tab.first; ptr!=NULL && strcmp(ptr->name,name)!=0; ptr=ptr->next)
+      /* nothing */;
+    if (ptr!=NULL) {
+      if ((ptr->value & TAGMASK)!=(value & TAGMASK))
+        return FALSE;
+      if (apply)
+        ptr->value|=(value & PUBLICTAG);
+    } else {
+      tag=(int)(value & TAGMASK) & (int)~FIXEDTAG;
+      if (tag!=last+1)
+        return FALSE;
+      last=tag;
+      if (apply)
+        append_constval(&tagname_tab,name,value,index);
+    } /* if */
+  } /* while */
+
+  /* libraries */
+  READVAL(rd,count);
+  while (count-->0 && !rd->error) {
+    name=read_name(rd);
+    READVAL(rd,value);
+    READVAL(rd,index);
+    if (apply && find_constval(&libname_tab,name,index)==NULL)
+      append_constval(&libname_tab,name,value,index);
+  } /* while */
+
+  /* aliases and text substitutions; these are stored in sorted order, and
+   * inserting them in reverse order adds each at the head of the list
+   */
+  for (i=0; i<2; i++) {
+    READVAL(rd,count);
+    if (rd->error || count<0)
+      return FALSE;
+    if (apply && count>0) {
+      const char **strings=(const char**)malloc(2*count*sizeof(char*));
+      if (strings==NULL)
+        error(103);             /* insufficient memory (fatal error) */
+      for (index=0; index<count; index++) {
+        strings[2*index]=read_string(rd);
+        strings[2*index+1]=read_string(rd);
+      } /* for */
+      while (index-->0) {
+        pattern=(char *)strings[2*index];
+        substitution=(char *)strings[2*index+1];
+        if (i==0) {
+          insert_alias(pattern,substitution);
+        } else {
+          #if !defined NO_DEFINE
+            int prefixlen;
+            for (prefixlen=0; alphanum(pattern[prefixlen]); prefixlen++)
+              /* nothing */;
+            insert_subst(pattern,substitution,prefixlen);
+          #endif
+        } /* if */
+      } /* while */
+      free((void*)strings);
+    } else {
+      while (count-->0 && !rd->error) {
+        pattern=(char *)read_string(rd);
+        substitution=(char *)read_string(rd);
+        if (pattern==NULL || substitution==NULL || (i==0 && (strlen(pattern)>sNAMEMAX || strlen(substitution)>sNAMEMAX)))
+          rd->error=TRUE;
+      } /* while */
+    } /* if */
+  } /* for */
+
+  /* symbols; when checking, the start of every symbol is saved, because the
+   * symbols are added in reverse order (as for the text substitutions)
+   */
+  READVAL(rd,count);
+  if (rd->error || count<0)
+    return FALSE;
+  if (!apply) {
+    for (index=0; index<count && !rd->error; index++) {
+      int parent,child;
+      symbols[index]=rd->pos;
+      read_symbol(rd,FALSE,&parent,&child);
+    } /* for */
+    symbols[count]=rd->pos;
+  } else if (count>0) {
+    table=(symbol**)malloc(count*sizeof(symbol*));
+    links=(int*)malloc(2*count*sizeof(int));
+    if (table==NULL || links==NULL)
+      error(103);               /* insufficient memory (fatal error) */
+    for (index=count-1; index>=0; index--) {
+      rd->pos=symbols[index];
+      table[index]=read_symbol(rd,TRUE,&links[2*index],&links[2*index+1]);
+      assert(table[index]!=NULL);
+    } /* for */
+    for (index=0; index<count; index++) {
+      if (links[2*index]>=0 && links[2*index]<count)
+        table[index]->parent=table[links[2*index]];
+      if (links[2*index+1]>=0 && links[2*index+1]<count)
+        table[index]->child=table[links[2*index+1]];
+    } /* for */
+    free(table);
+    free(links);
+    rd->pos=symbols[count];
+  } /* if */
+  return !rd->error;
+}
+
+/* open_header()
+ * Reads the precompiled header in memory and checks that it is up to date:
+ * the version and the environment must match and none of the files that the
+ * "prefix" file read (or looked for) may have changed. On success, the
+ * reader is positioned behind the list of files.
+ */
+static unsigned char *open_header(char *filename,char *prefixname,pchreader *rd)
+{
+  char magic[8];
+  int header[3];
+  HASHTABLE_U64 env,hash,filehash;
+  unsigned char *buffer;
+  const char *path;
+  long length,size,filesize;
+  FILE *fp;
+  int count;
+
+  if ((fp=fopen(filename,"rb"))==NULL)
+    return NULL;
+  fseek(fp,0,SEEK_END);
+  length=ftell(fp);
+  fseek(fp,0,SEEK_SET);
+  buffer= (length>0) ? (unsigned char*)malloc(length) : NULL;
+  if (buffer==NULL || fread(buffer,1,length,fp)!=(size_t)length) {
+    free(buffer);
+    fclose(fp);
+    return NULL;
+  } /* if */
+  fclose(fp);
+
+  rd->pos=buffer;
+  rd->end=buffer+length;
+  rd->error=FALSE;
+  READVAL(rd,magic);
+  READVAL(rd,header);
+  READVAL(rd,env);
+  if (memcmp(magic,PCH_MAGIC,sizeof magic)!=0 || header[0]!=PCH_VERSION
+      || header[1]!=sizeof(cell) || header[2]!=VERSION_INT
+      || env!=environment(prefixname))
+    rd->error=TRUE;
+
+  /* check whether any of the files was changed, or whether a file that was
+   * not found now exists
+   */
+  READVAL(rd,count);
+  while (count-->0 && !rd->error) {
+    path=read_string(rd);
+    READVAL(rd,size);
+    READVAL(rd,hash);
+    if (path==NULL || !hash_file(path,&filesize,&filehash) || filesize!=size || filehash!=hash)
+      rd->error=TRUE;
+  } /* while */
+  READVAL(rd,count);
+  while (count-->0 && !rd->error) {
+    path=read_string(rd);
+    if (path==NULL || file_exists(path))
+      rd->error=TRUE;
+  } /* while */
+
+  if (rd->error) {
+    free(buffer);
+    return NULL;
+  } /* if */
+  return buffer;
+}
+
+/* pch_uptodate()
+ * Returns TRUE if the precompiled header exists and is up to date.
+ */
+SC_FUNC int pch_uptodate(char *filename,char *prefixname)
+{
+  pchreader rd;
+  unsigned char *buffer=open_header(filename,prefixname,&rd);
+
+  free(buffer);
+  return buffer!=NULL;
+}
+
+/* pch_load()
+ * Restores the state after parsing the prefix file, from the precompiled
+ * header. Returns FALSE if the precompiled header does not exist or if it is
+ * out of date, in which case nothing is changed.
+ */
+SC_FUNC int pch_load(char *filename,char *prefixname)
+{
+  char magic[8];
+  unsigned char *buffer;
+  const unsigned char **symbols;
+  const unsigned char *start;
+  pchreader rd;
+  int result;
+
+  if ((buffer=open_header(filename,prefixname,&rd))==NULL)
+    return FALSE;
+  /* check everything, then restore everything */
+  result=FALSE;
+  start=rd.pos;
+  symbols=(const unsigned char**)malloc(((rd.end-rd.pos)/sizeof(int)+1)*sizeof(unsigned char*));
+  if (symbols!=NULL && restore(&rd,FALSE,symbols)) {
+    READVAL(&rd,magic);
+    if (!rd.error && memcmp(magic,PCH_MAGIC,sizeof magic)==0) {
+      rd.pos=start;
+      result=restore(&rd,TRUE,symbols);
+      assert(result);
+    } /* if */
+  } /* if */
+  free((void*)symbols);
+  free(buffer);
+  return result;
+}
@@ -0,0 +1,363 @@
+/*  Pawn compiler - phase timing and memory report
+ *
+ *  When enabled with the -T option, the compiler measures the processor time
+ *  that it spends in each phase (preprocessing, macro substitution, parsing,
+ *  peephole optimization, assembly and debug information), in each pass and
+ *  in each source file. A phase that runs inside another phase (macro
+ *  substitution is done while preprocessing, for example) is subtracted from
+ *  the time of the enclosing phase, so the phase times add up to the total.
+ *  Time is charged to the file that is being read at the moment, so the time
+ *  for a file includes the code that is generated for its functions. Times,
+ *  line counts and the other counts are totals over all passes.
+ *
+ *  The report is printed on the console, or it is written to a file in JSON
+ *  format, for use by other tools.
+ *
+ *  This software is provided "as-is", without any express or implied warranty.
+ *  In no event will the authors be held liable for any damages arising from
+ *  the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1.  The origin of this software must not be misrepresented; you must not
+ *      claim that you wrote the original software. If you use this software in
+ *      a product, an acknowledgment in the product documentation would be
+ *      appreciated but is not required.
+ *  2.  Altered source versions must be plainly marked as such, and must not be
+ *      misrepresented as being the original software.
+ *  3.  This notice may not be removed or altered from any source distribution.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lstring.h"
+#include "sc.h"
+
+#if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
+  #include <sys/resource.h>
+#endif
+
+#if defined FORTIFY
+  #include <alloc/fortify.h>
+#endif
+
+#define MAX_PHASENEST 16  /* phases nest at most a few levels deep */
+#define MAX_PASSES    16  /* further passes are added to the last one */
+
+typedef struct s_timedfile {
+  struct s_timedfile *next;
+  char *name;
+  clock_t time;
+  long lines;
+} timedfile;
+
+typedef struct s_timedpass {
+  char label[32];
+  clock_t time;
+} timedpass;
+
+static char *phasenames[tmNUMBER] = {
+  "other", "parse", "preprocess", "substitute", "optimize", "assemble", "debuginfo"
+};
+static char *counternames[tcNUMBER] = {
+  "macro_expansions", "staged_instructions", "peephole_replacements", "lines"
+};
+
+static clock_t starttime;         /* start of the compile */
+static clock_t lastmark;          /* last time that elapsed time was charged */
+static clock_t phasetime[tmNUMBER];
+static int phasestack[MAX_PHASENEST];
+static int phasetop;              /* number of entries on the phase stack */
+static int phaseskip;             /* nested phases beyond MAX_PHASENEST */
+static long counters[tcNUMBER];
+static timedpass passes[MAX_PASSES];
+static int numpasses;
+static int curpass;               /* index in passes[], or -1 outside a pass */
+static clock_t passstart;
+static timedfile *filelist;
+static timedfile *curfile;
+
+/* charge()
+ * Adds the time since the previous call to the current phase and to the
+ * current file.
+ */
+static void charge(void)
+{
+  clock_t now=clock();
+  clock_t elapsed=now-lastmark;
+  int phase=(phasetop>0) ? phasestack[phasetop-1] : tmOTHER;
+
+  assert(phase>=0 && phase<tmNUMBER);
+  phasetime[phase]+=elapsed;
+  if (curfile!=NULL)
+    curfile->time+=elapsed;
+  lastmark=now;
+}
+
+SC_FUNC void timer_init(void)
+{
+  memset(phasetime,0,sizeof phasetime);
+  memset(counters,0,sizeof counters);
+  phasetop=0;
+  phaseskip=0;
+  numpasses=0;
+  curpass=-1;
+  filelist=NULL;
+  curfile=NULL;
+  starttime=lastmark=clock();
+}
+
+SC_FUNC void timer_enter(int phase)
+{
+  if (!sc_timing)
+    return;
+  assert(phase>=0 && phase<tmNUMBER);
+  if (phasetop>=MAX_PHASENEST) {
+    phaseskip++;
+    return;
+  } /* if */
+  charge();
+  phasestack[phasetop++]=phase;
+}
+
+SC_FUNC void timer_leave(void)
+{
+  if (!sc_timing)
+    return;
+  if (phaseskip>0) {
+    phaseskip--;
+    return;
+  } /* if */
+  if (phasetop>0) {
+    charge();
+    phasetop--;
+  } /* if */
+}
+
+/* timer_pass()
+ * Starts a pass with the given label, or ends the current pass when "label"
+ * is NULL. A pass also starts the "parse" phase; on a fatal error the pass
+ * is never ended explicitly, timer_report() does this.
+ */
+SC_FUNC void timer_pass(const char *label)
+{
+  if (!sc_timing)
+    return;
+  if (curpass>=0) {
+    charge();
+    passes[curpass].time+=clock()-passstart;
+    curpass=-1;
+    phasetop=0;         /* drop any phases left open by a fatal error */
+    phaseskip=0;
+  } /* if */
+  if (label!=NULL) {
+    if (numpasses<MAX_PASSES) {
+      strlcpy(passes[numpasses].label,label,sizeof passes[numpasses].label);
+      passes[numpasses].time=0;
+      numpasses++;
+    } /* if */
+    curpass=numpasses-1;
+    passstart=clock();
+    timer_enter(tmPARSE);
+  } /* if */
+}
+
+/* timer_file()
+ * Sets the file that subsequent time is charged to; called when the compiler
+ * starts reading a file and when it returns to a file after an #include.
+ */
+SC_FUNC void timer_file(const char *name)
+{
+  timedfile *item;
+
+  if (!sc_timing)
+    return;
+  charge();
+  if (name==NULL) {
+    curfile=NULL;
+    return;
+  } /* if */
+  if (curfile!=NULL && strcmp(curfile->name,name)==0)
+    return;
+  for (item=filelist; item!=NULL && strcmp(item->name,name)!=0; item=item->next)
+    /* nothing */;
+  if (item==NULL) {
+    /* append a new item, so that the files are listed in the order that
+     * they were first read
+     */
+    timedfile **link;
+    if ((item=(timedfile*)malloc(sizeof(timedfile)))==NULL)
+      return;   /* don't report an error, the timing is merely informative */
+    if ((item->name=duplicatestring(name))==NULL) {
+      free(item);
+      return;
+    } /* if */
+    item->next=NULL;
+    item->time=0;
+    item->lines=0;
+    for (link=&filelist; *link!=NULL; link=&(*link)->next)
+      /* nothing */;
+    *link=item;
+  } /* if */
+  curfile=item;
+}
+
+SC_FUNC void timer_count(int counter)
+{
+  assert(counter>=0 && counter<tcNUMBER);
+  if (!sc_timing)
+    return;
+  counters[counter]++;
+  if (counter==tcLINES && curfile!=NULL)
+    curfile->lines++;
+}
+
+static double milliseconds(clock_t time)
+{
+  return (double)time*1000.0/CLOCKS_PER_SEC;
+}
+
+/* maxresident()
+ * Returns the peak resident memory of the process in kiB, or -1 if the
+ * operating system does not provide it.
+ */
+static long maxresident(void)
+{
+  #if defined LINUX || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF,&usage)!=0)
+      return -1;
+    #if defined __APPLE__
+      return (long)(usage.ru_maxrss/1024);  /* macOS returns bytes */
+    #else
+      return (long)usage.ru_maxrss;
+    #endif
+  #else
+    return -1;
+  #endif
+}
+
+static void json_string(FILE *fp,const char *str)
+{
+  fputc('"',fp);
+  for ( ; *str!='\0'; str++) {
+    unsigned char c=(unsigned char)*str;
+    if (c=='"' || c=='\\')
+      fprintf(fp,"\\%c",c);
+    else if (c<' ')
+      fprintf(fp,"\\u%04x",c);
+    else
+      fputc(c,fp);
+  } /* for */
+  fputc('"',fp);
+}
+
+static void write_json(FILE *fp,clock_t total,long refersize)
+{
+  timedfile *item;
+  int i;
+
+  fprintf(fp,"{\n  \"total_ms\": %.3f,\n",milliseconds(total));
+  fprintf(fp,"  \"phases_ms\": {");
+  for (i=0; i<tmNUMBER; i++)
+    fprintf(fp,"%s\n    \"%s\": %.3f",(i>0) ? "," : "",phasenames[i],milliseconds(phasetime[i]));
+  fprintf(fp,"\n  },\n  \"passes\": [");
+  for (i=0; i<numpasses; i++) {
+    fprintf(fp,"%s\n    { \"pass\": ",(i>0) ? "," : "");
+    json_string(fp,passes[i].label);
+    fprintf(fp,", \"ms\": %.3f }",milliseconds(passes[i].time));
+  } /* for */
+  fprintf(fp,"\n  ],\n  \"files\": [");
+  for (item=filelist; item!=NULL; item=item->next) {
+    fprintf(fp,"%s\n    { \"file\": ",(item!=filelist) ? "," : "");
+    json_string(fp,item->name);
+    fprintf(fp,", \"ms\": %.3f, \"lines\": %ld }",milliseconds(item->time),item->lines);
+  } /* for */
+  fprintf(fp,"\n  ],\n  \"counts\": {");
+  for (i=0; i<tcNUMBER; i++)
+    fprintf(fp,"\n    \"%s\": %ld,",counternames[i],counters[i]);
+  fprintf(fp,"\n    \"symbols\": %ld\n  },\n",symbol_pool.peak);
+  fprintf(fp,"  \"peak_memory\": {\n");
+  fprintf(fp,"    \"symbols\": %ld,\n",pool_peakmemory(&symbol_pool));
+  fprintf(fp,"    \"referrer_lists\": %ld,\n",refersize);
+  fprintf(fp,"    \"constant_lists\": %ld,\n",pool_peakmemory(&constvalue_pool));
+  fprintf(fp,"    \"names_macros\": %ld,\n",pool_peakmemory(&stringpair_pool));
+  fprintf(fp,"    \"resident_kib\": %ld\n  }\n}\n",maxresident());
+}
+
+static void write_text(clock_t total,long refersize)
+{
+  timedfile *item;
+  long resident;
+  int i;
+
+  pc_printf("\nTiming report (processor time):\n");
+  for (i=0; i<tmNUMBER; i++)
+    pc_printf("  %-22s %10.3f ms\n",phasenames[i],milliseconds(phasetime[i]));
+  pc_printf("  %-22s %10.3f ms\n","total",milliseconds(total));
+  pc_printf("Passes:\n");
+  for (i=0; i<numpasses; i++)
+    pc_printf("  %-22s %10.3f ms\n",passes[i].label,milliseconds(passes[i].time));
+  pc_printf("Files:\n");
+  for (item=filelist; item!=NULL; item=item->next)
+    pc_printf("  %10.3f ms %8ld lines  %s\n",milliseconds(item->time),item->lines,item->name);
+  pc_printf("Counts:\n");
+  pc_printf("  %-22s %10ld\n","symbols",symbol_pool.peak);
+  for (i=0; i<tcNUMBER; i++)
+    pc_printf("  %-22s %10ld\n",counternames[i],counters[i]);
+  pc_printf("Peak memory:\n");
+  pc_printf("  %-22s %10ld bytes\n","symbols",pool_peakmemory(&symbol_pool));
+  pc_printf("  %-22s %10ld bytes\n","referrer lists",refersize);
+  pc_printf("  %-22s %10ld bytes\n","constant lists",pool_peakmemory(&constvalue_pool));
+  pc_printf("  %-22s %10ld bytes\n","names & macros",pool_peakmemory(&stringpair_pool));
+  if ((resident=maxresident())>=0)
+    pc_printf("  %-22s %10ld kiB\n","process (resident)",resident);
+}
+
+/* timer_report()
+ * Prints the report on the console if "filename" is empty, or else writes it
+ * to the file in JSON format. This must be called before the memory pools are
+ * released, because releasing a pool resets its statistics.
+ */
+SC_FUNC void timer_report(const char *filename)
+{
+  long refersize=0;
+  clock_t total;
+  int i;
+
+  if (!sc_timing)
+    return;
+  timer_pass(NULL);
+  charge();
+  total=clock()-starttime;
+  for (i=0; i<REFER_POOLS; i++)
+    refersize+=pool_peakmemory(&refer_pool[i]);
+  if (filename==NULL || *filename=='\0') {
+    write_text(total,refersize);
+  } else {
+    FILE *fp=fopen(filename,"wb");
+    if (fp==NULL) {
+      /* do not use error(), because this is called while cleaning up */
+      pc_printf("Cannot write timing report to \"%s\"\n",filename);
+      return;
+    } /* if */
+    write_json(fp,total,refersize);
+    fclose(fp);
+  } /* if */
+}
+
+SC_FUNC void timer_cleanup(void)
+{
+  while (filelist!=NULL) {
+    timedfile *next=filelist->next;
+    free(filelist->name);
+    free(filelist);
+    filelist=next;
+  } /* while */
+  curfile=NULL;
+}
@@ -35,6 +35,20 @@
 SC_VDEFINE symbol loctab;                   /* local symbol table */
 SC_VDEFINE symbol glbtab;                   /* global symbol table */
 SC_VDEFINE struct hashtable_t symbol_cache_ht;
+SC_VDEFINE struct hashtable_t local_cache_ht;
+SC_VDEFINE unsigned int glbtab_version=0;   /* changes when a global symbol is added, removed or renamed */
+SC_VDEFINE mempool symbol_pool={ NULL, NULL, sizeof(symbol), 0, 0L, 0L };  /* memory for symbols */
+SC_VDEFINE mempool refer_pool[REFER_POOLS]={ /* memory for referrer lists */
+  { NULL, NULL, 1*sizeof(symbol*), 0, 0L, 0L },
+  { NULL, NULL, 2*sizeof(symbol*), 0, 0L, 0L },
+  { NULL, NULL, 4*sizeof(symbol*), 0, 0L, 0L },
+  { NULL, NULL, 8*sizeof(symbol*), 0, 0L, 0L },
+  { NULL, NULL, 16*sizeof(symbol*), 0, 0L, 0L },
+  { NULL, NULL, 32*sizeof(symbol*), 0, 0L, 0L },
+  { NULL, NULL, 64*sizeof(symbol*), 0, 0L, 0L }
+};
+SC_VDEFINE mempool constvalue_pool={ NULL, NULL, sizeof(constvalue), 0, 0L, 0L };  /* memory for constant lists */
+SC_VDEFINE mempool stringpair_pool={ NULL, NULL, sizeof(stringpair), 0, 0L, 0L };  /* memory for aliases and text substitutions */
 SC_VDEFINE cell *litq;                      /* the literal queue */
 SC_VDEFINE unsigned char pline[sLINEMAX+1]; /* the line read from the input file */
 SC_VDEFINE const unsigned char *lptr;       /* points to the current position in "pline" */
@@ -94,8 +108,11 @@ SC_VDEFINE int sc_curstates=0;              /* ID of the current state list */
 SC_VDEFINE int pc_optimize=sOPTIMIZE_NOMACRO; /* (peephole) optimization level */
 SC_VDEFINE int pc_memflags=0;               /* special flags for the stack/heap usage */
 SC_VDEFINE int pc_naked=FALSE;              /* if true mark following function as naked */
+SC_VDEFINE int pc_noinline=FALSE;           /* if true mark following function as not to be inlined */
 SC_VDEFINE int pc_compat=FALSE;             /* running in compatibility mode? */
 SC_VDEFINE int pc_recursion=FALSE;          /* enable detailed recursion report? */
+SC_VDEFINE int sc_pchrecord=pchNONE;        /* recording a precompiled header? */
+SC_VDEFINE int sc_timing=FALSE;             /* collect timing information? */
 
 SC_VDEFINE constvalue_root sc_automaton_tab = { NULL, NULL}; /* automaton table */
 SC_VDEFINE constvalue_root sc_state_tab = { NULL, NULL};   /* state table */
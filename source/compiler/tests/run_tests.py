@@ -19,9 +19,15 @@ parser.add_argument('-i', '--include',
                     help='add custom include directories for compile tests')
 parser.add_argument('-r', '--runner',
                     help='path to runner executable (pawnruns)')
+parser.add_argument('-s', '--scheduler',
+                    help='path to multi-threaded runner executable (pawnsched)')
 parser.add_argument('tests', metavar='test_name', nargs='*')
 options = parser.parse_args(sys.argv[1:])
 
+# The file module of the runner only opens files below this directory
+if 'AMXFILE' not in os.environ:
+  os.environ['AMXFILE'] = os.getcwd()
+
 def run_command(args, executable=None, merge_stderr=False):
   process = subprocess.Popen(args,
                              executable=executable,
@@ -58,16 +64,40 @@ def strip(s):
   return s.strip(' \t\r\n')
 
 class OutputCheckTest:
-  def __init__(self, name, errors=None, extra_args=None):
+  def __init__(self,
+               name,
+               errors=None,
+               extra_args=None,
+               output_pattern=None,
+               runs=1,
+               clean=None):
     self.name = name
     self.errors = errors
     self.extra_args = extra_args
+    self.output_pattern = output_pattern
+    self.runs = runs
+    self.clean = clean
 
   def run(self):
     args = [self.name + '.pwn']
     if self.extra_args is not None:
       args += self.extra_args
-    process, stdout, stderr = run_compiler(args=args)
+    if self.clean is not None:
+      for file in self.clean:
+        if os.path.exists(file):
+          os.remove(file)
+    output = ''
+    for i in range(self.runs):
+      process, stdout, stderr = run_compiler(args=args)
+      output += stdout
+    if self.output_pattern is not None:
+      output_pattern = strip(normalize_newlines(self.output_pattern))
+      if re.search(output_pattern, output, re.MULTILINE) is None:
+        self.fail_reason = (
+          'Output didn\'t match\n\nExpected output:\n\n{}\n\n'
+          'Actual output:\n\n{}'
+        ).format(output_pattern, output)
+        return False
     if self.errors is None:
       if process.returncode != 0:
         result = False
@@ -138,10 +168,45 @@ class PCodeCheckTest:
     return True
 
 class RuntimeTest:
-  def __init__(self, name, output, should_fail):
+  def __init__(self, name, output, should_fail, output_pattern, scheduler,
+               asm_pattern=None, asm_absent=None):
     self.name = name
     self.output = output
     self.should_fail = should_fail
+    self.output_pattern = output_pattern
+    self.scheduler = scheduler
+    self.asm_pattern = asm_pattern
+    self.asm_absent = asm_absent
+
+  def check_listing(self):
+    # Compile the script again to an assembler listing, to check that the
+    # code that ran is the code that the optimizer was expected to produce
+    process, stdout, stderr = run_compiler(['-a', self.name + '.pwn'])
+    if process.returncode != 0:
+      self.fail_reason = \
+        'Compiler exited with status {}'.format(process.returncode)
+      if stderr:
+        self.fail_reason += '\n\nErrors:\n\n{}'.format(stderr)
+      return False
+    with open(self.name + '.asm', 'r') as asm_file:
+      listing = normalize_newlines(asm_file.read())
+    if self.asm_pattern is not None:
+      asm_pattern = strip(normalize_newlines(self.asm_pattern))
+      if re.search(asm_pattern, listing, re.MULTILINE) is None:
+        self.fail_reason = (
+          'Code didn\'t match\n\nExpected code:\n\n{}\n\n'
+          'Actual code:\n\n{}'
+        ).format(asm_pattern, listing)
+        return False
+    if self.asm_absent is not None:
+      asm_absent = strip(normalize_newlines(self.asm_absent))
+      if re.search(asm_absent, listing, re.MULTILINE) is not None:
+        self.fail_reason = (
+          'Code matched\n\nUnexpected code:\n\n{}\n\n'
+          'Actual code:\n\n{}'
+        ).format(asm_absent, listing)
+        return False
+    return True
 
   def run(self):
     process, stdout, stderr = run_compiler([self.name + '.pwn'])
@@ -153,11 +218,12 @@ class RuntimeTest:
         self.fail_reason += '\n\nErrors:\n\n{}'.format(errors)
       return False
 
-    if options.runner is None:
+    runner = options.scheduler if self.scheduler else options.runner
+    if runner is None:
       self.fail_reason = 'Runner path is not set, can\'t run this test'
       return False
     process, output = run_command([
-      options.runner, self.name + '.amx'
+      runner, self.name + '.amx'
     ], merge_stderr=True)
     if not self.should_fail and process.returncode != 0:
       self.fail_reason = (
@@ -166,13 +232,24 @@ class RuntimeTest:
       return False
 
     output = strip(output)
-    expected_output = strip(self.output)
-    if output != expected_output:
-      self.fail_reason = (
-        'Output didn\'t match\n\nExpected output:\n\n{}\n\n'
-        'Actual output:\n\n{}'
-      ).format(expected_output, output)
-      return False
+    if self.output_pattern is not None:
+      output_pattern = strip(normalize_newlines(self.output_pattern))
+      if re.search(output_pattern, output, re.MULTILINE) is None:
+        self.fail_reason = (
+          'Output didn\'t match\n\nExpected output:\n\n{}\n\n'
+          'Actual output:\n\n{}'
+        ).format(output_pattern, output)
+        return False
+    else:
+      expected_output = strip(self.output)
+      if output != expected_output:
+        self.fail_reason = (
+          'Output didn\'t match\n\nExpected output:\n\n{}\n\n'
+          'Actual output:\n\n{}'
+        ).format(expected_output, output)
+        return False
+    if self.asm_pattern is not None or self.asm_absent is not None:
+      return self.check_listing()
     return True
 
 tests = []
@@ -192,7 +269,10 @@ for meta_file in glob.glob('*.meta'):
     tests.append(OutputCheckTest(
       name=name,
       errors=metadata.get('errors'),
-      extra_args=metadata.get('extra_args')))
+      extra_args=metadata.get('extra_args'),
+      output_pattern=metadata.get('output_pattern'),
+      runs=metadata.get('runs', 1),
+      clean=metadata.get('clean')))
   elif test_type == 'pcode_check':
     tests.append(PCodeCheckTest(
       name=name,
@@ -202,7 +282,11 @@ for meta_file in glob.glob('*.meta'):
     tests.append(RuntimeTest(
       name=name,
       output=metadata.get('output'),
-      should_fail=metadata.get('should_fail')))
+      should_fail=metadata.get('should_fail'),
+      output_pattern=metadata.get('output_pattern'),
+      scheduler=metadata.get('scheduler'),
+      asm_pattern=metadata.get('asm_pattern'),
+      asm_absent=metadata.get('asm_absent')))
   else:
     raise KeyError('Unknown test type: ' + test_type)
 